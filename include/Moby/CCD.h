@@ -21,6 +21,7 @@
 #include <Moby/PlanePrimitive.h>
 #include <Moby/BoxPrimitive.h>
 #include <Moby/CylinderPrimitive.h>
+#include <Moby/TriangleMeshPrimitive.h>
 #include <Moby/CollisionDetection.h>
 #include <Moby/BV.h>
 #include <Moby/GJK.h>
@@ -42,10 +43,10 @@ class CCD : public CollisionDetection
     virtual void save_to_xml(XMLTreePtr node, std::list<boost::shared_ptr<const Base> >& shared_objects) const;
     virtual void broad_phase(double dt, const std::vector<ControlledBodyPtr>& bodies, std::vector<std::pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check);
     virtual double calc_CA_Euler_step(const PairwiseDistInfo& pdi);
-    virtual void find_contacts(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL = NEAR_ZERO)
-    {
-      find_contacts(cgA, cgB, std::back_inserter(contacts), TOL);
-    }
+    virtual double calc_signed_dist(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    virtual void find_contacts(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL = NEAR_ZERO);
+    virtual void write_state(StateWriter& out) const;
+    virtual void read_state(StateReader& in, bool apply);
     static unsigned constrain_unsigned(int ii, int maxi){
      return (unsigned) std::min(std::max(ii,0),maxi);
     }
@@ -53,6 +54,15 @@ class CCD : public CollisionDetection
     template <class OutputIterator>
     OutputIterator find_contacts(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL = NEAR_ZERO);
 
+    /// Function that finds contacts between two geometries (contacts are appended to the vector)
+    typedef void (*FindContactsFn)(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+
+    /// Function that computes the signed distance between two geometries (the poses of pA and pB are set before the call)
+    typedef double (*SignedDistFn)(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+
+    static void register_find_contacts_fn(unsigned typeA, unsigned typeB, FindContactsFn fn);
+    static void register_signed_dist_fn(unsigned typeA, unsigned typeB, SignedDistFn fn);
+
     /// Pairs of collision geometries that aren't checked for contact/collision
     /**
      * \note collisions between geometries for two disabled bodies and
@@ -61,6 +71,9 @@ class CCD : public CollisionDetection
      */
     std::set<Ravelin::sorted_pair<CollisionGeometryPtr> > disabled_pairs;
 
+    /// If true, contacts between polyhedra are found using separating axes and polygon clipping (rather than half-space intersection); default is false
+    bool clip_polyhedron_contacts;
+
   protected:
     virtual double calc_next_CA_Euler_step(const PairwiseDistInfo& pdi) { return calc_next_CA_Euler_step_generic(pdi); }
 
@@ -78,50 +91,171 @@ class CCD : public CollisionDetection
     static double calc_max_dist(RigidBodyPtr rb, const Ravelin::Vector3d& n, double rmax);
     static double calc_max_step(RigidBodyPtr rbA, RigidBodyPtr rbB, const Ravelin::Vector3d& n, double rmaxA, double rmaxB, double dist);
 
-    // structure for doing broad phase collision detection
-    struct BoundsStruct
+    // an endpoint of a (swept) AABB projected onto one of the three axes
+    struct SAPEndpoint
+    {
+      double value;               // the coordinate of the endpoint
+      unsigned geom_id;           // index of the geometry in _geoms
+      bool end;                   // endpoint is for start or end
+      bool operator<(const SAPEndpoint& e) const { return (value < e.value || (value == e.value && !end && e.end)); }
+    };
+
+    // a node in the AABB tree over static geometries
+    struct StaticAABBNode
+    {
+      double lo[3];               // lower bounds of the node's AABB
+      double hi[3];               // upper bounds of the node's AABB
+      unsigned right;             // index of the right child (the left child immediately follows the node), or zero for a leaf
+      unsigned geom_id;           // index of the geometry in _geoms (leafs only)
+    };
+
+    // compares the centers of two geometries' AABBs along an axis
+    struct CenterLess
+    {
+      CenterLess(const std::vector<double>& lo, const std::vector<double>& hi) : _lo(lo), _hi(hi) {}
+      bool operator()(unsigned i, unsigned j) const { return _lo[i] + _hi[i] < _lo[j] + _hi[j]; }
+      const std::vector<double>& _lo;
+      const std::vector<double>& _hi;
+    };
+
+    /// Determines whether the swept AABBs of two geometries overlap along an axis
+    bool overlaps(unsigned i, unsigned j, unsigned axis) const { return _lo[axis][i] <= _hi[axis][j] && _lo[axis][j] <= _hi[axis][i]; }
+
+    /// Makes an (ordered) pair of geometry indices
+    static std::pair<unsigned, unsigned> make_id_pair(unsigned i, unsigned j) { return (i < j) ? std::make_pair(i, j) : std::make_pair(j, i); }
+
+    // an entry in the contact finding dispatch table
+    struct FindContactsEntry
+    {
+      FindContactsFn fn;          // the function to call
+      bool swap;                  // if true, the geometries are swapped for the call
+    };
+
+    // an entry in the signed distance dispatch table
+    struct SignedDistEntry
     {
-      bool end;                   // bounds is for start or end
-      CollisionGeometryPtr geom;  // the geometry
-      BVPtr bv;                   // the unexpanded bounding volume
-      bool operator<(const BoundsStruct& bs) const { return (!end && bs.end); }
+      SignedDistFn fn;            // the function to call
+      bool swap;                  // if true, the geometries are swapped for the call
     };
 
+    /// Contact finding functions, indexed by (type of A)*(number of types) + (type of B)
+    static std::vector<FindContactsEntry> _find_contacts_fns;
+
+    /// Signed distance functions, indexed by (type of A)*(number of types) + (type of B)
+    static std::vector<SignedDistEntry> _signed_dist_fns;
+
+    /// The number of primitive types in the dispatch tables
+    static unsigned _n_dispatch_types;
+
+    static void init_dispatch_tables();
+    static void build_dispatch_tables();
+    static std::vector<UnilateralConstraint>& get_thread_contacts_buffer();
+    static void resize_dispatch_tables(unsigned n);
+    static void set_find_contacts_fn(unsigned typeA, unsigned typeB, FindContactsFn fn);
+    static void set_signed_dist_fn(unsigned typeA, unsigned typeB, SignedDistFn fn);
+    static void transform_points(const Ravelin::Transform3d& T, const std::vector<Point3d>& points, std::vector<double>& x, std::vector<double>& y, std::vector<double>& z);
+    static unsigned get_dispatch_type(PrimitivePtr p) { unsigned t = p->get_type(); return (t < _n_dispatch_types) ? t : (unsigned) Primitive::eUnknown; }
+    static void find_contacts_generic_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_plane_generic_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_trimesh_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_heightmap_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_sphere_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_sphere_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_sphere_heightmap_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_box_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_cylinder_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_torus_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static void find_contacts_polyhedron_polyhedron_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL);
+    static double calc_signed_dist_generic_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_sphere_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_box_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_heightmap_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_plane_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_plane_cylinder_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_plane_polyhedron_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_torus_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+    static double calc_signed_dist_polyhedron_polyhedron_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB);
+
     // gets the distance on farthest points
     std::map<CollisionGeometryPtr, double> _rmax;
 
-    // see whether the bounds vectors need to be rebuilt
-    bool _rebuild_bounds_vecs;
+    /// The collision geometries processed by the broad phase (indexed by geometry id)
+    std::vector<CollisionGeometryPtr> _geoms;
+
+    /// The rigid bodies that the geometries belong to (indexed by geometry id)
+    std::vector<RigidBodyPtr> _geom_bodies;
+
+    /// The bounding spheres (indexed by geometry id)
+    std::vector<BVPtr> _bounding_spheres;
+
+    /// Lower bounds of the swept AABBs along each axis (indexed by geometry id)
+    std::vector<double> _lo[3];
+
+    /// Upper bounds of the swept AABBs along each axis (indexed by geometry id)
+    std::vector<double> _hi[3];
+
+    /// The global transforms of the geometries of disabled and sleeping bodies when their bounds were last computed (indexed by geometry id)
+    std::vector<Ravelin::Transform3d> _bounds_transforms;
+
+    /// The sorted AABB endpoints along each axis
+    std::vector<SAPEndpoint> _endpoints[3];
 
-    // the bounding spheres
-    std::map<CollisionGeometryPtr, BVPtr> _bounding_spheres;
+    /// Pairs of dynamic geometry ids whose swept AABBs overlap along all three axes
+    std::set<std::pair<unsigned, unsigned> > _overlapping_pairs;
 
-    /// AABB bounds (x-axis)
-    std::vector<std::pair<double, BoundsStruct> > _x_bounds;
+    /// Whether each geometry belonged to a disabled body when the broad phase was last rebuilt (indexed by geometry id)
+    std::vector<bool> _geom_static;
 
-    /// AABB bounds (y-axis)
-    std::vector<std::pair<double, BoundsStruct> > _y_bounds;
+    /// The AABB tree over the static geometries (in depth-first order)
+    std::vector<StaticAABBNode> _static_tree;
 
-    /// AABB bounds (z-axis)
-    std::vector<std::pair<double, BoundsStruct> > _z_bounds;
+    /// Pairs of dynamic and static geometry ids whose swept AABBs overlap
+    std::vector<std::pair<unsigned, unsigned> > _static_pairs;
 
-    /// Swept BVs computed during last call to is_contact/update_contacts()
-    std::map<CollisionGeometryPtr, BVPtr> _swept_BVs;
+    // the closest features (as determined by V-Clip) for a pair of polyhedral geometries
+    struct VClipFeatures
+    {
+      boost::shared_ptr<const Polyhedron::Feature> first;   // closest feature on the first geometry in the pair
+      boost::shared_ptr<const Polyhedron::Feature> second;  // closest feature on the second geometry in the pair
+      unsigned long first_id;                               // polyhedron identifier of the first geometry (see PolyhedralPrimitive::get_polyhedron_id())
+      unsigned long second_id;                              // polyhedron identifier of the second geometry
+    };
+
+    /// Closest features from the last V-Clip query on each pair of polyhedral geometries (used to warm start V-Clip)
+    std::map<Ravelin::sorted_pair<CollisionGeometryPtr>, VClipFeatures> _vclip_features;
 
     /// Minimum observed distance between two bodies (to make conservative advancement faster in face of numerical error)
     std::map<Ravelin::sorted_pair<CollisionGeometryPtr>, double> _min_dist_observed;
 
     static BVPtr construct_bounding_sphere(CollisionGeometryPtr cg);
-    void sort_AABBs(const std::vector<RigidBodyPtr>& rigid_bodies, double dt);
-    void update_bounds_vector(std::vector<std::pair<double, BoundsStruct> >& bounds, AxisType axis, double dt, bool recreate_bvs);
-    void build_bv_vector(const std::vector<RigidBodyPtr>& rigid_bodies, std::vector<std::pair<double, BoundsStruct> >& bounds);
+    bool update_geometries(const std::vector<RigidBodyPtr>& rigid_bodies);
+    bool update_bounds(double dt, bool rebuild);
+    void build_overlapping_pairs();
+    void sort_endpoints(AxisType axis);
+    bool update_static_geometries(bool force);
+    void build_static_tree();
+    void refit_static_tree();
+    unsigned build_static_tree(std::vector<unsigned>& ids, unsigned begin, unsigned end);
+    void find_static_pairs();
+    void add_pair_to_check(const std::pair<unsigned, unsigned>& ids, std::vector<std::pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check) const;
     BVPtr get_swept_BV(CollisionGeometryPtr geom, BVPtr bv, double dt);
+    void get_vclip_features(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, boost::shared_ptr<const Polyhedron::Feature>& closestA, boost::shared_ptr<const Polyhedron::Feature>& closestB);
+    void set_vclip_features(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, boost::shared_ptr<const Polyhedron::Feature> closestA, boost::shared_ptr<const Polyhedron::Feature> closestB);
 
     bool intersect_BV_trees(boost::shared_ptr<BV> a, boost::shared_ptr<BV> b, const Ravelin::Transform3d& aTb, CollisionGeometryPtr geom_a, CollisionGeometryPtr geom_b);
 
     template <class OutputIterator>
     OutputIterator find_contacts_polyhedron_polyhedron(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL);
 
+    template <class OutputIterator>
+    OutputIterator find_contacts_polyhedron_polyhedron_clip(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL);
+
+    bool calc_polyhedron_manifold(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, double TOL, Ravelin::Vector3d& normal, std::vector<Point3d>& points, std::vector<double>& depths);
+    static void get_face_vertices(boost::shared_ptr<Polyhedron::Face> f, boost::shared_ptr<const Ravelin::Pose3d> pose, const Ravelin::Transform3d& wTpose, std::vector<Point3d>& verts);
+    static void calc_projection_interval(const std::vector<Point3d>& verts, const Ravelin::Vector3d& n, double& lo, double& hi);
+    static void clip_polygon(const std::vector<Point3d>& poly, const Ravelin::Vector3d& n, double d, std::vector<Point3d>& clipped);
+    static void reduce_manifold(std::vector<Point3d>& points, std::vector<double>& depths, const Ravelin::Vector3d& normal);
+
     template <class OutputIterator>
     OutputIterator intersect_BV_leafs(BVPtr a, BVPtr b, const Ravelin::Transform3d& aTb, CollisionGeometryPtr geom_a, CollisionGeometryPtr geom_b, OutputIterator output_begin) const;
 
@@ -140,6 +274,9 @@ class CCD : public CollisionDetection
     template <class OutputIterator>
     OutputIterator find_contacts_cylinder_plane(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL);
 
+    template <class OutputIterator>
+    OutputIterator find_contacts_trimesh_generic(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL);
+
     template <class OutputIterator>
     OutputIterator find_contacts_heightmap_generic(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL);
 
@@ -155,9 +292,6 @@ class CCD : public CollisionDetection
     template <class OutputIterator>
     OutputIterator find_contacts_box_sphere(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL);
 
-    template <class RandomAccessIterator>
-    void insertion_sort(RandomAccessIterator begin, RandomAccessIterator end);
-
     template <class OutputIterator>
     OutputIterator find_contacts_vertex_vertex(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, boost::shared_ptr<Polyhedron::Vertex> v1, boost::shared_ptr<Polyhedron::Vertex> v2, double signed_dist, OutputIterator output_begin);
 
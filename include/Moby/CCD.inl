@@ -2,83 +2,19 @@
 template <class OutputIterator>
 OutputIterator CCD::find_contacts(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL)
 {
-  // look for special cases
-  PrimitivePtr pA = cgA->get_geometry();
-  PrimitivePtr pB = cgB->get_geometry();
-  if (boost::dynamic_pointer_cast<SpherePrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<SpherePrimitive>(pB))
-      return find_contacts_sphere_sphere(cgA, cgB, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<PlanePrimitive>(pB))
-      return find_contacts_sphere_plane(cgA, cgB, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<BoxPrimitive>(pB))
-      return find_contacts_box_sphere(cgB, cgA, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<HeightmapPrimitive>(pB))
-      return find_contacts_sphere_heightmap(cgA, cgB, output_begin, TOL);
-  }
-  else if (boost::dynamic_pointer_cast<BoxPrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<PlanePrimitive>(pB))
-      return find_contacts_plane_generic(cgB, cgA, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<PolyhedralPrimitive>(pB))
-      return find_contacts_polyhedron_polyhedron(cgA, cgB, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<SpherePrimitive>(pB))
-      return find_contacts_box_sphere(cgA, cgB, output_begin, TOL);
-  }
-  else if (boost::dynamic_pointer_cast<HeightmapPrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<SpherePrimitive>(pB))
-      return find_contacts_sphere_heightmap(cgB, cgA, output_begin, TOL);
-    else if (pB->is_convex())
-      return find_contacts_convex_heightmap(cgB, cgA, output_begin, TOL);
-    else
-      return find_contacts_heightmap_generic(cgA, cgB, output_begin, TOL);
-  }
-  else if (boost::dynamic_pointer_cast<PlanePrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<SpherePrimitive>(pB))
-      return find_contacts_sphere_plane(cgB, cgA, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<CylinderPrimitive>(pB))
-      return find_contacts_cylinder_plane(cgB, cgA, output_begin, TOL);
-    else if (boost::dynamic_pointer_cast<TorusPrimitive>(pB))
-      return find_contacts_torus_plane(cgB, cgA, output_begin, TOL);
-    else
-      return find_contacts_plane_generic(cgA, cgB, output_begin, TOL);
-  }
-  else if (boost::dynamic_pointer_cast<CylinderPrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<PlanePrimitive>(pB))
-      return find_contacts_cylinder_plane(cgA, cgB, output_begin, TOL);
-  }
-  else if (boost::dynamic_pointer_cast<PolyhedralPrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<PolyhedralPrimitive>(pB))
-      return find_contacts_polyhedron_polyhedron(cgA, cgB, output_begin, TOL);
-  }
-  else if (boost::dynamic_pointer_cast<TorusPrimitive>(pA))
-  {
-    if (boost::dynamic_pointer_cast<PlanePrimitive>(pB))
-    {
-      return find_contacts_torus_plane(cgA, cgB, output_begin, TOL);
-    }
-  }
-  else // no special case for A
-  {
-    if (boost::dynamic_pointer_cast<HeightmapPrimitive>(pB))
-    {
-      if (pA->is_convex())
-        return find_contacts_convex_heightmap(cgA, cgB, output_begin, TOL);
-      else
-        return find_contacts_heightmap_generic(cgB, cgA, output_begin, TOL);
-    }
-    else if (boost::dynamic_pointer_cast<PlanePrimitive>(pB))
-    {
-      return find_contacts_plane_generic(cgB, cgA, output_begin, TOL);
-    }
-  }
+  // borrow the thread's contact buffer (swapping retains its capacity, so
+  // no allocation is needed once the buffer has grown)
+  std::vector<UnilateralConstraint> contacts;
+  contacts.swap(get_thread_contacts_buffer());
+
+  // dispatch through the pairwise table
+  find_contacts(cgA, cgB, contacts, TOL);
+  output_begin = std::copy(contacts.begin(), contacts.end(), output_begin);
 
-  // still here? just use the generic contact finder
-  return find_contacts_generic(cgA, cgB, output_begin, TOL);
+  // return the buffer
+  contacts.clear();
+  contacts.swap(get_thread_contacts_buffer());
+  return output_begin;
 }
 
 /// Finds contacts between two polyhedra
@@ -107,19 +43,26 @@ OutputIterator CCD::find_contacts_polyhedron_polyhedron(CollisionGeometryPtr cgA
   boost::shared_ptr<const Ravelin::Pose3d> poseB = pB->get_pose(cgB);
 
   // get transforms to global frame
-  Ravelin::Transform3d wTa = Ravelin::Pose3d::calc_relative_pose(poseA, GLOBAL);
-  Ravelin::Transform3d wTb = Ravelin::Pose3d::calc_relative_pose(poseB, GLOBAL);
+  Ravelin::Transform3d wTa_tmp, wTb_tmp;
+  const Ravelin::Transform3d& wTa = get_transform(cgA, wTa_tmp);
+  const Ravelin::Transform3d& wTb = get_transform(cgB, wTb_tmp);
 
-  // call v-clip
+  // call v-clip, starting from the closest features of the last query
   boost::shared_ptr<const Polyhedron::Feature> closestA;
   boost::shared_ptr<const Polyhedron::Feature> closestB;
+  get_vclip_features(cgA, cgB, closestA, closestB);
   double dist = Polyhedron::vclip(pA, pB, poseA, poseB, closestA, closestB);
+  set_vclip_features(cgA, cgB, closestA, closestB);
   FILE_LOG(LOG_COLDET) << "v-clip reports distance of " << dist << std::endl;
 
   // see whether to generate contacts
   if (dist > TOL)
     return output_begin; 
 
+  // use separating axes and clipping, if desired
+  if (clip_polyhedron_contacts)
+    return find_contacts_polyhedron_polyhedron_clip(cgA, cgB, output_begin, TOL);
+
   // case #1: attempt to use volume of intersection
   if (dist <= 0.0)
   {
@@ -493,6 +436,28 @@ OutputIterator CCD::find_contacts_polyhedron_polyhedron(CollisionGeometryPtr cgA
   }
 }
 
+/// Finds contacts between two convex polyhedra using separating axes and polygon clipping
+/**
+ * Generates at most four contact points; see calc_polyhedron_manifold().
+ */
+template <class OutputIterator>
+OutputIterator CCD::find_contacts_polyhedron_polyhedron_clip(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL)
+{
+  Ravelin::Vector3d normal;
+  std::vector<Point3d> points;
+  std::vector<double> depths;
+
+  // compute the contact manifold
+  if (!calc_polyhedron_manifold(cgA, cgB, TOL, normal, points, depths))
+    return output_begin;
+
+  // create the contacts
+  for (unsigned i=0; i< points.size(); i++)
+    *output_begin++ = create_contact(cgA, cgB, points[i], normal, depths[i]);
+
+  return output_begin;
+}
+
 template <class OutputIterator>
 OutputIterator CCD::find_contacts_vertex_vertex(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, boost::shared_ptr<Polyhedron::Vertex> v1, boost::shared_ptr<Polyhedron::Vertex> v2, double signed_dist, OutputIterator output_begin){
 
@@ -704,15 +669,13 @@ OutputIterator CCD::find_contacts_cylinder_plane(CollisionGeometryPtr cgA, Colli
 
   // get the pose for the plane primitive
   boost::shared_ptr<const Ravelin::Pose3d> Pplane = pB->get_pose(cgB);
-  // get the pose for the cylinder
-  boost::shared_ptr<const Ravelin::Pose3d> Pcyl = pA->get_pose(cgA);
 
   ///////////////
   const double R = pA->get_radius();
   const double H = pA->get_height();
   const unsigned Y = 1;
 
-  Ravelin::Transform3d pPc = Ravelin::Pose3d::calc_relative_pose(Pcyl,Pplane);
+  Ravelin::Transform3d pPc = get_relative_transform(cgA, cgB);
 
   // cN is the cylinder axis with respect to the plane
   Ravelin::Vector3d cN = Ravelin::Vector3d(
@@ -814,13 +777,12 @@ OutputIterator CCD::find_contacts_sphere_plane(CollisionGeometryPtr cgA, Collisi
   FILE_LOG(LOG_COLDET) << " body A: " << cgA->get_single_body()->body_id << std::endl;
   FILE_LOG(LOG_COLDET) << " body B: " << cgB->get_single_body()->body_id << std::endl;
 
-  // get the poses for the two primitives
-  boost::shared_ptr<const Ravelin::Pose3d> sph_pose = pA->get_pose(cgA);
+  // get the pose for the plane primitive
   boost::shared_ptr<const Ravelin::Pose3d> plane_pose = pB->get_pose(cgB);
 
   // get the sphere in the plane pose
-  Point3d sph_c(0.0, 0.0, 0.0, sph_pose);
-  Point3d sph_c_plane = Ravelin::Pose3d::transform_point(plane_pose, sph_c);
+  Ravelin::Transform3d pTs = get_relative_transform(cgA, cgB);
+  Point3d sph_c_plane(pTs.x, plane_pose);
 
   // get the lowest point on the sphere
   double dist = sph_c_plane[Y] - pA->get_radius();
@@ -833,11 +795,12 @@ OutputIterator CCD::find_contacts_sphere_plane(CollisionGeometryPtr cgA, Collisi
   Point3d p(sph_c_plane[X], 0.5*(sph_c_plane[Y] - pA->get_radius()), sph_c_plane[Z], plane_pose);
 
   // setup the normal
-  Ravelin::Vector3d n(0.0, 1.0, 0.0, plane_pose);
-  n = Ravelin::Pose3d::transform_vector(GLOBAL, n);
+  Ravelin::Transform3d wTp_tmp;
+  const Ravelin::Transform3d& wTp = get_transform(cgB, wTp_tmp);
+  Ravelin::Vector3d n = wTp.transform_vector(Ravelin::Vector3d(0.0, 1.0, 0.0, plane_pose));
 
   // create the contact 
-  *o++ = create_contact(cgA, cgB, Ravelin::Pose3d::transform_point(GLOBAL, p), n, dist);
+  *o++ = create_contact(cgA, cgB, wTp.transform_point(p), n, dist);
 
   FILE_LOG(LOG_COLDET) << "CCD::find_contacts_sphere_plane() exited" << std::endl;
 
@@ -885,11 +848,118 @@ OutputIterator CCD::find_contacts_plane_generic(CollisionGeometryPtr cgA, Collis
   return o;
 }
 
+/// Finds contacts between a (possibly non-convex) triangle mesh (cgA) and another geometry
+/**
+ * Vertices of B are tested against the mesh, and vertices of the mesh that
+ * are near B are tested against B. Edges can cross without any vertex 
+ * penetrating, so the edges of B (if B is a triangle mesh or polyhedron) are
+ * also tested against the mesh, as are the edges of the mesh against B if B
+ * is a triangle mesh. The mesh queries use its distance hierarchy. 
+ */
 template <class OutputIterator>
-OutputIterator CCD::find_contacts_heightmap_generic(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator o, double TOL)
+OutputIterator CCD::find_contacts_trimesh_generic(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator o, double TOL)
 {
+  const double INF = std::numeric_limits<double>::max();
   std::vector<Point3d> vA, vB;
+  std::vector<Ravelin::Vector3d> n;
   double dist;
+
+  FILE_LOG(LOG_COLDET) << "CCD::find_contacts_trimesh_generic() entered with tolerance " << TOL << std::endl;
+
+  // get the triangle mesh primitive and its pose
+  boost::shared_ptr<TriangleMeshPrimitive> tmA = boost::dynamic_pointer_cast<TriangleMeshPrimitive>(cgA->get_geometry());
+  boost::shared_ptr<const Ravelin::Pose3d> PA = tmA->get_pose(cgA);
+
+  // get the vertices from B
+  cgB->get_vertices(vB);
+
+  // examine all points from B against A, computing the bounding box of B
+  // in A's frame
+  Ravelin::Origin3d lo(INF, INF, INF), hi(-INF, -INF, -INF);
+  for (unsigned i=0; i< vB.size(); i++)
+  {
+    Ravelin::Origin3d v(Ravelin::Pose3d::transform_point(PA, vB[i]));
+    for (unsigned j=0; j< 3; j++)
+    {
+      lo[j] = std::min(lo[j], v[j]);
+      hi[j] = std::max(hi[j], v[j]);
+    }
+
+    // see whether the point is inside the mesh
+    n.clear();
+    if ((dist = cgA->calc_dist_and_normal(vB[i], n)) <= TOL)
+    {
+      // add the contact points (normal points from B to A)
+      for (unsigned j=0; j< n.size(); j++)
+        *o++ = create_contact(cgA, cgB, vB[i], -n[j], dist);
+    }
+  }
+
+  // examine the points from A that lie near B against B
+  if (!vB.empty())
+  {
+    for (unsigned j=0; j< 3; j++)
+    {
+      lo[j] -= TOL;
+      hi[j] += TOL;
+    }
+    tmA->get_vertices(PA, lo, hi, vA);
+    for (unsigned i=0; i< vA.size(); i++)
+    {
+      n.clear();
+      if ((dist = cgB->calc_dist_and_normal(vA[i], n)) <= TOL)
+      {
+        // add the contact points
+        for (unsigned j=0; j< n.size(); j++)
+          *o++ = create_contact(cgA, cgB, vA[i], n[j], dist);
+      }
+    }
+  }
+
+  // examine the edges of B against A
+  boost::shared_ptr<const Ravelin::Pose3d> PB = cgB->get_geometry()->get_pose(cgB);
+  std::vector<std::pair<Point3d, Point3d> > edges;
+  TriangleMeshPrimitive::get_edges(cgB->get_geometry(), PB, edges);
+  for (unsigned i=0; i< edges.size(); i++)
+  {
+    Point3d p = Ravelin::Pose3d::transform_point(PA, edges[i].first);
+    Point3d q = Ravelin::Pose3d::transform_point(PA, edges[i].second);
+    Point3d cseg, cmesh;
+    Ravelin::Vector3d normal;
+    double t;
+
+    // crossings at the endpoints were found by the vertex tests 
+    if ((dist = tmA->calc_closest_points(p, q, cseg, cmesh, normal, t)) <= TOL && t > NEAR_ZERO && t < 1.0 - NEAR_ZERO)
+      *o++ = create_contact(cgA, cgB, cmesh, -normal, dist);
+  }
+
+  // examine the edges of A against B, if B is also a triangle mesh 
+  boost::shared_ptr<TriangleMeshPrimitive> tmB = boost::dynamic_pointer_cast<TriangleMeshPrimitive>(cgB->get_geometry());
+  if (tmB)
+  {
+    TriangleMeshPrimitive::get_edges(tmA, PA, edges);
+    for (unsigned i=0; i< edges.size(); i++)
+    {
+      Point3d p = Ravelin::Pose3d::transform_point(PB, edges[i].first);
+      Point3d q = Ravelin::Pose3d::transform_point(PB, edges[i].second);
+      Point3d cseg, cmesh;
+      Ravelin::Vector3d normal;
+      double t;
+      if ((dist = tmB->calc_closest_points(p, q, cseg, cmesh, normal, t)) <= TOL && t > NEAR_ZERO && t < 1.0 - NEAR_ZERO)
+        *o++ = create_contact(cgA, cgB, cmesh, normal, dist);
+    }
+  }
+
+  FILE_LOG(LOG_COLDET) << "CCD::find_contacts_trimesh_generic() exited" << std::endl;
+
+  return o;
+}
+
+template <class OutputIterator>
+OutputIterator CCD::find_contacts_heightmap_generic(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator o, double TOL)
+{
+  std::vector<Point3d> vA, vB;
+  std::vector<double> x, y, z, dist;
   std::vector<Ravelin::Vector3d> n;
 
   // get the heightmap primitive
@@ -899,31 +969,59 @@ OutputIterator CCD::find_contacts_heightmap_generic(CollisionGeometryPtr cgA, Co
   PrimitivePtr pB = cgB->get_geometry();
   BVPtr bvB = pB->get_BVH_root(cgB);
 
+  // get the poses of the two primitives
+  boost::shared_ptr<const Ravelin::Pose3d> PA = hmA->get_pose(cgA);
+  boost::shared_ptr<const Ravelin::Pose3d> PB = pB->get_pose(cgB);
+
   // get the vertices from A and B
-  hmA->get_vertices(bvB, hmA->get_pose(cgA), vA);
+  hmA->get_vertices(bvB, PA, vA, TOL);
   cgB->get_vertices(vB);
 
+  // compute the distances of all points from A to B at once
+  dist.resize(vA.size());
+  if (!vA.empty())
+  {
+    transform_points(Ravelin::Pose3d::calc_relative_pose(PA, PB), vA, x, y, z);
+    pB->calc_signed_dist_batch(PB, &x[0], &y[0], &z[0], vA.size(), &dist[0]);
+  }
+
   // examine all points from A against B
   for (unsigned i=0; i< vA.size(); i++)
   {
     // see whether the point is inside the primitive
-    if ((dist = cgB->calc_dist_and_normal(vA[i], n)) <= TOL)
+    if (dist[i] <= TOL)
     {
+      // get the normals
+      n.clear();
+      double d = cgB->calc_dist_and_normal(vA[i], n);
+
       // add the contact points
       for (unsigned j=0; j< n.size(); j++)
-        *o++ = create_contact(cgA, cgB, vA[i], -n[j], dist);
+        *o++ = create_contact(cgA, cgB, vA[i], -n[j], d);
     }
   }
 
+  // compute the heights of all points from B above A at once
+  dist.resize(vB.size());
+  if (!vB.empty())
+  {
+    transform_points(Ravelin::Pose3d::calc_relative_pose(PB, PA), vB, x, y, z);
+    hmA->calc_height_batch(&x[0], &y[0], &z[0], vB.size(), &dist[0]);
+  }
+
   // examine all points from B against A
   for (unsigned i=0; i< vB.size(); i++)
   {
     // see whether the point is inside the primitive
-    if ((dist = cgA->calc_dist_and_normal(vB[i], n)) <= TOL)
+    if (dist[i] <= TOL)
     {
+      // get the normals
+      n.clear();
+      double d = cgA->calc_dist_and_normal(vB[i], n);
+
       // add the contact point
       for (unsigned j=0; j< n.size(); j++)
-        *o++ = create_contact(cgA, cgB, vB[i], n[j], dist);
+        *o++ = create_contact(cgA, cgB, vB[i], n[j], d);
     }
   }
 
@@ -935,7 +1033,7 @@ OutputIterator CCD::find_contacts_heightmap_generic(CollisionGeometryPtr cgA, Co
 template <class OutputIterator>
 OutputIterator CCD::find_contacts_sphere_heightmap(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, OutputIterator output_begin, double TOL)
 {
-  const unsigned X = 0, Z = 2;
+  const unsigned X = 0, Y = 1, Z = 2;
 
   // get the output iterator
   OutputIterator o = output_begin;
@@ -952,7 +1050,7 @@ OutputIterator CCD::find_contacts_sphere_heightmap(CollisionGeometryPtr cgA, Col
   boost::shared_ptr<const Ravelin::Pose3d> pB = hmB->get_pose(cgB);
 
   // get the transform from the sphere pose to the heightmap
-  Ravelin::Transform3d T = Ravelin::Pose3d::calc_relative_pose(pA, pB);
+  Ravelin::Transform3d T = get_relative_transform(cgA, cgB);
 
   // transform the sphere center to the height map space
   Point3d ps_c(0.0, 0.0, 0.0, pA);
@@ -984,59 +1082,55 @@ OutputIterator CCD::find_contacts_sphere_heightmap(CollisionGeometryPtr cgA, Col
     contacts.push_back(create_contact(cgA, cgB, point, normal, min_sphere_dist));
   }
 
-  // get the corners of the bounding box in pB pose
+  // get the corners of the bounding box in pB pose; heightmap points
+  // within TOL of the sphere must lie within the box
   Point3d bv_lo = ps_c_B;
   Point3d bv_hi = ps_c_B;
   bv_lo[X] -= sA->get_radius();
   bv_hi[X] += sA->get_radius();
+  bv_lo[Y] -= sA->get_radius() + TOL;
+  bv_hi[Y] += sA->get_radius() + TOL;
   bv_lo[Z] -= sA->get_radius();
   bv_hi[Z] += sA->get_radius();
 
-  // get the heightmap width, depth, and heights
-  double width = hmB->get_width();
-  double depth = hmB->get_depth();
-  const Ravelin::MatrixNd& heights = hmB->get_heights();
-
-  // get the lower i and j indices
-  unsigned lowi = constrain_unsigned((bv_lo[X]+width*0.5)*(heights.rows()-1)/width,heights.rows()-1);
-  unsigned lowj = constrain_unsigned((bv_lo[Z]+depth*0.5)*(heights.columns()-1)/depth,heights.columns()-1);
+  // get the heightmap points in the bounding region
+  std::vector<Point3d> hverts;
+  hmB->get_vertices(bv_lo, bv_hi, hverts);
 
-  // get the upper i and j indices
-  unsigned upi = constrain_unsigned(((bv_hi[X]+width*0.5)*(heights.rows()-1)/width)+1,heights.rows()-1);
-  unsigned upj = constrain_unsigned(((bv_hi[Z]+depth*0.5)*(heights.columns()-1)/depth)+1,heights.columns()-1);
+  // compute the distances of all points in the bounding region at once
+  std::vector<double> x, y, z, dists(hverts.size());
+  if (!hverts.empty())
+  {
+    transform_points(T.inverse(), hverts, x, y, z);
+    sA->calc_signed_dist_batch(pA, &x[0], &y[0], &z[0], hverts.size(), &dists[0]);
+  }
 
   // iterate over all points in the bounding region
-  for (unsigned i=lowi; i< upi; i++)
-    for (unsigned j=lowj; j< upj; j++)
-    {
-      // compute the point on the heightmap
-      double x = -width*0.5+width*i/(heights.rows()-1);
-      double z = -depth*0.5+depth*j/(heights.columns()-1);
-      Point3d p(x, heights(i,j), z, pB);
-
-      // get the distance from the primitive
-      Point3d p_A = Ravelin::Pose3d::transform_point(pA, p);
-      double dist = sA->calc_signed_dist(p_A);
+  for (unsigned i=0; i< hverts.size(); i++)
+  {
+    // ignore distance if it isn't sufficiently close
+    const double dist = dists[i];
+    if (dist > TOL)
+      continue;
 
-      // ignore distance if it isn't sufficiently close
-      if (dist > TOL)
-        continue;
+    // get the point on the heightmap in the primitive frame
+    Point3d p_A(x[i], y[i], z[i], pA);
 
-      // setup the contact point
-      Point3d point = Ravelin::Pose3d::transform_point(GLOBAL, p_A);
+    // setup the contact point
+    Point3d point = Ravelin::Pose3d::transform_point(GLOBAL, p_A);
 
-      // setup the normal
-      Ravelin::Vector3d normal = Ravelin::Vector3d(0.0, 1.0, 0.0, pB);
-      if (dist >= 0.0)
-      {
-        double gx, gz;
-        hmB->calc_gradient(Ravelin::Pose3d::transform_point(pB, p_A), gx, gz);
-        normal = Ravelin::Vector3d(-gx, 1.0, -gz, pB);
-        normal.normalize();
-      }
-      normal = Ravelin::Pose3d::transform_vector(GLOBAL, normal);
-      contacts.push_back(create_contact(cgA, cgB, point, normal, dist));
+    // setup the normal
+    Ravelin::Vector3d normal = Ravelin::Vector3d(0.0, 1.0, 0.0, pB);
+    if (dist >= 0.0)
+    {
+      double gx, gz;
+      hmB->calc_gradient(Ravelin::Pose3d::transform_point(pB, p_A), gx, gz);
+      normal = Ravelin::Vector3d(-gx, 1.0, -gz, pB);
+      normal.normalize();
     }
+    normal = Ravelin::Pose3d::transform_vector(GLOBAL, normal);
+    contacts.push_back(create_contact(cgA, cgB, point, normal, dist));
+  }
 
   // create the normal pointing from B to A
   return std::copy(contacts.begin(), contacts.end(), o);
@@ -1063,17 +1157,25 @@ OutputIterator CCD::find_contacts_convex_heightmap(CollisionGeometryPtr cgA, Col
   boost::shared_ptr<const Ravelin::Pose3d> pB = hmB->get_pose(cgB);
 
   // get the transform from the primitive pose to the heightmap
-  Ravelin::Transform3d T = Ravelin::Pose3d::calc_relative_pose(pA, pB);
+  Ravelin::Transform3d T = get_relative_transform(cgA, cgB);
 
   // intersect vertices from the convex primitive against the heightmap
   std::vector<Point3d> cverts;
+  std::vector<double> cx, cy, cz, heights;
   sA->get_vertices(pA, cverts);
+  heights.resize(cverts.size());
+  if (!cverts.empty())
+  {
+    transform_points(T, cverts, cx, cy, cz);
+    hmB->calc_height_batch(&cx[0], &cy[0], &cz[0], cverts.size(), &heights[0]);
+  }
   for (unsigned i=0; i< cverts.size(); i++)
   {
-    Point3d pt = T.transform_point(cverts[i]);
-    const double HEIGHT = hmB->calc_height(pt);
+    const double HEIGHT = heights[i];
     if (HEIGHT < TOL)
     {
+      Point3d pt(cx[i], cy[i], cz[i], T.target);
+
       // setup the contact point
       Point3d point = Ravelin::Pose3d::transform_point(GLOBAL, pt);
 
@@ -1106,55 +1208,51 @@ OutputIterator CCD::find_contacts_convex_heightmap(CollisionGeometryPtr cgA, Col
   obb.R = T.q;
   obb.center = Point3d(T.x, T.target);
 
-  // get the AABB points in heightmap space
+  // get the AABB points in heightmap space; heightmap points within TOL of
+  // the primitive must lie within the AABB expanded by TOL
   bv_lo = obb.get_lower_bounds();
   bv_hi = obb.get_upper_bounds();
+  bv_lo[Y] -= TOL;
+  bv_hi[Y] += TOL;
 
-  // get the heightmap width, depth, and heights
-  double width = hmB->get_width();
-  double depth = hmB->get_depth();
-  const Ravelin::MatrixNd& heights = hmB->get_heights();
+  // get the heightmap points in the bounding region
+  std::vector<Point3d> hverts;
+  hmB->get_vertices(bv_lo, bv_hi, hverts);
 
-  // get the lower i and j indices
-  unsigned lowi = constrain_unsigned((bv_lo[X]+width*0.5)*(heights.rows()-1)/width,heights.rows()-1);
-  unsigned lowj = constrain_unsigned((bv_lo[Z]+depth*0.5)*(heights.columns()-1)/depth,heights.columns()-1);
-
-  // get the upper i and j indices
-  unsigned upi = constrain_unsigned(((bv_hi[X]+width*0.5)*(heights.rows()-1)/width)+1,heights.rows()-1);
-  unsigned upj = constrain_unsigned(((bv_hi[Z]+depth*0.5)*(heights.columns()-1)/depth)+1,heights.columns()-1);
+  // compute the distances of all points in the bounding region at once
+  std::vector<double> x, y, z, dists(hverts.size());
+  if (!hverts.empty())
+  {
+    transform_points(T.inverse(), hverts, x, y, z);
+    sA->calc_signed_dist_batch(pA, &x[0], &y[0], &z[0], hverts.size(), &dists[0]);
+  }
 
   // iterate over all points in the bounding region
-  for (unsigned i=lowi; i<= upi; i++)
-    for (unsigned j=lowj; j< upj; j++)
-    {
-      // compute the point on the heightmap
-      double x = -width*0.5+width*i/(heights.rows()-1);
-      double z = -depth*0.5+depth*j/(heights.columns()-1);
-      Point3d p(x, heights(i,j), z, pB);
-
-      // get the distance from the primitive
-      Point3d p_A = Ravelin::Pose3d::transform_point(pA, p);
-      double dist = sA->calc_signed_dist(p_A);
+  for (unsigned i=0; i< hverts.size(); i++)
+  {
+    // ignore distance if it isn't sufficiently close
+    const double dist = dists[i];
+    if (dist > TOL)
+      continue;
 
-      // ignore distance if it isn't sufficiently close
-      if (dist > TOL)
-        continue;
+    // get the point on the heightmap in the primitive frame
+    Point3d p_A(x[i], y[i], z[i], pA);
 
-      // setup the contact point
-      Point3d point = Ravelin::Pose3d::transform_point(GLOBAL, p_A);
+    // setup the contact point
+    Point3d point = Ravelin::Pose3d::transform_point(GLOBAL, p_A);
 
-      // setup the normal
-      Ravelin::Vector3d normal = Ravelin::Vector3d(0.0, 1.0, 0.0, pB);
-      if (dist >= 0.0)
-      {
-        double gx, gz;
-        hmB->calc_gradient(Ravelin::Pose3d::transform_point(pB, p_A), gx, gz);
-        normal = Ravelin::Vector3d(-gx, 1.0, -gz, pB);
-        normal.normalize();
-      }
-      normal = Ravelin::Pose3d::transform_vector(GLOBAL, normal);
-      contacts.push_back(create_contact(cgA, cgB, point, normal, dist));
+    // setup the normal
+    Ravelin::Vector3d normal = Ravelin::Vector3d(0.0, 1.0, 0.0, pB);
+    if (dist >= 0.0)
+    {
+      double gx, gz;
+      hmB->calc_gradient(Ravelin::Pose3d::transform_point(pB, p_A), gx, gz);
+      normal = Ravelin::Vector3d(-gx, 1.0, -gz, pB);
+      normal.normalize();
     }
+    normal = Ravelin::Pose3d::transform_vector(GLOBAL, normal);
+    contacts.push_back(create_contact(cgA, cgB, point, normal, dist));
+  }
 
   // create the normal pointing from B to A
   return std::copy(contacts.begin(), contacts.end(), o);
@@ -1171,19 +1269,10 @@ OutputIterator CCD::find_contacts_sphere_sphere(CollisionGeometryPtr cgA, Collis
   boost::shared_ptr<SpherePrimitive> sA = boost::dynamic_pointer_cast<SpherePrimitive>(cgA->get_geometry());
   boost::shared_ptr<SpherePrimitive> sB = boost::dynamic_pointer_cast<SpherePrimitive>(cgB->get_geometry());
 
-  // setup new pose for primitive A that refers to the underlying geometry
-  boost::shared_ptr<Ravelin::Pose3d> PoseA(new Ravelin::Pose3d(*sA->get_pose()));
-  PoseA->rpose = cgA->get_pose();
-
-  // setup new pose for primitive B that refers to the underlying geometry
-  boost::shared_ptr<Ravelin::Pose3d> PoseB(new Ravelin::Pose3d(*sB->get_pose()));
-  PoseB->rpose = cgB->get_pose();
-
   // get the two sphere centers in the global frame
-  PoseA->update_relative_pose(GLOBAL);
-  PoseB->update_relative_pose(GLOBAL);
-  Point3d cA0(PoseA->x, GLOBAL);
-  Point3d cB0(PoseB->x, GLOBAL);
+  Ravelin::Transform3d wTa_tmp, wTb_tmp;
+  Point3d cA0(get_transform(cgA, wTa_tmp).x, GLOBAL);
+  Point3d cB0(get_transform(cgB, wTb_tmp).x, GLOBAL);
 
   // determine the distance between the two spheres
   Ravelin::Vector3d d = cA0 - cB0;
@@ -1281,7 +1370,7 @@ OutputIterator CCD::find_contacts_torus_plane(CollisionGeometryPtr cgA, Collisio
   boost::shared_ptr<const Ravelin::Pose3d> Ptorus = torus_geom->get_pose(cgA); 
 
   // get the transformation from the torus's space to the plane's space
-  Ravelin::Transform3d tPp = Ravelin::Pose3d::calc_relative_pose(Pplane, Ptorus);
+  Ravelin::Transform3d tPp = get_relative_transform(cgB, cgA);
 
   // Z column of rotation matrix (plane to torus)
   // is plane normal in torus frame
@@ -1422,28 +1511,3 @@ OutputIterator CCD::find_contacts_torus_plane(CollisionGeometryPtr cgA, Collisio
 
   return o;
 }
-
-/// Does insertion sort -- custom comparison function not supported (uses operator<)
-template <class BidirectionalIterator>
-void CCD::insertion_sort(BidirectionalIterator first, BidirectionalIterator last)
-{
-  // safety check; exit if nothing to do
-  if (first == last)
-    return;
-
-  BidirectionalIterator min = first;
-
-  // loop
-  BidirectionalIterator i = first;
-  i++;
-  for (; i != last; i++)
-    if (*i < *min)
-      min = i;
-
-  // swap the iterators
-  std::iter_swap(first, min);
-  while (++first != last)
-    for (BidirectionalIterator j = first; *j < *(j-1); --j)
-      std::iter_swap((j-1), j);
-}
-
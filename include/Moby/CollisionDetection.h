@@ -25,6 +25,8 @@ class ArticulatedBody;
 class CollisionGeometry;
 class Triangle;
 class IndexedTriArray;
+class StateWriter;
+class StateReader;
 
 /// Defines an abstract collision detection mechanism
 /**
@@ -38,13 +40,42 @@ class IndexedTriArray;
 class CollisionDetection : public virtual Base
 {
   public:
-    CollisionDetection() {}
+    CollisionDetection() { _snapshot_generation = 0; _next_snapshot_generation = 1; }
     virtual ~CollisionDetection() {}
+    void update_transforms(const std::vector<CollisionGeometryPtr>& geoms);
+    const Ravelin::Transform3d& get_transform(CollisionGeometryPtr cg, Ravelin::Transform3d& wTp) const;
+    Ravelin::Transform3d get_relative_transform(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB) const;
+
+    /// Invalidates the transform snapshot (must be called whenever bodies are moved while the snapshot is in use)
+    void invalidate_transforms() { _snapshot_generation = 0; }
+
+    /// Invalidates the transform snapshot of a collision detector on leaving a scope
+    /**
+     * Simulators take snapshots only within a step; a guard in step()
+     * ensures that queries made after the step (when the user may move
+     * bodies) compute the transforms from the current poses.
+     */
+    class SnapshotGuard
+    {
+      public:
+        SnapshotGuard(boost::shared_ptr<CollisionDetection> coldet) : _coldet(coldet) {}
+        ~SnapshotGuard() { if (_coldet) _coldet->invalidate_transforms(); }
+
+      private:
+        boost::shared_ptr<CollisionDetection> _coldet;
+    };
+
     virtual void set_simulator(boost::shared_ptr<ConstraintSimulator> sim) {}
     virtual void broad_phase(double dt, const std::vector<ControlledBodyPtr>& bodies, std::vector<std::pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check);
     virtual double calc_CA_Euler_step(const PairwiseDistInfo& pdi) = 0;
     virtual void find_contacts(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, std::vector<UnilateralConstraint>& contacts, double TOL = NEAR_ZERO) = 0;
 
+    /// Writes state that is carried between steps and affects results (see Simulator::save_state())
+    virtual void write_state(StateWriter& out) const {}
+
+    /// Reads state written by write_state(), modifying the detector only if apply is true (see Simulator::read_state())
+    virtual void read_state(StateReader& in, bool apply) {}
+
     /// Calculates the signed distance between two geometries
     virtual double calc_signed_dist(CollisionGeometryPtr cg1, CollisionGeometryPtr cg2, Point3d& p1, Point3d& p2)
     {
@@ -58,6 +89,16 @@ class CollisionDetection : public virtual Base
     virtual double calc_next_CA_Euler_step(const PairwiseDistInfo& pdi) = 0;
     static UnilateralConstraint create_contact(CollisionGeometryPtr a, CollisionGeometryPtr b, const Point3d& point, const Ravelin::Vector3d& normal, double violation = 0.0);
 
+    /// Transforms from the primitive frames of the geometries (see Primitive::get_pose(CollisionGeometryPtr)) to the global frame, taken at the last call to update_transforms()
+    std::vector<Ravelin::Transform3d> _transforms;
+
+    /// Generation of the transform snapshot (zero if the snapshot is invalid)
+    unsigned _snapshot_generation;
+
+  private:
+    /// Generation of the next transform snapshot
+    unsigned _next_snapshot_generation;
+
   friend class ConstraintStabilization;
 }; // end class
 
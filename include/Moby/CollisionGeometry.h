@@ -26,6 +26,8 @@ class SingleBodyd;
 
 namespace Moby {
 
+class CollisionDetection;
+
 /// Defines collision geometry that may be used (in principle) many ways: for rigid bodies, non-rigid bodies, ...
 /**
  *  In principle the geometry may be very complex, and may support
@@ -36,6 +38,7 @@ namespace Moby {
 class CollisionGeometry : public virtual Base
 {
   friend class GeneralizedCCD;
+  friend class CollisionDetection;
 
   public:
     CollisionGeometry();
@@ -80,6 +83,15 @@ class CollisionGeometry : public virtual Base
   private:
     boost::weak_ptr<Ravelin::SingleBodyd> _single_body;
     boost::weak_ptr<CollisionGeometry> _parent;
+
+    /// Index of this geometry in the last transform snapshot that included it
+    unsigned _snapshot_index;
+
+    /// Generation of the last transform snapshot that included this geometry (zero if none)
+    unsigned _snapshot_generation;
+
+    /// The collision detector that took the last transform snapshot that included this geometry
+    const CollisionDetection* _snapshot_owner;
 }; // end class
 
 } // end namespace
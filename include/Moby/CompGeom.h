@@ -30,6 +30,7 @@
 #include <Moby/Log.h>
 #include <Moby/LP.h>
 #include <Moby/NumericalException.h>
+#include <Moby/QuickHull.h>
 #include <Moby/Types.h>
 
 #ifdef THREADSAFE
@@ -63,6 +64,15 @@ class CompGeom
     enum OrientationType { eLeft, eOn, eRight };
     enum VisibilityType { eVisible, eInvisible, eCoplanar };
 
+    /// The engine used to compute convex hulls and halfspace intersections
+    /**
+     * eQhull serializes all calls through a global mutex (qhull is
+     * non-reentrant); eQuickHull uses a per-thread QuickHull workspace and
+     * needs no locking.
+     */
+    enum HullEngine { eQhull, eQuickHull };
+    static HullEngine hull_engine;
+
     static SegLocationType determine_seg_location(const LineSeg3& seg, double t);
     static SegLocationType determine_seg_location(const LineSeg2& seg, double t);
     static unsigned get_num_intersects(SegSegIntersectType t);
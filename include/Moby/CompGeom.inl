@@ -235,6 +235,26 @@ OutputIterator CompGeomSpecTwo<ForwardIterator, OutputIterator, Point3d*>::calc_
   if (N_POINTS <= 4)
     return target_begin;
 
+  // use the reentrant engine, if selected
+  if (CompGeom::hull_engine == CompGeom::eQuickHull)
+  {
+    std::vector<Point3d*> source(source_begin, source_end);
+    std::vector<Ravelin::Origin3d> points(source.size());
+    for (unsigned i=0; i< source.size(); i++)
+      points[i] = Ravelin::Origin3d(*source[i]);
+    std::vector<IndexedTri> facets;
+    std::vector<unsigned> vertices;
+    if (!QuickHull::get_thread_workspace().calc_convex_hull_3D(points, facets))
+    {
+      FILE_LOG(LOG_COMPGEOM) << "CompGeom::calc_convex_hull_3D() - unable to compute hull using QuickHull" << std::endl;
+      throw NumericalException();
+    }
+    QuickHull::compact(facets, points.size(), vertices);
+    for (unsigned i=0; i< vertices.size(); i++)
+      (*target_begin++) = source[vertices[i]];
+    return target_begin;
+  }
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -740,6 +760,35 @@ TessellatedPolyhedronPtr CompGeomSpecOne<ForwardIterator, Point3d>::calc_convex_
   int curlong, totlong;
   FILE* outfile, * errfile;
 
+  // use the reentrant engine, if selected
+  if (CompGeom::hull_engine == CompGeom::eQuickHull)
+  {
+    std::vector<Ravelin::Origin3d> points;
+    for (ForwardIterator i = first; i != last; i++)
+      points.push_back(Ravelin::Origin3d(*i));
+    if (points.size() < 4)
+      return TessellatedPolyhedronPtr();
+
+    // compute the hull and keep only the hull vertices
+    std::vector<IndexedTri> facets;
+    std::vector<unsigned> vertex_indices;
+    if (!QuickHull::get_thread_workspace().calc_convex_hull_3D(points, facets))
+    {
+      FILE_LOG(LOG_COMPGEOM) << "CompGeom::calc_convex_hull() - unable to compute hull using QuickHull" << std::endl;
+      throw NumericalException();
+    }
+    QuickHull::compact(facets, points.size(), vertex_indices);
+    std::vector<Point3d> vertices(vertex_indices.size());
+    for (unsigned i=0; i< vertex_indices.size(); i++)
+      vertices[i] = Point3d(points[vertex_indices[i]], GLOBAL);
+
+    // create the polyhedron
+    TessellatedPolyhedronPtr polyhedron(new TessellatedPolyhedron(vertices.begin(), vertices.end(), facets.begin(), facets.end()));
+    assert(polyhedron->consistent());
+    FILE_LOG(LOG_COMPGEOM) << "3D convex hull is:" << std::endl << *polyhedron;
+    return polyhedron;
+  }
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -1713,6 +1762,24 @@ OutputIterator CompGeomSpecTwo<ForwardIterator, OutputIterator, Point2d>::calc_c
   if (N_POINTS <= 2)
     return target_begin;
   
+  // use the reentrant engine, if selected
+  if (CompGeom::hull_engine == CompGeom::eQuickHull)
+  {
+    std::vector<Point2d> source(source_begin, source_end);
+    std::vector<Ravelin::Origin2d> points(source.size());
+    for (unsigned i=0; i< source.size(); i++)
+      points[i] = Ravelin::Origin2d(source[i]);
+    std::vector<unsigned> hull;
+    if (!QuickHull::get_thread_workspace().calc_convex_hull_2D(points, hull))
+    {
+      FILE_LOG(LOG_COMPGEOM) << "CompGeom::calc_convex_hull_2D() - unable to compute hull using QuickHull" << std::endl;
+      return target_begin;
+    }
+    for (unsigned i=0; i< hull.size(); i++)
+      (*target_begin++) = source[hull[i]];
+    return target_begin;
+  }
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -1869,6 +1936,24 @@ OutputIterator CompGeomSpecTwo<ForwardIterator, OutputIterator, Ravelin::Origin2
   if (N_POINTS <= 2)
     return target_begin;
   
+  // use the reentrant engine, if selected
+  if (CompGeom::hull_engine == CompGeom::eQuickHull)
+  {
+    std::vector<Ravelin::Origin2d> source(source_begin, source_end);
+    std::vector<Ravelin::Origin2d> points(source.size());
+    for (unsigned i=0; i< source.size(); i++)
+      points[i] = source[i];
+    std::vector<unsigned> hull;
+    if (!QuickHull::get_thread_workspace().calc_convex_hull_2D(points, hull))
+    {
+      FILE_LOG(LOG_COMPGEOM) << "CompGeom::calc_convex_hull_2D() - unable to compute hull using QuickHull" << std::endl;
+      return target_begin;
+    }
+    for (unsigned i=0; i< hull.size(); i++)
+      (*target_begin++) = source[hull[i]];
+    return target_begin;
+  }
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -2573,6 +2658,25 @@ OutputIterator CompGeomSpecTwo<ForwardIterator, OutputIterator, Point2d*>::calc_
   for (ForwardIterator i = source_begin; i != source_end; i++)
     FILE_LOG(LOG_COMPGEOM) << "  " << *i << std::endl;
   
+  // use the reentrant engine, if selected
+  if (CompGeom::hull_engine == CompGeom::eQuickHull)
+  {
+    std::vector<Point2d*> source(source_begin, source_end);
+    assert(source.size() > 2);
+    std::vector<Ravelin::Origin2d> points(source.size());
+    for (unsigned i=0; i< source.size(); i++)
+      points[i] = Ravelin::Origin2d(*source[i]);
+    std::vector<unsigned> hull;
+    if (!QuickHull::get_thread_workspace().calc_convex_hull_2D(points, hull))
+    {
+      FILE_LOG(LOG_COMPGEOM) << "CompGeom::calc_convex_hull_2D() - unable to compute hull using QuickHull" << std::endl;
+      throw NumericalException();
+    }
+    for (unsigned i=0; i< hull.size(); i++)
+      (*target_begin++) = source[hull[i]];
+    return target_begin;
+  }
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -2823,6 +2927,26 @@ TessellatedPolyhedronPtr CompGeom::calc_hs_intersection(ForwardIterator start, F
   const unsigned X = 0, Y = 1, Z = 2;
   FILE* outfile, * errfile;
 
+  // use the reentrant engine, if selected
+  if (CompGeom::hull_engine == CompGeom::eQuickHull)
+  {
+    std::vector<std::pair<Ravelin::Origin3d, double> > halfspaces;
+    for (ForwardIterator i = start; i != end; i++)
+      halfspaces.push_back(std::make_pair(Ravelin::Origin3d(i->first), i->second));
+    std::vector<Ravelin::Origin3d> vertices;
+    if (!QuickHull::get_thread_workspace().calc_hs_intersection(halfspaces, interior_point, vertices))
+    {
+      FILE_LOG(LOG_COMPGEOM) << "CompGeom::calc_hs_intersection() - unable to compute intersection using QuickHull" << std::endl;
+      throw NumericalException();
+    }
+
+    // calculate the convex hull of the intersection points
+    std::list<Point3d> points;
+    for (unsigned i=0; i< vertices.size(); i++)
+      points.push_back(Point3d(vertices[i], GLOBAL));
+    return calc_convex_hull(points.begin(), points.end());
+  }
+
   // setup qhull flags
   std::ostringstream flags;
   flags << "qhull H";
@@ -17,6 +17,8 @@
 #include <Moby/CCD.h>
 #include <Moby/UnilateralConstraint.h>
 #include <Moby/ConstraintStabilization.h>
+#include <Moby/StepStats.h>
+#include <Moby/MetricsSink.h>
 
 namespace Moby {
 
@@ -38,9 +40,15 @@ class ConstraintSimulator : public Simulator
     boost::shared_ptr<ContactParameters> get_contact_parameters(CollisionGeometryPtr geom1, CollisionGeometryPtr geom2) const;
     const std::vector<PairwiseDistInfo>& get_pairwise_distances() const { return _pairwise_distances; }
 
+    /// Gets the timings and counters for the last step
+    const StepStats& get_step_stats() const { return _step_stats; }
+
     /// The constraint stabilization mechanism
     ConstraintStabilization cstab;
 
+    /// The sink for per-step constraint violation diagnostics (none by default)
+    boost::shared_ptr<MetricsSink> metrics_sink;
+
     /// Determines whether two geometries are not checked
     std::set<Ravelin::sorted_pair<CollisionGeometryPtr> > unchecked_pairs;
 
@@ -93,6 +101,16 @@ class ConstraintSimulator : public Simulator
      */
     double contact_dist_thresh;
 
+    /// If set to 'true', narrow phase collision detection is done in parallel
+    /**
+     * Signed distances and contacts are computed for all pairs from the 
+     * broad phase concurrently (when Moby is built with OpenMP support) and 
+     * the results are merged in pair order, so the output is identical to
+     * the serial case. The collision detection mechanism (including any 
+     * collision detection plugin) must be safe to call from multiple threads.
+     */
+    bool parallel_narrow_phase;
+
   protected:
     void calc_impacting_unilateral_constraint_forces(double dt);
     void find_unilateral_constraints(double min_contact_dist);
@@ -102,6 +120,8 @@ class ConstraintSimulator : public Simulator
     void broad_phase(double dt);
     void calc_pairwise_distances();
     void visualize_contact( UnilateralConstraint& constraint );
+    virtual void write_state(StateWriter& out) const;
+    virtual void read_state(StateReader& in, bool apply);
 
     /// Object for handling impact constraints
     ImpactConstraintHandler _impact_constraint_handler;
@@ -137,6 +157,12 @@ class ConstraintSimulator : public Simulator
 
     /// Geometric pairs that should be checked for unilateral constraints (according to broad phase collision detection)
     std::vector<std::pair<CollisionGeometryPtr, CollisionGeometryPtr> > _pairs_to_check;
+
+    /// Per-pair contact buffers used by the (parallel) narrow phase
+    std::vector<std::vector<UnilateralConstraint> > _pair_contacts;
+
+    /// Timings and counters for the current (or last) step
+    StepStats _step_stats;
 }; // end class
 
 } // end namespace
@@ -8,6 +8,7 @@
 #define _CONSTRAINT_STABILIZATION_H
 
 #include <vector>
+#include <map>
 #include <Ravelin/DynamicBodyd.h>
 #include <Moby/LCP.h>
 #include <Moby/UnilateralConstraintProblemData.h>
@@ -20,8 +21,41 @@ class ConstraintSimulator;
 class ConstraintStabilization 
 {
   public:
+    /// Statistics on the work done by a call to stabilize()
+    struct Report
+    {
+      Report() { n_islands = n_violated = n_unconverged = iterations = max_island_iterations = 0; max_bilateral_vio = time = 0.0; budget_exhausted = false; }
+
+      /// The number of islands examined
+      unsigned n_islands;
+
+      /// The number of islands with constraint violations (only these islands are stabilized)
+      unsigned n_violated;
+
+      /// The number of islands that still had violations when stabilization stopped
+      unsigned n_unconverged;
+
+      /// The total number of iterations over all islands
+      unsigned iterations;
+
+      /// The number of rounds in which any island was iterated (no island was iterated more often)
+      unsigned max_island_iterations;
+
+      /// The maximum bilateral constraint violation remaining after stabilization
+      double max_bilateral_vio;
+
+      /// The wall-clock time spent in stabilization (in seconds)
+      double time;
+
+      /// Whether the iteration or time budget stopped any island
+      bool budget_exhausted;
+    };
+
     ConstraintStabilization();
-    void stabilize(boost::shared_ptr<ConstraintSimulator> sim); 
+    const Report& stabilize(boost::shared_ptr<ConstraintSimulator> sim); 
+
+    /// Gets statistics on the work done by the last call to stabilize()
+    const Report& get_report() const { return _report; }
 
     // tolerance to solve unilateral constraints to
     double eps;
@@ -29,43 +63,83 @@ class ConstraintStabilization
     // tolerance to solve bilateral constraints to
     double bilateral_eps;
 
-    // maximum number of iterations for constraint stabilization
+    // maximum number of iterations for constraint stabilization (per island)
     unsigned max_iterations;
 
+    // maximum wall-clock time (in seconds) for constraint stabilization
+    double max_time;
+
   private:
-    void get_body_configurations(Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
-    void update_body_configurations(const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
-    bool update_q(const Ravelin::VectorNd& dq, Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
-    void compute_problem_data(std::vector<UnilateralConstraintProblemData>& pd, boost::shared_ptr<ConstraintSimulator> sim);
-    void add_contact_constraints(std::vector<UnilateralConstraint>& constraints, CollisionGeometryPtr cg1, CollisionGeometryPtr cg2, boost::shared_ptr<ConstraintSimulator> sim);
-    void add_limit_constraints(const std::vector<ControlledBodyPtr>& bodies, std::vector<UnilateralConstraint>& constraints);
-    void generate_body_index_map(std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& body_index_map, boost::shared_ptr<ConstraintSimulator> sim);
+    /// A set of bodies (and the constraints between them) that is stabilized independently of all other bodies
+    struct Island
+    {
+      Island() { max_bvio = 0.0; violated = iterated = stalled = budget_exhausted = false; }
+
+      /// The enabled (super) bodies in the island
+      std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> > bodies;
+
+      /// Indices of the geometry pairs (in the simulator's pairwise distances) that involve the island's bodies
+      std::vector<unsigned> pairs;
+
+      /// The implicit joints that involve the island's bodies
+      std::vector<JointPtr> ijoints;
+
+      /// Mapping from bodies to indices in the island's generalized coordinates
+      std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned> body_index_map;
+
+      /// The unilateral constraints of the island
+      std::vector<UnilateralConstraint> constraints;
+
+      /// The LCP solver used for the island
+      LCP lcp;
+
+      /// The maximum bilateral constraint violation in the island (before the last iteration)
+      double max_bvio;
+
+      /// Whether the island had constraint violations
+      bool violated;
+
+      /// Whether an iteration was performed on the island in the last round
+      bool iterated;
+
+      /// Whether the bodies in the island could not be moved to reduce the violations
+      bool stalled;
+
+      /// Whether the iteration or time budget stopped stabilization of the island
+      bool budget_exhausted;
+    };
+
+    void find_islands(boost::shared_ptr<ConstraintSimulator> sim, std::vector<Island>& islands);
+    void stabilize_island(boost::shared_ptr<ConstraintSimulator> sim, Island& island, unsigned round, double start_time) const;
+    static void get_body_configurations(Ravelin::VectorNd& q, const Island& island);
+    static void update_body_configurations(const Ravelin::VectorNd& q, const Island& island);
+    bool update_q(const Ravelin::VectorNd& dq, Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim, Island& island) const;
+    void compute_problem_data(std::vector<UnilateralConstraintProblemData>& pd, boost::shared_ptr<ConstraintSimulator> sim, Island& island) const;
+    static void add_contact_constraints(std::vector<UnilateralConstraint>& constraints, CollisionGeometryPtr cg1, CollisionGeometryPtr cg2, boost::shared_ptr<ConstraintSimulator> sim);
+    static void add_limit_constraints(const std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> >& bodies, std::vector<UnilateralConstraint>& constraints);
     static void set_unilateral_constraint_data(UnilateralConstraintProblemData& pd, const std::list<boost::shared_ptr<Ravelin::SingleBodyd> >& single_bodies);
     static void set_bilateral_only_constraint_data(UnilateralConstraintProblemData& q, const std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> >& island);
-    void determine_dq(UnilateralConstraintProblemData& pd, Ravelin::VectorNd& dqm, const std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& body_index_map);
+    static void determine_dq(UnilateralConstraintProblemData& pd, Ravelin::VectorNd& dqm, const std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& body_index_map, LCP& lcp);
     void update_from_stacked(const Ravelin::VectorNd& z, UnilateralConstraintProblemData& pd);
     void update_velocities(const UnilateralConstraintProblemData& pd);
     static double get_min_pairwise_dist(const std::vector<PairwiseDistInfo>& pdi); 
     static boost::shared_ptr<Ravelin::DynamicBodyd> get_super_body_from_rigid_body(boost::shared_ptr<Ravelin::RigidBodyd> sb);
     static boost::shared_ptr<Ravelin::DynamicBodyd> get_super_body(boost::shared_ptr<Ravelin::DynamicBodyd> sb);
-    double ridders_unilateral(double x1, double x2, double fx1, double fx2, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
-    double ridders_bilateral(double x1, double x2, double fx1, double fx2, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
-    double eval_unilateral(double t, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
-    double eval_bilateral(double t, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim);
+    static double ridders_unilateral(double x1, double x2, double fx1, double fx2, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim, Island& island);
+    static double ridders_bilateral(double x1, double x2, double fx1, double fx2, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim, Island& island);
+    static double eval_unilateral(double t, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim, Island& island);
+    static double eval_bilateral(double t, unsigned i, const Ravelin::VectorNd& dq, const Ravelin::VectorNd& q, boost::shared_ptr<ConstraintSimulator> sim, Island& island);
     static void save_velocities(boost::shared_ptr<ConstraintSimulator> sim, std::vector<Ravelin::VectorNd>& qd);
     static void restore_velocities(boost::shared_ptr<ConstraintSimulator> sim, const std::vector<Ravelin::VectorNd>& qd);
     static void add_contact_to_Jacobian(const UnilateralConstraint& c, SparseJacobian& Cn, const std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& gc_map, unsigned contact_idx);
-    static double evaluate_unilateral_constraints(boost::shared_ptr<ConstraintSimulator> sim, std::vector<double>& uC);
-    static double evaluate_bilateral_constraints(boost::shared_ptr<ConstraintSimulator> sim, std::vector<double>& C);
-
-    // the LCP solver
-    LCP _lcp;
+    static double evaluate_unilateral_constraints(boost::shared_ptr<ConstraintSimulator> sim, Island& island, std::vector<double>& uC);
+    static double evaluate_bilateral_constraints(const Island& island, std::vector<double>& C);
 
-    // the unilateral constraints
-    std::vector<UnilateralConstraint> constraints;
+    /// The islands found by the last call to stabilize()
+    std::vector<Island> _islands;
 
-    /// Geometric pairs that should be checked for unilateral constraints (according to broad phase collision detection)
-    std::vector<std::pair<CollisionGeometryPtr, CollisionGeometryPtr> > _pairs_to_check;
+    /// Statistics on the work done by the last call to stabilize()
+    Report _report;
 }
 ;
 
@@ -8,19 +8,47 @@
 #define _GJK_H
 
 #include <iostream>
+#include <vector>
+#include <map>
+#include <boost/weak_ptr.hpp>
+
 namespace Moby {
 
 /// An implementation of the GJK algorithm 
+/**
+ * Penetration depths of intersecting shapes are computed using the expanding
+ * polytope algorithm (EPA). The support directions of the final simplex are 
+ * cached for each pair of poses (i.e., for each pair of collision geometries)
+ * and are used to warm start the next query on that pair.
+ */
 class GJK
 {
   public:
+    /// Statistics from a single GJK query
+    struct Stats
+    {
+      unsigned gjk_iterations;    // number of GJK iterations
+      unsigned epa_iterations;    // number of EPA iterations (zero if the shapes were not intersecting)
+      bool warm_started;          // whether the query was warm started from the cache
+      bool intersecting;          // whether the shapes were found to be intersecting
+    };
+
     static double do_gjk(boost::shared_ptr<const Primitive> A, boost::shared_ptr<const Primitive> B, boost::shared_ptr<const Ravelin::Pose3d> pA, boost::shared_ptr<const Ravelin::Pose3d> pB, Point3d& cpA, Point3d& cpB, unsigned max_iter = 1000);
+    static void clear_cache();
+
+    /// Function called (if non-null) with the statistics of every query 
+    /**
+     * \note the function may be called from multiple threads simultaneously
+     *       when the narrow phase is run in parallel
+     */
+    static void (*stats_callback_fn)(const Stats& stats);
 
   private:
     struct SVertex
     {
       Point3d v;      // vA - vB: the vertex in the simplex
       Point3d vA, vB; // vertices from geometry A and B
+      Ravelin::Vector3d dir; // direction d (global frame) such that vA and vB support A and B in directions -d and d
       std::ostream& output(std::ostream& out) const;
 
       SVertex() {}
@@ -33,6 +61,32 @@ class GJK
       }
     };
 
+    // a triangular face of the polytope used by EPA
+    struct EPAFace
+    {
+      unsigned a, b, c;         // indices of the vertices (ccw from outside) 
+      Ravelin::Vector3d n;      // outward unit normal
+      double dist;              // distance from the origin to the plane of the face
+    };
+
+    // the pair of poses identifying a pair of geometries in the cache
+    typedef std::pair<boost::weak_ptr<const Ravelin::Pose3d>, boost::weak_ptr<const Ravelin::Pose3d> > PosePair;
+
+    static SVertex calc_support(boost::shared_ptr<const Primitive> A, boost::shared_ptr<const Primitive> B, boost::shared_ptr<const Ravelin::Pose3d> PA, boost::shared_ptr<const Ravelin::Pose3d> PB, const Ravelin::Vector3d& d);
+    static double do_epa(boost::shared_ptr<const Primitive> A, boost::shared_ptr<const Primitive> B, boost::shared_ptr<const Ravelin::Pose3d> PA, boost::shared_ptr<const Ravelin::Pose3d> PB, std::vector<SVertex>& verts, Point3d& cpA, Point3d& cpB, unsigned max_iter, unsigned& iter);
+    static bool make_face(const std::vector<SVertex>& verts, unsigned a, unsigned b, unsigned c, EPAFace& face);
+    static void report(const Stats& stats) { if (stats_callback_fn) (*stats_callback_fn)(stats); }
+    static void store_cache(const PosePair& key, const std::vector<Ravelin::Vector3d>& dirs);
+
+    /// The smallest cache size at which entries for destroyed poses are removed
+    static const unsigned MIN_CACHE_PURGE_SIZE = 256;
+
+    /// The cache size at which entries for destroyed poses are next removed
+    static unsigned _cache_purge_size;
+
+    /// The support directions of the final simplex from the last query on each pair of poses
+    static std::map<PosePair, std::vector<Ravelin::Vector3d> > _cache;
+
     class Simplex
     {
       public:
@@ -9,12 +9,19 @@
 
 #include <Moby/Primitive.h>
 #include <Moby/OBB.h>
+#include <Moby/HeightmapTiles.h>
 
 namespace Moby {
 
 class SpherePrimitive;
 
 /// Represents a heightmap with height zero on the xz plane (primitive can be transformed)
+/**
+ * Heights are stored in tiles with min/max quadtrees (see HeightmapTiles);
+ * queries descend the quadtrees, so that only samples near the query are
+ * examined. Heightmaps read from binary tiled files (.hmt) are
+ * memory-mapped, and tiles are read only when queries reach them.
+ */
 class HeightmapPrimitive : public Primitive
 {
   friend class CCD;
@@ -24,19 +31,22 @@ class HeightmapPrimitive : public Primitive
     HeightmapPrimitive(const Ravelin::Pose3d& T);
     virtual void set_pose(const Ravelin::Pose3d& T);
     virtual void get_vertices(boost::shared_ptr<const Ravelin::Pose3d> P, std::vector<Point3d>& vertices) const;
-    void get_vertices(BVPtr bv, boost::shared_ptr<const Ravelin::Pose3d> P, std::vector<Point3d>& vertices) const;
+    void get_vertices(BVPtr bv, boost::shared_ptr<const Ravelin::Pose3d> P, std::vector<Point3d>& vertices, double tol = 0.0) const;
+    void get_vertices(const Point3d& lo, const Point3d& hi, std::vector<Point3d>& vertices) const;
     virtual double calc_dist_and_normal(const Point3d& point, std::vector<Ravelin::Vector3d>& normals) const;
     virtual double calc_signed_dist(boost::shared_ptr<const Primitive> p, Point3d& pthis, Point3d& pp) const;
     double calc_signed_dist(boost::shared_ptr<const SpherePrimitive> s, Point3d& pthis, Point3d& psph) const;
     virtual Point3d get_supporting_point(const Ravelin::Vector3d& d) const;
     virtual double calc_signed_dist(const Point3d& p) const;
+    virtual void calc_signed_dist_batch(boost::shared_ptr<const Ravelin::Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const;
+    void calc_height_batch(const double* x, const double* y, const double* z, unsigned n, double* __restrict height) const;
     virtual osg::Node* create_visualization();
     virtual boost::shared_ptr<const IndexedTriArray> get_mesh(boost::shared_ptr<const Ravelin::Pose3d> P);
     virtual void calc_mass_properties() { _density.reset(); _J.set_zero(); }
     virtual BVPtr get_BVH_root(CollisionGeometryPtr geom);
     virtual void load_from_xml(boost::shared_ptr<const XMLTree> node, std::map<std::string, BasePtr>& id_map);
     virtual void save_to_xml(XMLTreePtr node, std::list<boost::shared_ptr<const Base> >& shared_objects) const;
-    const Ravelin::MatrixNd& get_heights() const { return _heights; }
+    const HeightmapTiles& get_tiles() const { return _tiles; }
     double get_width() const { return _width; }
     double get_depth() const { return _depth; }
     virtual double get_bounding_radius() const { return 0.0; }
@@ -51,8 +61,8 @@ class HeightmapPrimitive : public Primitive
     /// depth of the heightmap
     double _depth;
 
-    // heights
-    Ravelin::MatrixNd _heights;
+    /// heights
+    HeightmapTiles _tiles;
 
     /// The bounding volumes for the heightmap 
     std::map<CollisionGeometryPtr, boost::shared_ptr<OBB> > _obbs; 
@@ -0,0 +1,207 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_HEIGHTMAP_TILES_H
+#define _MOBY_HEIGHTMAP_TILES_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include <Ravelin/MatrixNd.h>
+
+namespace Moby {
+
+/// The heights of a heightmap, stored in fixed-size square tiles
+/**
+ * Each tile holds tile_size x tile_size samples. The minimum and maximum
+ * height of every tile is always available; each tile also has a min/max
+ * quadtree (mip pyramid) that is built when the tile is first queried, so
+ * that queries descend the quadtree rather than scanning samples. At most
+ * a fixed number of tiles are resident; the least recently used tile is
+ * evicted when another tile must be loaded.
+ *
+ * Heights are either held in memory (set_heights()) or memory-mapped from a
+ * binary tiled heightmap file (open()); in the latter case, the pages of a
+ * tile are only read once that tile is queried and are released when the
+ * tile is evicted.
+ *
+ * Queries may be made concurrently: tiles are loaded and evicted under a
+ * lock, and each query pins the tiles that it descends, so that they are
+ * not evicted by other threads. The limit on resident tiles may be
+ * exceeded while more tiles than the limit are pinned.
+ */
+class HeightmapTiles
+{
+  public:
+    /// The default number of samples along each side of a tile
+    static const unsigned DEFAULT_TILE_SIZE = 64;
+
+    /// The default maximum number of resident tiles
+    static const unsigned DEFAULT_MAX_RESIDENT_TILES = 1024;
+
+    /// The maximum number of samples along each side of a tile
+    static const unsigned MAX_TILE_SIZE = 1024;
+
+    /// Gets samples by row and column using only shifts and masks
+    /**
+     * Indices must lie within the heightmap (they are not clamped), so that
+     * loops gathering samples through a Sampler have no branches and can be
+     * vectorized. The sampler is valid until the heights are changed.
+     */
+    struct Sampler
+    {
+      /// The samples of all tiles
+      const double* data;
+
+      /// log2 of the tile size
+      unsigned shift;
+
+      /// The number of tile columns
+      unsigned tile_columns;
+
+      /// Gets the height of sample (i, j)
+      double operator()(unsigned i, unsigned j) const
+      {
+        const unsigned MASK = (1u << shift) - 1;
+        const unsigned T = (i >> shift)*tile_columns + (j >> shift);
+        return data[((size_t) T << (2*shift)) | ((i & MASK) << shift) | (j & MASK)];
+      }
+    };
+
+    HeightmapTiles();
+    ~HeightmapTiles();
+    void set_heights(const Ravelin::MatrixNd& heights, unsigned tile_size = DEFAULT_TILE_SIZE);
+    bool open(const std::string& filename);
+    bool write(const std::string& filename) const;
+    void close();
+    double get_height(unsigned i, unsigned j) const;
+    void set_max_resident_tiles(unsigned n);
+
+    template <class Visitor>
+    void visit_samples(unsigned lowi, unsigned upi, unsigned lowj, unsigned upj, Visitor& visitor) const;
+
+    /// Gets the number of sample rows
+    unsigned rows() const { return _rows; }
+
+    /// Gets the number of sample columns
+    unsigned columns() const { return _columns; }
+
+    /// Gets the number of samples along each side of a tile
+    unsigned get_tile_size() const { return _tile_size; }
+
+    /// Gets a sampler for the heights
+    Sampler get_sampler() const { Sampler s; s.data = _data; s.shift = _tile_shift; s.tile_columns = _tile_columns; return s; }
+
+    /// Gets the maximum number of resident tiles (zero indicates no limit)
+    unsigned get_max_resident_tiles() const { return _max_resident_tiles; }
+
+    /// Gets the number of tiles currently resident
+    unsigned num_resident_tiles() const { return _resident.size(); }
+
+    /// Gets the minimum height over all samples
+    double get_min_height() const { return (_tile_min.empty()) ? 0.0 : *std::min_element(_tile_min.begin(), _tile_min.end()); }
+
+    /// Gets the maximum height over all samples
+    double get_max_height() const { return (_tile_max.empty()) ? 0.0 : *std::max_element(_tile_max.begin(), _tile_max.end()); }
+
+  private:
+    /// Samples along each side of a quadtree leaf
+    static const unsigned LEAF_SIZE = 4;
+
+    /// A tile's min/max quadtree (empty when the tile is not resident)
+    struct Tile
+    {
+      Tile() { last_used = 0; pins = 0; }
+
+      /// Minimum heights of the quadtree nodes, stored level by level (the root is first)
+      std::vector<double> min_height;
+
+      /// Maximum heights of the quadtree nodes, stored level by level (the root is first)
+      std::vector<double> max_height;
+
+      /// The last time that the tile was queried
+      unsigned long last_used;
+
+      /// The number of queries descending the tile (pinned tiles are not evicted)
+      unsigned pins;
+    };
+
+    HeightmapTiles(const HeightmapTiles&);
+    HeightmapTiles& operator=(const HeightmapTiles&);
+    void setup_tiles(unsigned rows, unsigned columns, unsigned tile_size);
+    const Tile& load_tile(unsigned t) const;
+    const Tile& pin_tile(unsigned t) const;
+    void unpin_tile(unsigned t) const;
+    bool evict_lru_tile() const;
+    void evict_tile(unsigned t) const;
+    void lock() const;
+    void unlock() const;
+
+    template <class Visitor>
+    void visit_node(const Tile& tile, unsigned i0, unsigned j0, unsigned level, unsigned a, unsigned b, unsigned lowi, unsigned upi, unsigned lowj, unsigned upj, Visitor& visitor) const;
+
+    /// Gets the index of a quadtree node within a tile
+    static unsigned node_index(unsigned level, unsigned a, unsigned b) { return ((1u << (2*level)) - 1)/3 + (a << level) + b; }
+
+    /// Gets the samples of tile t (stored row-major)
+    const double* get_tile_data(unsigned t) const { return _data + (size_t) t*_tile_size*_tile_size; }
+
+    /// The number of sample rows and columns
+    unsigned _rows, _columns;
+
+    /// The number of samples along each side of a tile
+    unsigned _tile_size;
+
+    /// log2 of the tile size
+    unsigned _tile_shift;
+
+    /// The number of quadtree levels in each tile
+    unsigned _levels;
+
+    /// The number of tile rows and columns
+    unsigned _tile_rows, _tile_columns;
+
+    /// The minimum height of each tile
+    std::vector<double> _tile_min;
+
+    /// The maximum height of each tile
+    std::vector<double> _tile_max;
+
+    /// The samples of all tiles (tile by tile, each padded to full size)
+    const double* _data;
+
+    /// The samples, when held in memory
+    std::vector<double> _storage;
+
+    /// The memory mapping of the heightmap file (or NULL)
+    void* _mapping;
+
+    /// The size of the memory mapping
+    size_t _mapping_size;
+
+    /// The maximum number of resident tiles (zero indicates no limit)
+    unsigned _max_resident_tiles;
+
+    /// The quadtree of each tile
+    mutable std::vector<Tile> _tiles;
+
+    /// The indices of the resident tiles
+    mutable std::vector<unsigned> _resident;
+
+    /// Counter used to determine the least recently used tile
+    mutable unsigned long _clock;
+
+    /// Mutex for loading, pinning, and evicting tiles
+    mutable pthread_mutex_t _mutex;
+}; // end class
+
+#include "HeightmapTiles.inl"
+
+} // end namespace
+
+#endif
+
@@ -0,0 +1,89 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+/// Visits the samples within a range of indices, descending the min/max quadtrees
+/**
+ * The visitor must provide bool cull(double min_height, double max_height),
+ * which is called for every tile and quadtree node before it is descended
+ * and should return <b>true</b> if no sample with a height in that range
+ * can be of interest, and operator()(unsigned i, unsigned j, double height),
+ * which is called for every sample (i, j) that is not culled.
+ * \param lowi the lowest row index
+ * \param upi the highest row index (inclusive)
+ * \param lowj the lowest column index
+ * \param upj the highest column index (inclusive)
+ */
+template <class Visitor>
+void HeightmapTiles::visit_samples(unsigned lowi, unsigned upi, unsigned lowj, unsigned upj, Visitor& visitor) const
+{
+  // clip the range to the heightmap
+  if (_rows == 0 || _columns == 0)
+    return;
+  upi = std::min(upi, _rows-1);
+  upj = std::min(upj, _columns-1);
+  if (lowi > upi || lowj > upj)
+    return;
+
+  // visit all tiles overlapping the range
+  for (unsigned ti = lowi/_tile_size; ti <= upi/_tile_size; ti++)
+    for (unsigned tj = lowj/_tile_size; tj <= upj/_tile_size; tj++)
+    {
+      // cull the tile using its bounds (these are always available)
+      const unsigned T = ti*_tile_columns + tj;
+      if (visitor.cull(_tile_min[T], _tile_max[T]))
+        continue;
+
+      // load the tile and descend its quadtree; the tile is pinned so that
+      // other threads do not evict it meanwhile
+      const Tile& tile = pin_tile(T);
+      visit_node(tile, ti*_tile_size, tj*_tile_size, 0, 0, 0, lowi, upi, lowj, upj, visitor);
+      unpin_tile(T);
+    }
+}
+
+/// Visits the samples covered by a quadtree node
+/**
+ * \param i0 the row index of the first sample in the tile
+ * \param j0 the column index of the first sample in the tile
+ * \param level the level of the node (the root is level zero)
+ * \param a the row of the node within its level
+ * \param b the column of the node within its level
+ */
+template <class Visitor>
+void HeightmapTiles::visit_node(const Tile& tile, unsigned i0, unsigned j0, unsigned level, unsigned a, unsigned b, unsigned lowi, unsigned upi, unsigned lowj, unsigned upj, Visitor& visitor) const
+{
+  // get the samples covered by the node, clipped to the range
+  const unsigned SIZE = _tile_size >> level;
+  const unsigned NODE_LOWI = i0 + a*SIZE, NODE_LOWJ = j0 + b*SIZE;
+  const unsigned BEGIN_I = std::max(lowi, NODE_LOWI);
+  const unsigned END_I = std::min(upi+1, NODE_LOWI + SIZE);
+  const unsigned BEGIN_J = std::max(lowj, NODE_LOWJ);
+  const unsigned END_J = std::min(upj+1, NODE_LOWJ + SIZE);
+  if (BEGIN_I >= END_I || BEGIN_J >= END_J)
+    return;
+
+  // cull the node using its bounds
+  const unsigned NODE = node_index(level, a, b);
+  if (visitor.cull(tile.min_height[NODE], tile.max_height[NODE]))
+    return;
+
+  // visit the samples of a leaf
+  if (level+1 == _levels)
+  {
+    const double* data = get_tile_data((i0/_tile_size)*_tile_columns + j0/_tile_size);
+    for (unsigned i=BEGIN_I; i< END_I; i++)
+      for (unsigned j=BEGIN_J; j< END_J; j++)
+        visitor(i, j, data[(i-i0)*_tile_size + (j-j0)]);
+    return;
+  }
+
+  // descend to the children
+  visit_node(tile, i0, j0, level+1, 2*a, 2*b, lowi, upi, lowj, upj, visitor);
+  visit_node(tile, i0, j0, level+1, 2*a, 2*b+1, lowi, upi, lowj, upj, visitor);
+  visit_node(tile, i0, j0, level+1, 2*a+1, 2*b, lowi, upi, lowj, upj, visitor);
+  visit_node(tile, i0, j0, level+1, 2*a+1, 2*b+1, lowi, upi, lowj, upj, visitor);
+}
+
@@ -33,6 +33,8 @@
 namespace Moby {
 
 class ConstraintSimulator;
+class StateWriter;
+class StateReader;
 class NQP_IPOPT;
 class LCP_IPOPT;
 
@@ -46,6 +48,7 @@ class ImpactConstraintHandler
     ImpactConstraintHandler();
     void process_constraints(const std::vector<UnilateralConstraint>& constraints);
     static boost::shared_ptr<Ravelin::DynamicBodyd> get_super_body(boost::shared_ptr<Ravelin::SingleBodyd> sb);
+    unsigned long get_lcp_pivots() const;
 
     /// If set to true, uses the interior-point solver (default is false)
     bool use_ip_solver;
@@ -56,11 +59,81 @@ class ImpactConstraintHandler
     /// The tolerance for to the interior-point solver (default 1e-6)
     double ip_eps;
 
+    /// If set to true, uses the iterative (projected Gauss-Seidel) solver (default is false)
+    /**
+     * The iterative solver uses true friction cones for all contacts and 
+     * returns an approximate solution if it does not converge within
+     * pgs_max_iterations, trading accuracy for bounded solution time.
+     */
+    bool use_pgs_solver;
+
+    /// If set to true, the iterative solver is accelerated using nonsmooth nonlinear conjugate gradients (default is true)
+    bool pgs_nncg;
+
+    /// The maximum number of iterations to use for the iterative solver (default 100)
+    unsigned pgs_max_iterations;
+
+    /// The convergence tolerance for the iterative solver (default 1e-6)
+    double pgs_eps;
+
+    /// If set to true, solves are warm started using impulses from matching contacts of the last call (default is true)
+    /**
+     * Contacts are matched by geometry pair and by the contact point in the
+     * frame of the first geometry; limits are matched by joint and degree of
+     * freedom. The previous impulses and active sets are used only as the 
+     * starting point for the solvers, so the solution is unaffected.
+     */
+    bool warm_start;
+
+    /// Maximum distance between contact points for a contact to be matched to one from the last call (default 1e-2)
+    double warm_start_tol;
+
+    /// If set to true, independent groups of constraints are solved in parallel (default is false)
+    /**
+     * Each worker thread uses its own solver context (with its own
+     * temporaries), so this option requires Moby to be built with OpenMP 
+     * support. Groups share no bodies, so the impulses applied are identical
+     * to those applied when the groups are solved serially.
+     */
+    bool parallel_islands;
+
   private:
+    /// Contact data cached between calls for warm starting
+    struct CachedContact
+    {
+      Point3d p;                  // the contact point (frame of the first geometry of the pair)
+      Ravelin::Vector3d normal;   // the contact normal (toward the first geometry)
+      Ravelin::Vector3d tan1;     // the first contact tangent (flipped with the normal)
+      Ravelin::Vector3d impulse;  // the contact impulse (applied to the first geometry)
+      unsigned NK;                // the number of friction cone edges
+      std::vector<double> lcp;    // values of the contact's QP/LCP variables (if any)
+    };
+
+    /// Limit data cached between calls for warm starting
+    struct CachedLimit
+    {
+      double impulse;             // the limit impulse
+      std::vector<double> lcp;    // values of the limit's QP/LCP variables (if any)
+    };
+
+    /// Contact and limit data cached between calls (shared by all solver contexts)
+    struct WarmStartCache
+    {
+      WarmStartCache() { call = 0; }
+      unsigned call;
+      std::map<Ravelin::sorted_pair<CollisionGeometryPtr>, std::pair<unsigned, std::vector<CachedContact> > > contacts;
+      std::map<std::pair<JointPtr, unsigned>, std::pair<unsigned, CachedLimit> > limits;
+    };
+
+    typedef std::pair<std::list<UnilateralConstraint*>, std::list<boost::shared_ptr<Ravelin::SingleBodyd> > > ConstraintGroup;
+
+    void apply_model_to_group(const ConstraintGroup& group);
+    void setup_island_handlers(unsigned n);
     static void compute_signed_dist_dot_Jacobian(UnilateralConstraintProblemData& q, Ravelin::MatrixNd& J);
     void solve_frictionless_lcp(UnilateralConstraintProblemData& q, Ravelin::VectorNd& z);
     void apply_visc_friction_model_to_connected_constraints(const std::list<UnilateralConstraint*>& constraints, const std::list<boost::shared_ptr<Ravelin::SingleBodyd> >& single_bodies);
     void apply_no_slip_model_to_connected_constraints(const std::list<UnilateralConstraint*>& constraints, const std::list<boost::shared_ptr<Ravelin::SingleBodyd> >& single_bodies);
+    void apply_pgs_model_to_connected_constraints(const std::list<UnilateralConstraint*>& constraints, const std::list<boost::shared_ptr<Ravelin::SingleBodyd> >& single_bodies);
     void apply_ap_model_to_connected_constraints(const std::list<UnilateralConstraint*>& constraints, const std::list<boost::shared_ptr<Ravelin::SingleBodyd> >& single_bodies);
     static void update_from_stacked(UnilateralConstraintProblemData& q, const Ravelin::VectorNd& z);
     static void update_from_stacked(UnilateralConstraintProblemData& q);
@@ -72,6 +145,7 @@ class ImpactConstraintHandler
     void apply_visc_friction_model(UnilateralConstraintProblemData& epd);
     void apply_no_slip_model(UnilateralConstraintProblemData& epd);
     void apply_ap_model(UnilateralConstraintProblemData& epd);
+    void apply_pgs_model(UnilateralConstraintProblemData& epd);
     void solve_qp(Ravelin::VectorNd& z, UnilateralConstraintProblemData& epd);
     void solve_nqp(Ravelin::VectorNd& z, UnilateralConstraintProblemData& epd);
     void apply_model(const std::vector<UnilateralConstraint>& constraints);
@@ -96,9 +170,21 @@ class ImpactConstraintHandler
     static void compute_limit_components(const Ravelin::MatrixNd& X, UnilateralConstraintProblemData& epd);
     static void compute_X(UnilateralConstraintProblemData& epd, Ravelin::MatrixNd& X);
     static void update_generalized_velocities(const UnilateralConstraintProblemData& epd, const Ravelin::VectorNd& dv); 
+    static void determine_coupled_bodies(const UnilateralConstraintProblemData& q, const std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& gc_map, std::map<unsigned, std::vector<std::pair<unsigned, unsigned> > >& coupled);
+    static void mult_block_sparse(const SparseJacobian& J, const Ravelin::MatrixNd& X, const std::map<unsigned, std::vector<std::pair<unsigned, unsigned> > >& coupled, SparseJacobian& JX);
     static void add_contact_to_Jacobian(const UnilateralConstraint& c, SparseJacobian& Cn, SparseJacobian& Cs, SparseJacobian& Ct, const std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& gc_map, unsigned contact_index);
     static void add_contact_dir_to_Jacobian(boost::shared_ptr<Ravelin::RigidBodyd> rb, boost::shared_ptr<Ravelin::ArticulatedBodyd> ab, SparseJacobian& C, const Ravelin::Vector3d& contact_point, const Ravelin::Vector3d& d, const std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, unsigned>& gc_map, unsigned contact_index);
     static double calc_signed_dist(boost::shared_ptr<Ravelin::SingleBodyd> sb1, boost::shared_ptr<Ravelin::SingleBodyd> sb2);
+    void purge_warm_start_cache();
+    const CachedContact* find_cached_contact(const UnilateralConstraint& c, double& sign) const;
+    const CachedLimit* find_cached_limit(const UnilateralConstraint& l) const;
+    void get_warm_start(const UnilateralConstraintProblemData& q, Ravelin::VectorNd& z) const;
+    void get_normal_warm_start(const UnilateralConstraintProblemData& q, Ravelin::VectorNd& z) const;
+    void get_qp_warm_start(const UnilateralConstraintProblemData& q, Ravelin::VectorNd& z) const;
+    void store_warm_start(const UnilateralConstraintProblemData& q, const Ravelin::VectorNd& cn, const Ravelin::VectorNd& cs, const Ravelin::VectorNd& ct, const Ravelin::VectorNd& l, const Ravelin::VectorNd& lcp);
+    static void get_qp_lcp_indices(const UnilateralConstraintProblemData& q, std::vector<std::vector<unsigned> >& contact_indices, std::vector<std::vector<unsigned> >& limit_indices);
+    void write_warm_start(StateWriter& out) const;
+    void read_warm_start(StateReader& in, bool apply);
 
     Ravelin::LinAlgd _LA;
     LCP _lcp;
@@ -109,9 +195,15 @@ class ImpactConstraintHandler
     // a pointer to the simulator
     boost::shared_ptr<ConstraintSimulator> _simulator;
 
+    // contact and limit data from the last call, for warm starting
+    boost::shared_ptr<WarmStartCache> _cache;
+
+    // solver contexts used when solving groups in parallel (one per thread)
+    std::vector<boost::shared_ptr<ImpactConstraintHandler> > _island_handlers;
+
     // temporaries for compute_problem_data(), solve_qp_work(), solve_lcp(), and apply_impulses()
     Ravelin::MatrixNd _MM;
-    Ravelin::VectorNd _zlast, _v;
+    Ravelin::VectorNd _v, _vwarm, _empty;
 
     // temporaries for solve_qp_work() and solve_nqp_work()
     Ravelin::VectorNd _workv, _new_Cn_v;
@@ -145,6 +237,9 @@ class ImpactConstraintHandler
     Ravelin::MatrixNd _RTH;
     Ravelin::VectorNd _w, _workv2, _x;
 
+    // temporaries for apply_pgs_model()
+    std::vector<LCP::FrictionCone> _cones;
+
     // temporaries for solve_lcp()
     Ravelin::MatrixNd _AU, _AV, _B, _C, _D;
     Ravelin::VectorNd _AS, _alpha_x, _qq, _Cn_vplus;
@@ -24,6 +24,8 @@ namespace Moby {
 /// An array of triangles indexed into shared vertices 
 class IndexedTriArray
 {
+  friend class MeshCache;
+
   public:
     IndexedTriArray() {}
     IndexedTriArray(boost::shared_ptr<const std::vector<Ravelin::Origin3d> > vertices, const std::vector<IndexedTri>& facets);
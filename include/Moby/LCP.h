@@ -7,6 +7,7 @@
 #ifndef _MOBY_LCP_H
 #define _MOBY_LCP_H
 
+#include <vector>
 #include <Ravelin/MatrixNd.h>
 #include <Ravelin/SparseMatrixNd.h>
 #include <Ravelin/LinAlgd.h>
@@ -17,6 +18,19 @@ namespace Moby {
 class LCP
 {
   public:
+    /// A Coulomb friction cone coupling three variables of a nonlinear complementarity problem
+    /**
+     * The two tangential variables are projected onto the disk of radius
+     * mu*z[normal].
+     */
+    struct FrictionCone
+    {
+      unsigned normal;  // index of the normal variable
+      unsigned tan1;    // index of the first tangential variable
+      unsigned tan2;    // index of the second tangential variable
+      double mu;        // the coefficient of friction
+    };
+
     LCP();
     bool lcp_lemke_regularized(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp = -20, unsigned step_exp = 1, int max_exp = 1, double piv_tol = -1.0, double zero_tol = -1.0);
     bool lcp_lemke_regularized(const Ravelin::SparseMatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp = -20, unsigned step_exp = 4, int max_exp = 20, double piv_tol = -1.0, double zero_tol = -1.0);
@@ -25,16 +39,26 @@ class LCP
     bool lcp_fast(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double zero_tol = -1.0);
     bool lcp_fast_regularized(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp = -20, unsigned step_exp = 4, int max_exp = 20, double piv_tol = -1.0, double zero_tol = -1.0);
     bool fast_pivoting(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double eps = std::sqrt(std::numeric_limits<double>::epsilon()));
+    bool lcp_pgs(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, unsigned max_iter = 100, double tol = 1e-6, bool nncg = false);
+    bool ncp_pgs(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, const std::vector<FrictionCone>& cones, unsigned max_iter = 100, double tol = 1e-6, bool nncg = false);
+
+    /// The number of iterations used by the last call to lcp_pgs() or ncp_pgs()
+    unsigned iterations;
+
+    /// The total number of pivots (or iterations, for iterative solvers) performed by this solver
+    unsigned long total_pivots;
 
   private:
     unsigned pivots;
     static void log_failure(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q);
     static void set_basis(unsigned n, unsigned count, std::vector<unsigned>& bas, std::vector<unsigned>& nbas);
     static unsigned rand_min(const Ravelin::VectorNd& v, double zero_tol);
+    void pgs_sweep(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, const std::vector<FrictionCone>& cones) const;
+    void pgs_project(Ravelin::VectorNd& z, const std::vector<FrictionCone>& cones) const;
 
     // temporaries for regularized solver
     Ravelin::MatrixNd _MM;
-    Ravelin::VectorNd _wx;
+    Ravelin::VectorNd _wx, _zwarm;
 
     // temporaries for fast pivoting solver
     Ravelin::VectorNd _z, _w, _qbas, _qprime;
@@ -50,6 +74,11 @@ class LCP
     Ravelin::SparseMatrixNd _sBl;
     Ravelin::SparseMatrixNd _MMs, _MMx, _eye, _zero, _diag_lambda;
 
+    // temporaries for iterative solvers
+    Ravelin::VectorNd _zprev, _dz, _p;
+    std::vector<unsigned> _cone_idx;
+    std::vector<FrictionCone> _no_cones;
+
     // linear algebra
     Ravelin::LinAlgd _LA;
 }; // end class
@@ -45,9 +45,10 @@ class Log
     std::ostringstream& get(unsigned level = 0)
     {
       time_t rawtime;
+      tm t;
       std::time(&rawtime);
-      tm* ptm = std::gmtime(&rawtime);
-      os << "- " << ptm->tm_hour << ":" << ptm->tm_min << ":" << ptm->tm_sec;
+      gmtime_r(&rawtime, &t);
+      os << "- " << t.tm_hour << ":" << t.tm_min << ":" << t.tm_sec;
       os << " " << level << ": ";
       message_level = level;
       return os;
@@ -0,0 +1,70 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_MESH_CACHE_H
+#define _MOBY_MESH_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <Moby/IndexedTri.h>
+#include <Moby/IndexedTriArray.h>
+#include <Moby/MeshDistTree.h>
+#include <Moby/MeshOBBTree.h>
+
+namespace Moby {
+
+/// A cache of meshes read from Wavefront OBJ files and the data precomputed for them
+/**
+ * Meshes are keyed by a hash of the contents of the OBJ file. On the first
+ * load of a file, the mesh is parsed and its incident facets, coplanar
+ * features, distance hierarchy, bounding volume tree, and convex hull are
+ * computed and written to a compact binary file in the cache directory.
+ * Later loads (including loads by other processes) read the binary file
+ * instead, which avoids parsing the OBJ file and all of the precomputation. The file is memory-
+ * mapped only while it is validated and copied, so processes do not share
+ * the memory of a mesh; within a process, primitives loading the same file 
+ * share a single entry.
+ */
+class MeshCache
+{
+  public:
+    /// A mesh and the data precomputed for it
+    struct Entry
+    {
+      /// The mesh, as read from the OBJ file
+      boost::shared_ptr<const IndexedTriArray> mesh;
+
+      /// The distance hierarchy for the mesh
+      boost::shared_ptr<const MeshDistTree> dist_tree;
+
+      /// The bounding volume (OBB) tree for the mesh
+      boost::shared_ptr<const MeshOBBTree> obb_tree;
+
+      /// The indices of the mesh vertices on the convex hull (empty if the hull is degenerate)
+      std::vector<unsigned> hull_vertices;
+
+      /// The triangles of the convex hull (indexing hull_vertices)
+      std::vector<IndexedTri> hull_facets;
+    };
+
+    static boost::shared_ptr<const Entry> load(const std::string& obj_filename, const std::string& cache_dir);
+
+  private:
+    static boost::shared_ptr<Entry> build(const std::string& obj_filename);
+    static boost::shared_ptr<Entry> read(const std::string& filename, unsigned long long hash, unsigned long long obj_size);
+    static void write(const std::string& filename, const Entry& entry, unsigned long long hash, unsigned long long obj_size);
+
+    /// Entries loaded by this process (indexed by content hash)
+    static std::map<unsigned long long, boost::weak_ptr<const Entry> > _entries;
+}; // end class
+
+} // end namespace
+
+#endif
+
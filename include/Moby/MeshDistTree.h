@@ -0,0 +1,75 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_MESH_DIST_TREE_H
+#define _MOBY_MESH_DIST_TREE_H
+
+#include <vector>
+#include <Ravelin/Origin3d.h>
+#include <Moby/IndexedTriArray.h>
+
+namespace Moby {
+
+/// A hierarchy and pseudo-normals used for distance queries against a triangle mesh
+/**
+ * The hierarchy is an axis-aligned box tree stored in flat arrays, so that
+ * it can be shared between primitives using the same mesh and written to
+ * (and read from) the mesh cache without rebuilding it.
+ */
+class MeshDistTree
+{
+  friend class MeshCache;
+
+  public:
+    /// A node in the hierarchy (boxes are axis-aligned in the mesh frame)
+    struct Node
+    {
+      Ravelin::Origin3d lo;   // lower corner of the box
+      Ravelin::Origin3d hi;   // upper corner of the box
+      unsigned first;         // first child (internal node) or first index into _tris (leaf)
+      unsigned n;             // number of triangles (leaf) or zero (internal node)
+    };
+
+    MeshDistTree() { _convex = true; }
+    void build(const IndexedTriArray& mesh);
+    void translate(const Ravelin::Origin3d& dx);
+    double calc_closest_point(const IndexedTriArray& mesh, const Ravelin::Origin3d& p, Ravelin::Origin3d& closest, Ravelin::Origin3d& normal) const;
+    double calc_closest_points(const IndexedTriArray& mesh, const Ravelin::Origin3d& p, const Ravelin::Origin3d& q, Ravelin::Origin3d& cseg, Ravelin::Origin3d& cmesh, Ravelin::Origin3d& normal, double& t) const;
+    void get_vertices(const IndexedTriArray& mesh, const Ravelin::Origin3d& lo, const Ravelin::Origin3d& hi, std::vector<unsigned>& vertices) const;
+
+    /// Determines whether the hierarchy is empty (there is no mesh)
+    bool empty() const { return _nodes.empty(); }
+
+    /// Determines whether the mesh is convex
+    bool is_convex() const { return _convex; }
+
+    /// Gets the root node of the hierarchy (the hierarchy must not be empty)
+    const Node& get_root() const { return _nodes.front(); }
+
+  private:
+    /// The nodes (the root is the first node; children of a node are stored consecutively)
+    std::vector<Node> _nodes;
+
+    /// Triangle indices, ordered so that each leaf covers a contiguous range
+    std::vector<unsigned> _tris;
+
+    /// Unit normals of the triangles
+    std::vector<Ravelin::Origin3d> _tri_normals;
+
+    /// Angle-weighted pseudo-normals of the vertices
+    std::vector<Ravelin::Origin3d> _vertex_normals;
+
+    /// Pseudo-normals of the edges of each triangle (edges ab, bc, and ca of triangle i are at 3i, 3i+1, 3i+2)
+    std::vector<Ravelin::Origin3d> _edge_normals;
+
+    /// Whether the mesh is convex (closed, with convex dihedral angles at every edge)
+    bool _convex;
+}; // end class
+
+} // end namespace
+
+#endif
+
@@ -0,0 +1,64 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_MESH_OBB_TREE_H
+#define _MOBY_MESH_OBB_TREE_H
+
+#include <vector>
+#include <Ravelin/Origin3d.h>
+#include <Ravelin/Matrix3d.h>
+#include <Moby/IndexedTriArray.h>
+
+namespace Moby {
+
+/// An oriented bounding box tree around a triangle mesh, used for collision detection
+/**
+ * The tree is stored in flat arrays, independent of any collision geometry,
+ * so that it can be shared between primitives using the same mesh and
+ * written to (and read from) the mesh cache without rebuilding it. Each
+ * primitive instantiates OBB objects from the tree for its geometries.
+ */
+class MeshOBBTree
+{
+  friend class MeshCache;
+
+  public:
+    /// A node in the tree (boxes are in the mesh frame)
+    struct Node
+    {
+      Ravelin::Origin3d center;   // center of the box
+      Ravelin::Matrix3d R;        // principal axes of the box
+      Ravelin::Origin3d l;        // half-lengths of the box
+      unsigned first_child;       // index of the first child
+      unsigned n_children;        // number of children (zero for a leaf)
+      unsigned first_tri;         // first index into _tris
+      unsigned n_tris;            // number of triangles covered by the box
+    };
+
+    void build(const IndexedTriArray& mesh);
+    void translate(const Ravelin::Origin3d& dx);
+
+    /// Determines whether the tree is empty (there is no mesh)
+    bool empty() const { return _nodes.empty(); }
+
+    /// Gets the nodes (the root is the first node; children of a node are stored consecutively)
+    const std::vector<Node>& get_nodes() const { return _nodes; }
+
+    /// Gets the triangle indices covered by the nodes
+    const std::vector<unsigned>& get_tris() const { return _tris; }
+
+  private:
+    /// The nodes (the root is the first node; children of a node are stored consecutively)
+    std::vector<Node> _nodes;
+
+    /// Triangle indices; node i covers [_nodes[i].first_tri, _nodes[i].first_tri + _nodes[i].n_tris)
+    std::vector<unsigned> _tris;
+}; // end class
+
+} // end namespace
+
+#endif
+
@@ -0,0 +1,72 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0 
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_METRICS_SINK_H_
+#define _MOBY_METRICS_SINK_H_
+
+#include <cstdio>
+#include <string>
+#include <pthread.h>
+
+namespace Moby {
+
+/// A buffered, asynchronous sink for per-step constraint violation diagnostics
+/**
+ * Records are formatted into an in-memory buffer by the simulation thread.
+ * Full buffers are handed to a background thread that writes them to the 
+ * file, so the simulation thread never waits on file I/O. Records are
+ * written as CSV with the columns time, min_dist, max_bilateral_vio, and
+ * stabilization_iterations.
+ */
+class MetricsSink
+{
+  public:
+    MetricsSink();
+    ~MetricsSink();
+    bool open(const std::string& filename, unsigned buffer_size = 65536);
+    void close();
+    void flush();
+    void record(double time, double min_dist, double max_bilateral_vio, unsigned stabilization_iterations);
+
+    /// Determines whether the sink is open
+    bool is_open() const { return _fp != NULL; }
+
+    /// Gets the name of the file written by the sink
+    const std::string& get_filename() const { return _filename; }
+
+  private:
+    MetricsSink(const MetricsSink&);
+    MetricsSink& operator=(const MetricsSink&);
+    static void* write_thread(void* arg);
+
+    /// The file written to
+    FILE* _fp;
+
+    /// The name of the file written to
+    std::string _filename;
+
+    /// The buffer size at which records are handed to the writer thread
+    unsigned _buffer_size;
+
+    /// Records not yet handed to the writer thread (accessed only by the simulation thread)
+    std::string _buffer;
+
+    /// Records handed to the writer thread but not yet written
+    std::string _pending;
+
+    /// Indicates that the writer thread should exit once all pending records are written
+    bool _stop;
+
+    /// The writer thread and the synchronization primitives protecting _pending and _stop
+    pthread_t _thread;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+}; // end class
+
+} // end namespace
+
+#endif
+
@@ -35,6 +35,8 @@ class PlanePrimitive : public Primitive
     double calc_signed_dist(boost::shared_ptr<const CylinderPrimitive> s, Point3d& pthis, Point3d& psph) const;
     double calc_signed_dist(boost::shared_ptr<const SpherePrimitive> s, Point3d& pthis, Point3d& psph) const;
     virtual double calc_signed_dist(const Point3d& p) const;
+    virtual void calc_signed_dist_batch(boost::shared_ptr<const Ravelin::Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const;
+    void calc_height_batch(const double* x, const double* y, const double* z, unsigned n, double* height) const;
     virtual osg::Node* create_visualization();
     virtual boost::shared_ptr<const IndexedTriArray> get_mesh(boost::shared_ptr<const Ravelin::Pose3d> P);
     virtual void calc_mass_properties() { _density.reset(); _J.set_zero(); }
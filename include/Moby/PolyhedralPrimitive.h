@@ -23,9 +23,10 @@ class PolyhedralPrimitive : public Primitive
 {
   public:
 
-    PolyhedralPrimitive() : Primitive() { }
-    PolyhedralPrimitive(const Ravelin::Pose3d& T) : Primitive(T) { }
+    PolyhedralPrimitive() : Primitive() { _type = ePolyhedral; _poly_id = next_polyhedron_id(); }
+    PolyhedralPrimitive(const Ravelin::Pose3d& T) : Primitive(T) { _type = ePolyhedral; _poly_id = next_polyhedron_id(); }
     virtual double calc_signed_dist(boost::shared_ptr<const Primitive> p, Point3d& pthis, Point3d& pp) const;
+    double calc_signed_dist(boost::shared_ptr<const PolyhedralPrimitive> p, Point3d& pthis, Point3d& pp, boost::shared_ptr<const Polyhedron::Feature>& closestA, boost::shared_ptr<const Polyhedron::Feature>& closestB) const;
     virtual double calc_dist_and_normal(const Point3d& p, std::vector<Ravelin::Vector3d>& normals) const;
     virtual osg::Node* create_visualization();
     virtual BVPtr get_BVH_root(CollisionGeometryPtr geom);
@@ -40,6 +41,9 @@ class PolyhedralPrimitive : public Primitive
     /// Gets the polyhedron corresponding to this primitive (in its transformed state)
     const Polyhedron& get_polyhedron() const { return _poly; }
 
+    /// Gets an identifier for the polyhedron that changes whenever its features are replaced (features cached for another identifier are invalid)
+    unsigned long get_polyhedron_id() const { return _poly_id; }
+
     // Gets the number of facets in this primitive
     virtual unsigned num_facets() const { return _poly.get_faces().size();}
 
@@ -65,7 +69,15 @@ class PolyhedralPrimitive : public Primitive
   protected:
     void calc_mass_properties();
     double calc_signed_dist(boost::shared_ptr<const PolyhedralPrimitive> p, Point3d& pthis, Point3d& pp) const;
+    virtual double calc_sdf_sample(const Ravelin::Origin3d& p) const;
+    virtual void get_sdf_geometry(std::vector<Ravelin::Origin3d>& verts, std::vector<IndexedTri>& facets) const;
+    void polyhedron_changed();
+    static unsigned long next_polyhedron_id();
     Polyhedron _poly;
+
+  private:
+    /// Identifier for the polyhedron (see get_polyhedron_id())
+    unsigned long _poly_id;
 }; // end class
 
 #include "PolyhedralPrimitive.inl"
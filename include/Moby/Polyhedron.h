@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <Moby/Constants.h>
+#include <Moby/IndexedTri.h>
 #include <Moby/Plane.h>
 #include <Moby/Log.h>
 #include <Moby/NumericalException.h>
@@ -138,6 +139,10 @@ class Polyhedron
     enum FeatureType { eVertex, eEdge, eFace };
     static double calc_dist(FeatureType fA, FeatureType fB, boost::shared_ptr<const Polyhedron::Feature> closestA, boost::shared_ptr<const Polyhedron::Feature> closestB, Ravelin::Transform3d& aTb);
   private:
+    static void lock_qhull();
+    static void unlock_qhull();
+    static bool calc_convex_hull_reentrant(const std::vector<boost::shared_ptr<Vertex> >& verts, Polyhedron& poly);
+    static void build_from_hull(Polyhedron& poly, const std::vector<boost::shared_ptr<Vertex> >& verts, const std::vector<IndexedTri>& facets);
     static boost::shared_ptr<Plane> voronoi_plane (FeatureType fA, FeatureType fB, boost::shared_ptr<const Ravelin::Pose3d> pose, boost::shared_ptr<const Polyhedron::Feature>& featureA, boost::shared_ptr<const Polyhedron::Feature>& featureB);
     static bool clip_edge(boost::shared_ptr<const Polyhedron::Edge> edge, Ravelin::Transform3d fTe, double& min_lambda, double& max_lambda, boost::shared_ptr<const Polyhedron::Feature >& min_N, boost::shared_ptr<const Polyhedron::Feature >& max_N, const std::list<std::pair<boost::shared_ptr<const Polyhedron::Feature>, boost::shared_ptr<Plane> > >& planes_neighbors);
     static bool post_clip_deriv_check(FeatureType& fX, boost::shared_ptr<const Polyhedron::Feature >& X , boost::shared_ptr<const Polyhedron::Edge> edge, Ravelin::Transform3d& xTe, double& min_lambda, double& max_lambda, boost::shared_ptr<const Polyhedron::Feature >& min_N, boost::shared_ptr<const Polyhedron::Feature >& max_N);
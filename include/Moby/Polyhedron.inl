@@ -79,6 +79,11 @@ Polyhedron Polyhedron::calc_convex_hull(ForwardIterator begin, ForwardIterator e
   if (N_POINTS < 4)
     return Polyhedron();
 
+  // use the reentrant engine, if selected
+  Polyhedron hull;
+  if (calc_convex_hull_reentrant(verts, hull))
+    return hull;
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -106,6 +111,9 @@ Polyhedron Polyhedron::calc_convex_hull(ForwardIterator begin, ForwardIterator e
     qhull_points[j++] = verts[i]->o[Z];
   }
 
+  // lock the qhull mutex -- qhull is non-reentrant
+  lock_qhull();
+
   // execute qhull  
   exit_code = qh_new_qhull(DIM, N_POINTS, points_begin, IS_MALLOC, flags, outfile, errfile);
   if (exit_code != 0)
@@ -119,6 +127,9 @@ Polyhedron Polyhedron::calc_convex_hull(ForwardIterator begin, ForwardIterator e
     qh_freeqhull(!qh_ALL);
     qh_memfreeshort(&curlong, &totlong);
 
+    // release the mutex, since we're not using qhull anymore
+    unlock_qhull();
+
     // close the error stream, if necessary
     if (!LOGGING(LOG_COMPGEOM))
       fclose(errfile);
@@ -348,6 +359,9 @@ Polyhedron Polyhedron::calc_convex_hull(ForwardIterator begin, ForwardIterator e
   qh_freeqhull(!qh_ALL);
   qh_memfreeshort(&curlong, &totlong);
 
+  // release the qhull mutex
+  unlock_qhull();
+
   // close the error stream, if necessary
   if (!LOGGING(LOG_COMPGEOM))
     fclose(errfile);
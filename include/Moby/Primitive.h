@@ -30,6 +30,7 @@ namespace osg {
 namespace Moby {
 
 class CollisionGeometry;
+class ADF;
 
 /// Defines a triangle-mesh-based primitive type used for inertial property calculation and geometry provisions
 /**
@@ -43,8 +44,16 @@ class Primitive : public virtual Base
   friend class CSG;
 
   public:
+    /// Types of primitives (used to dispatch pairwise queries in constant time)
+    /**
+     * Primitive types defined outside of Moby should obtain a unique type
+     * from register_type().
+     */
+    enum PrimitiveType { eUnknown, eSphere, eBox, ePolyhedral, ePlane, eCylinder, eCone, eTorus, eHeightmap, eTriangleMesh, eNumPrimitiveTypes };
+
     Primitive();
     Primitive(const Ravelin::Pose3d& T);
+    static unsigned register_type();
     virtual ~Primitive();
     virtual void load_from_xml(boost::shared_ptr<const XMLTree> node, std::map<std::string, BasePtr>& id_map);
     virtual void save_to_xml(XMLTreePtr node, std::list<boost::shared_ptr<const Base> >& shared_objects) const;
@@ -54,6 +63,7 @@ class Primitive : public virtual Base
     virtual void set_pose(const Ravelin::Pose3d& T);
     virtual Point3d get_supporting_point(const Ravelin::Vector3d& d) const;
     virtual double calc_signed_dist(const Point3d& p) const;
+    virtual void calc_signed_dist_batch(boost::shared_ptr<const Ravelin::Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const;
     void add_collision_geometry(CollisionGeometryPtr cg);
     void remove_collision_geometry(CollisionGeometryPtr cg);
     boost::shared_ptr<const Ravelin::Pose3d> get_pose(CollisionGeometryPtr g) const;
@@ -96,8 +106,35 @@ class Primitive : public virtual Base
     /// Gets the inertia for this primitive 
     const Ravelin::SpatialRBInertiad& get_inertia() const { return _J; }
 
+    /// Gets the type of this primitive (a PrimitiveType or a type obtained from register_type())
+    unsigned get_type() const { return _type; }
+
+    void set_sdf_enabled(bool flag);
+
+    /// Determines whether point queries use a precomputed signed distance field
+    bool is_sdf_enabled() const { return _sdf_enabled; }
+
+    /// Sets the maximum octree depth and the interpolation tolerance used when building the signed distance field
+    void set_sdf_resolution(unsigned max_recursion, double epsilon) { _sdf_max_recursion = max_recursion; _sdf_epsilon = epsilon; invalidate_sdf(); }
+
+    /// Sets the directory used to cache signed distance fields on disk (the cache is disabled by default or if the directory is an empty string)
+    void set_sdf_cache_dir(const std::string& dir) { _sdf_cache_dir = dir; }
+
+    /// Sets the directory used to cache binary meshes on disk (the cache is disabled by default or if the directory is an empty string)
+    void set_mesh_cache_dir(const std::string& dir) { _mesh_cache_dir = dir; }
+
   protected:
     virtual void calc_mass_properties() = 0;
+    bool calc_sdf_dist_and_normal(const Point3d& p, double& dist, Ravelin::Vector3d& normal) const;
+
+    /// Discards the signed distance field (it will be rebuilt by the next query)
+    void invalidate_sdf() { _sdf.reset(); _sdf_built = false; }
+
+    /// Computes the exact signed distance used to build the signed distance field (point is in the primitive frame)
+    virtual double calc_sdf_sample(const Ravelin::Origin3d& p) const { return std::numeric_limits<double>::max(); }
+
+    /// Gets the vertices and facets of the geometry represented by the signed distance field (in the primitive frame)
+    virtual void get_sdf_geometry(std::vector<Ravelin::Origin3d>& verts, std::vector<IndexedTri>& facets) const { }
 
     /// The pose of this primitive (relative to the global frame)
     boost::shared_ptr<Ravelin::Pose3d> _F;
@@ -111,6 +148,9 @@ class Primitive : public virtual Base
     /// The inertia of the primitive
     Ravelin::SpatialRBInertiad _J;
 
+    /// The type of this primitive (set by the constructors of derived classes)
+    unsigned _type;
+
   protected:
 
     /// The poses of this primitive, relative to a collision geometry
@@ -120,6 +160,29 @@ class Primitive : public virtual Base
     std::set<boost::shared_ptr<Ravelin::Pose3d> > _poses;
 
   private:
+    static double sdf_distance_function(const Ravelin::Vector3d& p, void* data);
+    void build_sdf() const;
+
+    /// Whether point queries use a precomputed signed distance field
+    bool _sdf_enabled;
+
+    /// The maximum octree depth of the signed distance field
+    unsigned _sdf_max_recursion;
+
+    /// The interpolation tolerance of the signed distance field
+    double _sdf_epsilon;
+
+    /// The directory used to cache signed distance fields
+    std::string _sdf_cache_dir;
+
+    /// The directory used to cache binary meshes
+    std::string _mesh_cache_dir;
+
+    /// The signed distance field (built on first use)
+    mutable boost::shared_ptr<ADF> _sdf;
+
+    /// Whether an attempt has been made to build the signed distance field
+    mutable bool _sdf_built;
 
     /// The visualization transform (possibly NULL)
     osg::MatrixTransform* _vtransform;
@@ -0,0 +1,96 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_QUICKHULL_H
+#define _MOBY_QUICKHULL_H
+
+#include <vector>
+#include <utility>
+#include <Ravelin/Origin2d.h>
+#include <Ravelin/Origin3d.h>
+#include <Moby/Constants.h>
+#include <Moby/IndexedTri.h>
+
+namespace Moby {
+
+/// A reentrant engine for 2D and 3D convex hulls and 3D halfspace intersections
+/**
+ * qhull keeps its state in process-wide globals, so every call to it must
+ * be serialized. A QuickHull object keeps all of its state in the object
+ * itself, and its scratch storage is reused from call to call.
+ * get_thread_workspace() returns a separate object for each thread, so
+ * hulls can be computed concurrently without locking. 3D hulls are computed
+ * using quickhull and 2D hulls using Andrew's monotone chain algorithm.
+ * Points within the tolerance of a hull facet are treated as interior, so
+ * hulls contain no coplanar (or, in 2D, collinear) vertices.
+ */
+class QuickHull
+{
+  public:
+    QuickHull();
+    bool calc_convex_hull_2D(const std::vector<Ravelin::Origin2d>& points, std::vector<unsigned>& hull, double tol = NEAR_ZERO);
+    bool calc_convex_hull_3D(const std::vector<Ravelin::Origin3d>& points, std::vector<IndexedTri>& facets, double tol = NEAR_ZERO);
+    bool calc_hs_intersection(const std::vector<std::pair<Ravelin::Origin3d, double> >& halfspaces, const Ravelin::Origin3d& interior_point, std::vector<Ravelin::Origin3d>& vertices, double tol = NEAR_ZERO);
+    static void compact(std::vector<IndexedTri>& facets, unsigned n_points, std::vector<unsigned>& vertices);
+    static QuickHull& get_thread_workspace();
+
+  private:
+    // a triangular facet of the hull under construction
+    struct Facet
+    {
+      unsigned v[3];                  // vertices (ccw when viewed from outside)
+      unsigned adj[3];                // facet across edge (v[i], v[(i+1) % 3])
+      double n[3];                    // outward normal
+      double d;                       // offset (n'x = d on the facet plane)
+      std::vector<unsigned> outside;  // points above the facet
+      unsigned farthest;              // the point farthest above the facet
+      double farthest_dist;           // distance of the farthest point
+      bool deleted;                   // facet is no longer on the hull
+      bool visible;                   // facet is visible from the eye point
+    };
+
+    // compares two points lexicographically (used by the 2D hull)
+    struct LexLess
+    {
+      LexLess(const std::vector<Ravelin::Origin2d>& points) : _points(points) {}
+      bool operator()(unsigned i, unsigned j) const;
+      const std::vector<Ravelin::Origin2d>& _points;
+    };
+
+    const double* point(unsigned i) const { return &_pts[i*3]; }
+    double calc_dist(unsigned f, unsigned p) const;
+    unsigned new_facet(unsigned a, unsigned b, unsigned c);
+    void calc_plane(unsigned f);
+    void add_outside(unsigned f, unsigned p, double dist);
+    bool create_simplex();
+    void assign_points(const std::vector<unsigned>& points, const std::vector<unsigned>& facets);
+    void find_horizon(unsigned p, unsigned f, unsigned entry);
+    bool add_point(unsigned f);
+    static double cross2(const Ravelin::Origin2d& o, const Ravelin::Origin2d& a, const Ravelin::Origin2d& b);
+
+    /// The tolerance used for the current computation
+    double _eps;
+
+    /// The coordinates of the points (x, y, and z for each)
+    std::vector<double> _pts;
+
+    /// The facets (entries past _n_facets are spare storage)
+    std::vector<Facet> _facets;
+
+    /// The number of facets used by the current computation
+    unsigned _n_facets;
+
+    /// Scratch storage (retained between calls)
+    std::vector<unsigned> _points, _new_facets, _visible, _stack, _order;
+    std::vector<std::pair<unsigned, unsigned> > _horizon;
+    std::vector<Ravelin::Origin3d> _dual;
+    std::vector<IndexedTri> _dual_facets;
+}; // end class
+
+} // end namespace
+
+#endif
+
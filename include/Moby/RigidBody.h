@@ -68,6 +68,9 @@ class RigidBody : public virtual Ravelin::RigidBodyd, public virtual ControlledB
     virtual void set_inertia(const Ravelin::SpatialRBInertiad& J);
     virtual void apply_generalized_impulse(const Ravelin::SharedVectorNd& gj);
 
+    /// Determines whether the body has been put to sleep (see TimeSteppingSimulator::sleeping)
+    bool is_sleeping() const { return _sleeping; }
+
     template <class OutputIterator>
     OutputIterator get_parent_links(OutputIterator begin) const;
 
@@ -84,6 +87,9 @@ class RigidBody : public virtual Ravelin::RigidBodyd, public virtual ControlledB
     RigidBodyPtr get_parent_link(boost::shared_ptr<Ravelin::Jointd> j) const;
     RigidBodyPtr get_child_link(boost::shared_ptr<Ravelin::Jointd> j) const;
 
+    /// Whether the body has been put to sleep; sleeping is tracked separately from whether the body is enabled
+    bool _sleeping;
+
 #ifdef USE_OSG
     osg::Node * inertia_viz;
 #endif
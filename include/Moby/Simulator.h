@@ -30,6 +30,8 @@ class RigidBody;
 class ArticulatedBody;
 class RCArticulatedBody;
 class VisualizationData;
+class StateWriter;
+class StateReader;
 
 /// Simulator for both unarticulated and articulated rigid bodies without contact
 /**
@@ -54,6 +56,10 @@ class Simulator : public virtual Base
     void update_visualization();
     virtual void save_to_xml(XMLTreePtr node, std::list<boost::shared_ptr<const Base> >& shared_objects) const;
     virtual void load_from_xml(boost::shared_ptr<const XMLTree> node, std::map<std::string, BasePtr>& id_map);  
+    void save_state(std::vector<char>& buffer) const;
+    bool restore_state(const std::vector<char>& buffer);
+    bool save_state(const std::string& filename) const;
+    bool restore_state(const std::string& filename);
 
     /// The current simulation time
     double current_time;
@@ -85,16 +91,28 @@ class Simulator : public virtual Base
     /// Set of implicit joints maintained in the simulation (does not include implicit joints belonging to RCArticulatedBody objects)
     std::vector<JointPtr> implicit_joints;
 
+    /// If set to true, independent islands are processed in parallel (default is false)
+    /**
+     * Requires Moby to be built with OpenMP support; islands share no
+     * bodies, so results are identical to those computed serially.
+     */
+    bool parallel_islands;
+
   protected:
     void apply_impulse(boost::shared_ptr<Ravelin::DynamicBodyd> db, const Ravelin::SharedVectorNd& gj);
     void solve(const std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> >& island, const std::vector<JointPtr>& island_joints, const Ravelin::VectorNd& v, const Ravelin::VectorNd& f, double dt, Ravelin::VectorNd& a, Ravelin::VectorNd& lambda) const;
     virtual double check_pairwise_constraint_violations(double t) { return 0.0; }
     void find_islands(std::vector<std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> > >& islands);
     unsigned num_generalized_coordinates(const std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> > & island) const;
+
+    /// Gets the number of islands used by the last call to calc_fwd_dyn()
+    unsigned num_islands() const { return _islands.size(); }
     osg::Group* _persistent_vdata;
     osg::Group* _transient_vdata;
     void calc_fwd_dyn(double dt);
     void precalc_fwd_dyn();
+    virtual void write_state(StateWriter& out) const;
+    virtual void read_state(StateReader& in, bool apply);
 
     /// The set of bodies in the simulation
     std::vector<ControlledBodyPtr> _bodies;
@@ -109,6 +127,30 @@ class Simulator : public virtual Base
     double integrate(double step_size) { return integrate(step_size, _bodies.begin(), _bodies.end()); }
 
   private:
+    /// Workspace for computing forward dynamics of a single island
+    struct IslandWorkspace
+    {
+      Ravelin::VectorNd f, v, a, lambda;
+    };
+
+    bool update_island_cache();
+    void get_state_tables(std::vector<CollisionGeometryPtr>& geoms, std::vector<JointPtr>& joints, unsigned long long& layout) const;
+    void calc_fwd_dyn(double dt, unsigned island_idx);
+
+    /// The islands (computed by find_islands()) at the last topology change
+    std::vector<std::vector<boost::shared_ptr<Ravelin::DynamicBodyd> > > _islands;
+
+    /// The implicit joints in each island (including those of articulated bodies)
+    std::vector<std::vector<JointPtr> > _island_ijoints;
+
+    /// Per-island workspaces for calc_fwd_dyn()
+    std::vector<IslandWorkspace> _island_workspaces;
+
+    /// The bodies, implicit joints, and enabled states used to compute the islands 
+    std::vector<ControlledBodyPtr> _island_bodies;
+    std::vector<JointPtr> _island_implicit_joints;
+    std::vector<bool> _island_enabled;
+
     static Ravelin::VectorNd& ode(const Ravelin::VectorNd& x, double t, double dt, void* data, Ravelin::VectorNd& dx);
 }; // end class
 
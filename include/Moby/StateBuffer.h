@@ -0,0 +1,106 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_STATE_BUFFER_H
+#define _MOBY_STATE_BUFFER_H
+
+#include <map>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <Ravelin/VectorNd.h>
+#include <Ravelin/Vector3d.h>
+#include <Ravelin/Pose3d.h>
+#include <Moby/Types.h>
+
+namespace Moby {
+
+/// Writes simulation state to a flat binary buffer
+/**
+ * The buffer starts with a header identifying the format, the byte order,
+ * and the layout of the simulator (see Simulator::save_state()), followed by
+ * the size and a checksum of the state. Collision geometries and joints are
+ * written as indices into tables of the simulator's geometries and joints,
+ * so that the state can be restored into a simulator loaded from the same
+ * model by another process.
+ */
+class StateWriter
+{
+  public:
+    StateWriter(std::vector<char>& buffer, const std::vector<CollisionGeometryPtr>& geoms, const std::vector<JointPtr>& joints, unsigned long long layout);
+    void finish();
+    void write_vector(const Ravelin::VectorNd& v);
+    void write_vector3d(const Ravelin::Vector3d& v);
+    void write_geometry(CollisionGeometryPtr cg);
+    void write_joint(JointPtr joint);
+    static unsigned long long hash(const void* data, size_t n, unsigned long long h = 14695981039346656037ULL);
+
+    /// Writes raw bytes
+    void write(const void* data, size_t n) { const char* c = (const char*) data; _buffer.insert(_buffer.end(), c, c+n); }
+
+    /// Writes an unsigned integer
+    void write_unsigned(unsigned x) { boost::uint32_t y = x; write(&y, sizeof(boost::uint32_t)); }
+
+    /// Writes a floating point value
+    void write_double(double x) { write(&x, sizeof(double)); }
+
+  private:
+    /// The buffer being written
+    std::vector<char>& _buffer;
+
+    /// The offset of the state (following the header) in the buffer
+    size_t _start;
+
+    /// Mapping from geometries to indices in the geometry table
+    std::map<CollisionGeometryPtr, unsigned> _geom_index;
+
+    /// Mapping from joints to indices in the joint table
+    std::map<JointPtr, unsigned> _joint_index;
+}; // end class
+
+/// Reads simulation state written by StateWriter
+/**
+ * The header and checksum are verified on construction; reads past the end
+ * of the state or of geometries and joints not in the tables mark the reader
+ * as failed (see ok()), after which all reads return zeros or null pointers.
+ */
+class StateReader
+{
+  public:
+    StateReader(const char* data, size_t size, const std::vector<CollisionGeometryPtr>& geoms, const std::vector<JointPtr>& joints, unsigned long long layout);
+    void read(void* data, size_t n);
+    unsigned read_unsigned();
+    double read_double();
+    void read_vector(Ravelin::VectorNd& v);
+    Ravelin::Vector3d read_vector3d(boost::shared_ptr<const Ravelin::Pose3d> P);
+    CollisionGeometryPtr read_geometry();
+    JointPtr read_joint();
+
+    /// Determines whether the header was valid and all reads so far have succeeded
+    bool ok() const { return _ok; }
+
+    /// Determines whether all of the state has been read
+    bool at_end() const { return _ptr == _end; }
+
+    /// Marks the reader as failed (e.g., when the state does not match the simulator)
+    void fail() { _ok = false; }
+
+  private:
+    /// The next byte to read and the end of the state
+    const char* _ptr;
+    const char* _end;
+
+    /// Whether the header was valid and all reads so far have succeeded
+    bool _ok;
+
+    /// The geometry and joint tables
+    const std::vector<CollisionGeometryPtr>& _geoms;
+    const std::vector<JointPtr>& _joints;
+}; // end class
+
+} // end namespace
+
+#endif
+
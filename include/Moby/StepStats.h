@@ -0,0 +1,104 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0 
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#ifndef _MOBY_STEP_STATS_H_
+#define _MOBY_STEP_STATS_H_
+
+#include <cstddef>
+#include <ostream>
+
+namespace Moby {
+
+class ScopedPhaseTimer;
+
+/// Timings and counters for the phases of a single simulation step
+/**
+ * Times are wall-clock times (in seconds) accumulated over all mini-steps
+ * of the step; counters are likewise totals over the step, except where
+ * noted. Time spent in a phase run within another phase (e.g., the broad
+ * phase run during constraint stabilization) is counted only for the inner
+ * phase, so the phase times do not overlap.
+ */
+struct StepStats
+{
+  /// The phases of a simulation step that are timed
+  enum Phase { eBroadPhase, ePairwiseDistances, eConservativeAdvancement, eFindConstraints, ePenalty, eDynamics, eImpacts, eStabilization, eStep, eNumPhases };
+
+  StepStats() { active_timer = NULL; reset(); }
+  void reset();
+  static void write_csv_header(std::ostream& out);
+  void write_csv(std::ostream& out) const;
+  void write_json(std::ostream& out) const;
+  static const char* get_phase_name(Phase phase);
+  static double get_time();
+
+  /// The simulation time at the end of the step
+  double sim_time;
+
+  /// The time spent in each phase
+  double phase_time[eNumPhases];
+
+  /// The number of geometry pairs checked by the narrow phase
+  unsigned n_pairs_checked;
+
+  /// The number of contact constraints found
+  unsigned n_contacts;
+
+  /// The number of joint limit constraints found
+  unsigned n_limits;
+
+  /// The number of islands used to compute forward dynamics in the last mini-step of the step
+  unsigned n_islands;
+
+  /// The number of pivots (or iterations, for iterative solvers) used by the impact LCP solvers
+  unsigned long n_lcp_pivots;
+
+  /// The number of constraint stabilization iterations (over all islands) 
+  unsigned n_stabilization_iterations;
+
+  /// The number of mini-steps
+  unsigned n_mini_steps;
+
+  /// The number of times the mini-step budget was exhausted
+  unsigned n_mini_step_fallbacks;
+
+  /// The number of bodies asleep at the end of the step
+  unsigned n_sleeping_bodies;
+
+  /// The innermost timer currently running (NULL if none)
+  ScopedPhaseTimer* active_timer;
+}; // end struct
+
+/// Adds the time spent in a scope to a phase of a step
+/**
+ * Timers may be nested; the time spent in a nested timer's scope is
+ * removed from the phase of the enclosing timer.
+ */
+class ScopedPhaseTimer
+{
+  public:
+    ScopedPhaseTimer(StepStats& stats, StepStats::Phase phase) : _stats(stats), _phase(phase), _outer(stats.active_timer) { _stats.active_timer = this; _start = StepStats::get_time(); }
+
+    ~ScopedPhaseTimer()
+    {
+      const double ELAPSED = StepStats::get_time() - _start;
+      _stats.phase_time[_phase] += ELAPSED;
+      if (_outer)
+        _stats.phase_time[_outer->_phase] -= ELAPSED;
+      _stats.active_timer = _outer;
+    }
+
+  private:
+    StepStats& _stats;
+    StepStats::Phase _phase;
+    ScopedPhaseTimer* _outer;
+    double _start;
+}; // end class
+
+} // end namespace
+
+#endif
+
@@ -9,6 +9,7 @@
 
 #include <map>
 #include <Ravelin/sorted_pair>
+#include <Ravelin/SForced.h>
 #include <Moby/ConstraintSimulator.h>
 #include <Moby/ImpactConstraintHandler.h>
 #include <Moby/PenaltyConstraintHandler.h>
@@ -29,6 +30,9 @@ class TimeSteppingSimulator : public ConstraintSimulator
   friend class CollisionDetection;
 
   public:
+    /// What to do when the mini-step budget is exhausted
+    enum MiniStepFallback { eAcceptPenetration, eTruncateStep };
+
     TimeSteppingSimulator();
     virtual ~TimeSteppingSimulator() {}
     virtual void load_from_xml(boost::shared_ptr<const XMLTree> node, std::map<std::string, BasePtr>& id_map);
@@ -39,6 +43,56 @@ class TimeSteppingSimulator : public ConstraintSimulator
     // the minimum step that the simulator should take (default = 1e-8)
     double min_step_size;
 
+    /// The maximum number of position integration iterations per step (default is infinity)
+    /**
+     * Bounds the latency of a step when fast moving bodies reduce the
+     * conservative advancement step toward min_step_size. Every conservative
+     * advancement iteration (including those within a single mini-step) 
+     * counts against the budget. The last iteration permitted by the budget
+     * uses mini_step_fallback.
+     */
+    unsigned max_mini_steps;
+
+    /// What to do when the mini-step budget is exhausted (default is eAcceptPenetration)
+    /**
+     * eAcceptPenetration integrates the remainder of the step without 
+     * conservative advancement, so that bodies may interpenetrate; 
+     * interpenetration is then corrected by constraint stabilization. 
+     * eTruncateStep ends the step early, so the step size taken may be 
+     * smaller than that requested.
+     */
+    MiniStepFallback mini_step_fallback;
+
+    /// If set to 'true', islands of resting bodies are put to sleep (default is false)
+    /**
+     * A sleeping body (see RigidBody::is_sleeping()) remains enabled, but it
+     * is skipped by forward dynamics and integration, and broad phase 
+     * collision detection does not check it against other bodies that do
+     * not move, until its island is woken. An island of 
+     * rigid bodies (connected by contacts and implicit joints) sleeps once
+     * every body in it has had kinetic energy below sleep_ke_thresh and 
+     * speed below sleep_vel_thresh for sleep_time. Islands containing 
+     * articulated bodies or bodies with controllers never sleep. A sleeping
+     * island is woken when one of its bodies comes into contact with an awake
+     * body that is not resting, when the recurrent forces on one of its 
+     * bodies change, or when one of its bodies is disturbed: it receives an
+     * impulse, or its velocity or pose is changed.
+     */
+    bool sleeping;
+
+    /// The kinetic energy below which a body is considered to be resting
+    double sleep_ke_thresh;
+
+    /// The speed (infinity norm of the generalized velocity) below which a body is considered to be resting
+    double sleep_vel_thresh;
+
+    /// The amount of time that all bodies in an island must rest before the island is put to sleep
+    double sleep_time;
+
+    bool is_sleeping(RigidBodyPtr rb) const { return _sleeping_island_map.find(rb) != _sleeping_island_map.end(); }
+    void wake(RigidBodyPtr rb);
+    void wake_all();
+
     /// Determines whether two geometries are not checked
     std::set<Ravelin::sorted_pair<CollisionGeometryPtr> > unchecked_pairs;
 
@@ -51,9 +105,30 @@ class TimeSteppingSimulator : public ConstraintSimulator
   protected:
     bool constraints_met(const std::vector<PairwiseDistInfo>& current_pairwise_distances);
     std::set<Ravelin::sorted_pair<CollisionGeometryPtr> > get_current_contact_geoms() const;
-    double do_mini_step(double dt);
-    void step_si_Euler(double dt);
+    double do_mini_step(double dt, unsigned& budget);
+    double step_si_Euler(double dt);
     double calc_next_CA_Euler_step(double contact_dist_thresh) const;
+    void update_sleeping(double dt);
+    void check_sleeping_forces();
+    void check_sleeping_states();
+    void wake_island(unsigned i);
+    virtual void write_state(StateWriter& out) const;
+    virtual void read_state(StateReader& in, bool apply);
+
+    /// The amount of time that each awake body has been resting
+    std::map<boost::shared_ptr<Ravelin::DynamicBodyd>, double> _rest_time;
+
+    /// The islands that are asleep (woken islands are empty)
+    std::vector<std::vector<RigidBodyPtr> > _sleeping_islands;
+
+    /// Mapping from sleeping bodies to their islands
+    std::map<RigidBodyPtr, unsigned> _sleeping_island_map;
+
+    /// The recurrent forces (in the global frame) on each sleeping body when it was put to sleep
+    std::map<RigidBodyPtr, Ravelin::SForced> _sleep_forces;
+
+    /// The generalized coordinates (Euler) of each sleeping body when it was put to sleep
+    std::map<RigidBodyPtr, Ravelin::VectorNd> _sleep_coords;
 }; // end class
 
 } // end namespace
@@ -15,6 +15,9 @@
 #include <string>
 #include <Moby/Types.h>
 #include <Moby/Primitive.h>
+#include <Moby/MeshCache.h>
+#include <Moby/MeshDistTree.h>
+#include <Moby/MeshOBBTree.h>
 
 namespace Moby {
 
@@ -42,6 +45,10 @@ class TriangleMeshPrimitive : public Primitive
     virtual void set_pose(const Ravelin::Pose3d& T);
     virtual double calc_signed_dist(boost::shared_ptr<const Primitive> p, Point3d& pthis, Point3d& pp) const;
     virtual bool is_convex() const;
+    void get_vertices(boost::shared_ptr<const Ravelin::Pose3d> P, const Ravelin::Origin3d& lo, const Ravelin::Origin3d& hi, std::vector<Point3d>& vertices) const;
+    void get_bounding_box(Ravelin::Origin3d& lo, Ravelin::Origin3d& hi) const;
+    double calc_closest_points(const Point3d& p, const Point3d& q, Point3d& cseg, Point3d& cmesh, Ravelin::Vector3d& normal, double& t) const;
+    static void get_edges(boost::shared_ptr<const Primitive> primitive, boost::shared_ptr<const Ravelin::Pose3d> P, std::vector<std::pair<Point3d, Point3d> >& edges);
     
 
   private:
@@ -63,6 +70,22 @@ class TriangleMeshPrimitive : public Primitive
     /// Edge sample length above which pseudo-vertices are added
     double _edge_sample_length;
 
+    /// The hierarchy used for distance queries (shared with the mesh cache and other primitives using the same mesh)
+    boost::shared_ptr<const MeshDistTree> _dist_tree;
+
+    /// The bounding volume tree for the mesh (shared with the mesh cache and other primitives using the same mesh; built on first use if not cached)
+    boost::shared_ptr<const MeshOBBTree> _obb_tree;
+
+    /// The edges of the mesh (pairs of vertex indices)
+    std::vector<std::pair<unsigned, unsigned> > _edges;
+
+    void build_dist_tree();
+    void setup_edges();
+    void load_mesh(const std::string& filename);
+    double calc_closest_point(const Ravelin::Origin3d& p, Ravelin::Origin3d& closest, Ravelin::Origin3d& normal) const;
+    virtual double calc_sdf_sample(const Ravelin::Origin3d& p) const;
+    virtual void get_sdf_geometry(std::vector<Ravelin::Origin3d>& verts, std::vector<IndexedTri>& facets) const;
+
     /// Thick triangle structure augmented with mesh data
     class AThickTri : public ThickTriangle
     {
@@ -74,11 +97,6 @@ class TriangleMeshPrimitive : public Primitive
 
     void construct_mesh_vertices(boost::shared_ptr<const IndexedTriArray> mesh, CollisionGeometryPtr geom);
     void build_BB_tree(CollisionGeometryPtr geom);
-    void split_tris(const Point3d& point, const Ravelin::Vector3d& normal, const IndexedTriArray& orig_mesh, const std::list<unsigned>& ofacets, std::list<unsigned>& pfacets, std::list<unsigned>& nfacets);
-    bool split(boost::shared_ptr<const IndexedTriArray> mesh, BVPtr source, BVPtr& tgt1, BVPtr& tgt2, const Ravelin::Vector3d& axis);
-
-    template <class InputIterator, class OutputIterator>
-    static OutputIterator get_vertices(const IndexedTriArray& tris, InputIterator fselect_begin, InputIterator fselect_end, OutputIterator output, boost::shared_ptr<const Ravelin::Pose3d> P);
 
     /// Mapping from BVs to triangles contained within (not necessary to index this per geometry)
     std::map<BVPtr, std::list<unsigned> > _mesh_tris;
@@ -96,8 +114,6 @@ class TriangleMeshPrimitive : public Primitive
     std::pair<boost::shared_ptr<const IndexedTriArray>, std::list<unsigned> > _smesh;
 }; // end class
 
-#include "TriangleMeshPrimitive.inl"
-
 } // end namespace 
 
 #endif
@@ -112,6 +112,15 @@ namespace Moby{
   bool OUTPUT_ITER_NUM = false;
   bool OUTPUT_SIM_RATE = false;
   
+  /// The stream to which per-step timings and counters are written (if open)
+  std::ofstream STATS_OUT;
+  
+  /// Determines whether per-step timings and counters are written as JSON (one object per line) rather than CSV
+  bool STATS_JSON = false;
+  
+  /// The file to which per-step constraint violation diagnostics are written (none if empty)
+  std::string METRICS_FILE;
+  
   /// Render Contact Points
   bool RENDER_CONTACT_POINTS = false;
   
@@ -243,6 +252,15 @@ namespace Moby{
       s->step(STEP_SIZE);
     }
     
+    // output the step timings and counters, if desired
+    if (STATS_OUT.is_open() && eds)
+    {
+      if (STATS_JSON)
+        eds->get_step_stats().write_json(STATS_OUT);
+      else
+        eds->get_step_stats().write_csv(STATS_OUT);
+    }
+    
     
     // output the frame rate, if desired
     if (OUTPUT_FRAME_RATE)
@@ -575,6 +593,16 @@ namespace Moby{
         UPDATE_GRAPHICS = true;
         check_osg();
       }
+      else if (option.find("-os=") != std::string::npos)
+      {
+        std::string fname(&argv[i][TWOCHAR_ARG]);
+        STATS_OUT.open(fname.c_str());
+        STATS_JSON = (fname.find(".json") != std::string::npos);
+        if (!STATS_JSON)
+          StepStats::write_csv_header(STATS_OUT);
+      }
+      else if (option.find("-om=") != std::string::npos)
+        METRICS_FILE = std::string(&argv[i][TWOCHAR_ARG]);
       else if (option.find("-of") != std::string::npos)
         OUTPUT_FRAME_RATE = true;
       else if (option.find("-oi") != std::string::npos)
@@ -690,6 +718,19 @@ namespace Moby{
       return -1;
     }
     
+    // setup the constraint violation diagnostics, if desired
+    if (!METRICS_FILE.empty())
+    {
+      boost::shared_ptr<ConstraintSimulator> csim = boost::dynamic_pointer_cast<ConstraintSimulator>(s);
+      if (csim)
+      {
+        csim->metrics_sink = boost::shared_ptr<MetricsSink>(new MetricsSink);
+        csim->metrics_sink->open(METRICS_FILE);
+      }
+      else
+        std::cerr << "driver: simulator does not support constraint violation diagnostics" << std::endl;
+    }
+    
     // setup osg window if desired
 #ifdef USE_OSG
     if (ONSCREEN_RENDER)
@@ -803,6 +844,11 @@ namespace Moby{
       stop_sim = !step(s);
     }
     
+    // write any remaining constraint violation diagnostics
+    boost::shared_ptr<ConstraintSimulator> csim = boost::dynamic_pointer_cast<ConstraintSimulator>(s);
+    if (csim && csim->metrics_sink)
+      csim->metrics_sink->close();
+    
     close();
     
     return 0;
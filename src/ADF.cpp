@@ -4,8 +4,14 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
+#include <map>
 #include <set>
+#include <sstream>
 #include <cmath>
 #include <queue>
 #include <limits>
@@ -30,6 +36,20 @@ using namespace boost;
 using namespace Ravelin;
 using namespace Moby;
 
+// orders vectors lexicographically (used to identify shared cell vertices)
+struct VertexLess
+{
+  bool operator()(const Vector3d& a, const Vector3d& b) const
+  {
+    for (unsigned i=0; i< 3; i++)
+      if (a[i] < b[i])
+        return true;
+      else if (a[i] > b[i])
+        return false;
+    return false;
+  }
+};
+
 /// Constructs an adaptively-sampled distance field (ADF) with a recursion level of 0
 /**
  * The bounds of the ADF are set to -/+ infinity and the distances are set to 
@@ -673,7 +693,7 @@ void ADF::simplify(double epsilon)
       return;
 
   // we can possibly coalesce the children; check distances at 19 points
-  std::map<Vector3d, double> check;
+  std::map<Vector3d, double, VertexLess> check;
   for (unsigned i=0; i< OCT_CHILDREN; i++)
   {
     const std::vector<Vector3d>& vertices = _children[i]->get_vertices();
@@ -683,10 +703,10 @@ void ADF::simplify(double epsilon)
   }
 
   // get the set of vertices of this cell (sorted)
-  std::set<Vector3d> vertex_set(_vertices.begin(), _vertices.end());
+  std::set<Vector3d, VertexLess> vertex_set(_vertices.begin(), _vertices.end());
   
   // check distances at all points that don't already exist in this cell
-  for (std::map<Vector3d, double>::iterator i = check.begin(); i != check.end(); i++)
+  for (std::map<Vector3d, double, VertexLess>::iterator i = check.begin(); i != check.end(); i++)
   {
     // if the vertex exists in this cell, don't check it
     if (vertex_set.find(i->first) != vertex_set.end())
@@ -1387,12 +1407,18 @@ _children[2] = shared_ptr<ADF>(new ADF(shared_from_this(),  box_2_verts));
 }
 
 /// Saves this ADF to a file
+/**
+ * Values are written with full precision so that a loaded ADF reproduces the
+ * saved one exactly. The ADF is written to a temporary file that is then 
+ * renamed, so that concurrent readers (e.g., other processes sharing a cache
+ * directory) never see a partially written file.
+ */
 void ADF::save_to_file(const std::string& filename) const
 {
   const unsigned X = 0, Y = 1, Z = 2;
 
   // compose the map of vertices
-  std::map<Vector3d, unsigned> vertices;
+  std::map<Vector3d, unsigned, VertexLess> vertices;
   std::list<Vector3d> verts;
   std::stack<shared_ptr<const ADF> > s;
   s.push(shared_from_this());
@@ -1415,8 +1441,18 @@ void ADF::save_to_file(const std::string& filename) const
       s.push(cell->_children[i]);
   }
 
-  // open the file
-  std::ofstream out(filename.c_str());
+  // open a temporary file (unique to this process and ADF) in the same 
+  // directory, so that it can be renamed atomically
+  std::ostringstream tmp;
+  tmp << filename << ".tmp." << getpid() << "." << (const void*) this;
+  const std::string tmpname = tmp.str();
+  std::ofstream out(tmpname.c_str());
+  if (out.fail())
+  {
+    FILE_LOG(LOG_ADF) << "ADF::save_to_file() - unable to open " << tmpname << std::endl;
+    return;
+  }
+  out << std::setprecision(std::numeric_limits<double>::digits10 + 2);
 
   // write the number of vertices
   out << verts.size() << std::endl;
@@ -1460,23 +1496,37 @@ void ADF::save_to_file(const std::string& filename) const
     written++;
   }
 
-  // close the file
+  // close the file and move it into place
   out.close();
+  if (out.fail() || std::rename(tmpname.c_str(), filename.c_str()) != 0)
+  {
+    FILE_LOG(LOG_ADF) << "ADF::save_to_file() - unable to write " << filename << std::endl;
+    std::remove(tmpname.c_str());
+    return;
+  }
 
   FILE_LOG(LOG_ADF) << written << " cells written" << std::endl;
 }
 
 /// Reads a ADF tree from the given file
+/**
+ * \return the root of the ADF, or a NULL pointer if the file could not be
+ *         opened or is malformed
+ */
 shared_ptr<ADF> ADF::load_from_file(const std::string& filename)
 {
   const unsigned X = 0, Y = 1, Z = 2;
 
   // open the file
   std::ifstream in(filename.c_str());
+  if (in.fail())
+    return shared_ptr<ADF>();
 
   // read in the number of vertices
   unsigned verts;
   in >> verts;
+  if (in.fail())
+    return shared_ptr<ADF>();
 
   // read the vertices
   std::map<unsigned, Vector3d> vertices;
@@ -1527,6 +1577,11 @@ shared_ptr<ADF> ADF::load_from_file(const std::string& filename)
     // read whether this cell is a leaf node or not
     bool internal;
     in >> internal;
+    if (in.fail())
+    {
+      FILE_LOG(LOG_ADF) << "ADF::load_from_file() - " << filename << " is malformed" << std::endl;
+      return shared_ptr<ADF>();
+    }
 
     // if this is not a leaf, create and add all children to the stack
     if (internal)
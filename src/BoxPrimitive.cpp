@@ -19,6 +19,7 @@
 #include <Moby/CollisionGeometry.h>
 #include <Moby/HeightmapPrimitive.h>
 #include <Moby/QP.h>
+#include <Moby/FastThreadable.h>
 #include <Moby/BoxPrimitive.h>
 
 using namespace Ravelin;
@@ -37,6 +38,7 @@ using std::endl;
 /// Constructs a unit cube centered at the origin
 BoxPrimitive::BoxPrimitive()
 {
+  _type = eBox;
   _xlen = 1;
   _ylen = 1;
   _zlen = 1;
@@ -52,6 +54,7 @@ BoxPrimitive::BoxPrimitive()
 /// Constructs a box of the specified size
 BoxPrimitive::BoxPrimitive(double xlen, double ylen, double zlen)
 {
+  _type = eBox;
   _xlen = xlen;
   _ylen = ylen;
   _zlen = zlen;
@@ -67,6 +70,7 @@ BoxPrimitive::BoxPrimitive(double xlen, double ylen, double zlen)
 /// Constructs a unit cube transformed by the given matrix
 BoxPrimitive::BoxPrimitive(const Pose3d& P) : PolyhedralPrimitive(P)
 {
+  _type = eBox;
   _xlen = 1;
   _ylen = 1;
   _zlen = 1;
@@ -97,6 +101,7 @@ BoxPrimitive::BoxPrimitive(const Pose3d& P) : PolyhedralPrimitive(P)
 /// Constructs a box of the specified size transformed by the given matrix
 BoxPrimitive::BoxPrimitive(double xlen, double ylen, double zlen, const Pose3d& P) : PolyhedralPrimitive(P)
 {
+  _type = eBox;
   _xlen = xlen;
   _ylen = ylen;
   _zlen = zlen;
@@ -144,6 +149,7 @@ void BoxPrimitive::construct_polyhedron()
   CompGeom::calc_convex_hull(v, v+N_BOX_VERTS)->to_polyhedron(_poly); 
   assert(_poly.get_faces().size() == 6 || _poly.get_faces().size() == 12);
   assert(_poly.get_vertices().size() == 8);
+  polyhedron_changed();
 }
 
 /// Computes the signed distance from the box to a primitive
@@ -186,7 +192,7 @@ double BoxPrimitive::calc_closest_points(shared_ptr<const SpherePrimitive> s, Po
   const unsigned X = 0, Y = 1, Z = 2;
   Origin3d l, u, c, p;
   Matrix3d G;
-  static QP qp;
+  static FastThreadable<QP> qp;
 
   // to determine the closest point on/inside the box to the sphere, we
   // 1. compute the sphere center in the box frame
@@ -219,7 +225,7 @@ double BoxPrimitive::calc_closest_points(shared_ptr<const SpherePrimitive> s, Po
   l[Z] = -HALF_Z;  u[Z] = HALF_Z; 
   
   // solve the QP for the point nearest to the sphere center
-  qp.qp_gradproj(G, c, l, u, 100, p, NEAR_ZERO);
+  qp().qp_gradproj(G, c, l, u, 100, p, NEAR_ZERO);
 
   // setup the closest point on/in the box 
   pbox[X] = p[X];
@@ -776,12 +782,38 @@ double BoxPrimitive::calc_signed_dist(const Point3d& p) const
     }
     else if (inside)
     {
-      double dist = std::min(std::fabs(p[i] - extents[i]), std::fabs(p[i] + extents[i]));
+      double dist = -std::min(std::fabs(p[i] - extents[i]), std::fabs(p[i] + extents[i]));
       intDist = std::max(intDist, dist);
     }
   }
 
-  return (inside) ? -intDist : std::sqrt(sqrDist);
+  return (inside) ? intDist : std::sqrt(sqrDist);
+}
+
+/// Computes the signed distances of a batch of points from the box
+/**
+ * \see Primitive::calc_signed_dist_batch()
+ */
+void BoxPrimitive::calc_signed_dist_batch(shared_ptr<const Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const
+{
+  assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
+
+  // setup extents
+  const double EX = _xlen*0.5, EY = _ylen*0.5, EZ = _zlen*0.5;
+
+  // the loop has no branches, so that the compiler can vectorize it: the
+  // distance outside of the box is computed from the per-axis excess and
+  // the distance inside of the box from the nearest face
+  for (unsigned i=0; i< n; i++)
+  {
+    const double AX = std::fabs(x[i]), AY = std::fabs(y[i]), AZ = std::fabs(z[i]);
+    const double DX = std::max(AX - EX, 0.0);
+    const double DY = std::max(AY - EY, 0.0);
+    const double DZ = std::max(AZ - EZ, 0.0);
+    const double SQR_DIST = DX*DX + DY*DY + DZ*DZ;
+    const double INT_DIST = -std::min(EX - AX, std::min(EY - AY, EZ - AZ));
+    dist[i] = (SQR_DIST > 0.0) ? std::sqrt(SQR_DIST) : INT_DIST;
+  }
 }
 
 /// Computes the closest point on the box to a point (and returns the distance) 
@@ -7,6 +7,7 @@
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#include <pthread.h>
 #include <fstream>
 #include <set>
 #include <cmath>
@@ -31,6 +32,7 @@
 #include <Moby/PlanePrimitive.h>
 #include <Moby/GaussianMixture.h>
 #include <Moby/CSG.h>
+#include <Moby/StateBuffer.h>
 #include <Moby/CCD.h>
 
 using boost::dynamic_pointer_cast;
@@ -51,9 +53,507 @@ using std::make_pair;
 using namespace Ravelin;
 using namespace Moby;
 
+// the pairwise dispatch tables (shared by all collision detectors)
+vector<CCD::FindContactsEntry> CCD::_find_contacts_fns;
+vector<CCD::SignedDistEntry> CCD::_signed_dist_fns;
+unsigned CCD::_n_dispatch_types = 0;
+
+// builds the dispatch tables once, and serializes registration of handlers
+static pthread_once_t _dispatch_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t _dispatch_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// key for the per-thread contact buffers used by the templated find_contacts()
+static pthread_key_t _contacts_buffer_key;
+static pthread_once_t _contacts_buffer_once = PTHREAD_ONCE_INIT;
+
+/// Destroys a thread's contact buffer when the thread exits
+static void destroy_contacts_buffer(void* buffer)
+{
+  delete (vector<UnilateralConstraint>*) buffer;
+}
+
+/// Creates the key for the per-thread contact buffers
+static void create_contacts_buffer_key()
+{
+  pthread_key_create(&_contacts_buffer_key, &destroy_contacts_buffer);
+}
+
+/// Determines whether two transforms are identical
+static bool same_transform(const Transform3d& T1, const Transform3d& T2)
+{
+  return T1.x[0] == T2.x[0] && T1.x[1] == T2.x[1] && T1.x[2] == T2.x[2] &&
+         T1.q.x == T2.q.x && T1.q.y == T2.q.y && T1.q.z == T2.q.z && 
+         T1.q.w == T2.q.w;
+}
+
 /// Constructs a collision detector with default tolerances
 CCD::CCD()
 {
+  clip_polyhedron_contacts = false;
+
+  // setup the dispatch tables with the built-in pair handlers
+  init_dispatch_tables();
+}
+
+/// Sets up the dispatch tables with the built-in pair handlers (if they have not already been setup)
+/**
+ * Safe to call from multiple threads; the tables are built exactly once.
+ */
+void CCD::init_dispatch_tables()
+{
+  pthread_once(&_dispatch_once, &build_dispatch_tables);
+}
+
+/// Builds the dispatch tables with the built-in pair handlers
+void CCD::build_dispatch_tables()
+{
+  // every pair of types defaults to the generic routines
+  resize_dispatch_tables(Primitive::eNumPrimitiveTypes);
+
+  // planes and heightmaps have their own routines for every other type
+  for (unsigned i=0; i< _n_dispatch_types; i++)
+  {
+    if (i != Primitive::ePlane)
+      set_find_contacts_fn(Primitive::eHeightmap, i, find_contacts_heightmap_fn);
+    set_find_contacts_fn(Primitive::ePlane, i, find_contacts_plane_generic_fn);
+  }
+
+  // triangle meshes may be non-convex, so they use their distance hierarchy 
+  // against every type but planes and heightmaps 
+  for (unsigned i=0; i< _n_dispatch_types; i++)
+    if (i != Primitive::ePlane && i != Primitive::eHeightmap)
+      set_find_contacts_fn(Primitive::eTriangleMesh, i, find_contacts_trimesh_fn);
+
+  // setup the specialized contact routines
+  set_find_contacts_fn(Primitive::eSphere, Primitive::eSphere, find_contacts_sphere_sphere_fn);
+  set_find_contacts_fn(Primitive::eSphere, Primitive::ePlane, find_contacts_sphere_plane_fn);
+  set_find_contacts_fn(Primitive::eSphere, Primitive::eHeightmap, find_contacts_sphere_heightmap_fn);
+  set_find_contacts_fn(Primitive::eBox, Primitive::eSphere, find_contacts_box_sphere_fn);
+  set_find_contacts_fn(Primitive::eCylinder, Primitive::ePlane, find_contacts_cylinder_plane_fn);
+  set_find_contacts_fn(Primitive::eTorus, Primitive::ePlane, find_contacts_torus_plane_fn);
+  set_find_contacts_fn(Primitive::eBox, Primitive::eBox, find_contacts_polyhedron_polyhedron_fn);
+  set_find_contacts_fn(Primitive::eBox, Primitive::ePolyhedral, find_contacts_polyhedron_polyhedron_fn);
+  set_find_contacts_fn(Primitive::ePolyhedral, Primitive::ePolyhedral, find_contacts_polyhedron_polyhedron_fn);
+
+  // setup the specialized signed distance routines
+  // triangle meshes compute signed distances against every type but planes
+  // and heightmaps (which have their own routines) with the mesh first
+  for (unsigned i=0; i< _n_dispatch_types; i++)
+    if (i != Primitive::ePlane && i != Primitive::eHeightmap)
+      set_signed_dist_fn(Primitive::eTriangleMesh, i, calc_signed_dist_generic_fn);
+  set_signed_dist_fn(Primitive::eSphere, Primitive::eSphere, calc_signed_dist_sphere_sphere_fn);
+  set_signed_dist_fn(Primitive::eBox, Primitive::eSphere, calc_signed_dist_box_sphere_fn);
+  set_signed_dist_fn(Primitive::eHeightmap, Primitive::eSphere, calc_signed_dist_heightmap_sphere_fn);
+  set_signed_dist_fn(Primitive::ePlane, Primitive::eSphere, calc_signed_dist_plane_sphere_fn);
+  set_signed_dist_fn(Primitive::ePlane, Primitive::eCylinder, calc_signed_dist_plane_cylinder_fn);
+  set_signed_dist_fn(Primitive::ePlane, Primitive::eBox, calc_signed_dist_plane_polyhedron_fn);
+  set_signed_dist_fn(Primitive::ePlane, Primitive::ePolyhedral, calc_signed_dist_plane_polyhedron_fn);
+  set_signed_dist_fn(Primitive::eTorus, Primitive::ePlane, calc_signed_dist_torus_plane_fn);
+  set_signed_dist_fn(Primitive::eBox, Primitive::eBox, calc_signed_dist_polyhedron_polyhedron_fn);
+  set_signed_dist_fn(Primitive::eBox, Primitive::ePolyhedral, calc_signed_dist_polyhedron_polyhedron_fn);
+  set_signed_dist_fn(Primitive::ePolyhedral, Primitive::ePolyhedral, calc_signed_dist_polyhedron_polyhedron_fn);
+}
+
+/// Resizes the dispatch tables to hold n primitive types
+/**
+ * Types added to the tables use the handlers for Primitive::eUnknown.
+ */
+void CCD::resize_dispatch_tables(unsigned n)
+{
+  const unsigned OLD_N = _n_dispatch_types;
+  const unsigned UNKNOWN = Primitive::eUnknown;
+
+  // setup the default entries (the tables are empty on first use)
+  FindContactsEntry fc_default;
+  fc_default.fn = find_contacts_generic_fn;
+  fc_default.swap = false;
+  SignedDistEntry sd_default;
+  sd_default.fn = calc_signed_dist_generic_fn;
+  sd_default.swap = false;
+
+  // copy the existing entries, mapping new types to the unknown type
+  vector<FindContactsEntry> fc(n*n, fc_default);
+  vector<SignedDistEntry> sd(n*n, sd_default);
+  if (OLD_N > 0)
+  {
+    for (unsigned i=0; i< n; i++)
+    {
+      const unsigned OLD_I = (i < OLD_N) ? i : UNKNOWN;
+      for (unsigned j=0; j< n; j++)
+      {
+        const unsigned OLD_J = (j < OLD_N) ? j : UNKNOWN;
+        fc[i*n+j] = _find_contacts_fns[OLD_I*OLD_N+OLD_J];
+        sd[i*n+j] = _signed_dist_fns[OLD_I*OLD_N+OLD_J];
+      }
+    }
+  }
+
+  _find_contacts_fns.swap(fc);
+  _signed_dist_fns.swap(sd);
+  _n_dispatch_types = n;
+}
+
+/// Sets the contact finding function for a pair of types (in both orders)
+void CCD::set_find_contacts_fn(unsigned typeA, unsigned typeB, FindContactsFn fn)
+{
+  const unsigned N = _n_dispatch_types;
+  _find_contacts_fns[typeA*N+typeB].fn = fn;
+  _find_contacts_fns[typeA*N+typeB].swap = false;
+  if (typeA != typeB)
+  {
+    _find_contacts_fns[typeB*N+typeA].fn = fn;
+    _find_contacts_fns[typeB*N+typeA].swap = true;
+  }
+}
+
+/// Sets the signed distance function for a pair of types (in both orders)
+void CCD::set_signed_dist_fn(unsigned typeA, unsigned typeB, SignedDistFn fn)
+{
+  const unsigned N = _n_dispatch_types;
+  _signed_dist_fns[typeA*N+typeB].fn = fn;
+  _signed_dist_fns[typeA*N+typeB].swap = false;
+  if (typeA != typeB)
+  {
+    _signed_dist_fns[typeB*N+typeA].fn = fn;
+    _signed_dist_fns[typeB*N+typeA].swap = true;
+  }
+}
+
+/// Registers a function for finding contacts between two types of primitives
+/**
+ * \param typeA the type of the first primitive (from Primitive::get_type())
+ * \param typeB the type of the second primitive
+ * \param fn the function, which will be called with a geometry of typeA 
+ *        followed by a geometry of typeB (the function is also used for 
+ *        pairs of typeB and typeA)
+ * \note handlers should be registered before collision detection is run;
+ *       registration may resize the tables, which are read without locking
+ */
+void CCD::register_find_contacts_fn(unsigned typeA, unsigned typeB, FindContactsFn fn)
+{
+  init_dispatch_tables();
+  pthread_mutex_lock(&_dispatch_mutex);
+  if (std::max(typeA, typeB) >= _n_dispatch_types)
+    resize_dispatch_tables(std::max(typeA, typeB)+1);
+  set_find_contacts_fn(typeA, typeB, fn);
+  pthread_mutex_unlock(&_dispatch_mutex);
+}
+
+/// Registers a function for computing the signed distance between two types of primitives
+/**
+ * \param typeA the type of the first primitive (from Primitive::get_type())
+ * \param typeB the type of the second primitive
+ * \param fn the function, which will be called with a geometry of typeA 
+ *        followed by a geometry of typeB (the function is also used for 
+ *        pairs of typeB and typeA)
+ * \note handlers should be registered before collision detection is run;
+ *       registration may resize the tables, which are read without locking
+ */
+void CCD::register_signed_dist_fn(unsigned typeA, unsigned typeB, SignedDistFn fn)
+{
+  init_dispatch_tables();
+  pthread_mutex_lock(&_dispatch_mutex);
+  if (std::max(typeA, typeB) >= _n_dispatch_types)
+    resize_dispatch_tables(std::max(typeA, typeB)+1);
+  set_signed_dist_fn(typeA, typeB, fn);
+  pthread_mutex_unlock(&_dispatch_mutex);
+}
+
+/// Determines contact data between two geometries that are touching or interpenetrating (contacts are appended to the vector)
+void CCD::find_contacts(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  // get the handler for the pair of types
+  const unsigned TYPE_A = get_dispatch_type(cgA->get_geometry());
+  const unsigned TYPE_B = get_dispatch_type(cgB->get_geometry());
+  const FindContactsEntry& entry = _find_contacts_fns[TYPE_A*_n_dispatch_types+TYPE_B];
+
+  // call it
+  if (entry.swap)
+    (*entry.fn)(*this, cgB, cgA, contacts, TOL);
+  else
+    (*entry.fn)(*this, cgA, cgB, contacts, TOL);
+}
+
+/// Gets the contact buffer of the calling thread (created on first use)
+/**
+ * The templated find_contacts() swaps the buffer out while it is in use, so
+ * handlers that call find_contacts() recursively get a fresh buffer.
+ */
+vector<UnilateralConstraint>& CCD::get_thread_contacts_buffer()
+{
+  pthread_once(&_contacts_buffer_once, &create_contacts_buffer_key);
+  vector<UnilateralConstraint>* buffer = (vector<UnilateralConstraint>*) pthread_getspecific(_contacts_buffer_key);
+  if (!buffer)
+  {
+    buffer = new vector<UnilateralConstraint>;
+    pthread_setspecific(_contacts_buffer_key, buffer);
+  }
+
+  return *buffer;
+}
+
+/// Finds contacts using the generic contact finder
+void CCD::find_contacts_generic_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_generic(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a plane (cgA) and another geometry
+void CCD::find_contacts_plane_generic_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_plane_generic(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a triangle mesh (cgA) and another geometry
+void CCD::find_contacts_trimesh_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_trimesh_generic(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a heightmap (cgA) and another geometry
+void CCD::find_contacts_heightmap_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  if (cgB->get_geometry()->is_convex())
+    ccd.find_contacts_convex_heightmap(cgB, cgA, std::back_inserter(contacts), TOL);
+  else
+    ccd.find_contacts_heightmap_generic(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between two spheres
+void CCD::find_contacts_sphere_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_sphere_sphere(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a sphere and a plane
+void CCD::find_contacts_sphere_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_sphere_plane(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a sphere and a heightmap
+void CCD::find_contacts_sphere_heightmap_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_sphere_heightmap(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a box and a sphere
+void CCD::find_contacts_box_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_box_sphere(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a cylinder and a plane
+void CCD::find_contacts_cylinder_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_cylinder_plane(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between a torus and a plane
+void CCD::find_contacts_torus_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_torus_plane(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Finds contacts between two polyhedra
+void CCD::find_contacts_polyhedron_polyhedron_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, vector<UnilateralConstraint>& contacts, double TOL)
+{
+  ccd.find_contacts_polyhedron_polyhedron(cgA, cgB, std::back_inserter(contacts), TOL);
+}
+
+/// Computes the signed distance using the primitives' own routines
+double CCD::calc_signed_dist_generic_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  return cgA->get_geometry()->calc_signed_dist(cgB->get_geometry(), pA, pB);
+}
+
+/// Computes the signed distance between two spheres
+double CCD::calc_signed_dist_sphere_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const SpherePrimitive> sA = static_pointer_cast<const SpherePrimitive>(cgA->get_geometry());
+  shared_ptr<const SpherePrimitive> sB = static_pointer_cast<const SpherePrimitive>(cgB->get_geometry());
+  return sA->calc_signed_dist(sB, pA, pB);
+}
+
+/// Computes the signed distance between a box and a sphere
+double CCD::calc_signed_dist_box_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const BoxPrimitive> box = static_pointer_cast<const BoxPrimitive>(cgA->get_geometry());
+  shared_ptr<const SpherePrimitive> sph = static_pointer_cast<const SpherePrimitive>(cgB->get_geometry());
+  return box->calc_signed_dist(sph, pA, pB);
+}
+
+/// Transforms points and splits them into coordinate arrays for the batch distance queries
+void CCD::transform_points(const Transform3d& T, const vector<Point3d>& points, vector<double>& x, vector<double>& y, vector<double>& z)
+{
+  const unsigned X = 0, Y = 1, Z = 2;
+
+  x.resize(points.size());
+  y.resize(points.size());
+  z.resize(points.size());
+  for (unsigned i=0; i< points.size(); i++)
+  {
+    Point3d p = T.transform_point(points[i]);
+    x[i] = p[X];
+    y[i] = p[Y];
+    z[i] = p[Z];
+  }
+}
+
+/// Computes the signed distance between a heightmap and a sphere
+double CCD::calc_signed_dist_heightmap_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const HeightmapPrimitive> hm = static_pointer_cast<const HeightmapPrimitive>(cgA->get_geometry());
+  shared_ptr<const SpherePrimitive> sph = static_pointer_cast<const SpherePrimitive>(cgB->get_geometry());
+  return hm->calc_signed_dist(sph, pA, pB);
+}
+
+/// Computes the signed distance between a plane and a sphere
+double CCD::calc_signed_dist_plane_sphere_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const PlanePrimitive> plane = static_pointer_cast<const PlanePrimitive>(cgA->get_geometry());
+  shared_ptr<const SpherePrimitive> sph = static_pointer_cast<const SpherePrimitive>(cgB->get_geometry());
+  return plane->calc_signed_dist(sph, pA, pB);
+}
+
+/// Computes the signed distance between a plane and a cylinder
+double CCD::calc_signed_dist_plane_cylinder_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const PlanePrimitive> plane = static_pointer_cast<const PlanePrimitive>(cgA->get_geometry());
+  shared_ptr<const CylinderPrimitive> cyl = static_pointer_cast<const CylinderPrimitive>(cgB->get_geometry());
+  return plane->calc_signed_dist(cyl, pA, pB);
+}
+
+/// Computes the signed distance between a plane and a polyhedron
+double CCD::calc_signed_dist_plane_polyhedron_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const PlanePrimitive> plane = static_pointer_cast<const PlanePrimitive>(cgA->get_geometry());
+  shared_ptr<const PolyhedralPrimitive> poly = static_pointer_cast<const PolyhedralPrimitive>(cgB->get_geometry());
+  return plane->calc_signed_dist(poly, pA, pB);
+}
+
+/// Computes the signed distance between a torus and a plane
+double CCD::calc_signed_dist_torus_plane_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const TorusPrimitive> torus = static_pointer_cast<const TorusPrimitive>(cgA->get_geometry());
+  shared_ptr<const PlanePrimitive> plane = static_pointer_cast<const PlanePrimitive>(cgB->get_geometry());
+  return torus->calc_signed_dist(plane, pA, pB);
+}
+
+/// Computes the signed distance between two polyhedra using V-Clip, starting from the last closest features
+double CCD::calc_signed_dist_polyhedron_polyhedron_fn(CCD& ccd, CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  shared_ptr<const PolyhedralPrimitive> polyA = static_pointer_cast<const PolyhedralPrimitive>(cgA->get_geometry());
+  shared_ptr<const PolyhedralPrimitive> polyB = static_pointer_cast<const PolyhedralPrimitive>(cgB->get_geometry());
+
+  // compute the signed distance, starting from the last closest features
+  shared_ptr<const Polyhedron::Feature> closestA, closestB;
+  ccd.get_vclip_features(cgA, cgB, closestA, closestB);
+  double dist = polyA->calc_signed_dist(polyB, pA, pB, closestA, closestB);
+  ccd.set_vclip_features(cgA, cgB, closestA, closestB);
+
+  return dist;
+}
+
+/// Calculates the signed distance between two geometries
+/**
+ * The routine is selected from the signed distance dispatch table using the
+ * types of the two primitives. Pairs of polyhedral geometries are warm 
+ * started from the closest features found by the last V-Clip query on the 
+ * pair.
+ */
+double CCD::calc_signed_dist(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, Point3d& pA, Point3d& pB)
+{
+  // get the two primitives
+  PrimitivePtr primA = cgA->get_geometry();
+  PrimitivePtr primB = cgB->get_geometry();
+
+  // setup poses for the points
+  pA.pose = primA->get_pose(cgA);
+  pB.pose = primB->get_pose(cgB);
+
+  // get the handler for the pair of types
+  const unsigned TYPE_A = get_dispatch_type(primA);
+  const unsigned TYPE_B = get_dispatch_type(primB);
+  const SignedDistEntry& entry = _signed_dist_fns[TYPE_A*_n_dispatch_types+TYPE_B];
+
+  // call it
+  if (entry.swap)
+    return (*entry.fn)(*this, cgB, cgA, pB, pA);
+  else
+    return (*entry.fn)(*this, cgA, cgB, pA, pB);
+}
+
+/// Gets the closest features from the last V-Clip query on two geometries
+/**
+ * Features are null if there was no such query or if the polyhedron of
+ * either geometry has since been rebuilt or replaced (e.g., by 
+ * CollisionGeometry::set_geometry()).
+ */
+void CCD::get_vclip_features(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, shared_ptr<const Polyhedron::Feature>& closestA, shared_ptr<const Polyhedron::Feature>& closestB)
+{
+  const unsigned long ID_A = static_pointer_cast<const PolyhedralPrimitive>(cgA->get_geometry())->get_polyhedron_id();
+  const unsigned long ID_B = static_pointer_cast<const PolyhedralPrimitive>(cgB->get_geometry())->get_polyhedron_id();
+
+  // the cache may be accessed from the parallel narrow phase
+  #ifdef _OPENMP
+  #pragma omp critical (CCD_vclip_features)
+  #endif
+  {
+    map<sorted_pair<CollisionGeometryPtr>, VClipFeatures>::iterator i = _vclip_features.find(make_sorted_pair(cgA, cgB));
+    if (i != _vclip_features.end() && 
+        ((i->first.first == cgA) ? (i->second.first_id != ID_A || i->second.second_id != ID_B) : (i->second.first_id != ID_B || i->second.second_id != ID_A)))
+    {
+      // the features belong to a polyhedron that no longer exists
+      _vclip_features.erase(i);
+      i = _vclip_features.end();
+    }
+    if (i == _vclip_features.end())
+    {
+      closestA.reset();
+      closestB.reset();
+    }
+    else if (i->first.first == cgA)
+    {
+      closestA = i->second.first;
+      closestB = i->second.second;
+    }
+    else
+    {
+      closestA = i->second.second;
+      closestB = i->second.first;
+    }
+  }
+}
+
+/// Records the closest features from a V-Clip query on two geometries
+void CCD::set_vclip_features(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, shared_ptr<const Polyhedron::Feature> closestA, shared_ptr<const Polyhedron::Feature> closestB)
+{
+  const unsigned long ID_A = static_pointer_cast<const PolyhedralPrimitive>(cgA->get_geometry())->get_polyhedron_id();
+  const unsigned long ID_B = static_pointer_cast<const PolyhedralPrimitive>(cgB->get_geometry())->get_polyhedron_id();
+
+  // the cache may be accessed from the parallel narrow phase
+  #ifdef _OPENMP
+  #pragma omp critical (CCD_vclip_features)
+  #endif
+  {
+    sorted_pair<CollisionGeometryPtr> key = make_sorted_pair(cgA, cgB);
+    VClipFeatures& features = _vclip_features[key];
+    if (key.first == cgA)
+    {
+      features.first = closestA;
+      features.second = closestB;
+      features.first_id = ID_A;
+      features.second_id = ID_B;
+    }
+    else
+    {
+      features.first = closestB;
+      features.second = closestA;
+      features.first_id = ID_B;
+      features.second_id = ID_A;
+    }
+  }
 }
 
 // TODO: remove this as integrator is Euler 8/11/15
@@ -148,7 +648,7 @@ double CCD::calc_CA_Euler_step_sphere(const PairwiseDistInfo& pdi)
 
   // if the relative velocity at the point of contact is zero, return infinity
   std::vector<UnilateralConstraint> contacts;
-  find_contacts(pdi.a, pdi.b, std::back_inserter(contacts), NEAR_ZERO);
+  find_contacts(pdi.a, pdi.b, contacts, NEAR_ZERO);
   if ((contacts.size() == 1 && 
       std::fabs(contacts.front().calc_constraint_vel()) < NEAR_ZERO*10))
   {
@@ -586,7 +1086,7 @@ double CCD::calc_max_dist(RigidBodyPtr rb, const Vector3d& n, double rmax)
 {
   const unsigned X = 0, Y = 1, Z = 2;
 
-  if (!rb->is_enabled())
+  if (!rb->is_enabled() || rb->is_sleeping())
     return 0.0;
 
   // if the body is part of an articulated body, do that calculation instead
@@ -680,6 +1180,11 @@ void CCD::load_from_xml(shared_ptr<const XMLTree> node, map<std::string, BasePtr
 
   // call parent
   CollisionDetection::load_from_xml(node, id_map);
+
+  // read whether polyhedron contacts are found using clipping, if specified
+  XMLAttrib* clip_attrib = node->get_attrib("clip-polyhedron-contacts");
+  if (clip_attrib)
+    clip_polyhedron_contacts = clip_attrib->get_bool_value();
 }
 
 /// Implements Base::save_to_xml()
@@ -694,329 +1199,919 @@ void CCD::save_to_xml(XMLTreePtr node, list<shared_ptr<const Base> >& shared_obj
 
   // call the parent method 
   CollisionDetection::save_to_xml(node, shared_objects);
+
+  // save whether polyhedron contacts are found using clipping
+  node->attribs.insert(XMLAttrib("clip-polyhedron-contacts", clip_polyhedron_contacts));
+}
+
+/// Writes the minimum distances observed between pairs of interpenetrating geometries (these affect conservative advancement)
+/**
+ * The closest features cached for V-Clip are not written: they only
+ * determine where V-Clip starts and not its result.
+ */
+void CCD::write_state(StateWriter& out) const
+{
+  out.write_unsigned(_min_dist_observed.size());
+  for (map<sorted_pair<CollisionGeometryPtr>, double>::const_iterator i = _min_dist_observed.begin(); i != _min_dist_observed.end(); i++)
+  {
+    out.write_geometry(i->first.first);
+    out.write_geometry(i->first.second);
+    out.write_double(i->second);
+  }
+}
+
+/// Reads the minimum observed distances written by write_state()
+void CCD::read_state(StateReader& in, bool apply)
+{
+  map<sorted_pair<CollisionGeometryPtr>, double> min_dist_observed;
+  const unsigned N = in.read_unsigned();
+  for (unsigned i=0; i< N && in.ok(); i++)
+  {
+    CollisionGeometryPtr cgA = in.read_geometry();
+    CollisionGeometryPtr cgB = in.read_geometry();
+    const double DIST = in.read_double();
+    if (cgA && cgB)
+      min_dist_observed[make_sorted_pair(cgA, cgB)] = DIST;
+  }
+
+  if (in.ok() && apply)
+    _min_dist_observed.swap(min_dist_observed);
 }
 
 /****************************************************************************
- Methods for broad phase begin
+ Methods for clipping-based polyhedron/polyhedron contact begin
 ****************************************************************************/
-void CCD::broad_phase(double dt, const vector<ControlledBodyPtr>& bodies, vector<pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check)
+
+/// Computes the contact manifold between two convex polyhedra using separating axes and polygon clipping
+/**
+ * The axis of minimum penetration is found among the face normals of both
+ * polyhedra and the cross products of their edges. For a face axis, the most
+ * anti-parallel face on the other polyhedron (the incident face) is clipped 
+ * against the side planes of the reference face and the clipped points within
+ * TOL of the reference face become contact points; for an edge/edge axis, a 
+ * single contact point is placed between the closest points on the edges.
+ * \param normal the contact normal (pointing from B toward A) on return
+ * \param points the contact points (at most four) on return
+ * \param depths the signed distances at the contact points on return
+ * \return false if the polyhedra are separated by more than TOL 
+ */
+bool CCD::calc_polyhedron_manifold(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB, double TOL, Vector3d& normal, vector<Point3d>& points, vector<double>& depths)
 {
-  FILE_LOG(LOG_COLDET) << "CCD::broad_phase() entered" << std::endl;
+  const double INF = std::numeric_limits<double>::max();
+  const double AXIS_TOL = std::sqrt(NEAR_ZERO);
+  vector<pair<Vector3d, double> > hsA, hsB;
+  vector<Point3d> vA, vB;
 
-  // clear the swept BVs
-  _swept_BVs.clear();
+  // clear the manifold
+  points.clear();
+  depths.clear();
 
-  // get the set of rigid bodies
-  vector<RigidBodyPtr> rbs;
-  for (unsigned i=0; i< bodies.size(); i++)
+  // get the two primitives
+  shared_ptr<const PolyhedralPrimitive> pA = dynamic_pointer_cast<const PolyhedralPrimitive>(cgA->get_geometry());
+  shared_ptr<const PolyhedralPrimitive> pB = dynamic_pointer_cast<const PolyhedralPrimitive>(cgB->get_geometry());
+
+  // get the two polyhedra
+  const Polyhedron& polyA = pA->get_polyhedron();
+  const Polyhedron& polyB = pB->get_polyhedron();
+
+  // get the two poses and the transforms to the global frame 
+  shared_ptr<const Pose3d> poseA = pA->get_pose(cgA);
+  shared_ptr<const Pose3d> poseB = pB->get_pose(cgB);
+  Transform3d wTa_tmp, wTb_tmp;
+  const Transform3d& wTa = get_transform(cgA, wTa_tmp);
+  const Transform3d& wTb = get_transform(cgB, wTb_tmp);
+
+  // get the face planes and vertices in the global frame
+  PolyhedralPrimitive::get_halfspaces(polyA, poseA, wTa, std::back_inserter(hsA));
+  PolyhedralPrimitive::get_halfspaces(polyB, poseB, wTb, std::back_inserter(hsB));
+  for (unsigned i=0; i< polyA.get_vertices().size(); i++)
+    vA.push_back(wTa.transform_point(Point3d(polyA.get_vertices()[i]->o, poseA)));
+  for (unsigned i=0; i< polyB.get_vertices().size(); i++)
+    vB.push_back(wTb.transform_point(Point3d(polyB.get_vertices()[i]->o, poseB)));
+
+  // find the face of A with the greatest separation
+  double sepA = -INF, lo, hi;
+  unsigned faceA = 0;
+  for (unsigned i=0; i< hsA.size(); i++)
   {
-    ArticulatedBodyPtr ab = dynamic_pointer_cast<ArticulatedBody>(bodies[i]);
-    if (ab)
+    calc_projection_interval(vB, hsA[i].first, lo, hi);
+    if (lo - hsA[i].second > sepA)
     {
-      BOOST_FOREACH(shared_ptr<RigidBodyd> rb, ab->get_links())
-        rbs.push_back(dynamic_pointer_cast<RigidBody>(rb));
+      sepA = lo - hsA[i].second;
+      faceA = i;
     }
-    else
-      rbs.push_back(dynamic_pointer_cast<RigidBody>(bodies[i]));
   }
+  if (sepA > TOL)
+    return false;
 
-  // look to see whether the bounds vector needs to be rebuilt
-  unsigned count = 0;
-  for (unsigned i=0; i< rbs.size(); i++)
-    count += rbs[i]->geometries.size();
-  if (count != _bounding_spheres.size())
+  // find the face of B with the greatest separation
+  double sepB = -INF;
+  unsigned faceB = 0;
+  for (unsigned i=0; i< hsB.size(); i++)
   {
-    // clear the map of bounding spheres
-    _bounding_spheres.clear();
-
-    // indicate the bounding vectors need to be rebuilt
-    _rebuild_bounds_vecs = true;
-
-    for (unsigned j=0; j< rbs.size(); j++)
-    BOOST_FOREACH(CollisionGeometryPtr i, rbs[j]->geometries)
+    calc_projection_interval(vA, hsB[i].first, lo, hi);
+    if (lo - hsB[i].second > sepB)
     {
-      // get farthest distance on each geometry while we're at it
-      _rmax[i] = i->get_farthest_point_distance();
-
-      // get the primitive for the geometry
-      PrimitivePtr p = i->get_geometry();
-
-      // construct a bounding sphere for the geometry
-      BVPtr bv = construct_bounding_sphere(i);
-
-      // store the bounding sphere
-      _bounding_spheres[i] = bv;
+      sepB = lo - hsB[i].second;
+      faceB = i;
     }
   }
-  else
+  if (sepB > TOL)
+    return false;
+
+  // find the pair of edge directions with the greatest separation; the 
+  // axis is oriented to point from B toward A 
+  const vector<shared_ptr<Polyhedron::Edge> >& edgesA = polyA.get_edges();
+  const vector<shared_ptr<Polyhedron::Edge> >& edgesB = polyB.get_edges();
+  double sepE = -INF, loA, hiA, loB, hiB;
+  Vector3d axisE(GLOBAL), dirEA(GLOBAL), dirEB(GLOBAL);
+  for (unsigned i=0; i< edgesA.size(); i++)
   {
-    // update any bounding spheres that need to be rebuild
-    for (std::map<CollisionGeometryPtr, BVPtr>::iterator i = _bounding_spheres.begin(); i != _bounding_spheres.end(); i++)
+    Vector3d dA = wTa.transform_vector(Vector3d(edgesA[i]->v2->o - edgesA[i]->v1->o, poseA));
+    for (unsigned j=0; j< edgesB.size(); j++)
     {
-      RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(i->first->get_single_body());
-      if (rb->is_enabled())
+      Vector3d dB = wTb.transform_vector(Vector3d(edgesB[j]->v2->o - edgesB[j]->v1->o, poseB));
+
+      // skip (nearly) parallel edges
+      Vector3d axis = Vector3d::cross(dA, dB);
+      double axis_norm = axis.norm();
+      if (axis_norm < NEAR_ZERO * std::max((double) 1.0, dA.norm()*dB.norm()))
+        continue;
+      axis /= axis_norm;
+
+      // compute the separation along the axis
+      calc_projection_interval(vA, axis, loA, hiA);
+      calc_projection_interval(vB, axis, loB, hiB);
+      if (loA - hiB > sepE)
       {
-        BVPtr old_bv = i->second;
-        i->second = construct_bounding_sphere(i->first);
-        for (unsigned j=0; j< _x_bounds.size(); j++)
-        {
-          if (_x_bounds[j].second.bv == old_bv) _x_bounds[j].second.bv = i->second;
-          if (_y_bounds[j].second.bv == old_bv) _y_bounds[j].second.bv = i->second;
-          if (_z_bounds[j].second.bv == old_bv) _z_bounds[j].second.bv = i->second;
-        }
+        sepE = loA - hiB;
+        axisE = axis;
+        dirEA = dA;
+        dirEB = dB;
+      }
+      if (loB - hiA > sepE)
+      {
+        sepE = loB - hiA;
+        axisE = -axis;
+        dirEA = dA;
+        dirEB = dB;
       }
     }
   }
+  if (sepE > TOL)
+    return false;
 
-  // clear the vector of pairs to check
-  to_check.clear();
-
-  // sort the AABBs
-  sort_AABBs(rbs, dt);
-
-  // store how many overlaps we have for pairs
-  map<sorted_pair<CollisionGeometryPtr>, unsigned> overlaps;
-
-  // set of active bounds
-  set<CollisionGeometryPtr> active_bounds;
+  FILE_LOG(LOG_COLDET) << "CCD::calc_polyhedron_manifold() - face A separation: " << sepA << " face B separation: " << sepB << " edge separation: " << sepE << std::endl;
 
-  // scan through the x-bounds
-  for (unsigned i=0; i< _x_bounds.size(); i++)
+  // prefer face axes to edge axes (and faces of A to faces of B) unless the
+  // separation is significantly larger
+  bool refA = (sepA + AXIS_TOL >= sepB);
+  double sepF = (refA) ? sepA : sepB;
+  if (sepE > sepF + AXIS_TOL)
   {
-    // eliminate from the active bounds if at the end of a bound
-    if (_x_bounds[i].second.end)
+    // find the edges of A and B (parallel to the axis edges) that support
+    // the axis
+    double maxA = -INF, maxB = -INF;
+    Point3d a1, a2, b1, b2;
+    for (unsigned i=0; i< edgesA.size(); i++)
     {
-      assert(active_bounds.find(_x_bounds[i].second.geom) != active_bounds.end());
-      active_bounds.erase(_x_bounds[i].second.geom);
+      Point3d v1 = wTa.transform_point(Point3d(edgesA[i]->v1->o, poseA));
+      Point3d v2 = wTa.transform_point(Point3d(edgesA[i]->v2->o, poseA));
+      if (Vector3d::cross(v2 - v1, dirEA).norm() > NEAR_ZERO * std::max((double) 1.0, dirEA.norm_sq()))
+        continue;
+      double support = -axisE.dot(v1) - axisE.dot(v2);
+      if (support > maxA)
+      {
+        maxA = support;
+        a1 = v1;
+        a2 = v2;
+      }
     }
-    else
+    for (unsigned i=0; i< edgesB.size(); i++)
     {
-      // at the start of a bound
-      BOOST_FOREACH(CollisionGeometryPtr cg, active_bounds)
-        overlaps[make_sorted_pair(cg, _x_bounds[i].second.geom)]++;
-
-      // add the geometry to the active set
-      active_bounds.insert(_x_bounds[i].second.geom);
+      Point3d v1 = wTb.transform_point(Point3d(edgesB[i]->v1->o, poseB));
+      Point3d v2 = wTb.transform_point(Point3d(edgesB[i]->v2->o, poseB));
+      if (Vector3d::cross(v2 - v1, dirEB).norm() > NEAR_ZERO * std::max((double) 1.0, dirEB.norm_sq()))
+        continue;
+      double support = axisE.dot(v1) + axisE.dot(v2);
+      if (support > maxB)
+      {
+        maxB = support;
+        b1 = v1;
+        b2 = v2;
+      }
     }
+
+    // place the contact point between the closest points on the edges
+    Point3d cpA, cpB;
+    CompGeom::calc_closest_points(LineSeg3(a1, a2), LineSeg3(b1, b2), cpA, cpB);
+    normal = axisE;
+    points.push_back((cpA + cpB)*0.5);
+    depths.push_back(sepE);
+    FILE_LOG(LOG_COLDET) << " -- edge/edge contact at " << points.back() << " with normal " << normal << std::endl;
+    return true;
   }
 
-  // scan through the y-bounds
-  for (unsigned i=0; i< _y_bounds.size(); i++)
+  // setup the reference and incident polyhedra 
+  const Polyhedron& polyR = (refA) ? polyA : polyB;
+  const Polyhedron& polyI = (refA) ? polyB : polyA;
+  const vector<pair<Vector3d, double> >& hsR = (refA) ? hsA : hsB;
+  const vector<pair<Vector3d, double> >& hsI = (refA) ? hsB : hsA;
+  shared_ptr<const Pose3d> poseR = (refA) ? poseA : poseB;
+  shared_ptr<const Pose3d> poseI = (refA) ? poseB : poseA;
+  const Transform3d& wTr = (refA) ? wTa : wTb;
+  const Transform3d& wTi = (refA) ? wTb : wTa;
+  const unsigned faceR = (refA) ? faceA : faceB;
+  const Vector3d& nR = hsR[faceR].first;
+  const double dR = hsR[faceR].second;
+
+  // the incident face is the face most anti-parallel to the reference face 
+  unsigned faceI = 0;
+  double min_dot = INF;
+  for (unsigned i=0; i< hsI.size(); i++)
   {
-    // eliminate from the active bounds if at the end of a bound
-    if (_y_bounds[i].second.end)
+    double dot = nR.dot(hsI[i].first);
+    if (dot < min_dot)
     {
-      assert(active_bounds.find(_y_bounds[i].second.geom) != active_bounds.end());
-      active_bounds.erase(_y_bounds[i].second.geom);
+      min_dot = dot;
+      faceI = i;
     }
-    else
+  }
+
+  // get the vertices of the reference and incident faces 
+  vector<Point3d> vR, vI, clipped;
+  get_face_vertices(polyR.get_faces()[faceR], poseR, wTr, vR);
+  get_face_vertices(polyI.get_faces()[faceI], poseI, wTi, vI);
+
+  // compute the centroid of the reference face
+  Point3d centroid(0.0, 0.0, 0.0, GLOBAL);
+  for (unsigned i=0; i< vR.size(); i++)
+    centroid += vR[i];
+  centroid /= vR.size();
+
+  // clip the incident face against the side planes of the reference face
+  for (unsigned i=0, j=vR.size()-1; i< vR.size() && !vI.empty(); j=i++)
+  {
+    // get the side plane, making it point away from the face interior 
+    Vector3d side = Vector3d::cross(vR[i] - vR[j], nR);
+    double side_norm = side.norm();
+    if (side_norm < NEAR_ZERO)
+      continue;
+    side /= side_norm;
+    double d = side.dot(vR[j]);
+    if (side.dot(centroid) > d)
     {
-      // at the start of a bound
-      BOOST_FOREACH(CollisionGeometryPtr cg, active_bounds)
-        overlaps[make_sorted_pair(cg, _y_bounds[i].second.geom)]++;
+      side = -side;
+      d = -d;
+    }
 
-      // add the geometry to the active set
-      active_bounds.insert(_y_bounds[i].second.geom);
+    // clip
+    clip_polygon(vI, side, d, clipped);
+    vI.swap(clipped);
+  }
+
+  // keep clipped points within the tolerance of the reference face; contact
+  // points are placed midway between the two surfaces
+  for (unsigned i=0; i< vI.size(); i++)
+  {
+    double depth = nR.dot(vI[i]) - dR;
+    if (depth > TOL)
+      continue;
+    points.push_back(vI[i] - nR*(depth*0.5));
+    depths.push_back(depth);
+  }
+
+  // reference normals point outward, so flip it if the reference face is A's 
+  normal = (refA) ? -nR : nR;
+
+  // keep no more than four points
+  reduce_manifold(points, depths, normal);
+  FILE_LOG(LOG_COLDET) << " -- " << points.size() << " face contacts with normal " << normal << std::endl;
+
+  return !points.empty();
+}
+
+/// Gets the vertices of a face of a polyhedron, transformed to the global frame
+void CCD::get_face_vertices(shared_ptr<Polyhedron::Face> f, shared_ptr<const Pose3d> pose, const Transform3d& wTpose, vector<Point3d>& verts)
+{
+  verts.clear();
+  Polyhedron::VertexFaceIterator vfi(f, true);
+  while (true)
+  {
+    verts.push_back(wTpose.transform_point(Point3d((*vfi)->o, pose)));
+    if (!vfi.has_next())
+      break;
+    vfi.advance();
+  }
+}
+
+/// Computes the interval spanned by a set of points projected onto an axis
+void CCD::calc_projection_interval(const vector<Point3d>& verts, const Vector3d& n, double& lo, double& hi)
+{
+  lo = std::numeric_limits<double>::max();
+  hi = -std::numeric_limits<double>::max();
+  for (unsigned i=0; i< verts.size(); i++)
+  {
+    double proj = n.dot(verts[i]);
+    lo = std::min(lo, proj);
+    hi = std::max(hi, proj);
+  }
+}
+
+/// Clips a polygon against the half-space n'x <= d (Sutherland-Hodgman) 
+void CCD::clip_polygon(const vector<Point3d>& poly, const Vector3d& n, double d, vector<Point3d>& clipped)
+{
+  clipped.clear();
+  if (poly.empty())
+    return;
+
+  for (unsigned i=0, j=poly.size()-1; i< poly.size(); j=i++)
+  {
+    // get the signed distances of the edge endpoints
+    const Point3d& p = poly[j];
+    const Point3d& q = poly[i];
+    double dp = n.dot(p) - d;
+    double dq = n.dot(q) - d;
+
+    // add the intersection point if the edge strictly crosses the plane
+    if ((dp < 0.0 && dq > 0.0) || (dp > 0.0 && dq < 0.0))
+      clipped.push_back(p + (q - p)*(dp/(dp - dq)));
+
+    // keep the endpoint if it is inside
+    if (dq <= 0.0)
+      clipped.push_back(q);
+  }
+}
+
+/// Reduces a contact manifold to at most four points
+/**
+ * Keeps the deepest point, the point farthest from it, and the points on 
+ * either side of the line between those two that maximize the area of the
+ * resulting quadrilateral.
+ */
+void CCD::reduce_manifold(vector<Point3d>& points, vector<double>& depths, const Vector3d& normal)
+{
+  const unsigned MAX_POINTS = 4;
+  if (points.size() <= MAX_POINTS)
+    return;
+
+  // first point is the deepest 
+  unsigned idx[MAX_POINTS];
+  idx[0] = std::min_element(depths.begin(), depths.end()) - depths.begin();
+
+  // second point is farthest from the first
+  double max_dist = -1.0;
+  idx[1] = idx[0];
+  for (unsigned i=0; i< points.size(); i++)
+  {
+    double dist = (points[i] - points[idx[0]]).norm_sq();
+    if (dist > max_dist)
+    {
+      max_dist = dist;
+      idx[1] = i;
     }
   }
 
-  // scan through the z-bounds
-  for (unsigned i=0; i< _z_bounds.size(); i++)
+  // third and fourth points maximize the (signed) area of the triangles 
+  // formed with the first two
+  Vector3d e = points[idx[1]] - points[idx[0]];
+  double max_area = -std::numeric_limits<double>::max();
+  double min_area = std::numeric_limits<double>::max();
+  idx[2] = idx[3] = idx[0];
+  for (unsigned i=0; i< points.size(); i++)
   {
-    // eliminate from the active bounds if at the end of a bound
-    if (_z_bounds[i].second.end)
+    double area = normal.dot(Vector3d::cross(e, points[i] - points[idx[0]]));
+    if (area > max_area)
     {
-      assert(active_bounds.find(_z_bounds[i].second.geom) != active_bounds.end());
-      active_bounds.erase(_z_bounds[i].second.geom);
+      max_area = area;
+      idx[2] = i;
     }
-    else
+    if (area < min_area)
     {
-      // at the start of a bound
-      BOOST_FOREACH(CollisionGeometryPtr cg, active_bounds)
-        overlaps[make_sorted_pair(cg, _z_bounds[i].second.geom)]++;
-
-      // add the geometry to the active set
-      active_bounds.insert(_z_bounds[i].second.geom);
+      min_area = area;
+      idx[3] = i;
     }
   }
 
-  // now setup pairs to check
-  for (map<sorted_pair<CollisionGeometryPtr>, unsigned>::const_iterator i = overlaps.begin(); i != overlaps.end(); i++)
+  // setup the reduced manifold, skipping duplicate indices
+  vector<Point3d> rpoints;
+  vector<double> rdepths;
+  for (unsigned i=0; i< MAX_POINTS; i++)
   {
-    FILE_LOG(LOG_COLDET) << i->second << " overlaps between " << i->first.first << " (" << i->first.first->get_single_body()->body_id << ") and " << i->first.second << " (" << i->first.second->get_single_body()->body_id << ")" << std::endl;
-
-    // only consider the pair if they overlap in all three dimensions
-    if (i->second < 3)
+    if (std::find(idx, idx+i, idx[i]) != idx+i)
       continue;
+    rpoints.push_back(points[idx[i]]);
+    rdepths.push_back(depths[idx[i]]);
+  }
+  points.swap(rpoints);
+  depths.swap(rdepths);
+}
 
-    // if the pair is disabled, continue looping
-    if (this->disabled_pairs.find(i->first) != this->disabled_pairs.end())
-      continue;
+/****************************************************************************
+ Methods for broad phase begin
+****************************************************************************/
+void CCD::broad_phase(double dt, const vector<ControlledBodyPtr>& bodies, vector<pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check)
+{
+  FILE_LOG(LOG_COLDET) << "CCD::broad_phase() entered" << std::endl;
 
-    // get the rigid bodies corresponding to the geometries
-    RigidBodyPtr rb1 = dynamic_pointer_cast<RigidBody>(i->first.first->get_single_body());
-    RigidBodyPtr rb2 = dynamic_pointer_cast<RigidBody>(i->first.second->get_single_body());
+  // get the set of rigid bodies
+  vector<RigidBodyPtr> rbs;
+  for (unsigned i=0; i< bodies.size(); i++)
+  {
+    ArticulatedBodyPtr ab = dynamic_pointer_cast<ArticulatedBody>(bodies[i]);
+    if (ab)
+    {
+      BOOST_FOREACH(shared_ptr<RigidBodyd> rb, ab->get_links())
+        rbs.push_back(dynamic_pointer_cast<RigidBody>(rb));
+    }
+    else
+      rbs.push_back(dynamic_pointer_cast<RigidBody>(bodies[i]));
+  }
 
-    // don't check pairs from the same rigid body
-    if (rb1 == rb2)
-      continue;
+  // see whether geometries were added or removed or whether bodies were
+  // enabled or disabled 
+  bool geoms_changed = update_geometries(rbs);
+  if (update_static_geometries(geoms_changed))
+  {
+    // compute all bounds from scratch and do standard sorts of the endpoints
+    update_bounds(dt, true);
+    std::sort(_endpoints[eXAxis].begin(), _endpoints[eXAxis].end());
+    std::sort(_endpoints[eYAxis].begin(), _endpoints[eYAxis].end());
+    std::sort(_endpoints[eZAxis].begin(), _endpoints[eZAxis].end());
 
-    // if both rigid bodies are disabled, don't check
-    if (!rb1->is_enabled() && !rb2->is_enabled())
-      continue;
+    // determine the overlapping dynamic pairs using a full sweep
+    build_overlapping_pairs();
 
-    // if we're here, we have a candidate for the narrow phase
-    to_check.push_back(make_pair(i->first.first, i->first.second));
-    FILE_LOG(LOG_COLDET) << "  ... checking pair" << std::endl;
+    // build the tree over the static geometries
+    build_static_tree();
   }
+  else
+  {
+    // update the bounds; endpoints are nearly sorted, so do insertion sorts,
+    // which update the set of overlapping pairs as endpoints swap 
+    if (update_bounds(dt, false))
+      refit_static_tree();
+    sort_endpoints(eXAxis);
+    sort_endpoints(eYAxis);
+    sort_endpoints(eZAxis);
+  }
+
+  // query the static tree with the bounds of the dynamic geometries
+  find_static_pairs();
+  FILE_LOG(LOG_COLDET) << "  " << _overlapping_pairs.size() << " dynamic/dynamic and " << _static_pairs.size() << " dynamic/static overlaps" << std::endl;
+
+  // clear the vector of pairs to check
+  to_check.clear();
+
+  // now setup pairs to check
+  for (set<pair<unsigned, unsigned> >::const_iterator i = _overlapping_pairs.begin(); i != _overlapping_pairs.end(); i++)
+    add_pair_to_check(*i, to_check);
+  for (unsigned i=0; i< _static_pairs.size(); i++)
+    add_pair_to_check(_static_pairs[i], to_check);
 
   FILE_LOG(LOG_COLDET) << "CCD::broad_phase() exited" << std::endl;
 }
 
-/// Gets the swept BV, creating it if necessary
-BVPtr CCD::get_swept_BV(CollisionGeometryPtr cg, BVPtr bv, double dt)
+/// Adds a pair of geometries with overlapping bounds to the pairs to be checked by the narrow phase, if the pair is not filtered
+void CCD::add_pair_to_check(const pair<unsigned, unsigned>& ids, vector<pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check) const
 {
-  const unsigned X = 0, Y = 1, Z = 2;
-
-  // verify that the map for the geometry has already been setup
-  map<CollisionGeometryPtr, BVPtr>::iterator vi;
-  vi = _swept_BVs.find(cg);
-  if (vi != _swept_BVs.end())
-    return vi->second;
+  // get the geometries
+  CollisionGeometryPtr cg1 = _geoms[ids.first];
+  CollisionGeometryPtr cg2 = _geoms[ids.second];
+  FILE_LOG(LOG_COLDET) << "overlap between " << cg1 << " (" << cg1->get_single_body()->body_id << ") and " << cg2 << " (" << cg2->get_single_body()->body_id << ")" << std::endl;
+
+  // get the rigid bodies corresponding to the geometries
+  RigidBodyPtr rb1 = _geom_bodies[ids.first];
+  RigidBodyPtr rb2 = _geom_bodies[ids.second];
+
+  // don't check pairs from the same rigid body
+  if (rb1 == rb2)
+    return;
+
+  // if neither rigid body moves (both are disabled or asleep), don't check;
+  // sleeping bodies remain in the sweep-and-prune structure, so that putting
+  // them to sleep and waking them does not rebuild the broad phase
+  if ((!rb1->is_enabled() || rb1->is_sleeping()) && 
+      (!rb2->is_enabled() || rb2->is_sleeping()))
+    return;
+
+  // if the pair is disabled, don't check 
+  if (!this->disabled_pairs.empty() && this->disabled_pairs.find(make_sorted_pair(cg1, cg2)) != this->disabled_pairs.end())
+    return;
+
+  // if we're here, we have a candidate for the narrow phase
+  to_check.push_back(make_pair(cg1, cg2));
+  FILE_LOG(LOG_COLDET) << "  ... checking pair" << std::endl;
+}
 
-  // get the rigid body
-  RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(cg->get_single_body());
+/// Updates the geometries processed by the broad phase
+/**
+ * \return <b>true</b> if geometries were added or removed (and the broad
+ *         phase data structures must be rebuilt)
+ */
+bool CCD::update_geometries(const vector<RigidBodyPtr>& rigid_bodies)
+{
+  // see whether the geometries are unchanged since the last call
+  unsigned count = 0;
+  bool changed = false;
+  for (unsigned j=0; j< rigid_bodies.size() && !changed; j++)
+    BOOST_FOREACH(CollisionGeometryPtr i, rigid_bodies[j]->geometries)
+    {
+      if (count >= _geoms.size() || _geoms[count] != i)
+      {
+        changed = true;
+        break;
+      }
+      count++;
+    }
+  if (!changed && count == _geoms.size())
+    return false;
+
+  // features and simplices cached for the old geometries may no longer be 
+  // valid
+  _vclip_features.clear();
+  GJK::clear_cache();
+
+  // rebuild the vectors of geometries; the farthest point distances are
+  // recomputed, so that removed geometries are not kept alive
+  _geoms.clear();
+  _geom_bodies.clear();
+  _rmax.clear();
+  for (unsigned j=0; j< rigid_bodies.size(); j++)
+    BOOST_FOREACH(CollisionGeometryPtr i, rigid_bodies[j]->geometries)
+    {
+      _geoms.push_back(i);
+      _geom_bodies.push_back(rigid_bodies[j]);
 
-  // get the current velocity and the velocity limits
-  const SVelocityd& v = rb->get_velocity();
+      // get farthest distance on each geometry while we're at it
+      _rmax[i] = i->get_farthest_point_distance();
+    }
 
-  // compute the swept BV
-  BVPtr swept_bv = bv->calc_swept_BV(cg, v*dt);
-  FILE_LOG(LOG_BV) << "new BV: " << swept_bv << std::endl;
+  // remove the minimum observed distances of pairs with removed geometries
+  // (distances of the remaining pairs are part of the simulation state)
+  for (map<sorted_pair<CollisionGeometryPtr>, double>::iterator i = _min_dist_observed.begin(); i != _min_dist_observed.end(); )
+  {
+    if (_rmax.find(i->first.first) == _rmax.end() || _rmax.find(i->first.second) == _rmax.end())
+      _min_dist_observed.erase(i++);
+    else
+      i++;
+  }
 
-  // store the bounding volume
-  _swept_BVs[cg] = swept_bv;
+  // resize the bounding sphere and bounds vectors
+  const unsigned N = _geoms.size();
+  _bounding_spheres.resize(N);
+  _bounds_transforms.resize(N);
+  for (unsigned i=0; i< 3; i++)
+  {
+    _lo[i].resize(N);
+    _hi[i].resize(N);
+  }
 
-  return swept_bv;
+  return true;
 }
 
-void CCD::sort_AABBs(const vector<RigidBodyPtr>& rigid_bodies, double dt)
+/// Partitions the geometries into static geometries (those of disabled bodies) and dynamic geometries
+/**
+ * Only dynamic geometries are placed in the sweep-and-prune structure; 
+ * static geometries are placed in an AABB tree (see build_static_tree()) 
+ * that is queried by the dynamic geometries, so overlaps between static
+ * geometries are never generated.
+ * \param force if <b>true</b>, the partition is rebuilt even if no body has
+ *        been enabled or disabled
+ * \return <b>true</b> if the partition was rebuilt (and the broad phase data
+ *         structures must be rebuilt)
+ */
+bool CCD::update_static_geometries(bool force)
 {
-  // rebuild the vector of bounds
-  if (_rebuild_bounds_vecs)
+  const unsigned N = _geoms.size();
+
+  // see whether any body has been enabled or disabled
+  bool changed = force || _geom_static.size() != N;
+  for (unsigned i=0; i< N && !changed; i++)
+    if (_geom_static[i] == _geom_bodies[i]->is_enabled())
+      changed = true;
+  if (!changed)
+    return false;
+
+  // partition the geometries
+  _geom_static.resize(N);
+  for (unsigned i=0; i< N; i++)
+    _geom_static[i] = !_geom_bodies[i]->is_enabled();
+
+  // setup the endpoints for the dynamic geometries
+  for (unsigned i=0; i< 3; i++)
   {
-    build_bv_vector(rigid_bodies, _x_bounds);
-    _y_bounds = _x_bounds;
-    _z_bounds = _x_bounds;
+    _endpoints[i].clear();
+    for (unsigned j=0; j< N; j++)
+    {
+      if (_geom_static[j])
+        continue;
+
+      SAPEndpoint e;
+      e.geom_id = j;
+      e.end = false;
+      _endpoints[i].push_back(e);
+      e.end = true;
+      _endpoints[i].push_back(e);
+    }
   }
 
-  // update bounds vectors
-  update_bounds_vector(_x_bounds, eXAxis, dt, true);
-  update_bounds_vector(_y_bounds, eYAxis, dt, false);
-  update_bounds_vector(_z_bounds, eZAxis, dt, false);
+  return true;
+}
+
+/// Builds the AABB tree over the (swept) bounds of the static geometries
+void CCD::build_static_tree()
+{
+  // get the static geometries
+  vector<unsigned> ids;
+  for (unsigned i=0; i< _geoms.size(); i++)
+    if (_geom_static[i])
+      ids.push_back(i);
+
+  // build the tree 
+  _static_tree.clear();
+  if (!ids.empty())
+    build_static_tree(ids, 0, ids.size());
+
+  FILE_LOG(LOG_COLDET) << " -- built static AABB tree over " << ids.size() << " geometries (" << _static_tree.size() << " nodes)" << std::endl;
+}
 
-  // if geometry was added or removed, do standard sorts of vectors
-  if (_rebuild_bounds_vecs)
+/// Builds the subtree of the static AABB tree over ids[begin..end-1] 
+/**
+ * Nodes are stored in depth-first order, so the left child of a node
+ * immediately follows it.
+ * \return the index of the root of the subtree
+ */
+unsigned CCD::build_static_tree(vector<unsigned>& ids, unsigned begin, unsigned end)
+{
+  const double INF = std::numeric_limits<double>::max();
+
+  // add the node
+  const unsigned idx = _static_tree.size();
+  _static_tree.push_back(StaticAABBNode());
+
+  // compute the bounds of the node
+  StaticAABBNode node;
+  for (unsigned i=0; i< 3; i++)
   {
-    std::sort(_x_bounds.begin(), _x_bounds.end());
-    std::sort(_y_bounds.begin(), _y_bounds.end());
-    std::sort(_z_bounds.begin(), _z_bounds.end());
+    node.lo[i] = INF;
+    node.hi[i] = -INF;
+    for (unsigned j=begin; j< end; j++)
+    {
+      node.lo[i] = std::min(node.lo[i], _lo[i][ids[j]]);
+      node.hi[i] = std::max(node.hi[i], _hi[i][ids[j]]);
+    }
+  }
 
-    // now indicate that bounds vectors have been (re)built
-    _rebuild_bounds_vecs = false;
+  // see whether this is a leaf
+  if (end - begin == 1)
+  {
+    node.geom_id = ids[begin];
+    node.right = 0;
+    _static_tree[idx] = node;
+    return idx;
   }
-  else
+
+  // split at the median center along the longest axis
+  unsigned axis = eXAxis;
+  for (unsigned i=eYAxis; i<= eZAxis; i++)
+    if (node.hi[i] - node.lo[i] > node.hi[axis] - node.lo[axis])
+      axis = i;
+  const unsigned mid = (begin + end)/2;
+  std::nth_element(ids.begin()+begin, ids.begin()+mid, ids.begin()+end, CenterLess(_lo[axis], _hi[axis]));
+
+  // build the children
+  build_static_tree(ids, begin, mid);
+  node.geom_id = 0;
+  node.right = build_static_tree(ids, mid, end);
+  _static_tree[idx] = node;
+  return idx;
+}
+
+/// Refits the static AABB tree to the current bounds of the static geometries
+/**
+ * The topology of the tree is retained, so refitting is cheaper than 
+ * rebuilding the tree, but the tree may become less efficient if static
+ * geometries are moved far.
+ */
+void CCD::refit_static_tree()
+{
+  // children follow their parents, so process the nodes in reverse order
+  for (unsigned n = _static_tree.size(); n-- > 0; )
+  {
+    StaticAABBNode& node = _static_tree[n];
+    for (unsigned i=0; i< 3; i++)
+    {
+      if (node.right == 0)
+      {
+        node.lo[i] = _lo[i][node.geom_id];
+        node.hi[i] = _hi[i][node.geom_id];
+      }
+      else
+      {
+        node.lo[i] = std::min(_static_tree[n+1].lo[i], _static_tree[node.right].lo[i]);
+        node.hi[i] = std::max(_static_tree[n+1].hi[i], _static_tree[node.right].hi[i]);
+      }
+    }
+  }
+
+  FILE_LOG(LOG_COLDET) << " -- refit static AABB tree (" << _static_tree.size() << " nodes)" << std::endl;
+}
+
+/// Finds all pairs of dynamic and static geometries whose swept AABBs overlap
+void CCD::find_static_pairs()
+{
+  vector<unsigned> stack;
+
+  // clear the pairs
+  _static_pairs.clear();
+  if (_static_tree.empty())
+    return;
+
+  // query the tree with each dynamic geometry
+  for (unsigned i=0; i< _geoms.size(); i++)
   {
-    // bounds are nearly sorted; do insertion sort
-    insertion_sort(_x_bounds.begin(), _x_bounds.end());
-    insertion_sort(_y_bounds.begin(), _y_bounds.end());
-    insertion_sort(_z_bounds.begin(), _z_bounds.end());
+    if (_geom_static[i])
+      continue;
+
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+      const unsigned n = stack.back();
+      stack.pop_back();
+      const StaticAABBNode& node = _static_tree[n];
+
+      // check for overlap
+      if (_lo[eXAxis][i] > node.hi[eXAxis] || node.lo[eXAxis] > _hi[eXAxis][i] ||
+          _lo[eYAxis][i] > node.hi[eYAxis] || node.lo[eYAxis] > _hi[eYAxis][i] ||
+          _lo[eZAxis][i] > node.hi[eZAxis] || node.lo[eZAxis] > _hi[eZAxis][i])
+        continue;
+
+      // add the pair if this is a leaf; otherwise, descend 
+      if (node.right == 0)
+        _static_pairs.push_back(make_id_pair(i, node.geom_id));
+      else
+      {
+        stack.push_back(node.right);
+        stack.push_back(n+1);
+      }
+    }
   }
 }
 
-void CCD::update_bounds_vector(vector<pair<double, BoundsStruct> >& bounds, AxisType axis, double dt, bool recreate_bvs)
+/// Updates the swept AABB bounds of all geometries and their endpoints 
+/**
+ * \param rebuild if <b>true</b>, bounds for geometries of disabled and 
+ *        sleeping bodies are computed unconditionally
+ * \note geometries of disabled and sleeping bodies are not integrated, so 
+ *       their bounds are recomputed only when their global transforms have 
+ *       changed (e.g., when a disabled body is posed kinematically)
+ * \return <b>true</b> if the bounds of a static geometry changed (and the 
+ *         static AABB tree must be refit)
+ */
+bool CCD::update_bounds(double dt, bool rebuild)
 {
   const unsigned X = 0, Y = 1, Z = 2;
+  Transform3d wTg;
+  bool static_moved = false;
 
-  FILE_LOG(LOG_COLDET) << " -- update_bounds_vector() entered (axis=" << axis << ")" << std::endl;
+  FILE_LOG(LOG_COLDET) << " -- update_bounds() entered" << std::endl;
 
-  // iterate over bounds vector
-  for (unsigned i=0; i< bounds.size(); i++)
+  // iterate over all geometries
+  for (unsigned i=0; i< _geoms.size(); i++)
   {
-    // get the bounding volume and collision geometry
-    BVPtr bv = bounds[i].second.bv;
-    CollisionGeometryPtr geom = bounds[i].second.geom;
+    // geometries of disabled and sleeping bodies move only if posed 
+    // explicitly; detect that from their transforms
+    if (!_geom_bodies[i]->is_enabled() || _geom_bodies[i]->is_sleeping())
+    {
+      const Transform3d& T = get_transform(_geoms[i], wTg);
+      if (!rebuild)
+      {
+        if (same_transform(T, _bounds_transforms[i]))
+          continue;
+        FILE_LOG(LOG_COLDET) << "  geometry " << _geoms[i] << " of resting body " << _geom_bodies[i]->body_id << " has moved" << std::endl;
+        if (_geom_static[i])
+          static_moved = true;
+      }
+      _bounds_transforms[i] = T;
+    }
 
-    // recreate the BV if necessary
-    if (recreate_bvs)
-      _swept_BVs.erase(geom);
+    // (re)construct the bounding sphere 
+    _bounding_spheres[i] = construct_bounding_sphere(_geoms[i]);
 
     // get the swept bounding volume (should be defined in global frame)
-    BVPtr swept_bv = get_swept_BV(geom, bv, dt);
+    BVPtr swept_bv = get_swept_BV(_geoms[i], _bounding_spheres[i], dt);
     assert(swept_bv->get_relative_pose() == GLOBAL);
 
-    // get the bound for the bounding volume
-    Point3d bound = (bounds[i].second.end) ? swept_bv->get_upper_bounds() : swept_bv->get_lower_bounds();
-    FILE_LOG(LOG_COLDET) << "  updating collision geometry: " << geom << "  rigid body: " << geom->get_single_body()->body_id << std::endl;
+    // store the bounds
+    Point3d lo = swept_bv->get_lower_bounds();
+    Point3d hi = swept_bv->get_upper_bounds();
+    _lo[eXAxis][i] = lo[X];  _hi[eXAxis][i] = hi[X];
+    _lo[eYAxis][i] = lo[Y];  _hi[eYAxis][i] = hi[Y];
+    _lo[eZAxis][i] = lo[Z];  _hi[eZAxis][i] = hi[Z];
+    FILE_LOG(LOG_COLDET) << "  updated collision geometry: " << _geoms[i] << "  rigid body: " << _geom_bodies[i]->body_id << " lower bounds: " << lo << " upper bounds: " << hi << std::endl;
+  }
+
+  // update the endpoints 
+  for (unsigned i=0; i< 3; i++)
+  {
+    vector<SAPEndpoint>& ep = _endpoints[i];
+    for (unsigned j=0; j< ep.size(); j++)
+      ep[j].value = (ep[j].end) ? _hi[i][ep[j].geom_id] : _lo[i][ep[j].geom_id];
+  }
 
-    // update the bounds for the given axis
-    switch (axis)
-    {
-      case eXAxis:
-        bounds[i].first = bound[X];
-        break;
+  FILE_LOG(LOG_COLDET) << " -- update_bounds() exited" << std::endl;
 
-      case eYAxis:
-        bounds[i].first = bound[Y];
-        break;
+  return static_moved;
+}
 
-      case eZAxis:
-        bounds[i].first = bound[Z];
-        break;
+/// Determines all overlapping pairs from scratch by sweeping the (sorted) x-axis endpoints
+void CCD::build_overlapping_pairs()
+{
+  // clear the set of overlapping pairs
+  _overlapping_pairs.clear();
 
-      default:
-        assert(false);
+  // the active geometries
+  vector<unsigned> active;
+
+  // scan through the x-axis endpoints
+  const vector<SAPEndpoint>& ep = _endpoints[eXAxis];
+  for (unsigned i=0; i< ep.size(); i++)
+  {
+    const unsigned id = ep[i].geom_id;
+
+    // eliminate from the active bounds if at the end of a bound
+    if (ep[i].end)
+    {
+      vector<unsigned>::iterator j = std::find(active.begin(), active.end(), id);
+      assert(j != active.end());
+      *j = active.back();
+      active.pop_back();
     }
+    else
+    {
+      // at the start of a bound; check the other two axes
+      for (unsigned j=0; j< active.size(); j++)
+        if (overlaps(id, active[j], eYAxis) && overlaps(id, active[j], eZAxis))
+          _overlapping_pairs.insert(make_id_pair(id, active[j]));
 
-    if (bounds[i].second.end)
-      FILE_LOG(LOG_COLDET) << "    upper bound: " << bounds[i].first << std::endl;
-    if (!bounds[i].second.end)
-      FILE_LOG(LOG_COLDET) << "    lower bound: " << bounds[i].first << std::endl;
+      // add the geometry to the active set
+      active.push_back(id);
+    }
   }
-
-  FILE_LOG(LOG_COLDET) << " -- update_bounds_vector() exited" << std::endl;
 }
 
-void CCD::build_bv_vector(const vector<RigidBodyPtr>& rigid_bodies, vector<pair<double, BoundsStruct> >& bounds)
+/// Sorts the (nearly sorted) endpoints along an axis using insertion sort, updating the set of overlapping pairs as endpoints swap
+void CCD::sort_endpoints(AxisType axis)
 {
-  const double INF = std::numeric_limits<double>::max();
+  vector<SAPEndpoint>& ep = _endpoints[axis];
 
-  // clear the vector
-  bounds.clear();
+  for (unsigned i=1; i< ep.size(); i++)
+  {
+    // get the endpoint to be inserted
+    const SAPEndpoint e = ep[i];
 
-  // iterate over all collision geometries
-  for (unsigned j=0; j< rigid_bodies.size(); j++)
-    BOOST_FOREACH(CollisionGeometryPtr i, rigid_bodies[j]->geometries)
+    // move the endpoint toward the front until it is in order
+    unsigned j = i;
+    for (; j > 0 && e < ep[j-1]; j--)
     {
-      // get the primitive for the geometry
-      PrimitivePtr p = i->get_geometry();
+      const SAPEndpoint& f = ep[j-1];
 
-      // get the bounding sphere
-      BVPtr bv = _bounding_spheres.find(i)->second;
+      // if a start passes an end, the intervals begin to overlap along this 
+      // axis; add the pair if the AABBs overlap along all axes 
+      if (!e.end && f.end)
+      {
+        if (overlaps(e.geom_id, f.geom_id, eXAxis) &&
+            overlaps(e.geom_id, f.geom_id, eYAxis) &&
+            overlaps(e.geom_id, f.geom_id, eZAxis))
+          _overlapping_pairs.insert(make_id_pair(e.geom_id, f.geom_id));
+      }
+      // if an end passes a start, the intervals no longer overlap
+      else if (e.end && !f.end)
+        _overlapping_pairs.erase(make_id_pair(e.geom_id, f.geom_id));
 
-      // setup the bounds structure
-      BoundsStruct bs;
-      bs.end = false;
-      bs.geom = i;
-      bs.bv = bv;
+      ep[j] = f;
+    }
 
-      // add the lower bound
-      bounds.push_back(make_pair(-INF, bs));
+    // store the endpoint
+    ep[j] = e;
+  }
+}
 
-      // modify the bounds structure to indicate the end bound
-      bs.end = true;
-      bounds.push_back(make_pair(INF, bs));
-    }
+/// Computes the swept BV
+BVPtr CCD::get_swept_BV(CollisionGeometryPtr cg, BVPtr bv, double dt)
+{
+  // get the rigid body
+  RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(cg->get_single_body());
+
+  // get the current velocity
+  const SVelocityd& v = rb->get_velocity();
+
+  // compute the swept BV
+  BVPtr swept_bv = bv->calc_swept_BV(cg, v*dt);
+  FILE_LOG(LOG_BV) << "new BV: " << swept_bv << std::endl;
+
+  return swept_bv;
 }
 
 /// Constructs a bounding sphere for a given primitive type
@@ -10,6 +10,7 @@
 #include <set>
 #include <Moby/Constants.h>
 #include <Moby/CollisionGeometry.h>
+#include <Moby/Primitive.h>
 #include <Moby/RigidBody.h>
 #include <Moby/ArticulatedBody.h>
 #include <Moby/ConstraintSimulator.h>
@@ -24,6 +25,60 @@ using std::list;
 using std::pair;
 using namespace Moby;
 
+/// Takes a snapshot of the global transforms of a set of geometries
+/**
+ * The transforms are computed once and stored contiguously; the narrow phase 
+ * then reads them through get_transform() rather than walking the pose chain
+ * for every query. The snapshot remains valid until invalidate_transforms()
+ * or update_transforms() is called; simulators invalidate it when they move
+ * bodies and when step() returns.
+ */
+void CollisionDetection::update_transforms(const vector<CollisionGeometryPtr>& geoms)
+{
+  // get the new generation
+  _snapshot_generation = _next_snapshot_generation++;
+  if (_next_snapshot_generation == 0)
+    _next_snapshot_generation = 1;
+
+  // compute the transforms
+  _transforms.resize(geoms.size());
+  for (unsigned i=0; i< geoms.size(); i++)
+  {
+    const CollisionGeometryPtr& cg = geoms[i];
+    _transforms[i] = Pose3d::calc_relative_pose(cg->get_geometry()->get_pose(cg), GLOBAL);
+    cg->_snapshot_index = i;
+    cg->_snapshot_generation = _snapshot_generation;
+    cg->_snapshot_owner = this;
+  }
+}
+
+/// Gets the transform from the primitive frame of a geometry to the global frame
+/**
+ * \param cg the collision geometry
+ * \param wTp storage for the transform, used only if the geometry is not in 
+ *        the current snapshot
+ * \return a reference to the transform (either in the snapshot or wTp)
+ */
+const Transform3d& CollisionDetection::get_transform(CollisionGeometryPtr cg, Transform3d& wTp) const
+{
+  // use the snapshot if it is current
+  if (_snapshot_generation > 0 && cg->_snapshot_generation == _snapshot_generation && cg->_snapshot_owner == this)
+    return _transforms[cg->_snapshot_index];
+
+  // otherwise, compute the transform
+  wTp = Pose3d::calc_relative_pose(cg->get_geometry()->get_pose(cg), GLOBAL);
+  return wTp;
+}
+
+/// Gets the transform from the primitive frame of geometry A to the primitive frame of geometry B 
+Transform3d CollisionDetection::get_relative_transform(CollisionGeometryPtr cgA, CollisionGeometryPtr cgB) const
+{
+  Transform3d wTa_tmp, wTb_tmp;
+  const Transform3d& wTa = get_transform(cgA, wTa_tmp);
+  const Transform3d& wTb = get_transform(cgB, wTb_tmp);
+  return wTb.inverse() * wTa;
+}
+
 /// Default broad phase function (checks everything)
 void CollisionDetection::broad_phase(double dt, const std::vector<ControlledBodyPtr>& bodies, std::vector<std::pair<CollisionGeometryPtr, CollisionGeometryPtr> >& to_check)
 {
@@ -26,6 +26,9 @@ using namespace Moby;
 CollisionGeometry::CollisionGeometry()
 {
   _F = shared_ptr<Pose3d>(new Pose3d);
+  _snapshot_index = 0;
+  _snapshot_generation = 0;
+  _snapshot_owner = NULL;
 }
 
 /// Gets a supporting point for this geometry in a particular direction
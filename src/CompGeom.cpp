@@ -24,6 +24,9 @@ pthread_mutex_t Moby::CompGeom::_qhull_mutex = PTHREAD_MUTEX_INITIALIZER;
 using namespace Ravelin;
 using namespace Moby;
 
+/// qhull is the default engine
+CompGeom::HullEngine CompGeom::hull_engine = CompGeom::eQhull;
+
 /// Helper function for calc_min_area_rect()
 void CompGeom::update_box(const Point2d& lP, const Point2d& rP, const Point2d& bP, const Point2d& tP, const Vector2d& U, const Vector2d& V, double& min_area_div4, Point2d& center, Vector2d axis[2], double extent[2])
 {
@@ -35,6 +35,7 @@ using std::vector;
 /// Constructs a cone centered at the origin, with the longitudinal axis aligned with the y-axis, radius 1.0, height 1.0, 1 ring and 10 circle points 
 ConePrimitive::ConePrimitive()
 {
+  _type = eCone;
   _radius = 1.0;
   _height = 1.0;
   _npoints = 10;
@@ -45,6 +46,7 @@ ConePrimitive::ConePrimitive()
 /// Constructs a cone along the y-axis with specified radius and height, centered at the origin, with 1 ring and 10 circle points 
 ConePrimitive::ConePrimitive(double radius, double height)
 {
+  _type = eCone;
   if (height < (double) 0.0)
     throw std::runtime_error("Attempting to set negative height in ConePrimitive (constructor)");
   if (radius < (double) 0.0)
@@ -60,6 +62,7 @@ ConePrimitive::ConePrimitive(double radius, double height)
 /// Constructs a cone along the y-axis with specified radius and height, centered at the origin, with 1 ring and 10 circle points 
 ConePrimitive::ConePrimitive(double radius, double height, const Pose3d& T) : Primitive(T)
 {
+  _type = eCone;
   if (height < (double) 0.0)
     throw std::runtime_error("Attempting to set negative height in ConePrimitive (constructor)");
   if (radius < (double) 0.0)
@@ -75,6 +78,7 @@ ConePrimitive::ConePrimitive(double radius, double height, const Pose3d& T) : Pr
 /// Constructs a cone along the y-axis and centered at the origin with specified, radius, height, points and rings
 ConePrimitive::ConePrimitive(double radius, double height, unsigned npoints, unsigned nrings, const Pose3d& T) : Primitive(T)
 {
+  _type = eCone;
   if (height < (double) 0.0)
     throw std::runtime_error("Attempting to set negative height in ConePrimitive (constructor)");
   if (radius < (double) 0.0)
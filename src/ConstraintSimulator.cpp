@@ -4,6 +4,9 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <unistd.h>
 #include <boost/tuple/tuple.hpp>
 #include <Moby/XMLTree.h>
@@ -19,6 +22,7 @@
 #include <Moby/InvalidStateException.h>
 #include <Moby/InvalidVelocityException.h>
 #include <Moby/ConstraintStabilization.h>
+#include <Moby/StateBuffer.h>
 #include <Moby/ConstraintSimulator.h>
 
 #ifdef USE_OSG
@@ -51,6 +55,7 @@ ConstraintSimulator::ConstraintSimulator()
   post_mini_step_callback_fn = NULL;
   get_contact_parameters_callback_fn = NULL;
   render_contact_points = false;
+  parallel_narrow_phase = false;
 
   // setup contact distance thresholds
   contact_dist_thresh = 1e-6;
@@ -297,6 +302,8 @@ void ConstraintSimulator::visualize_contact( UnilateralConstraint& constraint )
 /// Handles constraints
 void ConstraintSimulator::calc_impacting_unilateral_constraint_forces(double dt)
 {
+  ScopedPhaseTimer timer(_step_stats, StepStats::eImpacts);
+
   // if there are no constraints, quit now
   if (_rigid_constraints.empty() && implicit_joints.empty())
     return;
@@ -334,7 +341,12 @@ void ConstraintSimulator::calc_impacting_unilateral_constraint_forces(double dt)
   // set simulator pointer
   _impact_constraint_handler._simulator = dynamic_pointer_cast<ConstraintSimulator>(shared_from_this());
 
+  // independent groups are solved in parallel if islands are processed in
+  // parallel
+  _impact_constraint_handler.parallel_islands = parallel_islands;
+
   // compute impulses here...
+  const unsigned long PIVOTS = _impact_constraint_handler.get_lcp_pivots();
   try
   {
     _impact_constraint_handler.process_constraints(_rigid_constraints);
@@ -348,6 +360,7 @@ void ConstraintSimulator::calc_impacting_unilateral_constraint_forces(double dt)
       std::cerr << "warning: constraint tolerances exceeded; constraint velocity violation " << e.violation << std::endl;
     #endif
   }
+  _step_stats.n_lcp_pivots += _impact_constraint_handler.get_lcp_pivots() - PIVOTS;
 
   // call the post application callback, if any
   if (constraint_post_callback_fn)
@@ -357,6 +370,8 @@ void ConstraintSimulator::calc_impacting_unilateral_constraint_forces(double dt)
 /// Computes compliant contact forces 
 void ConstraintSimulator::calc_compliant_unilateral_constraint_forces()
 {
+  ScopedPhaseTimer timer(_step_stats, StepStats::ePenalty);
+
   // if there are no compliant constraints, quit now
   if (_compliant_constraints.empty())
     return;
@@ -449,27 +464,44 @@ void ConstraintSimulator::determine_geometries()
  */
 void ConstraintSimulator::calc_pairwise_distances()
 {
-  // clear the vector
-  _pairwise_distances.clear();
+  ScopedPhaseTimer timer(_step_stats, StepStats::ePairwiseDistances);
 
-  for (unsigned i=0; i< _pairs_to_check.size(); i++)
+  // setup the vector; entry i corresponds to the i'th pair to check
+  const int NPAIRS = (int) _pairs_to_check.size();
+  _pairwise_distances.resize(NPAIRS);
+  _step_stats.n_pairs_checked += NPAIRS;
+
+  // snapshot the global transforms of all geometries at the current poses
+  _coldet->update_transforms(_geometries);
+
+  // pairs are independent; process them in parallel if requested
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) if (parallel_narrow_phase)
+  #endif
+  for (int i=0; i< NPAIRS; i++)
   {
-    PairwiseDistInfo pdi;
+    PairwiseDistInfo& pdi = _pairwise_distances[i];
     pdi.a = _pairs_to_check[i].first;
     pdi.b = _pairs_to_check[i].second;
     pdi.dist = _coldet->calc_signed_dist(pdi.a, pdi.b, pdi.pa, pdi.pb);
-    Pose3d poseA(*pdi.a->get_pose());
-    Pose3d poseB(*pdi.b->get_pose());
-    poseA.update_relative_pose(GLOBAL);
-    poseB.update_relative_pose(GLOBAL);
-    FILE_LOG(LOG_SIMULATOR) << "ConstraintSimulator::calc_pairwise_distances() - signed distance between " << pdi.a->get_single_body()->body_id << " and " << pdi.b->get_single_body()->body_id << ": " << pdi.dist << std::endl;
-    _pairwise_distances.push_back(pdi);
+  }
+
+  // log the distances in pair order (outside of the parallel region)
+  if (LOGGING(LOG_SIMULATOR))
+  {
+    for (int i=0; i< NPAIRS; i++)
+    {
+      const PairwiseDistInfo& pdi = _pairwise_distances[i];
+      FILE_LOG(LOG_SIMULATOR) << "ConstraintSimulator::calc_pairwise_distances() - signed distance between " << pdi.a->get_single_body()->body_id << " and " << pdi.b->get_single_body()->body_id << ": " << pdi.dist << std::endl;
+    }
   }
 }
 
 /// Does broad phase collision detection, identifying which pairs of geometries may come into contact over time step of dt
 void ConstraintSimulator::broad_phase(double dt)
 {
+  ScopedPhaseTimer timer(_step_stats, StepStats::eBroadPhase);
+
   // call the broad phase
   _coldet->broad_phase(dt, _bodies, _pairs_to_check);
 
@@ -488,6 +520,7 @@ void ConstraintSimulator::broad_phase(double dt)
 void ConstraintSimulator::find_unilateral_constraints(double contact_dist_thresh)
 {
   FILE_LOG(LOG_SIMULATOR) << "ConstraintSimulator::find_unilateral_constraints() entered" << std::endl;
+  ScopedPhaseTimer timer(_step_stats, StepStats::eFindConstraints);
 
   // clear the vectors of constraints
   _rigid_constraints.clear();
@@ -504,9 +537,19 @@ void ConstraintSimulator::find_unilateral_constraints(double contact_dist_thresh
      // get limit constraints
     ab->find_limit_constraints(std::back_inserter(_rigid_constraints));
   }
-
-  // find contact constraints
-  BOOST_FOREACH(const PairwiseDistInfo& pdi, _pairwise_distances)
+  const unsigned N_LIMITS = _rigid_constraints.size();
+
+  // find contact constraints for each pair; contacts are written to per-pair
+  // buffers so that pairs can be processed in parallel
+  const int NPAIRS = (int) _pairwise_distances.size();
+  _pair_contacts.resize(NPAIRS);
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) if (parallel_narrow_phase)
+  #endif
+  for (int i=0; i< NPAIRS; i++)
+  {
+    const PairwiseDistInfo& pdi = _pairwise_distances[i];
+    _pair_contacts[i].clear();
     if (pdi.dist < contact_dist_thresh)
     {
       // see whether one of the bodies is compliant
@@ -514,10 +557,30 @@ void ConstraintSimulator::find_unilateral_constraints(double contact_dist_thresh
       RigidBodyPtr rbb = dynamic_pointer_cast<RigidBody>(pdi.b->get_single_body());
       if (rba->compliance == RigidBody::eCompliant || 
           rbb->compliance == RigidBody::eCompliant)
-        _coldet->find_contacts(pdi.a, pdi.b, _compliant_constraints);
+        _coldet->find_contacts(pdi.a, pdi.b, _pair_contacts[i]);
       else        
-        _coldet->find_contacts(pdi.a, pdi.b, _rigid_constraints, contact_dist_thresh);
+        _coldet->find_contacts(pdi.a, pdi.b, _pair_contacts[i], contact_dist_thresh);
     }
+  }
+
+  // merge the contacts in pair order
+  for (int i=0; i< NPAIRS; i++)
+  {
+    if (_pair_contacts[i].empty())
+      continue;
+    const PairwiseDistInfo& pdi = _pairwise_distances[i];
+    RigidBodyPtr rba = dynamic_pointer_cast<RigidBody>(pdi.a->get_single_body());
+    RigidBodyPtr rbb = dynamic_pointer_cast<RigidBody>(pdi.b->get_single_body());
+    if (rba->compliance == RigidBody::eCompliant || 
+        rbb->compliance == RigidBody::eCompliant)
+      _compliant_constraints.insert(_compliant_constraints.end(), _pair_contacts[i].begin(), _pair_contacts[i].end());
+    else
+      _rigid_constraints.insert(_rigid_constraints.end(), _pair_contacts[i].begin(), _pair_contacts[i].end());
+  }
+
+  // update the counters
+  _step_stats.n_limits += N_LIMITS;
+  _step_stats.n_contacts += _rigid_constraints.size() + _compliant_constraints.size() - N_LIMITS;
 
   // set constraints to proper type
   for (unsigned i=0; i< _compliant_constraints.size(); i++)
@@ -571,6 +634,13 @@ void ConstraintSimulator::load_from_xml(shared_ptr<const XMLTree> node, map<std:
     _coldet->set_simulator(shared_this);
   }
 
+  // read whether the built-in collision detector finds polyhedron contacts
+  // using clipping, if specified
+  XMLAttrib* clip_attrib = node->get_attrib("clip-polyhedron-contacts");
+  shared_ptr<CCD> ccd = dynamic_pointer_cast<CCD>(_coldet);
+  if (clip_attrib && ccd)
+    ccd->clip_polyhedron_contacts = clip_attrib->get_bool_value();
+
   // read the unilateral constraint stabilization tolerance, if any
   XMLAttrib* unilateral_cstab_tol_attrib = node->get_attrib("unilateral-stabilization-tol");
   if (unilateral_cstab_tol_attrib)
@@ -586,11 +656,29 @@ void ConstraintSimulator::load_from_xml(shared_ptr<const XMLTree> node, map<std:
   if (cstab_max_iter_attrib)
     cstab.max_iterations = cstab_max_iter_attrib->get_unsigned_value();
 
+  // read the maximum constraint stabilization time, if any
+  XMLAttrib* cstab_max_time_attrib = node->get_attrib("constraint-stabilization-max-time");
+  if (cstab_max_time_attrib)
+    cstab.max_time = cstab_max_time_attrib->get_real_value();
+
+  // read the constraint violation diagnostics file, if any
+  XMLAttrib* metrics_file_attrib = node->get_attrib("metrics-file");
+  if (metrics_file_attrib)
+  {
+    metrics_sink = shared_ptr<MetricsSink>(new MetricsSink);
+    metrics_sink->open(metrics_file_attrib->get_string_value());
+  }
+
   // read the contact distance threshold, if any
   XMLAttrib* contact_dist_thresh_attrib = node->get_attrib("contact-dist-thresh");
   if (contact_dist_thresh_attrib)
     contact_dist_thresh = contact_dist_thresh_attrib->get_real_value();
 
+  // read whether the narrow phase should be done in parallel, if specified
+  XMLAttrib* parallel_narrow_phase_attrib = node->get_attrib("parallel-narrow-phase");
+  if (parallel_narrow_phase_attrib)
+    parallel_narrow_phase = parallel_narrow_phase_attrib->get_bool_value();
+
   // read in any ContactParameters
   child_nodes = node->find_child_nodes("ContactParameters");
   if (!child_nodes.empty())
@@ -720,6 +808,7 @@ void ConstraintSimulator::save_to_xml(XMLTreePtr node, list<shared_ptr<const Bas
   node->attribs.insert(XMLAttrib("unilateral-stabilization-tol", cstab.eps));
   node->attribs.insert(XMLAttrib("bilateral-stabilization-tol", cstab.bilateral_eps));
   node->attribs.insert(XMLAttrib("constraint-stabilization-max-iterations", cstab.max_iterations));
+  node->attribs.insert(XMLAttrib("constraint-stabilization-max-time", cstab.max_time));
 
   // save the dissipation mechanism
   if (_dissipator)
@@ -729,15 +818,21 @@ void ConstraintSimulator::save_to_xml(XMLTreePtr node, list<shared_ptr<const Bas
   }
 
   // save any collision detection plugins
-  if (!dynamic_pointer_cast<CCD>(_coldet))
+  shared_ptr<CCD> ccd = dynamic_pointer_cast<CCD>(_coldet);
+  if (!ccd)
   {
     node->attribs.insert(XMLAttrib("collision-detection-plugin", _coldet->id));
     shared_objects.push_back(_coldet);
   }
+  else
+    node->attribs.insert(XMLAttrib("clip-polyhedron-contacts", ccd->clip_polyhedron_contacts));
 
   // save the distance thresholds
   node->attribs.insert(XMLAttrib("contact-dist-thesh", contact_dist_thresh));
 
+  // save whether the narrow phase is done in parallel
+  node->attribs.insert(XMLAttrib("parallel-narrow-phase", parallel_narrow_phase));
+
   // save all ContactParameters
   for (map<sorted_pair<BasePtr>, shared_ptr<ContactParameters> >::const_iterator i = contact_params.begin(); i != contact_params.end(); i++)
   {
@@ -756,4 +851,56 @@ void ConstraintSimulator::save_to_xml(XMLTreePtr node, list<shared_ptr<const Bas
   }
 }
 
+/// Writes the state of the simulation that is not part of the model (see Simulator::save_state())
+/**
+ * In addition to the state written by Simulator, writes the contact and
+ * limit data used to warm start the impact solver and the state of the
+ * collision detector. Constraint stabilization carries no state between
+ * steps; pairwise distances and constraints are recomputed every step.
+ */
+void ConstraintSimulator::write_state(StateWriter& out) const
+{
+  // write the coordinates and velocities
+  Simulator::write_state(out);
+
+  // write the warm starting data
+  _impact_constraint_handler.write_warm_start(out);
+
+  // write the state of the collision detector
+  out.write_unsigned((_coldet) ? 1 : 0);
+  if (_coldet)
+    _coldet->write_state(out);
+}
 
+/// Reads the state written by write_state() (see Simulator::read_state())
+void ConstraintSimulator::read_state(StateReader& in, bool apply)
+{
+  // read the coordinates and velocities
+  Simulator::read_state(in, apply);
+  if (!in.ok())
+    return;
+
+  // read the warm starting data
+  _impact_constraint_handler.read_warm_start(in, apply);
+
+  // read the state of the collision detector
+  const bool COLDET = (in.read_unsigned() != 0);
+  if (COLDET != (bool) _coldet)
+  {
+    in.fail();
+    return;
+  }
+  if (_coldet)
+    _coldet->read_state(in, apply);
+  if (!in.ok() || !apply)
+    return;
+
+  // the transforms of the geometries have changed
+  if (_coldet)
+    _coldet->invalidate_transforms();
+
+  // distances and constraints at the previous configuration are no longer valid
+  _pairwise_distances.clear();
+  _rigid_constraints.clear();
+  _compliant_constraints.clear();
+}
@@ -28,10 +28,15 @@
  */
 
 #include <map>
+#include <set>
 #include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <Moby/Types.h>
 #include <Moby/ConstraintSimulator.h>
 #include <Moby/RCArticulatedBody.h>
+#include <Moby/StepStats.h>
 #include <Moby/ConstraintStabilization.h>
 #include <boost/algorithm/minmax_element.hpp>
 #include <utility>
@@ -55,6 +60,9 @@ ConstraintStabilization::ConstraintStabilization()
   // set maximum iterations to infinity, by default 
   max_iterations = std::numeric_limits<unsigned>::max();
 
+  // set maximum time to infinity, by default
+  max_time = std::numeric_limits<double>::max();
+
   // set unilateral tolerance to negative NEAR_ZERO by default
   eps = NEAR_ZERO;
 
@@ -84,8 +92,12 @@ void ConstraintStabilization::restore_velocities(shared_ptr<ConstraintSimulator>
   }
 }
 
-/// Get the maximum amount of unilateral constraint violation
-double ConstraintStabilization::evaluate_unilateral_constraints(shared_ptr<ConstraintSimulator> sim, vector<double>& uC)
+/// Get the maximum amount of unilateral constraint violation in an island
+/**
+ * The signed distances of the island's geometry pairs are also written to
+ * the simulator's pairwise distance information.
+ */
+double ConstraintStabilization::evaluate_unilateral_constraints(shared_ptr<ConstraintSimulator> sim, Island& island, vector<double>& uC)
 {
   // set violation to infinite initially
   double vio = std::numeric_limits<double>::max();
@@ -93,28 +105,29 @@ double ConstraintStabilization::evaluate_unilateral_constraints(shared_ptr<Const
   // clear uC
   uC.clear();
 
-  // calculate the pairwise distances
-  sim->calc_pairwise_distances();
+  // get the collision detection mechanism
+  shared_ptr<CollisionDetection> coldet = sim->get_collision_detection();
 
-  // get the maximum amount of unilateral constraint violation
-  const vector<PairwiseDistInfo>& pdi = sim->_pairwise_distances;
-  for (unsigned i=0; i< pdi.size(); i++)
+  // calculate the pairwise distances for the island
+  vector<PairwiseDistInfo>& pdi = sim->_pairwise_distances;
+  for (unsigned i=0; i< island.pairs.size(); i++)
   {
-    uC.push_back(pdi[i].dist);
+    PairwiseDistInfo& p = pdi[island.pairs[i]];
+    p.dist = coldet->calc_signed_dist(p.a, p.b, p.pa, p.pb);
+    uC.push_back(p.dist);
     vio = std::min(vio, uC.back());
   }
 
-  // look at all articulated bodies
-  const vector<ControlledBodyPtr>& bodies = sim->get_dynamic_bodies();
-  for (unsigned i=0; i< bodies.size(); i++)
+  // look at all articulated bodies in the island
+  for (unsigned i=0; i< island.bodies.size(); i++)
   {
-    shared_ptr<RCArticulatedBodyd> rcab = dynamic_pointer_cast<RCArticulatedBodyd>(bodies[i]);
+    shared_ptr<RCArticulatedBodyd> rcab = dynamic_pointer_cast<RCArticulatedBodyd>(island.bodies[i]);
     if (rcab)
     {
       const std::vector<shared_ptr<Jointd> >& joints = rcab->get_joints();
       for (unsigned j=0; j< joints.size(); j++)
       {
-        shared_ptr<Joint> joint = dynamic_pointer_cast<Joint>(joints[i]);
+        shared_ptr<Joint> joint = dynamic_pointer_cast<Joint>(joints[j]);
         const VectorNd& tare = joint->get_q_tare(); 
         for (unsigned k=0; k< joint->num_dof(); k++)
         {
@@ -130,8 +143,8 @@ double ConstraintStabilization::evaluate_unilateral_constraints(shared_ptr<Const
   return vio;
 }
 
-/// Evaluates implicit bilateral constraints and returns the most significant violation
-double ConstraintStabilization::evaluate_bilateral_constraints(shared_ptr<ConstraintSimulator> sim, vector<double>& C)
+/// Evaluates implicit bilateral constraints in an island and returns the most significant violation
+double ConstraintStabilization::evaluate_bilateral_constraints(const Island& island, vector<double>& C)
 {
   const unsigned SPATIAL_DIM = 6;
   double eval[SPATIAL_DIM];
@@ -139,17 +152,17 @@ double ConstraintStabilization::evaluate_bilateral_constraints(shared_ptr<Constr
   // clear C - we'll build it as we go
   C.clear();
 
-  // no need to continue if there are no implicit constraints
-  if(sim->implicit_joints.size() == 0)
-    return 0.0;
-
-  // evaluate all constraints in the simulator
-  for (unsigned i=0; i< sim->implicit_joints.size(); i++)
+  // evaluate all constraints in the island
+  for (unsigned i=0; i< island.ijoints.size(); i++)
   {
-    sim->implicit_joints[i]->evaluate_constraints(eval);
-    std::copy(eval, eval+sim->implicit_joints[i]->num_constraint_eqns(), std::back_inserter(C));
+    island.ijoints[i]->evaluate_constraints(eval);
+    std::copy(eval, eval+island.ijoints[i]->num_constraint_eqns(), std::back_inserter(C));
   }
 
+  // no need to continue if there are no implicit constraints
+  if (C.empty())
+    return 0.0;
+
   if (LOGGING(LOG_CONSTRAINT))
   {
     std::stringstream C_str;
@@ -163,83 +176,236 @@ double ConstraintStabilization::evaluate_bilateral_constraints(shared_ptr<Constr
   return (std::fabs(*mmelm.first) > std::fabs(*mmelm.second)) ? std::fabs(*mmelm.first) : std::fabs(*mmelm.second);
 }
 
-/// Stabilizes the constraints in the simulator
-void ConstraintStabilization::stabilize(shared_ptr<ConstraintSimulator> sim)
+/// Finds the representative of a disjoint set
+static unsigned find_set(vector<unsigned>& parent, unsigned i)
 {
-  FILE_LOG(LOG_SIMULATOR)<< "======constraint stabilization start======"<<std::endl;
-  VectorNd dq, q, v;
-  std::vector<UnilateralConstraintProblemData> pd;
-  std::vector<VectorNd> qd_save;
-  std::vector<double> C, uC;
-  std::map<shared_ptr<DynamicBodyd>, unsigned> body_index_map;
-
-  // look for no constraint stabilization
-  if (max_iterations == 0)
-    return;
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
 
-  // save the generalized velocities
-  save_velocities(sim, qd_save);
+/// Partitions the enabled bodies in the simulator into islands that can be stabilized independently
+/**
+ * Bodies are connected by the geometry pairs found by the simulator's broad
+ * phase and by implicit joints; geometry pairs against disabled bodies are
+ * placed into the island of the enabled body. Geometry pairs between two 
+ * disabled bodies are not examined.
+ */
+void ConstraintStabilization::find_islands(shared_ptr<ConstraintSimulator> sim, vector<Island>& islands)
+{
+  const unsigned UINF = std::numeric_limits<unsigned>::max();
 
-  // get the body configurations and setup the body index map
-  get_body_configurations(q, sim);
-  generate_body_index_map(body_index_map, sim);
+  // map the enabled bodies to indices
+  vector<shared_ptr<DynamicBodyd> > bodies;
+  map<shared_ptr<DynamicBodyd>, unsigned> body_map;
+  for (unsigned i=0; i< sim->_bodies.size(); i++)
+  {
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(sim->_bodies[i]);
+    if (db->is_enabled())
+    {
+      body_map[db] = bodies.size();
+      bodies.push_back(db);
+    }
+  }
 
-  // evaluate the bilateral constraints
-  double max_bvio = evaluate_bilateral_constraints(sim, C);
+  // setup the pairwise distance information for the broad phase pairs
+  const vector<pair<CollisionGeometryPtr, CollisionGeometryPtr> >& pairs = sim->_pairs_to_check;
+  vector<PairwiseDistInfo>& pdi = sim->_pairwise_distances;
+  pdi.resize(pairs.size());
+  for (unsigned i=0; i< pairs.size(); i++)
+  {
+    pdi[i].a = pairs[i].first;
+    pdi[i].b = pairs[i].second;
+  }
 
-  // see whether any pairwise distances are below epsilon
-  double max_uvio = evaluate_unilateral_constraints(sim, uC);
+  // every body starts in its own set
+  vector<unsigned> parent(bodies.size());
+  for (unsigned i=0; i< parent.size(); i++)
+    parent[i] = i;
 
-  FILE_LOG(LOG_SIMULATOR) <<"maximum unilateral constraint violation (before stabilization loop): "<< max_uvio <<std::endl;
-  FILE_LOG(LOG_SIMULATOR) <<"maximum bilateral constraint violation (before stabilization loop): "<< max_bvio <<std::endl;
+  // connect bodies through geometry pairs
+  vector<unsigned> pair_body(pairs.size(), UINF);
+  for (unsigned i=0; i< pairs.size(); i++)
+  {
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator a_iter = body_map.find(get_super_body(pairs[i].first->get_single_body()));
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator b_iter = body_map.find(get_super_body(pairs[i].second->get_single_body()));
+    if (a_iter != body_map.end())
+    {
+      pair_body[i] = a_iter->second;
+      if (b_iter != body_map.end())
+        parent[find_set(parent, a_iter->second)] = find_set(parent, b_iter->second);
+    }
+    else if (b_iter != body_map.end())
+      pair_body[i] = b_iter->second;
+  }
 
-  unsigned iterations = 0;
-  while (max_uvio < eps || max_bvio > bilateral_eps)
+  // connect bodies through implicit joints
+  vector<unsigned> joint_body(sim->implicit_joints.size(), UINF);
+  for (unsigned i=0; i< sim->implicit_joints.size(); i++)
   {
-    // look for maximum iterations
-    if (iterations == max_iterations)
+    JointPtr joint = sim->implicit_joints[i];
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator in_iter = body_map.find(get_super_body(joint->get_inboard_link()));
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator out_iter = body_map.find(get_super_body(joint->get_outboard_link()));
+    if (in_iter != body_map.end())
     {
-      FILE_LOG(LOG_SIMULATOR) << " -- maximum number of iterations reached" << std::endl;
-      FILE_LOG(LOG_SIMULATOR) << " -- failed to effectively finish the constraint stabilization process!" << std::endl;
-      break;
+      joint_body[i] = in_iter->second;
+      if (out_iter != body_map.end())
+        parent[find_set(parent, in_iter->second)] = find_set(parent, out_iter->second);
     }
+    else if (out_iter != body_map.end())
+      joint_body[i] = out_iter->second;
+  }
 
-    FILE_LOG(LOG_SIMULATOR) <<"maximum unilateral constraint violation: "<< max_uvio <<std::endl;
-    FILE_LOG(LOG_SIMULATOR) <<"maximum bilateral constraint violation: "<< max_bvio <<std::endl;
+  // create one island per set
+  islands.clear();
+  vector<unsigned> island_index(bodies.size(), UINF);
+  for (unsigned i=0; i< bodies.size(); i++)
+  {
+    unsigned root = find_set(parent, i);
+    if (island_index[root] == UINF)
+    {
+      island_index[root] = islands.size();
+      islands.push_back(Island());
+    }
+    Island& island = islands[island_index[root]];
+    island.bodies.push_back(bodies[i]);
+  }
 
-    // zero body velocities first (we only want to change positions based on
-    // our updates)
-    for (unsigned i=0; i< sim->_bodies.size(); i++)
+  // setup the mapping from bodies to generalized coordinates
+  for (unsigned i=0; i< islands.size(); i++)
+  {
+    unsigned cur_index = 0;
+    for (unsigned j=0; j< islands[i].bodies.size(); j++)
     {
-      shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(sim->_bodies[i]);
-      db->get_generalized_velocity(DynamicBodyd::eSpatial, v);
-      v.set_zero();
-      db->set_generalized_velocity(DynamicBodyd::eSpatial, v);
+      islands[i].body_index_map[islands[i].bodies[j]] = cur_index;
+      cur_index += islands[i].bodies[j]->num_generalized_coordinates(DynamicBodyd::eEuler);
     }
+  }
 
-    // compute problem data (get M, N, alpha, etc.) 
-    compute_problem_data(pd, sim);
+  // assign geometry pairs and implicit joints to islands
+  for (unsigned i=0; i< pair_body.size(); i++)
+    if (pair_body[i] != UINF)
+      islands[island_index[find_set(parent, pair_body[i])]].pairs.push_back(i);
+  for (unsigned i=0; i< joint_body.size(); i++)
+    if (joint_body[i] != UINF)
+      islands[island_index[find_set(parent, joint_body[i])]].ijoints.push_back(sim->implicit_joints[i]);
+}
+
+/// Stabilizes the constraints in the simulator
+/**
+ * Stabilization proceeds in rounds. Each round partitions the bodies into
+ * islands using the current broad phase pairs and performs one iteration on
+ * every island with constraint violations (in parallel, if the simulator 
+ * processes islands in parallel). Iterations move bodies, which can bring 
+ * them near bodies that the previous pairs did not include, so the broad 
+ * phase is rerun before every round but the first. max_iterations limits the
+ * iterations for each island and max_time limits the total time.
+ */
+const ConstraintStabilization::Report& ConstraintStabilization::stabilize(shared_ptr<ConstraintSimulator> sim)
+{
+  FILE_LOG(LOG_SIMULATOR)<< "======constraint stabilization start======"<<std::endl;
+  std::vector<VectorNd> qd_save;
+  std::set<shared_ptr<DynamicBodyd> > stalled;
+
+  // reset the report 
+  const double START_TIME = StepStats::get_time();
+  _report = Report();
+
+  // look for no constraint stabilization
+  if (max_iterations == 0)
+    return _report;
+
+  // save the generalized velocities
+  save_velocities(sim, qd_save);
 
-    // determine dq's
-    dq.set_zero(q.size());
-    for (unsigned i=0; i< pd.size(); i++)
-      determine_dq(pd[i], dq, body_index_map);
-    FILE_LOG(LOG_SIMULATOR) << "dq: " << dq << std::endl;
+  // islands move bodies independently, so the transform snapshot is not used
+  sim->get_collision_detection()->invalidate_transforms();
 
-    // determine s and update q; NOTE: update q computes the pairwise distances 
-    if (!update_q(dq, q, sim))
+  // stabilize in rounds, recording exceptions so that they may be rethrown 
+  // outside of any parallel region
+  vector<std::string> errors;
+  for (unsigned round = 0; ; round++)
+  {
+    // update the broad phase pairs for the moved bodies (the first round
+    // uses the pairs from the step); the time is counted for the broad phase
+    // rather than for stabilization (see ScopedPhaseTimer)
+    if (round > 0)
+      sim->broad_phase(0.0);
+
+    // find the islands
+    find_islands(sim, _islands);
+    const int N_ISLANDS = (int) _islands.size();
+
+    // islands containing bodies that could not be moved in an earlier round
+    // are not stabilized further
+    for (int i=0; i< N_ISLANDS; i++)
+      for (unsigned j=0; j< _islands[i].bodies.size() && !_islands[i].stalled; j++)
+        if (stalled.find(_islands[i].bodies[j]) != stalled.end())
+          _islands[i].stalled = true;
+
+    // do an iteration on each island
+    errors.assign(N_ISLANDS, std::string());
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) if (sim->parallel_islands && N_ISLANDS > 1)
+    #endif
+    for (int i=0; i< N_ISLANDS; i++)
     {
-      FILE_LOG(LOG_SIMULATOR) << " -- failed to effectively finish the constraint stabilization process!" << std::endl;
-      break;
+      try
+      {
+        stabilize_island(sim, _islands[i], round, START_TIME);
+      }
+      catch (std::exception& e)
+      {
+        errors[i] = e.what();
+        if (errors[i].empty())
+          errors[i] = "unknown exception";
+      }
     }
 
-    // update minimum distance
-    max_uvio = evaluate_unilateral_constraints(sim, uC);
+    // restore the generalized velocities and rethrow the first exception, if
+    // any
+    for (int i=0; i< N_ISLANDS; i++)
+      if (!errors[i].empty())
+      {
+        restore_velocities(sim, qd_save);
+        throw std::runtime_error(errors[i]);
+      }
 
-    // update constraint violation
-    max_bvio = evaluate_bilateral_constraints(sim, C);
+    // update the report
+    bool iterated = false;
+    if (round == 0)
+      _report.n_islands = (unsigned) N_ISLANDS;
+    _report.max_bilateral_vio = 0.0;
+    _report.n_unconverged = 0;
+    for (int i=0; i< N_ISLANDS; i++)
+    {
+      const Island& island = _islands[i];
+      _report.max_bilateral_vio = std::max(_report.max_bilateral_vio, island.max_bvio);
+      if (!island.violated)
+        continue;
+      if (round == 0)
+        _report.n_violated++;
+      if (island.iterated)
+      {
+        _report.iterations++;
+        iterated = true;
+      }
+      else
+        _report.n_unconverged++;
+      if (island.budget_exhausted)
+        _report.budget_exhausted = true;
+      if (island.stalled)
+        stalled.insert(island.bodies.begin(), island.bodies.end());
+    }
+    if (iterated)
+      _report.max_island_iterations++;
 
-    iterations++;
+    // stop once no island needs (or is permitted) another iteration
+    if (!iterated)
+      break;
   }
 
   // restore the generalized velocities
@@ -249,12 +415,94 @@ void ConstraintStabilization::stabilize(shared_ptr<ConstraintSimulator> sim)
 //  sim->find_unilateral_constraints(sim->contact_dist_thresh);
 //  sim->calc_impacting_unilateral_constraint_forces(-1.0); 
 
-  FILE_LOG(LOG_SIMULATOR) << iterations << " iterations required" << std::endl;
+  _report.time = StepStats::get_time() - START_TIME;
+
+  FILE_LOG(LOG_SIMULATOR) << _report.n_violated << " of " << _report.n_islands << " islands stabilized" << std::endl;
+  FILE_LOG(LOG_SIMULATOR) << _report.iterations << " iterations required (" << _report.max_island_iterations << " maximum per island)" << std::endl;
+  if (_report.n_unconverged > 0)
+    FILE_LOG(LOG_SIMULATOR) << " -- failed to effectively finish the constraint stabilization process for " << _report.n_unconverged << " islands!" << std::endl;
   FILE_LOG(LOG_SIMULATOR) <<"=====constraint stabilization end ======" << std::endl;
+
+  return _report;
+}
+
+/// Performs one stabilization iteration on a single island, if it has constraint violations
+/**
+ * \param round the number of earlier rounds (each island containing a body
+ *        was permitted at most one iteration per round)
+ * \param start_time the time that stabilization started
+ */
+void ConstraintStabilization::stabilize_island(shared_ptr<ConstraintSimulator> sim, Island& island, unsigned round, double start_time) const
+{
+  VectorNd dq, q, v;
+  std::vector<UnilateralConstraintProblemData> pd;
+  std::vector<double> C, uC;
+
+  // setup the island's status
+  island.violated = false;
+  island.iterated = false;
+  island.budget_exhausted = false;
+
+  // evaluate the bilateral constraints
+  double max_bvio = evaluate_bilateral_constraints(island, C);
+  island.max_bvio = max_bvio;
+
+  // see whether any pairwise distances are below epsilon
+  double max_uvio = evaluate_unilateral_constraints(sim, island, uC);
+
+  // islands without constraint violations need no work
+  if (max_uvio >= eps && max_bvio <= bilateral_eps)
+    return;
+  island.violated = true;
+
+  FILE_LOG(LOG_SIMULATOR) <<"maximum unilateral constraint violation: "<< max_uvio <<std::endl;
+  FILE_LOG(LOG_SIMULATOR) <<"maximum bilateral constraint violation: "<< max_bvio <<std::endl;
+
+  // islands that could not be moved earlier are not stabilized further
+  if (island.stalled)
+    return;
+
+  // look for maximum iterations or time
+  if (round >= max_iterations || StepStats::get_time() - start_time > max_time)
+  {
+    FILE_LOG(LOG_SIMULATOR) << " -- maximum number of iterations or time reached" << std::endl;
+    island.budget_exhausted = true;
+    return;
+  }
+
+  // get the body configurations
+  get_body_configurations(q, island);
+
+  // zero body velocities first (we only want to change positions based on
+  // our updates)
+  for (unsigned i=0; i< island.bodies.size(); i++)
+  {
+    island.bodies[i]->get_generalized_velocity(DynamicBodyd::eSpatial, v);
+    v.set_zero();
+    island.bodies[i]->set_generalized_velocity(DynamicBodyd::eSpatial, v);
+  }
+
+  // compute problem data (get M, N, alpha, etc.) 
+  compute_problem_data(pd, sim, island);
+
+  // determine dq's
+  dq.set_zero(q.size());
+  for (unsigned i=0; i< pd.size(); i++)
+    determine_dq(pd[i], dq, island.body_index_map, island.lcp);
+  FILE_LOG(LOG_SIMULATOR) << "dq: " << dq << std::endl;
+
+  // determine s and update q; NOTE: update q computes the pairwise distances 
+  if (!update_q(dq, q, sim, island))
+  {
+    island.stalled = true;
+    return;
+  }
+
+  island.iterated = true;
 }
 
-/// Adds unilateral constraints for joint limits in an articulated body
-void ConstraintStabilization::add_limit_constraints(const vector<ControlledBodyPtr>& bodies, std::vector<UnilateralConstraint>& constraints)
+/// Adds unilateral constraints for joint limits in articulated bodies
+void ConstraintStabilization::add_limit_constraints(const vector<shared_ptr<DynamicBodyd> >& bodies, std::vector<UnilateralConstraint>& constraints)
 {
   const double INF = std::numeric_limits<double>::max();
 
@@ -343,10 +591,11 @@ void ConstraintStabilization::add_contact_constraints(std::vector<UnilateralCons
   }
 }
 
-/// Computes the constraint data
-void ConstraintStabilization::compute_problem_data(std::vector<UnilateralConstraintProblemData>& pd_vector, shared_ptr<ConstraintSimulator> sim)
+/// Computes the constraint data for an island
+void ConstraintStabilization::compute_problem_data(std::vector<UnilateralConstraintProblemData>& pd_vector, shared_ptr<ConstraintSimulator> sim, Island& isl) const
 {
   VectorNd tmpv;
+  vector<UnilateralConstraint>& constraints = isl.constraints;
 
   // clear the constraints vector
   constraints.clear();
@@ -354,32 +603,15 @@ void ConstraintStabilization::compute_problem_data(std::vector<UnilateralConstra
   // clear the problem data vector 
   pd_vector.clear();
 
-  // get all bodies
-  const std::vector<shared_ptr<ControlledBody> >& bodies = sim->_bodies;
-
-  // get the collision detection mechanism
-  shared_ptr<CollisionDetection> coldet = sim->get_collision_detection();
-
-  // do broad phase collision detection here
-  coldet->broad_phase(0.0, bodies, _pairs_to_check);
-
-  // remove pairs that are unchecked
-  for (unsigned i=0; i< _pairs_to_check.size(); )
-    if (sim->unchecked_pairs.find(make_sorted_pair(_pairs_to_check[i].first, _pairs_to_check[i].second)) != sim->unchecked_pairs.end())
-    {
-      _pairs_to_check[i] = _pairs_to_check.back();
-      _pairs_to_check.pop_back();
-    }
-    else
-      i++;
-
-  // now add contact constraints for each checked pair
-  typedef std::pair<CollisionGeometryPtr, CollisionGeometryPtr> CheckPair;
-  BOOST_FOREACH(CheckPair& to_check, _pairs_to_check)
+  // now add contact constraints for each of the island's pairs
+  for (unsigned i=0; i< isl.pairs.size(); i++)
+  {
+    const pair<CollisionGeometryPtr, CollisionGeometryPtr>& to_check = sim->_pairs_to_check[isl.pairs[i]];
     add_contact_constraints(constraints, to_check.first, to_check.second, sim);
+  }
 
   // add limit constraints
-  add_limit_constraints(bodies, constraints);
+  add_limit_constraints(isl.bodies, constraints);
 
   //FILE_LOG(LOG_SIMULATOR) << "constraints added" << std::endl;
   // 2) for each articulated body, add as many UnilateralConstraint objects as
@@ -393,7 +625,7 @@ void ConstraintStabilization::compute_problem_data(std::vector<UnilateralConstra
   // find islands
   list<vector<shared_ptr<DynamicBodyd> > > remaining_islands;
   list<pair<list<UnilateralConstraint*>, list<shared_ptr<SingleBodyd> > > > islands;
-  UnilateralConstraint::determine_connected_constraints(constraints, sim->implicit_joints, islands, remaining_islands);
+  UnilateralConstraint::determine_connected_constraints(constraints, isl.ijoints, islands, remaining_islands);
 
   // process unilateral constraint islands
   typedef pair<list<UnilateralConstraint*>, list<shared_ptr<SingleBodyd> > > IslandType;
@@ -929,7 +1161,7 @@ void ConstraintStabilization::add_contact_to_Jacobian(const UnilateralConstraint
 }
 
 /// Computes deltaq by solving a linear complementarity problem
-void ConstraintStabilization::determine_dq(UnilateralConstraintProblemData& pd, VectorNd& dqm, const std::map<shared_ptr<DynamicBodyd>, unsigned>& body_index_map)
+void ConstraintStabilization::determine_dq(UnilateralConstraintProblemData& pd, VectorNd& dqm, const std::map<shared_ptr<DynamicBodyd>, unsigned>& body_index_map, LCP& lcp)
 {
   VectorNd z, dq_sub;
 
@@ -951,8 +1183,8 @@ void ConstraintStabilization::determine_dq(UnilateralConstraintProblemData& pd,
   FILE_LOG(LOG_SIMULATOR) << "qq: " << qq << std::endl;
 
   // solve N*inv(M)*N'*dq = N*alpha for impulses 
-  if (!_lcp.lcp_fast(MM, qq, z))
-    _lcp.lcp_lemke_regularized(MM, qq, z);
+  if (!lcp.lcp_fast(MM, qq, z))
+    lcp.lcp_lemke_regularized(MM, qq, z);
   FILE_LOG(LOG_SIMULATOR) << "zz: " << z << std::endl;
 
   // update velocities
@@ -1053,15 +1285,15 @@ static double sqr(double x) { return x*x; }
 /**
  * Two body version
  */
-bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_ptr<ConstraintSimulator> sim, Island& island) const
 {
   VectorNd qstar, grad;
   vector<double> C, C_old, uC, uC_old;
   const double MIN_T = NEAR_ZERO;
 
   // evaluate the constraints
-  evaluate_unilateral_constraints(sim, uC_old);
-  evaluate_bilateral_constraints(sim, C_old);
+  evaluate_unilateral_constraints(sim, island, uC_old);
+  evaluate_bilateral_constraints(island, C_old);
 
   // compute old bilateral constraint violations
   double old_bilateral_cvio = 0.0;
@@ -1073,9 +1305,9 @@ bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_p
   // find the pairwise distances and implicit constraint evaluations at q + dq
   qstar = dq;
   qstar += q;
-  update_body_configurations(qstar, sim);
-  evaluate_unilateral_constraints(sim, uC); 
-  evaluate_bilateral_constraints(sim, C);
+  update_body_configurations(qstar, island);
+  evaluate_unilateral_constraints(sim, island, uC); 
+  evaluate_bilateral_constraints(island, C);
 
   // we may have to find roots for all pairwise distances
   vector<bool> unilateral_bracket;
@@ -1121,7 +1353,7 @@ bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_p
       continue;
 
     // call Ridder's method to determine new t
-    double root = ridders_unilateral(0, t, uC_old[i], uC[i], i, dq, q, sim);
+    double root = ridders_unilateral(0, t, uC_old[i], uC[i], i, dq, q, sim, island);
     if (root > 0.0 && root < 1.0)
       t = std::min(root, t);
   }
@@ -1136,7 +1368,7 @@ bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_p
       continue;
 
     // call Ridder's method to determine new t
-    double root = ridders_bilateral(0, t, C_old[i], C[i], i, dq, q, sim);
+    double root = ridders_bilateral(0, t, C_old[i], C[i], i, dq, q, sim, island);
     if (root > 0.0 && root < 1.0)
       t = std::min(root, t);
   }
@@ -1147,9 +1379,9 @@ bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_p
   qstar += q;
 
   // re-evaluate signed distances and bilateral constraints
-  update_body_configurations(qstar, sim);
-  evaluate_unilateral_constraints(sim, uC); 
-  evaluate_bilateral_constraints(sim, C);
+  update_body_configurations(qstar, island);
+  evaluate_unilateral_constraints(sim, island, uC); 
+  evaluate_bilateral_constraints(island, C);
 
   // for values that aren't bracketed, further decrease t until there is
   // no increase in error
@@ -1201,9 +1433,9 @@ bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_p
     qstar += q;
 
     // re-evaluate signed distances and bilateral constraints
-    update_body_configurations(qstar, sim);
-    evaluate_bilateral_constraints(sim, C);
-    evaluate_unilateral_constraints(sim, uC);
+    update_body_configurations(qstar, island);
+    evaluate_bilateral_constraints(island, C);
+    evaluate_unilateral_constraints(sim, island, uC);
   }
 
   FILE_LOG(LOG_SIMULATOR) << "t: " << t << std::endl;
@@ -1215,51 +1447,37 @@ bool ConstraintStabilization::update_q(const VectorNd& dq, VectorNd& q, shared_p
   return true;
 }
 
-/// Gets the body configurations, placing them into q 
-void ConstraintStabilization::get_body_configurations(VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+/// Gets the configurations of the bodies in an island, placing them into q 
+void ConstraintStabilization::get_body_configurations(VectorNd& q, const Island& island)
 {  
-  const std::vector<shared_ptr<ControlledBody> >& bodies = sim->_bodies;
   unsigned NGC = 0;
 
   // resize the vector appropriately
-  BOOST_FOREACH(shared_ptr<ControlledBody> cb, bodies)
-  {
-    shared_ptr<DynamicBodyd> body = dynamic_pointer_cast<DynamicBodyd>(cb);
+  BOOST_FOREACH(shared_ptr<DynamicBodyd> body, island.bodies)
     NGC += body->num_generalized_coordinates(DynamicBodyd::eEuler);
-  }
   q.resize(NGC);
 
   // set the appropriate part of the vector
   unsigned start = 0;
-  BOOST_FOREACH(shared_ptr<ControlledBody> cb, bodies)
+  BOOST_FOREACH(shared_ptr<DynamicBodyd> body, island.bodies)
   {
-    shared_ptr<DynamicBodyd> body = dynamic_pointer_cast<DynamicBodyd>(cb);
     SharedVectorNd body_gcs = q.segment(start, start + body->num_generalized_coordinates(DynamicBodyd::eEuler));
     body->get_generalized_coordinates_euler(body_gcs);
     start += body->num_generalized_coordinates(DynamicBodyd::eEuler);
   }
 }
 
-/// Computes mapping from bodies to generalized coordinate indices 
-void ConstraintStabilization::generate_body_index_map(std::map<shared_ptr<DynamicBodyd>, unsigned>& body_index_map, shared_ptr<ConstraintSimulator> sim)
-{
-  const std::vector<shared_ptr<ControlledBody> >& bodies = sim->_bodies;
-  unsigned cur_index = 0;
-
-  BOOST_FOREACH(shared_ptr<ControlledBody> cb, bodies){
-    shared_ptr<DynamicBodyd> body = dynamic_pointer_cast<DynamicBodyd>(cb);
-    body_index_map.insert(std::make_pair(body, cur_index));
-    cur_index += body->num_generalized_coordinates(DynamicBodyd::eEuler);
-  }
-}
-
-/// Updates the body configurations given q
-void ConstraintStabilization::update_body_configurations(const VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+/// Updates the configurations of the bodies in an island given q
+/**
+ * \note the collision detector's transform snapshot is invalidated by
+ *       stabilize() rather than here, so that islands may be updated in 
+ *       parallel
+ */
+void ConstraintStabilization::update_body_configurations(const VectorNd& q, const Island& island)
 {
-  const std::vector<shared_ptr<ControlledBody> >& bodies = sim->_bodies;
   unsigned last = 0;
-  BOOST_FOREACH(shared_ptr<ControlledBody> cb, bodies){
-    shared_ptr<DynamicBodyd> body = dynamic_pointer_cast<DynamicBodyd>(cb);
+  BOOST_FOREACH(shared_ptr<DynamicBodyd> body, island.bodies)
+  {
     unsigned ngc = body->num_generalized_coordinates(DynamicBodyd::eEuler);
     Ravelin::SharedConstVectorNd gc_shared = q.segment(last,last+ngc);
     body->set_generalized_coordinates_euler(gc_shared);
@@ -1278,9 +1496,9 @@ static double sign(double x, double y)
 
 // TODO: update this
 /// Evaluates the function for root finding
-double ConstraintStabilization::eval_unilateral(double t, unsigned i, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+double ConstraintStabilization::eval_unilateral(double t, unsigned i, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim, Island& island)
 {
-  static VectorNd qstar;
+  VectorNd qstar;
   std::vector<double> uC;
 
   // setup qstar
@@ -1289,18 +1507,18 @@ double ConstraintStabilization::eval_unilateral(double t, unsigned i, const Vect
   qstar += q; 
 
   // update body configurations
-  update_body_configurations(qstar, sim);
+  update_body_configurations(qstar, island);
 
   // compute new pairwise distance information
-  evaluate_unilateral_constraints(sim, uC); 
+  evaluate_unilateral_constraints(sim, island, uC); 
 
   return uC[i];
 }
 
 /// Evaluates the function for root finding
-double ConstraintStabilization::eval_bilateral(double t, unsigned i, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+double ConstraintStabilization::eval_bilateral(double t, unsigned i, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim, Island& island)
 {
-  static VectorNd qstar;
+  VectorNd qstar;
   std::vector<double> C;
 
   // setup qstar
@@ -1309,17 +1527,17 @@ double ConstraintStabilization::eval_bilateral(double t, unsigned i, const Vecto
   qstar += q; 
 
   // update body configurations
-  update_body_configurations(qstar, sim);
+  update_body_configurations(qstar, island);
 
   // compute new constraint evaluations
-  evaluate_bilateral_constraints(sim, C); 
+  evaluate_bilateral_constraints(island, C); 
 
   return C[i];
 }
 
 
 /// Ridders method for root finding
-double ConstraintStabilization::ridders_unilateral(double x1, double x2, double fl, double fh, unsigned idx, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+double ConstraintStabilization::ridders_unilateral(double x1, double x2, double fl, double fh, unsigned idx, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim, Island& island)
 {
   const unsigned MAX_ITERATIONS = 25;
   const double TOL = 1e-4;
@@ -1333,13 +1551,13 @@ double ConstraintStabilization::ridders_unilateral(double x1, double x2, double
     for (unsigned j=0;j< MAX_ITERATIONS;j++) 
     { 
       xm=0.5*(xl+xh);
-      fm=eval_unilateral(xm, idx, dq, q, sim); // First of two function evaluations per iteration
+      fm=eval_unilateral(xm, idx, dq, q, sim, island); // First of two function evaluations per iteration
       s=std::sqrt(fm*fm-fl*fh); 
       if (s == 0.0) 
         return ans;
       xnew=xm+(xm-xl)*((fl >= fh ? 1.0 : -1.0)*fm/s); // Updating formula
       ans=xnew;
-      fnew=eval_unilateral(ans, idx, dq, q, sim);
+      fnew=eval_unilateral(ans, idx, dq, q, sim, island);
       if (std::fabs(fnew) < TOL && fnew >= 0.0)
         return xnew;
       if (sign(fm,fnew) != fm) 
@@ -1379,7 +1597,7 @@ double ConstraintStabilization::ridders_unilateral(double x1, double x2, double
 }
 
 /// Ridders method for root finding
-double ConstraintStabilization::ridders_bilateral(double x1, double x2, double fl, double fh, unsigned idx, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim)
+double ConstraintStabilization::ridders_bilateral(double x1, double x2, double fl, double fh, unsigned idx, const VectorNd& dq, const VectorNd& q, shared_ptr<ConstraintSimulator> sim, Island& island)
 {
   const unsigned MAX_ITERATIONS = 25;
   const double TOL = 1e-6;
@@ -1393,13 +1611,13 @@ double ConstraintStabilization::ridders_bilateral(double x1, double x2, double f
     for (unsigned j=0;j< MAX_ITERATIONS;j++) 
     { 
       xm=0.5*(xl+xh);
-      fm=eval_bilateral(xm, idx, dq, q, sim); // First of two function evaluations per iteration
+      fm=eval_bilateral(xm, idx, dq, q, sim, island); // First of two function evaluations per iteration
       s=std::sqrt(fm*fm-fl*fh); 
       if (s == 0.0) 
         return ans;
       xnew=xm+(xm-xl)*((fl >= fh ? 1.0 : -1.0)*fm/s); // Updating formula
       ans=xnew;
-      fnew=eval_bilateral(ans, idx, dq, q, sim);
+      fnew=eval_bilateral(ans, idx, dq, q, sim, island);
       if (std::fabs(fnew) < TOL)
         return ans; 
       if (sign(fm,fnew) != fm) 
@@ -36,6 +36,7 @@ using std::endl;
 /// Constructs a cylinder centered at the origin, with the longitudinal axis aligned with the y-axis, radius 1.0, height 1.0, 10 circle points, and 2 rings
 CylinderPrimitive::CylinderPrimitive()
 {
+  _type = eCylinder;
   _radius = 1.0;
   _height = 1.0;
   _npoints = 10;
@@ -46,6 +47,7 @@ CylinderPrimitive::CylinderPrimitive()
 /// Constructs a cylinder along the y-axis with specified radius and height, centered at the origin, with 10 circle points and 2 rings
 CylinderPrimitive::CylinderPrimitive(double radius, double height)
 {
+  _type = eCylinder;
   if (height < (double) 0.0)
     throw std::runtime_error("Attempting to set negative height in CylinderPrimitive (constructor)");
   if (radius < (double) 0.0)
@@ -61,6 +63,7 @@ CylinderPrimitive::CylinderPrimitive(double radius, double height)
 /// Constructs a cylinder along the y-axis with specified radius and height, centered at the origin, with 10 circle points and 2 rings
 CylinderPrimitive::CylinderPrimitive(double radius, double height, const Pose3d& T) : Primitive(T)
 {
+  _type = eCylinder;
   if (height < (double) 0.0)
     throw std::runtime_error("Attempting to set negative height in CylinderPrimitive (constructor)");
   if (radius < (double) 0.0)
@@ -76,6 +79,7 @@ CylinderPrimitive::CylinderPrimitive(double radius, double height, const Pose3d&
 /// Constructs a cylinder along the y-axis and centered at the origin with specified, radius, height, number of points and number of rings
 CylinderPrimitive::CylinderPrimitive(double radius, double height, unsigned n, unsigned nrings, const Pose3d& T) : Primitive(T)
 {
+  _type = eCylinder;
   if (height < (double) 0.0)
     throw std::runtime_error("Attempting to set negative height in CylinderPrimitive (constructor)");
   if (radius < (double) 0.0)
@@ -307,8 +307,11 @@ double EventDrivenSimulator::step(double step_size)
 {
   const double INF = std::numeric_limits<double>::max();
 
-  // determine the set of collision geometries
+  // determine the set of collision geometries; the transform snapshot taken
+  // during the step is invalidated on return, since bodies may be moved 
+  // before the next step
   determine_geometries();
+  CollisionDetection::SnapshotGuard snapshot_guard(_coldet);
 
   // clear one-step visualization data
   #ifdef USE_OSG
@@ -4,6 +4,7 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 
+#include <algorithm>
 #include <Moby/Tetrahedron.h>
 #include <Moby/Triangle.h>
 #include <Moby/CompGeom.h>
@@ -12,9 +13,67 @@
 #include <Moby/GJK.h>
 
 using boost::shared_ptr;
+using std::vector;
+using std::map;
+using std::pair;
 using namespace Ravelin;
 using namespace Moby;
 
+// static members
+void (*GJK::stats_callback_fn)(const GJK::Stats&) = NULL;
+map<GJK::PosePair, vector<Vector3d> > GJK::_cache;
+const unsigned GJK::MIN_CACHE_PURGE_SIZE;
+unsigned GJK::_cache_purge_size = GJK::MIN_CACHE_PURGE_SIZE;
+
+/// Clears the cache of simplices used to warm start queries
+void GJK::clear_cache()
+{
+  #ifdef _OPENMP
+  #pragma omp critical (GJK_cache)
+  #endif
+  {
+    _cache.clear();
+    _cache_purge_size = MIN_CACHE_PURGE_SIZE;
+  }
+}
+
+/// Stores the support directions of the final simplex for a pair of poses
+/**
+ * Entries for poses that have been destroyed are removed whenever the cache
+ * has doubled in size since they were last removed, so that the cache does
+ * not grow without bound as geometries are created and destroyed.
+ */
+void GJK::store_cache(const PosePair& key, const vector<Vector3d>& dirs)
+{
+  #ifdef _OPENMP
+  #pragma omp critical (GJK_cache)
+  #endif
+  {
+    _cache[key] = dirs;
+    if (_cache.size() >= _cache_purge_size)
+    {
+      for (map<PosePair, vector<Vector3d> >::iterator i = _cache.begin(); i != _cache.end(); )
+      {
+        if (i->first.first.expired() || i->first.second.expired())
+          _cache.erase(i++);
+        else
+          i++;
+      }
+      _cache_purge_size = std::max(MIN_CACHE_PURGE_SIZE, (unsigned) _cache.size()*2);
+    }
+  }
+}
+
+/// Computes the vertex of the Minkowski difference A - B that supports direction -d
+GJK::SVertex GJK::calc_support(shared_ptr<const Primitive> A, shared_ptr<const Primitive> B, shared_ptr<const Pose3d> PA, shared_ptr<const Pose3d> PB, const Vector3d& d)
+{
+  Point3d pA = A->get_supporting_point(-Pose3d::transform_vector(PA, d));
+  Point3d pB = B->get_supporting_point(Pose3d::transform_vector(PB, d)); 
+  SVertex V(pA, pB);
+  V.dir = d;
+  return V;
+}
+
 std::ostream& GJK::SVertex::output(std::ostream& out) const
 {
   out << " " << v << std::endl;
@@ -379,7 +438,7 @@ void GJK::Simplex::add(const SVertex& v)
       _type = eTriangle;
     else if (vol < 0)
     {
-      std::swap(_v2.v, _v3.v);
+      std::swap(_v2, _v3);
       assert(Tetrahedron(_v1.v, _v2.v, _v3.v, _v4.v).calc_volume() > 0.0);
     }
   }
@@ -509,32 +568,69 @@ double GJK::do_gjk(CollisionGeometryPtr A, CollisionGeometryPtr B, Point3d& clos
 */
 
 /// Does GJK using primitives and poses defined in collision geometry frames
+/**
+ * \return the signed distance between the two primitives; if the primitives
+ *         are intersecting, the negation of the penetration depth (computed
+ *         using EPA), in which case cpA and cpB are set to the deepest points
+ */
 double GJK::do_gjk(shared_ptr<const Primitive> A, shared_ptr<const Primitive> B, shared_ptr<const Pose3d> PA, shared_ptr<const Pose3d> PB, Point3d& closestA, Point3d& closestB, unsigned max_iter)
 {
   const double INF = std::numeric_limits<double>::max();
+  vector<Vector3d> dirs;
+  Stats stats;
+  stats.gjk_iterations = 0;
+  stats.epa_iterations = 0;
+  stats.intersecting = false;
+
+  // get the support directions from the last query on this pair, if any
+  const PosePair key(PA, PB);
+  #ifdef _OPENMP
+  #pragma omp critical (GJK_cache)
+  #endif
+  {
+    map<PosePair, vector<Vector3d> >::const_iterator cache_iter = _cache.find(key);
+    if (cache_iter != _cache.end())
+      dirs = cache_iter->second;
+  }
+  stats.warm_started = !dirs.empty();
 
-  // setup a random direction
-  Point3d rdir((double) rand() / RAND_MAX * 2.0 - 1.0,(double) rand() / RAND_MAX * 2.0 - 1.0, (double) rand() / RAND_MAX * 2.0 - 1.0, GLOBAL);
-  Point3d pA = A->get_supporting_point(-Pose3d::transform_vector(PA, rdir));
-  Point3d pB = B->get_supporting_point(Pose3d::transform_vector(PB, rdir)); 
+  // setup a random direction if there is no cached simplex 
+  if (dirs.empty())
+  {
+    Vector3d rdir((double) rand() / RAND_MAX * 2.0 - 1.0,(double) rand() / RAND_MAX * 2.0 - 1.0, (double) rand() / RAND_MAX * 2.0 - 1.0, GLOBAL);
+    dirs.push_back(rdir);
+  }
 
-  // setup the initial support (a point)
-  SVertex p(pA, pB);
-  Simplex S = p;
+  // setup the initial simplex, re-evaluating the supports in the cached 
+  // directions at the current poses and skipping duplicate vertices
+  Simplex S = calc_support(A, B, PA, PB, dirs.front());
+  for (unsigned i=1; i< dirs.size(); i++)
+  {
+    SVertex V = calc_support(A, B, PA, PB, dirs[i]);
+    bool duplicate = false;
+    for (unsigned j=0; j< S.num_vertices() && !duplicate; j++)
+      duplicate = ((V.v - S.get_vertex(j).v).norm() < NEAR_ZERO);
+    if (!duplicate)
+      S.add(V);
+  }
   if (LOGGING(LOG_COLDET))
   {
     std::ostringstream oss;
     S.output(oss); 
     FILE_LOG(LOG_COLDET) << "GJK::do_gjk() entered" << std::endl;
-    FILE_LOG(LOG_COLDET) << " -- initial simplex: " << oss.str() << std::endl;
+    FILE_LOG(LOG_COLDET) << " -- initial simplex (warm started? " << stats.warm_started << "): " << oss.str() << std::endl;
   }
 
   // setup the minimum dot
   double min_dist = std::numeric_limits<double>::max();
+  double dist = INF;
+  bool done = false;
 
   // GJK loop
-  for (unsigned i=0; i< max_iter; i++)
+  for (unsigned i=0; i< max_iter && !done; i++)
   {
+    stats.gjk_iterations++;
+
     // find the closest point in the simplex to the origin
     Point3d p = S.find_closest_and_simplify();
     if (LOGGING(LOG_COLDET))
@@ -552,53 +648,294 @@ double GJK::do_gjk(shared_ptr<const Primitive> A, shared_ptr<const Primitive> B,
     {
       FILE_LOG(LOG_COLDET) << "GJK::do_gjk() shapes are intersecting"  << std::endl;
 
-      // A and B are intersecting, do not attempt to determine interpenetrating
-      // distance
-      return -1.0;
+      // A and B are intersecting; determine the interpenetration distance
+      // using the boundary of the Minkowski difference 
+      stats.intersecting = true;
+      vector<SVertex> verts;
+      for (unsigned j=0; j< S.num_vertices(); j++)
+        verts.push_back(S.get_vertex(j));
+      dist = -do_epa(A, B, PA, PB, verts, closestA, closestB, max_iter, stats.epa_iterations);
+      done = true;
     }
     // look for no progress
     else if (pnorm > min_dist-NEAR_ZERO)
     {
       FILE_LOG(LOG_COLDET) << "GJK::do_gjk() unable to progress!"  << std::endl;
-      return pnorm;
+      dist = pnorm;
+      done = true;
     }
-
-    // get the new supporting points and determine the new vertex
-    Point3d pA = A->get_supporting_point(-Pose3d::transform_vector(PA, p));
-    Point3d pB = B->get_supporting_point(Pose3d::transform_vector(PB, p)); 
-    SVertex V(pA, pB);
-    if (LOGGING(LOG_COLDET))
+    else
     {
-      std::ostringstream oss;
-      V.output(oss); 
-      FILE_LOG(LOG_COLDET) << " -- new vertex: " << oss.str() << std::endl;
+      // get the new supporting points and determine the new vertex
+      SVertex V = calc_support(A, B, PA, PB, p);
+      if (LOGGING(LOG_COLDET))
+      {
+        std::ostringstream oss;
+        V.output(oss); 
+        FILE_LOG(LOG_COLDET) << " -- new vertex: " << oss.str() << std::endl;
+      }
+
+      // get the minimum distance  
+      min_dist = std::min(min_dist, pnorm);
+
+      // look to see whether no intersection
+      double vdotd = V.v.dot(-p);
+      FILE_LOG(LOG_COLDET) << " -- <new vertex, direction> : " << vdotd << std::endl;
+      if (vdotd < 0.0)
+      {
+        FILE_LOG(LOG_COLDET) << "GJK::do_gjk() dist=" << min_dist << ", exiting" << std::endl;
+        dist = min_dist;
+        done = true;
+      }
+      else
+      {
+        // add the new vertex to the simplex
+        S.add(V);
+        if (LOGGING(LOG_COLDET))
+        {
+          std::ostringstream oss;
+          S.output(oss); 
+          FILE_LOG(LOG_COLDET) << "GJK::do_gjk() added new point to simplex, now: " << oss.str() << std::endl;
+        }
+      }
     }
+  }
 
-    // get the minimum distance  
-    min_dist = std::min(min_dist, pnorm);
+  if (!done)
+    throw std::runtime_error("maximum GJK iterations exceeded");
 
-    // look to see whether no intersection
-    double vdotd = V.v.dot(-p);
-    FILE_LOG(LOG_COLDET) << " -- <new vertex, direction> : " << vdotd << std::endl;
-    if (vdotd < 0.0)
+  // cache the support directions of the final simplex
+  dirs.clear();
+  for (unsigned i=0; i< S.num_vertices(); i++)
+    dirs.push_back(S.get_vertex(i).dir);
+  store_cache(key, dirs);
+
+  // report statistics
+  report(stats);
+
+  return dist;
+}
+
+/// Sets up a face of the EPA polytope
+/**
+ * \return false if the face is degenerate
+ */
+bool GJK::make_face(const vector<SVertex>& verts, unsigned a, unsigned b, unsigned c, EPAFace& face)
+{
+  face.a = a;
+  face.b = b;
+  face.c = c;
+  face.n = Vector3d::cross(verts[b].v - verts[a].v, verts[c].v - verts[a].v);
+  double nrm = face.n.norm();
+  if (nrm < NEAR_ZERO)
+    return false;
+  face.n /= nrm;
+  face.dist = face.n.dot(verts[a].v);
+  return true;
+}
+
+/// Computes the penetration depth of two intersecting primitives using the expanding polytope algorithm 
+/**
+ * \param verts the vertices of the GJK simplex containing the origin; the
+ *        vertices of the final polytope on return
+ * \param cpA the deepest point on A (in A's frame) on return 
+ * \param cpB the deepest point on B (in B's frame) on return 
+ * \param iter the number of EPA iterations on return
+ * \return the (nonnegative) penetration depth
+ */
+double GJK::do_epa(shared_ptr<const Primitive> A, shared_ptr<const Primitive> B, shared_ptr<const Pose3d> PA, shared_ptr<const Pose3d> PB, vector<SVertex>& verts, Point3d& cpA, Point3d& cpB, unsigned max_iter, unsigned& iter)
+{
+  const double INF = std::numeric_limits<double>::max();
+  const unsigned X = 0, Y = 1, Z = 2;
+  vector<EPAFace> faces;
+  vector<pair<unsigned, unsigned> > horizon;
+  iter = 0;
+
+  FILE_LOG(LOG_COLDET) << "GJK::do_epa() entered" << std::endl;
+
+  // expand the simplex to a tetrahedron; each vertex added must increase the
+  // dimension of the simplex
+  while (verts.size() < 4)
+  {
+    // setup candidate directions
+    vector<Vector3d> cands;
+    if (verts.size() == 1)
     {
-      FILE_LOG(LOG_COLDET) << "GJK::do_gjk() dist=" << min_dist << ", exiting" << std::endl;
-      return min_dist;
+      for (unsigned k=0; k< 6; k++)
+      {
+        Vector3d axis(0.0, 0.0, 0.0, GLOBAL);
+        axis[k/2] = (k % 2 == 0) ? 1.0 : -1.0;
+        cands.push_back(axis);
+      }
+    }
+    else if (verts.size() == 2)
+    {
+      // get directions orthogonal to the segment
+      Vector3d d = verts[1].v - verts[0].v;
+      unsigned min_idx = X;
+      if (std::fabs(d[Y]) < std::fabs(d[min_idx]))
+        min_idx = Y;
+      if (std::fabs(d[Z]) < std::fabs(d[min_idx]))
+        min_idx = Z;
+      Vector3d axis(0.0, 0.0, 0.0, GLOBAL);
+      axis[min_idx] = 1.0;
+      Vector3d n1 = Vector3d::normalize(Vector3d::cross(d, axis));
+      Vector3d n2 = Vector3d::normalize(Vector3d::cross(d, n1));
+      cands.push_back(n1);
+      cands.push_back(-n1);
+      cands.push_back(n2);
+      cands.push_back(-n2);
     }
     else
     {
-      // add the new vertex to the simplex
-      S.add(V);
-      if (LOGGING(LOG_COLDET))
+      // get the normals to the triangle
+      Vector3d n = Vector3d::normalize(Vector3d::cross(verts[1].v - verts[0].v, verts[2].v - verts[0].v));
+      cands.push_back(n);
+      cands.push_back(-n);
+    }
+
+    // try the candidates
+    bool expanded = false;
+    for (unsigned j=0; j< cands.size() && !expanded; j++)
+    {
+      // get the support of A - B in the candidate direction
+      SVertex V = calc_support(A, B, PA, PB, -cands[j]);
+
+      // compute the distance of the vertex from the affine hull of the simplex 
+      Vector3d w = V.v - verts[0].v;
+      double hull_dist;
+      if (verts.size() == 1)
+        hull_dist = w.norm();
+      else if (verts.size() == 2)
       {
-        std::ostringstream oss;
-        S.output(oss); 
-        FILE_LOG(LOG_COLDET) << "GJK::do_gjk() added new point to simplex, now: " << oss.str() << std::endl;
+        Vector3d d = verts[1].v - verts[0].v;
+        hull_dist = Vector3d::cross(w, d).norm()/d.norm();
+      }
+      else
+        hull_dist = std::fabs(cands.front().dot(w));
+      if (hull_dist > NEAR_ZERO)
+      {
+        verts.push_back(V);
+        expanded = true;
       }
     }
+
+    // quit if the simplex could not be expanded 
+    if (!expanded)
+      break;
   }
 
-  throw std::runtime_error("maximum GJK iterations exceeded");
-  return min_dist;
-}
+  // if the simplex could not be expanded, the shapes are just touching 
+  if (verts.size() < 4)
+  {
+    FILE_LOG(LOG_COLDET) << "GJK::do_epa() unable to expand simplex; shapes are touching" << std::endl;
+    cpA = verts.front().vA;
+    cpB = verts.front().vB;
+    return 0.0;
+  }
+
+  // setup the faces of the tetrahedron, oriented to point outward
+  const unsigned TETRA_FACES[4][4] = { {0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0} };
+  for (unsigned i=0; i< 4; i++)
+  {
+    EPAFace f;
+    if (!make_face(verts, TETRA_FACES[i][0], TETRA_FACES[i][1], TETRA_FACES[i][2], f))
+      continue;
+    if (f.n.dot(verts[TETRA_FACES[i][3]].v - verts[f.a].v) > 0.0)
+      make_face(verts, f.a, f.c, f.b, f);
+    faces.push_back(f);
+  }
 
+  // expand the polytope
+  unsigned closest = 0;
+  while (!faces.empty() && iter < max_iter)
+  {
+    iter++;
+
+    // find the face closest to the origin
+    closest = 0;
+    for (unsigned i=1; i< faces.size(); i++)
+      if (faces[i].dist < faces[closest].dist)
+        closest = i;
+    const EPAFace& f = faces[closest];
+
+    // get the support of A - B in the direction of the face normal 
+    SVertex V = calc_support(A, B, PA, PB, -f.n);
+    double vdist = f.n.dot(V.v);
+    FILE_LOG(LOG_COLDET) << "GJK::do_epa() iteration: " << iter << " face distance: " << f.dist << " support distance: " << vdist << std::endl;
+
+    // see whether the boundary of the Minkowski difference has been reached 
+    if (vdist - f.dist < NEAR_ZERO*std::max((double) 1.0, f.dist))
+      break;
+
+    // remove all faces visible from the new vertex, recording horizon edges
+    verts.push_back(V);
+    const unsigned vidx = verts.size() - 1;
+    horizon.clear();
+    for (unsigned i=0; i< faces.size(); )
+    {
+      if (faces[i].n.dot(V.v - verts[faces[i].a].v) > 0.0)
+      {
+        const unsigned edges[3][2] = { {faces[i].a, faces[i].b}, {faces[i].b, faces[i].c}, {faces[i].c, faces[i].a} };
+        for (unsigned j=0; j< 3; j++)
+        {
+          // an edge shared by two visible faces is not on the horizon
+          vector<pair<unsigned, unsigned> >::iterator e = std::find(horizon.begin(), horizon.end(), std::make_pair(edges[j][1], edges[j][0]));
+          if (e != horizon.end())
+            horizon.erase(e);
+          else
+            horizon.push_back(std::make_pair(edges[j][0], edges[j][1]));
+        }
+        faces[i] = faces.back();
+        faces.pop_back();
+      }
+      else
+        i++;
+    }
+
+    // add faces connecting the horizon to the new vertex
+    for (unsigned i=0; i< horizon.size(); i++)
+    {
+      EPAFace fnew;
+      if (make_face(verts, horizon[i].first, horizon[i].second, vidx, fnew))
+        faces.push_back(fnew);
+    }
+  }
+
+  // if the polytope degenerated, the shapes are just touching
+  if (faces.empty())
+  {
+    FILE_LOG(LOG_COLDET) << "GJK::do_epa() polytope degenerated" << std::endl;
+    cpA = verts.front().vA;
+    cpB = verts.front().vB;
+    return 0.0;
+  }
+
+  // find the face closest to the origin (may have changed if the iteration
+  // limit was reached)
+  closest = 0;
+  for (unsigned i=1; i< faces.size(); i++)
+    if (faces[i].dist < faces[closest].dist)
+      closest = i;
+  const EPAFace& f = faces[closest];
+
+  // compute the barycentric coordinates of the projection of the origin 
+  // onto the closest face
+  Vector3d p = f.n * f.dist;
+  Vector3d v0 = verts[f.b].v - verts[f.a].v;
+  Vector3d v1 = verts[f.c].v - verts[f.a].v;
+  Vector3d v2 = p - verts[f.a].v;
+  double d00 = v0.dot(v0), d01 = v0.dot(v1), d11 = v1.dot(v1);
+  double d20 = v2.dot(v0), d21 = v2.dot(v1);
+  double denom = d00*d11 - d01*d01;
+  double lb = (std::fabs(denom) > 0.0) ? (d11*d20 - d01*d21)/denom : 0.0;
+  double lc = (std::fabs(denom) > 0.0) ? (d00*d21 - d01*d20)/denom : 0.0;
+  double la = 1.0 - lb - lc;
+
+  // compute the deepest points on A and B
+  cpA = verts[f.a].vA*la + verts[f.b].vA*lb + verts[f.c].vA*lc;
+  cpB = verts[f.a].vB*la + verts[f.b].vB*lb + verts[f.c].vB*lc;
+  FILE_LOG(LOG_COLDET) << "GJK::do_epa() penetration depth: " << f.dist << " after " << iter << " iterations" << std::endl;
+
+  return std::max(f.dist, 0.0);
+}
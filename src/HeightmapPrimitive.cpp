@@ -12,7 +12,7 @@
 #include <osg/Material>
 #include <osg/LightModel>
 #endif
-#include <boost/algorithm/minmax_element.hpp>
+#include <algorithm>
 #include <Moby/Constants.h>
 #include <Moby/CompGeom.h>
 #include <Ravelin/sorted_pair>
@@ -36,12 +36,14 @@ using std::make_pair;
 /// Initializes the heightmap primitive
 HeightmapPrimitive::HeightmapPrimitive()
 {
+  _type = eHeightmap;
   _width = _depth = 0.0;
 }
 
 /// Initializes the heightmap primitive
 HeightmapPrimitive::HeightmapPrimitive(const Ravelin::Pose3d& T) : Primitive(T)
 {
+  _type = eHeightmap;
   _width = _depth = 0.0;
 }
 
@@ -85,10 +87,9 @@ BVPtr HeightmapPrimitive::get_BVH_root(CollisionGeometryPtr geom)
     // setup the translation for the OBB
     obb->center.set_zero(P);
 
-    // get the maximum and minimum height
-    pair<ColumnIteratord, ColumnIteratord> mmax = boost::minmax_element(_heights.column_iterator_begin(), _heights.column_iterator_end());
-    double maxy = *mmax.second;
-    double miny = *mmax.first;
+    // get the maximum and minimum height (available without loading tiles)
+    double maxy = _tiles.get_max_height();
+    double miny = _tiles.get_min_height();
     obb->center[Y] = (maxy+miny)*0.5;
 
     // setup obb dimensions
@@ -110,34 +111,106 @@ shared_ptr<const IndexedTriArray> HeightmapPrimitive::get_mesh(shared_ptr<const
 }
 
 /// Gets the vertices of the heightmap that could intersect with a given bounding volume
-void HeightmapPrimitive::get_vertices(BVPtr bv, shared_ptr<const Pose3d> P, vector<Point3d>& vertices) const
+/**
+ * \param tol vertices within this distance of the bounding volume are also
+ *        returned
+ */
+void HeightmapPrimitive::get_vertices(BVPtr bv, shared_ptr<const Pose3d> P, vector<Point3d>& vertices, double tol) const
 {
   assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
-  const unsigned X = 0, Z = 2;
+  const unsigned X = 0, Y = 1, Z = 2;
+  const double INF = std::numeric_limits<double>::max();
 
-  // clear the vector of vertices
-  vertices.clear();
+  // get the corners of the bounding box in the frame of the bounding volume
+  Point3d lo = bv->get_lower_bounds();
+  Point3d hi = bv->get_upper_bounds();
 
-  // get the corners of the bounding box in this frame
-  Point3d bv_lo = bv->get_lower_bounds();
-  Point3d bv_hi = bv->get_lower_bounds();
+  // compute the bounds of the box in this frame
+  Point3d bv_lo(-INF, -INF, -INF, P);
+  Point3d bv_hi(INF, INF, INF, P);
+  if (std::fabs(lo[X]) < INF && std::fabs(lo[Y]) < INF && std::fabs(lo[Z]) < INF &&
+      std::fabs(hi[X]) < INF && std::fabs(hi[Y]) < INF && std::fabs(hi[Z]) < INF)
+  {
+    bv_lo = Point3d(INF, INF, INF, P);
+    bv_hi = Point3d(-INF, -INF, -INF, P);
+    for (unsigned i=0; i< 8; i++)
+    {
+      Point3d corner((i & 1) ? hi[X] : lo[X], (i & 2) ? hi[Y] : lo[Y], (i & 4) ? hi[Z] : lo[Z], lo.pose);
+      Point3d c = Pose3d::transform_point(P, corner);
+      for (unsigned j=0; j< 3; j++)
+      {
+        bv_lo[j] = std::min(bv_lo[j], c[j] - tol);
+        bv_hi[j] = std::max(bv_hi[j], c[j] + tol);
+      }
+    }
+  }
 
-  // get the lower i and j indices
-  unsigned lowi = (unsigned) ((bv_lo[X]+_width*0.5)*(_heights.rows()-1)/_width);
-  unsigned lowj = (unsigned) ((bv_lo[Z]+_depth*0.5)*(_heights.columns()-1)/_depth);
+  // get the vertices in the box
+  get_vertices(bv_lo, bv_hi, vertices);
+}
 
-  // get the upper i and j indices
-  unsigned upi = (unsigned) ((bv_hi[X]+_width*0.5)*(_heights.rows()-1)/_width)+1;
-  unsigned upj = (unsigned) ((bv_hi[Z]+_depth*0.5)*(_heights.columns()-1)/_depth)+1;
+// computes the range of sample indices covering [lo, hi] along one dimension
+static void calc_index_range(double lo, double hi, double size, unsigned n, unsigned& low, unsigned& up)
+{
+  const double MAXI = (double) (n-1);
+  low = (unsigned) std::min(std::max((lo+size*0.5)*MAXI/size, 0.0), MAXI);
+  up = (unsigned) std::min(std::max((hi+size*0.5)*MAXI/size + 1.0, 0.0), MAXI);
+}
 
-  // iterate over all points
-  for (unsigned i=lowi; i<= upi; i++)
-    for (unsigned j=lowj; j< upj; j++)
+/// Visits heightmap samples, collecting those with heights in a given range
+class HeightRangeVisitor
+{
+  public:
+    HeightRangeVisitor(const HeightmapTiles& tiles, double width, double depth, double miny, double maxy, shared_ptr<const Pose3d> P, vector<Point3d>& vertices) : _tiles(tiles), _vertices(vertices)
     {
-      double x = -_width*0.5+_width*i/(_heights.rows()-1);
-      double z = -_depth*0.5+_depth*j/(_heights.columns()-1);
-      vertices.push_back(Point3d(x, _heights(i,j), z, P));
+      _width = width;
+      _depth = depth;
+      _miny = miny;
+      _maxy = maxy;
+      _P = P;
     }
+
+    bool cull(double min_height, double max_height) const { return max_height < _miny || min_height > _maxy; }
+
+    void operator()(unsigned i, unsigned j, double height)
+    {
+      if (height < _miny || height > _maxy)
+        return;
+      double x = -_width*0.5+_width*i/(_tiles.rows()-1);
+      double z = -_depth*0.5+_depth*j/(_tiles.columns()-1);
+      _vertices.push_back(Point3d(x, height, z, _P));
+    }
+
+  private:
+    const HeightmapTiles& _tiles;
+    double _width, _depth, _miny, _maxy;
+    shared_ptr<const Pose3d> _P;
+    vector<Point3d>& _vertices;
+};
+
+/// Gets the vertices of the heightmap that lie within an axis-aligned box
+/**
+ * \param lo the lower corner of the box (in a heightmap pose)
+ * \param hi the upper corner of the box (in the same pose)
+ * \param vertices the vertices, on return (in the pose of the box)
+ */
+void HeightmapPrimitive::get_vertices(const Point3d& lo, const Point3d& hi, vector<Point3d>& vertices) const
+{
+  const unsigned X = 0, Y = 1, Z = 2;
+
+  // clear the vector of vertices
+  vertices.clear();
+  if (_tiles.rows() < 2 || _tiles.columns() < 2)
+    return;
+
+  // get the range of indices covering the box
+  unsigned lowi, upi, lowj, upj;
+  calc_index_range(lo[X], hi[X], _width, _tiles.rows(), lowi, upi);
+  calc_index_range(lo[Z], hi[Z], _depth, _tiles.columns(), lowj, upj);
+
+  // descend the quadtrees, culling samples outside of the box's height range
+  HeightRangeVisitor visitor(_tiles, _width, _depth, lo[Y], hi[Y], lo.pose, vertices);
+  _tiles.visit_samples(lowi, upi, lowj, upj, visitor);
 }
 
 /// Gets the vertices of the heightmap
@@ -149,17 +222,24 @@ void HeightmapPrimitive::get_vertices(shared_ptr<const Pose3d> P, vector<Point3d
   vertices.clear();
 
   // iterate over all points
-  for (unsigned i=0; i< _heights.rows(); i++)
-    for (unsigned j=0; j< _heights.columns(); j++)
+  for (unsigned i=0; i< _tiles.rows(); i++)
+    for (unsigned j=0; j< _tiles.columns(); j++)
     {
-      double x = -_width*0.5+_width*i/(_heights.rows()-1);
-      double z = -_depth*0.5+_depth*j/(_heights.columns()-1);
-      vertices.push_back(Point3d(x, _heights(i,j), z, P));
+      double x = -_width*0.5+_width*i/(_tiles.rows()-1);
+      double z = -_depth*0.5+_depth*j/(_tiles.columns()-1);
+      vertices.push_back(Point3d(x, _tiles.get_height(i,j), z, P));
     }
 }
 
-unsigned constrain_unsigned(int ii, int maxi){
-  return (unsigned) std::min(std::max(ii,0),maxi);
+// locates a coordinate within the grid of samples along one dimension,
+// giving the index of the cell containing it and the fractional position
+// within the cell (coordinates beyond the heightmap are clamped to it)
+static void locate_sample(double q, double half_size, double scale, unsigned n, unsigned& i, double& s)
+{
+  const double MAXU = (double) (n-1);
+  double u = std::min(std::max((q + half_size)*scale, 0.0), MAXU);
+  i = std::min((unsigned) u, n-2);
+  s = u - i;
 }
 
 /// Computes the height at a particular point
@@ -168,31 +248,69 @@ double HeightmapPrimitive::calc_height(const Point3d& p) const
   assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end());
   const unsigned X = 0, Y = 1, Z = 2;
 
-  // get the X and Z query points
-  const unsigned qx = p[X];
-  const unsigned qz = p[Z];
+  // use the batch method for a single point
+  const double x = p[X], y = p[Y], z = p[Z];
+  double height;
+  calc_height_batch(&x, &y, &z, 1, &height);
+  return height;
+}
 
-  // determine the indices 
-  unsigned i = constrain_unsigned((qx+_width*0.5)*(_heights.rows()-1)/_width,_heights.rows()-1);
-  unsigned j = constrain_unsigned((qz+_depth*0.5)*(_heights.columns()-1)/_depth,_heights.columns()-1);
-  
-  // setup inputs
-  double x0 = -_width*0.5+_width*i/(_heights.rows()-1);
-  double z0 = -_depth*0.5+_depth*j/(_heights.columns()-1);
-  double x1 = -_width*0.5+_width*(i+1)/(_heights.rows()-1);
-  double z1 = -_depth*0.5+_depth*(j+1)/(_heights.columns()-1);
+/// Computes the heights of a batch of points above the heightmap
+/**
+ * Heights are bilinearly interpolated between samples.
+ * \param x the x coordinates of the n points (in a pose of this primitive)
+ * \param y the y coordinates of the n points
+ * \param z the z coordinates of the n points
+ * \param n the number of points
+ * \param height the n heights, on return (must not overlap the coordinates)
+ */
+void HeightmapPrimitive::calc_height_batch(const double* x, const double* y, const double* z, unsigned n, double* __restrict height) const
+{
+  const unsigned ROWS = _tiles.rows(), COLUMNS = _tiles.columns();
 
-  // compute s and t
-  double s = qx/(x1 - x0);
-  double t = qz/(z1 - z0); 
+  // a heightmap needs at least two samples along each dimension
+  if (ROWS < 2 || COLUMNS < 2)
+  {
+    const double H = _tiles.get_height(0,0);
+    for (unsigned k=0; k< n; k++)
+      height[k] = y[k] - H;
+    return;
+  }
 
-  // get four height values
-  const double f00 = _heights(i,j);
-  const double f10 = _heights(i+1,j);
-  const double f01 = _heights(i,j+1);
-  const double f11 = _heights(i+1,j+1);
+  // setup the mapping from coordinates to samples
+  const double HALF_WIDTH = _width*0.5, HALF_DEPTH = _depth*0.5;
+  const double SCALE_X = (ROWS-1)/_width, SCALE_Z = (COLUMNS-1)/_depth;
+  const double MAX_U = ROWS-1, MAX_V = COLUMNS-1;
+  const int MAX_I = ROWS-2, MAX_J = COLUMNS-2;
+  const HeightmapTiles::Sampler F = _tiles.get_sampler();
+
+  // the loop has no branches or divisions and gathers the samples through
+  // shifts and masks, so that the compiler can vectorize it (this also
+  // requires the heights not to alias the samples); coordinates beyond the
+  // heightmap, and NaN coordinates, are clamped to it
+  for (unsigned k=0; k< n; k++)
+  {
+    // locate the point in the grid
+    const double U = std::min(std::max(0.0, (x[k] + HALF_WIDTH)*SCALE_X), MAX_U);
+    const double V = std::min(std::max(0.0, (z[k] + HALF_DEPTH)*SCALE_Z), MAX_V);
+    const int i = std::min((int) U, MAX_I);
+    const int j = std::min((int) V, MAX_J);
+    const double s = U - i, t = V - j;
+
+    // interpolate the four surrounding samples
+    const double f00 = F(i,j), f10 = F(i+1,j), f01 = F(i,j+1), f11 = F(i+1,j+1);
+    height[k] = y[k] - ((f00*(1.0-s) + f10*s)*(1.0-t) + (f01*(1.0-s) + f11*s)*t);
+  }
+}
 
-  return p[Y] - f00*(1.0-s)*(1.0-t) + f10*s*(1.0-t) + f01*(1.0-s)*t + f11*s*t;
+/// Computes the signed distances of a batch of points from the heightmap
+/**
+ * \see Primitive::calc_signed_dist_batch()
+ */
+void HeightmapPrimitive::calc_signed_dist_batch(shared_ptr<const Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const
+{
+  assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
+  calc_height_batch(x, y, z, n, dist);
 }
 
 /// Computes the gradient at a particular point
@@ -200,36 +318,31 @@ void HeightmapPrimitive::calc_gradient(const Point3d& p, double& gx, double& gz)
 {
   assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end());
   const unsigned X = 0, Z = 2;
+  const unsigned ROWS = _tiles.rows(), COLUMNS = _tiles.columns();
 
-  // get the X and Z query points
-  const unsigned qx = p[X];
-  const unsigned qz = p[Z];
-
-  // determine the indices 
-  unsigned i = constrain_unsigned(qx*(_heights.rows()-1)/_width + _width*0.5,_heights.rows()-1);
-  unsigned j = constrain_unsigned(qz*(_heights.columns()-1)/_depth + _depth*0.5,_heights.columns()-1);
-
-  // setup inputs
-  double x0 = -_width*0.5+_width*i/(_heights.rows()-1);
-  double z0 = -_depth*0.5+_depth*j/(_heights.columns()-1);
-  double x1 = -_width*0.5+_width*(i+1)/(_heights.rows()-1);
-  double z1 = -_depth*0.5+_depth*(j+1)/(_heights.columns()-1);
+  // a heightmap needs at least two samples along each dimension
+  gx = gz = 0.0;
+  if (ROWS < 2 || COLUMNS < 2)
+    return;
 
-  // compute s and t
-  double s = qx/(x1 - x0);
-  double t = qz/(z1 - z0); 
+  // locate the point in the grid
+  const double SCALE_X = (ROWS-1)/_width, SCALE_Z = (COLUMNS-1)/_depth;
+  unsigned i, j;
+  double s, t;
+  locate_sample(p[X], _width*0.5, SCALE_X, ROWS, i, s);
+  locate_sample(p[Z], _depth*0.5, SCALE_Z, COLUMNS, j, t);
 
   // get four height values
-  const double f00 = _heights(i,j);
-  const double f10 = _heights(i+1,j);
-  const double f01 = _heights(i,j+1);
-  const double f11 = _heights(i+1,j+1);
+  const double f00 = _tiles.get_height(i,j);
+  const double f10 = _tiles.get_height(i+1,j);
+  const double f01 = _tiles.get_height(i,j+1);
+  const double f11 = _tiles.get_height(i+1,j+1);
 
   // compute the x gradient
-  gx = f10*(1.0-t) + f11*t;
+  gx = ((f10 - f00)*(1.0-t) + (f11 - f01)*t)*SCALE_X;
 
   // compute the z gradient
-  gz = f01*(1.0-s) + f11*s;
+  gz = ((f01 - f00)*(1.0-s) + (f11 - f10)*s)*SCALE_Z;
 }
 
 static void perturb_color(float color[3])
@@ -308,9 +421,9 @@ osg::Node* HeightmapPrimitive::create_visualization()
 
   // create the faces - we're going to iterate over every grouping of four
   // points
-  const unsigned COLS = _heights.columns();
-  for (unsigned i=0; i< _heights.rows()-1; i++)
-    for (unsigned j=0; j< _heights.columns()-1; j++)
+  const unsigned COLS = _tiles.columns();
+  for (unsigned i=0; i< _tiles.rows()-1; i++)
+    for (unsigned j=0; j< _tiles.columns()-1; j++)
     {
       // get the four indices
       const unsigned V1 =  i*COLS+j; // i, j
@@ -339,12 +452,64 @@ osg::Node* HeightmapPrimitive::create_visualization()
   #endif 
 }
 
+/// Visits heightmap samples, finding the sample closest to a sphere
+class SphereDistVisitor
+{
+  public:
+    SphereDistVisitor(const HeightmapTiles& tiles, double width, double depth, shared_ptr<const SpherePrimitive> s, shared_ptr<const Pose3d> P, shared_ptr<const Pose3d> Ps, double center_y, double& min_dist, Point3d& closest) : _tiles(tiles), _min_dist(min_dist), _closest(closest)
+    {
+      _width = width;
+      _depth = depth;
+      _s = s;
+      _P = P;
+      _Ps = Ps;
+      _center_y = center_y;
+    }
+
+    // samples can be no closer to the sphere than the vertical distance from
+    // its center to their heights
+    bool cull(double min_height, double max_height) const
+    {
+      double ydist = std::max(0.0, std::max(_center_y - max_height, min_height - _center_y));
+      return ydist - _s->get_radius() >= _min_dist;
+    }
+
+    void operator()(unsigned i, unsigned j, double height)
+    {
+      // compute the point on the heightmap
+      double x = -_width*0.5+_width*i/(_tiles.rows()-1);
+      double z = -_depth*0.5+_depth*j/(_tiles.columns()-1);
+      FILE_LOG(LOG_COLDET) << "p = (" << x << "," << z << "," << height << ")" << std::endl;
+      FILE_LOG(LOG_COLDET) << "pi = (" << i << "," << j << "," << height << ")" << std::endl;
+      Point3d p(x, height, z, _P);
+      Point3d ps_prime = Pose3d::transform_point(_Ps, p);
+
+      // get the distance from the sphere
+      double dist = _s->calc_signed_dist(ps_prime);
+
+      // see how the distance compares
+      if (dist < _min_dist)
+      {
+        _min_dist = dist;
+        _closest = ps_prime;
+      }
+    }
+
+  private:
+    const HeightmapTiles& _tiles;
+    double _width, _depth, _center_y;
+    shared_ptr<const SpherePrimitive> _s;
+    shared_ptr<const Pose3d> _P, _Ps;
+    double& _min_dist;
+    Point3d& _closest;
+};
+
 /// Computes the distance from a sphere primitive
 double HeightmapPrimitive::calc_signed_dist(shared_ptr<const SpherePrimitive> s, Point3d& pthis, Point3d& ps) const
 {
 
   FILE_LOG(LOG_COLDET) << "HeightmapPrimitive::calc_signed_dist() - computing signed distance "  << std::endl;
-  const unsigned X = 0, Z = 2;
+  const unsigned X = 0, Y = 1, Z = 2;
   assert(_poses.find(const_pointer_cast<Pose3d>(pthis.pose)) != _poses.end());
   Point3d ps_prime = ps;
 
@@ -374,41 +539,24 @@ double HeightmapPrimitive::calc_signed_dist(shared_ptr<const SpherePrimitive> s,
   bv_lo[Z] -= s->get_radius();
   bv_hi[Z] += s->get_radius();
 
-  // get the lower i and j indices
-  unsigned lowi = constrain_unsigned((bv_lo[X]+_width*0.5)*(_heights.rows()-1)/_width,_heights.rows()-1);
-  unsigned lowj = constrain_unsigned((bv_lo[Z]+_depth*0.5)*(_heights.columns()-1)/_depth,_heights.columns()-1);
+  // a heightmap needs at least two samples along each dimension
+  if (_tiles.rows() < 2 || _tiles.columns() < 2)
+    return min_dist;
 
-  // get the upper i and j indices
-  unsigned upi = constrain_unsigned(((bv_hi[X]+_width*0.5)*(_heights.rows()-1)/_width)+1,_heights.rows()-1);
-  unsigned upj = constrain_unsigned(((bv_hi[Z]+_depth*0.5)*(_heights.columns()-1)/_depth)+1,_heights.columns()-1);
+  // get the range of indices covering the bounding region
+  unsigned lowi, upi, lowj, upj;
+  calc_index_range(bv_lo[X], bv_hi[X], _width, _tiles.rows(), lowi, upi);
+  calc_index_range(bv_lo[Z], bv_hi[Z], _depth, _tiles.columns(), lowj, upj);
 
   FILE_LOG(LOG_COLDET) << "i = [" << lowi << ":" << upi << "]" << std::endl;
   FILE_LOG(LOG_COLDET) << "j = [" << lowj << ":" << upj << "]" << std::endl;
-  // iterate over all points in the bounding region
   FILE_LOG(LOG_COLDET) << "size = (" << _width << "," << _depth << ")" << std::endl;
-  FILE_LOG(LOG_COLDET) << "sizei = (" << _heights.rows() << "," << _heights.columns() << ")" << std::endl;
+  FILE_LOG(LOG_COLDET) << "sizei = (" << _tiles.rows() << "," << _tiles.columns() << ")" << std::endl;
 
-  for (unsigned i=lowi; i<= upi &&  i < _heights.rows(); i++)
-    for (unsigned j=lowj; j<= upj && j < _heights.columns(); j++)
-    {
-      // compute the point on the heightmap
-      double x = -_width*0.5+_width*i/(_heights.rows()-1);
-      double z = -_depth*0.5+_depth*j/(_heights.columns()-1);
-      FILE_LOG(LOG_COLDET) << "p = (" << x << "," << z << "," << _heights(i,j) << ")" << std::endl;
-      FILE_LOG(LOG_COLDET) << "pi = (" << i << "," << j << "," << _heights(i,j) << ")" << std::endl;
-      Point3d p(x, _heights(i,j), z, pthis.pose);
-      Point3d ps_prime = Pose3d::transform_point(ps.pose, p);
-
-      // get the distance from the sphere
-      double dist = s->calc_signed_dist(ps_prime);
-
-      // see how the distance compares
-      if (dist < min_dist)
-      {
-        min_dist = dist;
-        ps = ps_prime;
-      }
-    }
+  // descend the quadtrees over the bounding region, culling samples that
+  // cannot be closer than the closest sample found so far
+  SphereDistVisitor visitor(_tiles, _width, _depth, s, pthis.pose, ps.pose, ps_c_this[Y], min_dist, ps);
+  _tiles.visit_samples(lowi, upi, lowj, upj, visitor);
 
   FILE_LOG(LOG_COLDET) << "min_dist "  << min_dist << std::endl;
   return min_dist;
@@ -475,7 +623,7 @@ double HeightmapPrimitive::calc_dist_and_normal(const Point3d& p, std::vector<Ve
   {
     double gx, gz;
     calc_gradient(p, gx, gz);
-    normal = Vector3d::normalize(Vector3d(gx, 1, gz, p.pose));
+    normal = Vector3d::normalize(Vector3d(-gx, 1, -gz, p.pose));
   }
   else
     normal = Vector3d(0.0, 1.0, 0.0, p.pose);
@@ -493,26 +641,63 @@ void HeightmapPrimitive::load_from_xml(shared_ptr<const XMLTree> node, std::map<
   // load the parent data
   Primitive::load_from_xml(node, id_map);
 
+  // read in the tile size used for text heightmaps, if specified
+  unsigned tile_size = HeightmapTiles::DEFAULT_TILE_SIZE;
+  XMLAttrib* tile_size_attr = node->get_attrib("tile-size");
+  if (tile_size_attr)
+    tile_size = tile_size_attr->get_unsigned_value();
+
+  // read in the maximum number of resident tiles, if specified
+  XMLAttrib* resident_attr = node->get_attrib("max-resident-tiles");
+  if (resident_attr)
+    _tiles.set_max_resident_tiles(resident_attr->get_unsigned_value());
+
   // read in the height map
   XMLAttrib* file_attr = node->get_attrib("filename");
   if (file_attr)
   {
-    std::ifstream in(file_attr->get_string_value().c_str());
-    if (!in.fail())
+    // setup the file extension for binary tiled heightmaps
+    const char* HMT_EXT = ".hmt";
+
+    // get the lowercase version of the filename
+    std::string fname = file_attr->get_string_value();
+    std::string fname_lower = fname;
+    std::transform(fname_lower.begin(), fname_lower.end(), fname_lower.begin(), ::tolower);
+
+    // binary tiled heightmaps are memory-mapped; text heightmaps are read
+    // and tiled in memory
+    if (fname_lower.size() >= strlen(HMT_EXT) && fname_lower.find(HMT_EXT) == fname_lower.size() - strlen(HMT_EXT))
     {
-      unsigned rows, cols;
-      in >> rows;
-      in >> cols;
-      _heights.resize(rows, cols);
-      for (unsigned i=0; i< rows; i++)
-        for (unsigned j=0; j< cols; j++)
-          in >> _heights(i,j);
-      in.close();
+      if (!_tiles.open(fname))
+      {
+        std::cerr << "HeightmapPrimitive::load_from_xml() - unable to read heightmap!" << std::endl;
+        MatrixNd heights;
+        heights.set_zero(1,1);
+        _tiles.set_heights(heights);
+      }
     }
     else
     {
-      std::cerr << "HeightmapPrimitive::load_from_xml() - unable to read heightmap!" << std::endl;
-      _heights.set_zero(1,1);
+      std::ifstream in(fname.c_str());
+      if (!in.fail())
+      {
+        unsigned rows, cols;
+        in >> rows;
+        in >> cols;
+        MatrixNd heights(rows, cols);
+        for (unsigned i=0; i< rows; i++)
+          for (unsigned j=0; j< cols; j++)
+            in >> heights(i,j);
+        in.close();
+        _tiles.set_heights(heights, tile_size);
+      }
+      else
+      {
+        std::cerr << "HeightmapPrimitive::load_from_xml() - unable to read heightmap!" << std::endl;
+        MatrixNd heights;
+        heights.set_zero(1,1);
+        _tiles.set_heights(heights);
+      }
     }
   }
 
@@ -542,27 +727,21 @@ void HeightmapPrimitive::save_to_xml(XMLTreePtr node, std::list<shared_ptr<const
   // save the depth 
   node->attribs.insert(XMLAttrib("depth", _depth));
 
-  // write out the height map
+  // save the maximum number of resident tiles
+  node->attribs.insert(XMLAttrib("max-resident-tiles", _tiles.get_max_resident_tiles()));
+
+  // write out the height map (as a binary tiled heightmap)
   const unsigned MAX_DIGITS = 28;
   char buffer[MAX_DIGITS+1];
   sprintf(buffer, "%p", this);
-  std::string filename = "heightmap" + std::string(buffer) + ".dat";
+  std::string filename = "heightmap" + std::string(buffer) + ".hmt";
 
   // add the filename as an attribute
   node->attribs.insert(XMLAttrib("filename", filename));
 
   // write the heightmap
-  std::ofstream out(filename.c_str());
-  if (out.fail())
-  {
+  if (!_tiles.write(filename))
     std::cerr << "HeightmapPrimitive::save_to_xml() - unexpectedly unable to write heightmap!" << std::endl;
-    return;
-  }
-  out << _heights.rows() << " " << _heights.columns() << std::endl;
-  for (unsigned i=0; i< _heights.rows(); i++)
-    for (unsigned j=0; j< _heights.columns(); j++)
-      out << _heights(i,j);
-  out.close();
 }
 
 
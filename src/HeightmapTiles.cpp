@@ -0,0 +1,440 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <boost/cstdint.hpp>
+#include <Moby/Constants.h>
+#include <Moby/Log.h>
+#include <Moby/HeightmapTiles.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using boost::uint32_t;
+using boost::uint64_t;
+using std::string;
+using std::vector;
+using std::endl;
+
+// identifies a tiled heightmap file and its format version
+static const char MAGIC[8] = { 'M', 'O', 'B', 'Y', 'H', 'M', 'A', 'P' };
+static const uint32_t VERSION = 1;
+
+// identifies the byte order of the machine that wrote the file
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// size of the file header (magic, version, byte order mark, rows, columns,
+// tile size, padding, and the offset to the samples)
+static const size_t HEADER_SIZE = 40;
+
+// the samples in the file begin on a boundary of this size, so that tiles
+// can be released page by page
+static const size_t DATA_ALIGNMENT = 4096;
+
+/// Creates an empty heightmap
+HeightmapTiles::HeightmapTiles()
+{
+  _rows = _columns = 0;
+  _tile_rows = _tile_columns = 0;
+  _tile_size = DEFAULT_TILE_SIZE;
+  _tile_shift = 0;
+  _levels = 0;
+  _data = NULL;
+  _mapping = NULL;
+  _mapping_size = 0;
+  _max_resident_tiles = DEFAULT_MAX_RESIDENT_TILES;
+  _clock = 0;
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+HeightmapTiles::~HeightmapTiles()
+{
+  close();
+  pthread_mutex_destroy(&_mutex);
+}
+
+/// Releases the heights
+void HeightmapTiles::close()
+{
+  if (_mapping)
+    munmap(_mapping, _mapping_size);
+  _mapping = NULL;
+  _mapping_size = 0;
+  _data = NULL;
+  _storage.clear();
+  _tiles.clear();
+  _resident.clear();
+  _tile_min.clear();
+  _tile_max.clear();
+  _rows = _columns = 0;
+  _tile_rows = _tile_columns = 0;
+  _levels = 0;
+}
+
+/// Locks the tiles against loading, pinning, and eviction by other threads
+void HeightmapTiles::lock() const
+{
+  pthread_mutex_lock(&_mutex);
+}
+
+/// Unlocks the tiles
+void HeightmapTiles::unlock() const
+{
+  pthread_mutex_unlock(&_mutex);
+}
+
+/// Sets up the tile dimensions for a heightmap of the given size
+/**
+ * \param tile_size the requested tile size, which is rounded up to a power
+ *        of two and clamped to MAX_TILE_SIZE
+ */
+void HeightmapTiles::setup_tiles(unsigned rows, unsigned columns, unsigned tile_size)
+{
+  // the quadtree requires the tile size to be a power of two multiple of the
+  // leaf size
+  const unsigned MAX_SIZE = MAX_TILE_SIZE;
+  _tile_size = LEAF_SIZE;
+  while (_tile_size < std::min(tile_size, MAX_SIZE))
+    _tile_size *= 2;
+  for (_tile_shift = 0; (1u << _tile_shift) < _tile_size; _tile_shift++);
+
+  // compute the number of quadtree levels
+  _levels = 1;
+  for (unsigned size = _tile_size; size > LEAF_SIZE; size /= 2)
+    _levels++;
+
+  // setup the number of tiles
+  _rows = rows;
+  _columns = columns;
+  _tile_rows = (unsigned) (((unsigned long long) rows + _tile_size - 1)/_tile_size);
+  _tile_columns = (unsigned) (((unsigned long long) columns + _tile_size - 1)/_tile_size);
+  const unsigned NTILES = _tile_rows*_tile_columns;
+  _tiles.clear();
+  _tiles.resize(NTILES);
+  _resident.clear();
+  _tile_min.resize(NTILES);
+  _tile_max.resize(NTILES);
+}
+
+/// Sets the heights from a dense matrix, holding them in memory
+/**
+ * \param heights the heights, indexed by row (x) and column (z)
+ * \param tile_size the number of samples along each side of a tile (this
+ *        is rounded up to a power of two and clamped to MAX_TILE_SIZE)
+ */
+void HeightmapTiles::set_heights(const MatrixNd& heights, unsigned tile_size)
+{
+  // release any existing heights
+  close();
+
+  // setup the tiles
+  setup_tiles(heights.rows(), heights.columns(), tile_size);
+  const unsigned S = _tile_size;
+  _storage.resize((size_t) _tiles.size()*S*S, 0.0);
+  _data = (_storage.empty()) ? NULL : &_storage.front();
+
+  // copy the heights into the tiles and compute the bounds of each tile
+  for (unsigned ti=0; ti< _tile_rows; ti++)
+    for (unsigned tj=0; tj< _tile_columns; tj++)
+    {
+      const unsigned T = ti*_tile_columns + tj;
+      double* data = &_storage[(size_t) T*S*S];
+      _tile_min[T] = std::numeric_limits<double>::max();
+      _tile_max[T] = -std::numeric_limits<double>::max();
+      for (unsigned i=ti*S; i< std::min(_rows, (ti+1)*S); i++)
+        for (unsigned j=tj*S; j< std::min(_columns, (tj+1)*S); j++)
+        {
+          const double H = heights(i,j);
+          data[(i-ti*S)*S + (j-tj*S)] = H;
+          _tile_min[T] = std::min(_tile_min[T], H);
+          _tile_max[T] = std::max(_tile_max[T], H);
+        }
+    }
+}
+
+/// Sets the maximum number of resident tiles (zero indicates no limit)
+void HeightmapTiles::set_max_resident_tiles(unsigned n)
+{
+  lock();
+  _max_resident_tiles = n;
+  while (_max_resident_tiles > 0 && _resident.size() > _max_resident_tiles && evict_lru_tile());
+  unlock();
+}
+
+/// Gets the height of a sample
+/**
+ * Indices beyond the heightmap are clamped to its boundary.
+ */
+double HeightmapTiles::get_height(unsigned i, unsigned j) const
+{
+  if (_rows == 0 || _columns == 0)
+    return 0.0;
+  return get_sampler()(std::min(i, _rows-1), std::min(j, _columns-1));
+}
+
+/// Makes a tile resident (building its quadtree), evicting the least recently used tile if necessary
+/**
+ * \note the caller must hold the lock
+ */
+const HeightmapTiles::Tile& HeightmapTiles::load_tile(unsigned t) const
+{
+  Tile& tile = _tiles[t];
+  tile.last_used = ++_clock;
+  if (!tile.min_height.empty())
+    return tile;
+
+  // evict the least recently used tile, if necessary
+  if (_max_resident_tiles > 0 && _resident.size() >= _max_resident_tiles)
+    evict_lru_tile();
+
+  FILE_LOG(LOG_COLDET) << "HeightmapTiles::load_tile() - loading tile " << t << endl;
+
+  // get the samples of the tile that lie within the heightmap
+  const unsigned S = _tile_size;
+  const unsigned TI = t / _tile_columns, TJ = t % _tile_columns;
+  const unsigned VALID_ROWS = std::min(S, _rows - TI*S);
+  const unsigned VALID_COLUMNS = std::min(S, _columns - TJ*S);
+  const double* data = get_tile_data(t);
+
+  // allocate the quadtree
+  const unsigned NNODES = node_index(_levels, 0, 0);
+  tile.min_height.resize(NNODES, std::numeric_limits<double>::max());
+  tile.max_height.resize(NNODES, -std::numeric_limits<double>::max());
+
+  // compute the bounds of the leaves
+  const unsigned LEAVES = 1u << (_levels-1);
+  for (unsigned a=0; a< LEAVES; a++)
+    for (unsigned b=0; b< LEAVES; b++)
+    {
+      const unsigned NODE = node_index(_levels-1, a, b);
+      for (unsigned i=a*LEAF_SIZE; i< std::min(VALID_ROWS, (a+1)*LEAF_SIZE); i++)
+        for (unsigned j=b*LEAF_SIZE; j< std::min(VALID_COLUMNS, (b+1)*LEAF_SIZE); j++)
+        {
+          tile.min_height[NODE] = std::min(tile.min_height[NODE], data[i*S+j]);
+          tile.max_height[NODE] = std::max(tile.max_height[NODE], data[i*S+j]);
+        }
+    }
+
+  // compute the bounds of the internal nodes from their children
+  for (unsigned level = _levels-1; level > 0; level--)
+  {
+    const unsigned N = 1u << (level-1);
+    for (unsigned a=0; a< N; a++)
+      for (unsigned b=0; b< N; b++)
+      {
+        const unsigned NODE = node_index(level-1, a, b);
+        for (unsigned c=0; c< 4; c++)
+        {
+          const unsigned CHILD = node_index(level, 2*a + c/2, 2*b + c%2);
+          tile.min_height[NODE] = std::min(tile.min_height[NODE], tile.min_height[CHILD]);
+          tile.max_height[NODE] = std::max(tile.max_height[NODE], tile.max_height[CHILD]);
+        }
+      }
+  }
+
+  _resident.push_back(t);
+  return tile;
+}
+
+/// Loads a tile (if necessary) and pins it, so that it is not evicted until unpin_tile() is called
+const HeightmapTiles::Tile& HeightmapTiles::pin_tile(unsigned t) const
+{
+  lock();
+  const Tile& tile = load_tile(t);
+  _tiles[t].pins++;
+  unlock();
+  return tile;
+}
+
+/// Unpins a tile pinned by pin_tile()
+/**
+ * Tiles that could not be evicted while pinned are evicted once the number
+ * of resident tiles exceeds the limit.
+ */
+void HeightmapTiles::unpin_tile(unsigned t) const
+{
+  lock();
+  _tiles[t].pins--;
+  while (_max_resident_tiles > 0 && _resident.size() > _max_resident_tiles && evict_lru_tile());
+  unlock();
+}
+
+/// Evicts the least recently used tile that is not pinned
+/**
+ * \note the caller must hold the lock
+ * \return <b>false</b> if every resident tile is pinned
+ */
+bool HeightmapTiles::evict_lru_tile() const
+{
+  bool found = false;
+  unsigned lru = 0;
+  for (unsigned i=0; i< _resident.size(); i++)
+  {
+    const unsigned T = _resident[i];
+    if (_tiles[T].pins == 0 && (!found || _tiles[T].last_used < _tiles[lru].last_used))
+    {
+      lru = T;
+      found = true;
+    }
+  }
+
+  if (found)
+    evict_tile(lru);
+  return found;
+}
+
+/// Evicts a tile, releasing its quadtree and (for memory-mapped files) its samples
+/**
+ * \note the caller must hold the lock
+ */
+void HeightmapTiles::evict_tile(unsigned t) const
+{
+  FILE_LOG(LOG_COLDET) << "HeightmapTiles::evict_tile() - evicting tile " << t << endl;
+
+  // release the quadtree
+  std::vector<double>().swap(_tiles[t].min_height);
+  std::vector<double>().swap(_tiles[t].max_height);
+  _resident.erase(std::find(_resident.begin(), _resident.end(), t));
+
+  // release the pages holding the samples; the mapping is read-only, so the
+  // pages are read back from the file if the tile is needed again
+  if (_mapping)
+  {
+    const size_t PAGE_SIZE = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t BYTES = (size_t) _tile_size*_tile_size*sizeof(double);
+    size_t begin = (const char*) get_tile_data(t) - (const char*) _mapping;
+    size_t end = begin + BYTES;
+    begin = ((begin + PAGE_SIZE - 1)/PAGE_SIZE)*PAGE_SIZE;
+    end = (end/PAGE_SIZE)*PAGE_SIZE;
+    if (begin < end)
+      madvise((char*) _mapping + begin, end - begin, MADV_DONTNEED);
+  }
+}
+
+/// Opens a binary tiled heightmap file, memory-mapping its samples
+/**
+ * Tiles are read from the file only when they are queried.
+ * \return <b>true</b> if the file was opened successfully
+ */
+bool HeightmapTiles::open(const string& filename)
+{
+  // release any existing heights
+  close();
+
+  // map the file
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < HEADER_SIZE)
+  {
+    ::close(fd);
+    return false;
+  }
+  const size_t SIZE = (size_t) st.st_size;
+  void* addr = mmap(NULL, SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+  const char* bytes = (const char*) addr;
+
+  // read the header
+  uint32_t version, bom, rows, columns, tile_size;
+  uint64_t data_offset;
+  std::memcpy(&version, bytes + 8, sizeof(uint32_t));
+  std::memcpy(&bom, bytes + 12, sizeof(uint32_t));
+  std::memcpy(&rows, bytes + 16, sizeof(uint32_t));
+  std::memcpy(&columns, bytes + 20, sizeof(uint32_t));
+  std::memcpy(&tile_size, bytes + 24, sizeof(uint32_t));
+  std::memcpy(&data_offset, bytes + 32, sizeof(uint64_t));
+  if (std::memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || bom != BYTE_ORDER_MARK || tile_size < LEAF_SIZE || tile_size > MAX_TILE_SIZE || (tile_size & (tile_size-1)) != 0 || data_offset % sizeof(double) != 0)
+  {
+    FILE_LOG(LOG_COLDET) << "HeightmapTiles::open() - " << filename << " is not a tiled heightmap" << endl;
+    munmap(addr, SIZE);
+    return false;
+  }
+
+  // verify the size of the file before allocating any tiles
+  const uint64_t TILE_ROWS = ((uint64_t) rows + tile_size - 1)/tile_size;
+  const uint64_t TILE_COLUMNS = ((uint64_t) columns + tile_size - 1)/tile_size;
+  const uint64_t NTILES = TILE_ROWS*TILE_COLUMNS;
+  const uint64_t TILE_SAMPLES = (uint64_t) tile_size*tile_size;
+  if (NTILES > std::numeric_limits<unsigned>::max() || data_offset < HEADER_SIZE || data_offset > SIZE || (data_offset - HEADER_SIZE)/(2*sizeof(double)) < NTILES || (SIZE - data_offset)/sizeof(double)/TILE_SAMPLES < NTILES)
+  {
+    FILE_LOG(LOG_COLDET) << "HeightmapTiles::open() - " << filename << " is truncated" << endl;
+    munmap(addr, SIZE);
+    return false;
+  }
+  setup_tiles(rows, columns, tile_size);
+
+  // read the bounds of each tile
+  for (size_t i=0; i< NTILES; i++)
+  {
+    std::memcpy(&_tile_min[i], bytes + HEADER_SIZE + i*2*sizeof(double), sizeof(double));
+    std::memcpy(&_tile_max[i], bytes + HEADER_SIZE + (i*2+1)*sizeof(double), sizeof(double));
+  }
+
+  // the samples are used directly from the mapping
+  _mapping = addr;
+  _mapping_size = SIZE;
+  _data = (const double*) (bytes + data_offset);
+
+  return true;
+}
+
+/// Writes the heights to a binary tiled heightmap file
+/**
+ * \return <b>true</b> if the file was written successfully
+ */
+bool HeightmapTiles::write(const string& filename) const
+{
+  // setup the header
+  const size_t NTILES = _tiles.size();
+  const uint64_t DATA_OFFSET = ((HEADER_SIZE + NTILES*2*sizeof(double) + DATA_ALIGNMENT - 1)/DATA_ALIGNMENT)*DATA_ALIGNMENT;
+  vector<char> header(DATA_OFFSET, 0);
+  const uint32_t ROWS = _rows, COLUMNS = _columns, TILE_SIZE = _tile_size;
+  std::memcpy(&header[0], MAGIC, sizeof(MAGIC));
+  std::memcpy(&header[8], &VERSION, sizeof(uint32_t));
+  std::memcpy(&header[12], &BYTE_ORDER_MARK, sizeof(uint32_t));
+  std::memcpy(&header[16], &ROWS, sizeof(uint32_t));
+  std::memcpy(&header[20], &COLUMNS, sizeof(uint32_t));
+  std::memcpy(&header[24], &TILE_SIZE, sizeof(uint32_t));
+  std::memcpy(&header[32], &DATA_OFFSET, sizeof(uint64_t));
+  for (size_t i=0; i< NTILES; i++)
+  {
+    std::memcpy(&header[HEADER_SIZE + i*2*sizeof(double)], &_tile_min[i], sizeof(double));
+    std::memcpy(&header[HEADER_SIZE + (i*2+1)*sizeof(double)], &_tile_max[i], sizeof(double));
+  }
+
+  // write the file under a temporary name
+  char pid[32];
+  std::sprintf(pid, ".%d", (int) getpid());
+  string tmp_filename = filename + pid;
+  FILE* fp = std::fopen(tmp_filename.c_str(), "wb");
+  if (!fp)
+    return false;
+  const size_t NSAMPLES = NTILES*_tile_size*_tile_size;
+  bool written = (std::fwrite(&header.front(), 1, header.size(), fp) == header.size());
+  if (NSAMPLES > 0)
+    written = written && (std::fwrite(_data, sizeof(double), NSAMPLES, fp) == NSAMPLES);
+  written = (std::fclose(fp) == 0) && written;
+
+  // move it into place
+  if (!written || std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+  {
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
@@ -4,6 +4,9 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <iomanip>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/minmax_element.hpp>
@@ -48,6 +51,16 @@ ImpactConstraintHandler::ImpactConstraintHandler()
   ip_max_iterations = 100;
   ip_eps = 1e-6;
   use_ip_solver = false;
+  use_pgs_solver = false;
+  pgs_nncg = true;
+  pgs_max_iterations = 100;
+  pgs_eps = 1e-6;
+  warm_start = true;
+  warm_start_tol = 1e-2;
+  parallel_islands = false;
+
+  // setup the cache for warm starting
+  _cache = shared_ptr<WarmStartCache>(new WarmStartCache);
 
   // initialize IPOPT, if present
   #ifdef HAVE_IPOPT
@@ -81,9 +94,15 @@ void ImpactConstraintHandler::process_constraints(const vector<UnilateralConstra
   FILE_LOG(LOG_CONSTRAINT) << "*************************************************************";
   FILE_LOG(LOG_CONSTRAINT) << endl;
 
+  // mark a new call for the warm starting cache
+  _cache->call++;
+
   // apply the method to all contacts
   apply_model(constraints);
 
+  // remove cached data for constraints that no longer exist
+  purge_warm_start_cache();
+
   FILE_LOG(LOG_CONSTRAINT) << "*************************************************************" << endl;
   FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::process_constraints() exited" << endl;
   FILE_LOG(LOG_CONSTRAINT) << "*************************************************************" << endl;
@@ -110,45 +129,50 @@ void ImpactConstraintHandler::apply_model(const vector<UnilateralConstraint>& co
   // **********************************************************
   // do method for each connected set
   // **********************************************************
-  for (list<pair<list<UnilateralConstraint*>, list<shared_ptr<SingleBodyd> > > >::iterator i = groups.begin(); i != groups.end(); i++)
-  {
-      // copy the lists
-      pair<list<UnilateralConstraint*>, list<shared_ptr<SingleBodyd> > > rconstraints = *i;
-
-      FILE_LOG(LOG_CONSTRAINT) << " -- pre-constraint velocity (all constraints): " << std::endl;
-      for (list<UnilateralConstraint*>::iterator j = i->first.begin(); j != i->first.end(); j++)
-        FILE_LOG(LOG_CONSTRAINT) << "    constraint: " << std::endl << **j;
+  vector<ConstraintGroup*> group_vec;
+  for (list<ConstraintGroup>::iterator i = groups.begin(); i != groups.end(); i++)
+    group_vec.push_back(&*i);
+  const int NGROUPS = (int) group_vec.size();
 
-      // look to see whether all contact constraints have zero or infinite Coulomb friction
-      bool all_inf = true, all_frictionless = true;
-      BOOST_FOREACH(UnilateralConstraint* e, rconstraints.first)
-        if (e->constraint_type == UnilateralConstraint::eContact)
-        {
-          if (e->contact_mu_coulomb < 1e2)
-            all_inf = false;
-          if (e->contact_mu_coulomb > 0.0)
-            all_frictionless = false;
-        }
-
-      // apply model to the reduced contacts
-      if (all_inf)
-        apply_no_slip_model_to_connected_constraints(rconstraints.first, rconstraints.second);
-// TODO: fix viscous model- seems to be a bug in it
-//      else if (all_frictionless)
-//        apply_visc_friction_model_to_connected_constraints(rconstraints);
-  #ifdef USE_AP_MODEL
-      else {
-        apply_ap_model_to_connected_constraints(rconstraints.first, rconstraints.second);
+  #ifdef _OPENMP
+  if (parallel_islands && NGROUPS > 1)
+  {
+    // setup one solver context per thread
+    setup_island_handlers(omp_get_max_threads());
+
+    // groups share no bodies, so they can be solved independently; 
+    // exceptions may not leave the parallel region, so record them (note:
+    // vector<bool> is not safe for concurrent writes)
+    vector<std::string> errors(NGROUPS);
+    vector<unsigned char> failed(NGROUPS, 0);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i=0; i< NGROUPS; i++)
+    {
+      try
+      {
+        _island_handlers[omp_get_thread_num()]->apply_model_to_group(*group_vec[i]);
       }
-  #else
-      else
-        apply_model_to_connected_constraints(rconstraints.first, rconstraints.second);
-  #endif
+      catch (std::exception& e)
+      {
+        failed[i] = 1;
+        errors[i] = e.what();
+      }
+      catch (...)
+      {
+        failed[i] = 1;
+        errors[i] = "Unable to solve constraint problem!";
+      }
+    }
 
-      FILE_LOG(LOG_CONSTRAINT) << " -- post-constraint velocity (all constraints): " << std::endl;
-      for (list<UnilateralConstraint*>::iterator j = i->first.begin(); j != i->first.end(); j++)
-        FILE_LOG(LOG_CONSTRAINT) << "    constraint: " << std::endl << **j;
+    // report the first failure (in group order)
+    for (int i=0; i< NGROUPS; i++)
+      if (failed[i])
+        throw std::runtime_error(errors[i]);
   }
+  else
+  #endif
+  for (int i=0; i< NGROUPS; i++)
+    apply_model_to_group(*group_vec[i]);
 
   // setup amount of constraint violation
   double max_vio = std::numeric_limits<double>::max();
@@ -167,6 +191,91 @@ void ImpactConstraintHandler::apply_model(const vector<UnilateralConstraint>& co
     throw ImpactToleranceException(impacting, max_vio);
 }
 
+/// Applies the model to a single group of connected constraints
+void ImpactConstraintHandler::apply_model_to_group(const ConstraintGroup& group)
+{
+  // copy the lists
+  ConstraintGroup rconstraints = group;
+
+  FILE_LOG(LOG_CONSTRAINT) << " -- pre-constraint velocity (all constraints): " << std::endl;
+  for (list<UnilateralConstraint*>::const_iterator j = group.first.begin(); j != group.first.end(); j++)
+    FILE_LOG(LOG_CONSTRAINT) << "    constraint: " << std::endl << **j;
+
+  // look to see whether all contact constraints have zero or infinite Coulomb friction
+  bool all_inf = true, all_frictionless = true;
+  BOOST_FOREACH(UnilateralConstraint* e, rconstraints.first)
+    if (e->constraint_type == UnilateralConstraint::eContact)
+    {
+      if (e->contact_mu_coulomb < 1e2)
+        all_inf = false;
+      if (e->contact_mu_coulomb > 0.0)
+        all_frictionless = false;
+    }
+
+  // apply model to the reduced contacts
+  if (all_inf)
+    apply_no_slip_model_to_connected_constraints(rconstraints.first, rconstraints.second);
+// TODO: fix viscous model- seems to be a bug in it
+//  else if (all_frictionless)
+//    apply_visc_friction_model_to_connected_constraints(rconstraints);
+  else if (use_pgs_solver)
+    apply_pgs_model_to_connected_constraints(rconstraints.first, rconstraints.second);
+  #ifdef USE_AP_MODEL
+  else {
+    apply_ap_model_to_connected_constraints(rconstraints.first, rconstraints.second);
+  }
+  #else
+  else
+    apply_model_to_connected_constraints(rconstraints.first, rconstraints.second);
+  #endif
+
+  FILE_LOG(LOG_CONSTRAINT) << " -- post-constraint velocity (all constraints): " << std::endl;
+  for (list<UnilateralConstraint*>::const_iterator j = group.first.begin(); j != group.first.end(); j++)
+    FILE_LOG(LOG_CONSTRAINT) << "    constraint: " << std::endl << **j;
+}
+
+/// Gets the total number of LCP pivots (or iterations, for iterative solvers) performed by this handler and its solver contexts
+unsigned long ImpactConstraintHandler::get_lcp_pivots() const
+{
+  unsigned long pivots = _lcp.total_pivots;
+  for (unsigned i=0; i< _island_handlers.size(); i++)
+    if (_island_handlers[i])
+      pivots += _island_handlers[i]->get_lcp_pivots();
+  return pivots;
+}
+
+/// Sets up the solver contexts used for solving groups of constraints in parallel
+/**
+ * \param n the number of solver contexts (threads)
+ */
+void ImpactConstraintHandler::setup_island_handlers(unsigned n)
+{
+  if (_island_handlers.size() < n)
+    _island_handlers.resize(n);
+
+  for (unsigned i=0; i< n; i++)
+  {
+    // create the context if necessary
+    if (!_island_handlers[i])
+      _island_handlers[i] = shared_ptr<ImpactConstraintHandler>(new ImpactConstraintHandler);
+
+    // copy the parameters
+    ImpactConstraintHandler& h = *_island_handlers[i];
+    h._simulator = _simulator;
+    h.use_ip_solver = use_ip_solver;
+    h.ip_max_iterations = ip_max_iterations;
+    h.ip_eps = ip_eps;
+    h.use_pgs_solver = use_pgs_solver;
+    h.pgs_nncg = pgs_nncg;
+    h.pgs_max_iterations = pgs_max_iterations;
+    h.pgs_eps = pgs_eps;
+    h.warm_start = warm_start;
+    h.warm_start_tol = warm_start_tol;
+    h._cache = _cache;
+    h.parallel_islands = false;
+  }
+}
+
 /**
  * Applies purely viscous friction model to connected constraints
  * \param constraints a set of connected constraints
@@ -673,6 +782,13 @@ void ImpactConstraintHandler::propagate_impulse_data(const UnilateralConstraintP
 }
 
 /// Applies impulses to bodies
+/**
+ * Impulses on disabled bodies are not applied (they would have no effect).
+ * UnilateralConstraint::determine_connected_constraints() does not connect
+ * groups through disabled bodies, so a disabled body (e.g., the ground) may
+ * be in contact with every group; skipping it keeps groups processed in
+ * parallel from sharing any body.
+ */
 void ImpactConstraintHandler::apply_impulses(const UnilateralConstraintProblemData& q)
 {
   map<shared_ptr<DynamicBodyd>, VectorNd> gj;
@@ -694,21 +810,27 @@ void ImpactConstraintHandler::apply_impulses(const UnilateralConstraintProblemDa
     shared_ptr<DynamicBodyd> b2 = dynamic_pointer_cast<DynamicBodyd>(sb2->get_super_body());
 
     // convert force on first body to generalized forces
-    if ((gj_iter = gj.find(b1)) == gj.end())
-      b1->convert_to_generalized_force(sb1, w, gj[b1]);
-    else
+    if (sb1->is_enabled())
     {
-      b1->convert_to_generalized_force(sb1, w, _v);
-      gj_iter->second += _v;
+      if ((gj_iter = gj.find(b1)) == gj.end())
+        b1->convert_to_generalized_force(sb1, w, gj[b1]);
+      else
+      {
+        b1->convert_to_generalized_force(sb1, w, _v);
+        gj_iter->second += _v;
+      }
     }
 
     // convert force on second body to generalized forces
-    if ((gj_iter = gj.find(b2)) == gj.end())
-      b2->convert_to_generalized_force(sb2, -w, gj[b2]);
-    else
+    if (sb2->is_enabled())
     {
-      b2->convert_to_generalized_force(sb2, -w, _v);
-      gj_iter->second += _v;
+      if ((gj_iter = gj.find(b2)) == gj.end())
+        b2->convert_to_generalized_force(sb2, -w, gj[b2]);
+      else
+      {
+        b2->convert_to_generalized_force(sb2, -w, _v);
+        gj_iter->second += _v;
+      }
     }
   }
 
@@ -971,6 +1093,9 @@ void ImpactConstraintHandler::apply_visc_friction_model(UnilateralConstraintProb
   q.cs.negate();
   q.ct.negate();
 
+  // cache the impulses for warm starting
+  store_warm_start(q, q.cn, q.cs, q.ct, q.l, _empty);
+
   // setup a temporary frame
   shared_ptr<Pose3d> P(new Pose3d);
 
@@ -1235,7 +1360,12 @@ void ImpactConstraintHandler::apply_no_slip_model(UnilateralConstraintProblemDat
   // setup remainder of LCP vector
   _qq -= _workv;
 
+  // warm start using the impulses cached for matching constraints (a zero
+  // length vector cold starts the solvers)
+  get_normal_warm_start(q, _vwarm);
+
   // attempt to solve the LCP using the fast method
+  _v = _vwarm;
   if (!_lcp.lcp_fast(_MM, _qq, _v))
   {
     FILE_LOG(LOG_CONSTRAINT) << "Principal pivoting method LCP solver failed; falling back to slower solvers" << std::endl;
@@ -1248,6 +1378,8 @@ void ImpactConstraintHandler::apply_no_slip_model(UnilateralConstraintProblemDat
     A.set_zero(0, _qq.size());
     b.resize(0);
     (_workv2 = _qq).negate();
+    if ((_v = _vwarm).size() != _qq.size())
+      _v.set_zero(_qq.size());
     if (!_qp.qp_activeset(_MM, _workv, lb, ub, _MM, _workv2, A, b, _v))
     {
       FILE_LOG(LOG_CONSTRAINT) << "QP failed to find feasible point; finding closest feasible point" << std::endl;
@@ -1259,6 +1391,7 @@ void ImpactConstraintHandler::apply_no_slip_model(UnilateralConstraintProblemDat
         throw std::runtime_error("Unable to solve constraint LCP!");
 
       #else
+      _v = _vwarm;
       if (!_lcp.lcp_lemke_regularized(_MM, _qq, _v))
         throw std::runtime_error("Unable to solve constraint LCP!");
       #endif
@@ -1278,6 +1411,7 @@ void ImpactConstraintHandler::apply_no_slip_model(UnilateralConstraintProblemDat
       }
     }
     #else
+    _v = _vwarm;
     if (!_lcp.lcp_lemke_regularized(_MM, _qq, _v))
       throw std::runtime_error("Unable to solve constraint LCP!");
     #endif
@@ -1307,6 +1441,9 @@ void ImpactConstraintHandler::apply_no_slip_model(UnilateralConstraintProblemDat
   q.cs.set(S_indices.begin(), S_indices.end(), cs_vec);
   q.ct.set(T_indices.begin(), T_indices.end(), ct_vec);
 
+  // cache the impulses for warm starting
+  store_warm_start(q, q.cn, q.cs, q.ct, q.l, _empty);
+
   // setup a temporary frame
   shared_ptr<Pose3d> P(new Pose3d);
 
@@ -1509,9 +1646,16 @@ void ImpactConstraintHandler::solve_frictionless_lcp(UnilateralConstraintProblem
   FILE_LOG(LOG_CONSTRAINT) << "  LCP matrix: " << std::endl << _MM;
   FILE_LOG(LOG_CONSTRAINT) << "  LCP vector: " << _qq << std::endl;
 
-  // solve the LCP
-  if (!_lcp.lcp_fast(_MM, _qq, _v) && !_lcp.lcp_lemke_regularized(_MM, _qq, _v))
-    throw std::runtime_error("Unable to solve constraint LCP!");
+  // solve the LCP, warm starting using the impulses cached for matching
+  // constraints
+  get_normal_warm_start(q, _vwarm);
+  _v = _vwarm;
+  if (!_lcp.lcp_fast(_MM, _qq, _v))
+  {
+    _v = _vwarm;
+    if (!_lcp.lcp_lemke_regularized(_MM, _qq, _v))
+      throw std::runtime_error("Unable to solve constraint LCP!");
+  }
 
   // determine the value of kappa
   SharedConstVectorNd cn = _v.segment(0, q.N_CONTACTS);
@@ -1844,6 +1988,103 @@ void ImpactConstraintHandler::add_contact_to_Jacobian(const UnilateralConstraint
   add_contact_dir_to_Jacobian(rb2, su2, Ct, c.contact_point, -c.contact_tan2, gc_map, contact_idx);
 } 
 
+/// Determines the bodies that are coupled through implicit joint constraints (and hence through X)
+/**
+ * \param coupled on return, maps the starting generalized coordinate index 
+ *        of each (enabled) super body to the (starting index, number of 
+ *        generalized coordinates) of every body coupled to it, itself included
+ */
+void ImpactConstraintHandler::determine_coupled_bodies(const UnilateralConstraintProblemData& q, const map<shared_ptr<DynamicBodyd>, unsigned>& gc_map, map<unsigned, vector<pair<unsigned, unsigned> > >& coupled)
+{
+  // initially, every body is in its own component
+  map<shared_ptr<DynamicBodyd>, unsigned> component;
+  unsigned n_components = 0;
+  for (map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator i = gc_map.begin(); i != gc_map.end(); i++)
+    component[i->first] = n_components++;
+
+  // merge the components of bodies connected by implicit joints
+  for (unsigned i=0; i< q.island_ijoints.size(); i++)
+  {
+    shared_ptr<DynamicBodyd> in = q.island_ijoints[i]->get_inboard_link()->get_super_body();
+    shared_ptr<DynamicBodyd> out = q.island_ijoints[i]->get_outboard_link()->get_super_body();
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator in_iter = component.find(in);
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator out_iter = component.find(out);
+    if (in_iter == component.end() || out_iter == component.end())
+      continue;
+    const unsigned old_label = out_iter->second;
+    const unsigned new_label = in_iter->second;
+    if (old_label == new_label)
+      continue;
+    for (map<shared_ptr<DynamicBodyd>, unsigned>::iterator j = component.begin(); j != component.end(); j++)
+      if (j->second == old_label)
+        j->second = new_label;
+  }
+
+  // gather the members of each component
+  map<unsigned, vector<pair<unsigned, unsigned> > > members;
+  for (map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator i = component.begin(); i != component.end(); i++)
+  {
+    const unsigned NGC = i->first->num_generalized_coordinates(DynamicBodyd::eSpatial);
+    members[i->second].push_back(std::make_pair(gc_map.find(i->first)->second, NGC));
+  }
+
+  // setup the coupled bodies
+  coupled.clear();
+  for (map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator i = component.begin(); i != component.end(); i++)
+    coupled[gc_map.find(i->first)->second] = members[i->second];
+}
+
+/// Computes J*X as a sparse Jacobian, computing only the blocks for which X is nonzero 
+/**
+ * \param coupled the bodies coupled through X (see determine_coupled_bodies())
+ */
+void ImpactConstraintHandler::mult_block_sparse(const SparseJacobian& J, const MatrixNd& X, const map<unsigned, vector<pair<unsigned, unsigned> > >& coupled, SparseJacobian& JX)
+{
+  map<pair<unsigned, unsigned>, unsigned> block_index;
+  MatrixNd tmp;
+
+  // setup JX
+  JX.rows = J.rows;
+  JX.cols = J.cols;
+  JX.blocks.clear();
+
+  // loop over all blocks of J
+  for (unsigned i=0; i< J.blocks.size(); i++)
+  {
+    const MatrixBlock& Jb = J.blocks[i];
+    const unsigned C = Jb.columns();
+
+    // get the bodies coupled to the body of this block
+    map<unsigned, vector<pair<unsigned, unsigned> > >::const_iterator c = coupled.find(Jb.st_col_idx);
+    assert(c != coupled.end());
+
+    // compute the product with each nonzero block of X in these rows 
+    for (unsigned j=0; j< c->second.size(); j++)
+    {
+      const unsigned CSTART = c->second[j].first;
+      const unsigned NGC = c->second[j].second;
+      Jb.block.mult(X.block(Jb.st_col_idx, Jb.st_col_idx+C, CSTART, CSTART+NGC), tmp);
+
+      // accumulate into an existing block for these rows and columns, if any
+      pair<unsigned, unsigned> key(Jb.st_row_idx, CSTART);
+      map<pair<unsigned, unsigned>, unsigned>::const_iterator k = block_index.find(key);
+      if (k != block_index.end())
+      {
+        assert(JX.blocks[k->second].rows() == tmp.rows());
+        JX.blocks[k->second].block += tmp;
+      }
+      else
+      {
+        block_index[key] = JX.blocks.size();
+        JX.blocks.push_back(MatrixBlock());
+        JX.blocks.back().st_row_idx = Jb.st_row_idx;
+        JX.blocks.back().st_col_idx = CSTART;
+        JX.blocks.back().block = tmp;
+      }
+    }
+  }
+}
+
 void ImpactConstraintHandler::add_contact_dir_to_Jacobian(shared_ptr<RigidBodyd> rb, shared_ptr<ArticulatedBodyd> ab, SparseJacobian& C, const Vector3d& contact_point, const Vector3d& d, const std::map<shared_ptr<DynamicBodyd>, unsigned>& gc_map, unsigned contact_index)
 {
   const unsigned N_SPATIAL = 6;
@@ -2121,30 +2362,41 @@ void ImpactConstraintHandler::compute_problem_data(UnilateralConstraintProblemDa
   for (unsigned i=0; i< q.contact_constraints.size(); i++)
     add_contact_to_Jacobian(*q.contact_constraints[i], Cn, Cs, Ct, gc_map, i); 
 
-  // compute X_CnT, X_CsT, and X_CtT
-  Cn.mult(X, tmp);  MatrixNd::transpose(tmp, q.X_CnT);
-  Cs.mult(X, tmp);  MatrixNd::transpose(tmp, q.X_CsT);
-  Ct.mult(X, tmp);  MatrixNd::transpose(tmp, q.X_CtT);
+  // determine which bodies are coupled through X; X is zero everywhere else
+  map<unsigned, vector<pair<unsigned, unsigned> > > coupled;
+  determine_coupled_bodies(q, gc_map, coupled);
+
+  // compute Cn*X, Cs*X, and Ct*X, keeping only the nonzero blocks
+  SparseJacobian Cn_X, Cs_X, Ct_X;
+  mult_block_sparse(Cn, X, coupled, Cn_X);
+  mult_block_sparse(Cs, X, coupled, Cs_X);
+  mult_block_sparse(Ct, X, coupled, Ct_X);
+
+  // compute X_CnT, X_CsT, and X_CtT (X is symmetric)
+  Cn_X.to_dense(tmp);  MatrixNd::transpose(tmp, q.X_CnT);
+  Cs_X.to_dense(tmp);  MatrixNd::transpose(tmp, q.X_CsT);
+  Ct_X.to_dense(tmp);  MatrixNd::transpose(tmp, q.X_CtT);
   q.J.mult(X, tmp); MatrixNd::transpose(tmp, q.X_JxT);
   
   // compute limit components - must do this first
   compute_limit_components(X, q);
 
-  // compute problem data for Cn rows
-  Cn.mult(q.X_CnT, q.Cn_X_CnT); 
-  Cn.mult(q.X_CsT, q.Cn_X_CsT);  
-  Cn.mult(q.X_CtT, q.Cn_X_CtT);  
+  // compute problem data for Cn rows; only blocks of contacts that share 
+  // (coupled) bodies are computed
+  Cn_X.mult_transpose(Cn, q.Cn_X_CnT); 
+  Cn_X.mult_transpose(Cs, q.Cn_X_CsT);  
+  Cn_X.mult_transpose(Ct, q.Cn_X_CtT);  
   Cn.mult(q.X_LT,  q.Cn_X_LT);  
   Cn.mult(q.X_JxT,  q.Cn_X_JxT);
 
   // compute problem data for Cs rows
-  Cs.mult(q.X_CsT, q.Cs_X_CsT);  
-  Cs.mult(q.X_CtT, q.Cs_X_CtT);  
+  Cs_X.mult_transpose(Cs, q.Cs_X_CsT);  
+  Cs_X.mult_transpose(Ct, q.Cs_X_CtT);  
   Cs.mult(q.X_LT,  q.Cs_X_LT);  
   Cs.mult(q.X_JxT,  q.Cs_X_JxT);  
 
   // compute problem data for Ct rows
-  Ct.mult(q.X_CtT, q.Ct_X_CtT);  
+  Ct_X.mult_transpose(Ct, q.Ct_X_CtT);  
   Ct.mult(q.X_LT,  q.Ct_X_LT);  
   Ct.mult(q.X_JxT,  q.Ct_X_JxT);  
 
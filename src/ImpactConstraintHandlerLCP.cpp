@@ -3,6 +3,7 @@
 #include <boost/algorithm/minmax_element.hpp>
 #include <limits>
 #include <set>
+#include <algorithm>
 #include <cmath>
 #include <numeric>
 #include <Moby/permute.h>
@@ -328,8 +329,28 @@ void ImpactConstraintHandler::apply_ap_model(UnilateralConstraintProblemData& q)
   q.Cs_v.negate();
   q.Ct_v.negate();
 
+  // warm start using the impulses cached for matching constraints, splitting
+  // the tangential impulses into their positive and negative parts (the
+  // friction cone multipliers start at zero)
+  VectorNd z, x;
+  get_warm_start(q, x);
+  if (x.size() > 0)
+  {
+    z.set_zero(_qq.size());
+    for (unsigned i=0; i< NC; i++)
+    {
+      const double CS = x[NC+i], CT = x[NC*2+i];
+      z[i] = x[i];
+      z[NC+i] = std::max(CS, 0.0);
+      z[NC+NC+i] = std::max(-CS, 0.0);
+      z[NC+NC*2+i] = std::max(CT, 0.0);
+      z[NC+NC*3+i] = std::max(-CT, 0.0);
+    }
+    for (unsigned i=0; i< N_LIMIT; i++)
+      z[N_FRICT+i] = x[NC*3+i];
+  }
+
   // solve the LCP
-  VectorNd z;
   if (!_lcp.lcp_lemke_regularized(_MM, _qq, z, -20, 1, -2))
     throw std::exception();
 
@@ -343,6 +364,9 @@ void ImpactConstraintHandler::apply_ap_model(UnilateralConstraintProblemData& q)
 
   q.l = z.segment(N_FRICT,N_FRICT+N_LIMIT);
 
+  // cache the impulses for warm starting
+  store_warm_start(q, q.cn, q.cs, q.ct, q.l, _empty);
+
   // setup a temporary frame
   shared_ptr<Pose3d> P(new Pose3d);
 
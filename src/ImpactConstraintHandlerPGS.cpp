@@ -0,0 +1,183 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <vector>
+#include <list>
+#include <Moby/Constants.h>
+#include <Moby/UnilateralConstraint.h>
+#include <Moby/Log.h>
+#include <Moby/ImpactConstraintHandler.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using std::list;
+using boost::shared_ptr;
+using std::vector;
+using std::endl;
+
+/**
+ * Applies the iterative (projected Gauss-Seidel) solver to a set of connected
+ * constraints
+ * \param constraints a set of connected constraints
+ */
+void ImpactConstraintHandler::apply_pgs_model_to_connected_constraints(const list<UnilateralConstraint*>& constraints, const list<shared_ptr<SingleBodyd> >& single_bodies)
+{
+  FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::apply_pgs_model_to_connected_constraints() entered" << endl;
+
+  // reset problem data
+  _epd.reset();
+
+  // set the simulator
+  _epd.simulator = _simulator;
+
+  // save the constraints
+  _epd.constraints = vector<UnilateralConstraint*>(constraints.begin(), constraints.end());
+
+  // determine sets of contact and limit constraints
+  _epd.partition_constraints();
+
+  // compute all constraint cross-terms
+  compute_problem_data(_epd, single_bodies);
+
+  // clear all impulses
+  for (unsigned i=0; i< _epd.N_CONTACTS; i++)
+    _epd.contact_constraints[i]->contact_impulse.set_zero(GLOBAL);
+  for (unsigned i=0; i< _epd.N_LIMITS; i++)
+    _epd.limit_constraints[i]->limit_impulse = 0.0;
+
+  // solve the model, warm starting using impulses cached for matching
+  // constraints
+  get_warm_start(_epd, _z);
+  apply_pgs_model(_epd);
+
+  // cache the impulses
+  store_warm_start(_epd, _epd.cn, _epd.cs, _epd.ct, _epd.l, _empty);
+
+  // determine velocities due to impulse application
+  update_constraint_velocities_from_impulses(_epd);
+
+  // get the constraint violation before applying impulses
+  double minv = calc_min_constraint_velocity(_epd);
+
+  // apply restitution
+  if (apply_restitution(_epd))
+  {
+    // update the body velocity
+    update_from_stacked(_epd);
+
+    // determine velocities due to impulse application
+    update_constraint_velocities_from_impulses(_epd);
+
+    // check to see whether we need to solve another impact problem
+    double minv_plus = calc_min_constraint_velocity(_epd);
+    FILE_LOG(LOG_CONSTRAINT) << "Applying restitution" << std::endl;
+    FILE_LOG(LOG_CONSTRAINT) << "  compression v+ minimum: " << minv << std::endl;
+    FILE_LOG(LOG_CONSTRAINT) << "  restitution v+ minimum: " << minv_plus << std::endl;
+    if (minv_plus < 0.0 && minv_plus < minv - NEAR_ZERO)
+    {
+      _z.resize(0);
+      apply_pgs_model(_epd);
+    }
+  }
+
+  FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::apply_pgs_model_to_connected_constraints() exiting" << endl;
+}
+
+/// Solves the contact problem using projected Gauss-Seidel and applies the impulses
+/**
+ * Variables are stacked as [cn; cs; ct; l]; every contact uses a true
+ * friction cone with radius mu_coulomb*cn. Viscous friction is applied (as
+ * in the viscous friction LCP model) as a fixed impulse -mu_viscous times 
+ * the tangential velocity, whose effect on the constraint velocities enters
+ * the problem vector; the cached and returned tangential impulses include
+ * it. The solver is warm started from _z if its size matches.
+ */
+void ImpactConstraintHandler::apply_pgs_model(UnilateralConstraintProblemData& q)
+{
+  const unsigned NCONTACTS = q.N_CONTACTS;
+  const unsigned NLIMITS = q.N_LIMITS;
+  const unsigned CN_IDX = 0;
+  const unsigned CS_IDX = CN_IDX + NCONTACTS;
+  const unsigned CT_IDX = CS_IDX + NCONTACTS;
+  const unsigned L_IDX = CT_IDX + NCONTACTS;
+  const unsigned NVARS = L_IDX + NLIMITS;
+
+  FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::apply_pgs_model() entered" << std::endl;
+
+  // setup the (symmetric) problem matrix
+  _MM.resize(NVARS, NVARS);
+  _MM.set_sub_mat(CN_IDX, CN_IDX, q.Cn_X_CnT);
+  _MM.set_sub_mat(CN_IDX, CS_IDX, q.Cn_X_CsT);
+  _MM.set_sub_mat(CN_IDX, CT_IDX, q.Cn_X_CtT);
+  _MM.set_sub_mat(CN_IDX, L_IDX, q.Cn_X_LT);
+  _MM.set_sub_mat(CS_IDX, CN_IDX, q.Cn_X_CsT, Ravelin::eTranspose);
+  _MM.set_sub_mat(CS_IDX, CS_IDX, q.Cs_X_CsT);
+  _MM.set_sub_mat(CS_IDX, CT_IDX, q.Cs_X_CtT);
+  _MM.set_sub_mat(CS_IDX, L_IDX, q.Cs_X_LT);
+  _MM.set_sub_mat(CT_IDX, CN_IDX, q.Cn_X_CtT, Ravelin::eTranspose);
+  _MM.set_sub_mat(CT_IDX, CS_IDX, q.Cs_X_CtT, Ravelin::eTranspose);
+  _MM.set_sub_mat(CT_IDX, CT_IDX, q.Ct_X_CtT);
+  _MM.set_sub_mat(CT_IDX, L_IDX, q.Ct_X_LT);
+  _MM.set_sub_mat(L_IDX, CN_IDX, q.Cn_X_LT, Ravelin::eTranspose);
+  _MM.set_sub_mat(L_IDX, CS_IDX, q.Cs_X_LT, Ravelin::eTranspose);
+  _MM.set_sub_mat(L_IDX, CT_IDX, q.Ct_X_LT, Ravelin::eTranspose);
+  _MM.set_sub_mat(L_IDX, L_IDX, q.L_X_LT);
+
+  // setup the problem vector
+  _qq.resize(NVARS);
+  _qq.set_sub_vec(CN_IDX, q.Cn_v);
+  _qq.set_sub_vec(CS_IDX, q.Cs_v);
+  _qq.set_sub_vec(CT_IDX, q.Ct_v);
+  _qq.set_sub_vec(L_IDX, q.L_v);
+
+  // compute the viscous friction impulses and add their effect on the
+  // constraint velocities to the problem vector
+  _workv2.set_zero(NVARS);
+  for (unsigned i=0; i< NCONTACTS; i++)
+  {
+    const double MU_VISC = q.contact_constraints[i]->contact_mu_viscous;
+    _workv2[CS_IDX + i] = -MU_VISC * q.Cs_v[i];
+    _workv2[CT_IDX + i] = -MU_VISC * q.Ct_v[i];
+  }
+  _MM.mult(_workv2, _workv);
+  _qq += _workv;
+
+  // the warm start includes the viscous friction impulses
+  if (_z.size() == NVARS)
+    _z -= _workv2;
+
+  // setup the friction cones
+  _cones.resize(NCONTACTS);
+  for (unsigned i=0; i< NCONTACTS; i++)
+  {
+    _cones[i].normal = CN_IDX + i;
+    _cones[i].tan1 = CS_IDX + i;
+    _cones[i].tan2 = CT_IDX + i;
+    _cones[i].mu = q.contact_constraints[i]->contact_mu_coulomb;
+  }
+
+  FILE_LOG(LOG_CONSTRAINT) << "  PGS matrix: " << std::endl << _MM;
+  FILE_LOG(LOG_CONSTRAINT) << "  PGS vector: " << _qq << std::endl;
+
+  // solve the problem (warm starting from _z if it has been setup); the
+  // approximate solution is used if the solver does not converge
+  if (!_lcp.ncp_pgs(_MM, _qq, _z, _cones, pgs_max_iterations, pgs_eps, pgs_nncg))
+    FILE_LOG(LOG_CONSTRAINT) << "  PGS solver did not converge in " << pgs_max_iterations << " iterations; using approximate solution" << std::endl;
+  FILE_LOG(LOG_CONSTRAINT) << "  PGS result (" << _lcp.iterations << " iterations): " << _z << std::endl;
+
+  // save the impulses (adding the viscous friction impulses)
+  _z += _workv2;
+  q.cn = _z.segment(CN_IDX, CS_IDX);
+  q.cs = _z.segment(CS_IDX, CT_IDX);
+  q.ct = _z.segment(CT_IDX, L_IDX);
+  q.l = _z.segment(L_IDX, NVARS);
+
+  // apply the impulses and update the velocities
+  update_from_stacked(q);
+
+  FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::apply_pgs_model() exited" << std::endl;
+}
+
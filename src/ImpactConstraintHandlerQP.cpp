@@ -154,16 +154,15 @@ void ImpactConstraintHandler::solve_qp_work(UnilateralConstraintProblemData& epd
   FILE_LOG(LOG_CONSTRAINT) << "LCP matrix: " << std::endl << _MM;
   FILE_LOG(LOG_CONSTRAINT) << "LCP vector: " << _qq << std::endl;
 
-  // init z 
+  // init z; warm start using the data cached for matching constraints
   z.resize(_qq.rows());
-
-  // try warmstarting if possible
-  if (z.size() == _zlast.size())
-    z = _zlast;
+  get_qp_warm_start(epd, z);
 
   // solve the LCP using Lemke's algorithm
   #if defined(USE_QLCPD) or defined(USE_QPOASES)
   VectorNd lb(c.size()), ub(c.size());
+  if (z.size() != _qq.rows())
+    z.set_zero(_qq.rows());
   lb.set_zero();
   ub.set_one() *= 1e+29;
   if (!_qp.qp_activeset(H, c, lb, ub, M, q, A, b, z))
@@ -229,16 +228,21 @@ void ImpactConstraintHandler::solve_qp_work(UnilateralConstraintProblemData& epd
   FILE_LOG(LOG_CONSTRAINT) << "LCP solution: " << z << std::endl;
   #endif
 
-  // store zlast
-  _zlast = z;
-
-  // get relevant forces
-  SharedVectorNd cn = _zlast.segment(0, N_CONTACTS);
-  SharedVectorNd cs = _zlast.segment(N_CONTACTS, N_CONTACTS*2);
-  SharedVectorNd ct = _zlast.segment(N_CONTACTS*2, N_CONTACTS*3);
-  SharedVectorNd ncs = _zlast.segment(N_CONTACTS*3, N_CONTACTS*4);
-  SharedVectorNd nct = _zlast.segment(N_CONTACTS*4, N_CONTACTS*5);
-  SharedVectorNd l = _zlast.segment(N_CONTACTS*5, N_CONTACTS*5+epd.N_LIMITS);
+  // get relevant forces (copied, since z is reformatted below)
+  VectorNd lcp = z;
+  SharedVectorNd cn = lcp.segment(0, N_CONTACTS);
+  SharedVectorNd cs = lcp.segment(N_CONTACTS, N_CONTACTS*2);
+  SharedVectorNd ct = lcp.segment(N_CONTACTS*2, N_CONTACTS*3);
+  SharedVectorNd ncs = lcp.segment(N_CONTACTS*3, N_CONTACTS*4);
+  SharedVectorNd nct = lcp.segment(N_CONTACTS*4, N_CONTACTS*5);
+  SharedVectorNd l = lcp.segment(N_CONTACTS*5, N_CONTACTS*5+epd.N_LIMITS);
+
+  // cache the solution for warm starting
+  _workv = cn;
+  _workv2 = l;
+  (_a = cs) -= ncs;
+  (_b = ct) -= nct;
+  store_warm_start(epd, _workv, _a, _b, _workv2, (lcp.size() == _qq.rows()) ? lcp : _empty);
 
   // put z in the expected format (full contact forces)
   z.set_zero(epd.N_VARS);
@@ -254,7 +258,7 @@ void ImpactConstraintHandler::solve_qp_work(UnilateralConstraintProblemData& epd
   if (LOGGING(LOG_CONSTRAINT))
   {
     VectorNd workv;
-    SharedVectorNd zsub = _zlast.segment(0, c.rows());
+    SharedVectorNd zsub = lcp.segment(0, c.rows());
     H.mult(zsub, workv) *= 0.5;
     workv += c;
     FILE_LOG(LOG_CONSTRAINT) << "(signed) computed energy dissipation: " << zsub.dot(workv) << std::endl;
@@ -0,0 +1,487 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <map>
+#include <Moby/Constants.h>
+#include <Moby/CollisionGeometry.h>
+#include <Moby/UnilateralConstraint.h>
+#include <Moby/Log.h>
+#include <Moby/StateBuffer.h>
+#include <Moby/ImpactConstraintHandler.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using boost::shared_ptr;
+using std::vector;
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::endl;
+
+/// Removes cached data for contacts and limits not seen during the current call
+void ImpactConstraintHandler::purge_warm_start_cache()
+{
+  typedef map<sorted_pair<CollisionGeometryPtr>, pair<unsigned, vector<CachedContact> > > ContactMap;
+  typedef map<pair<JointPtr, unsigned>, pair<unsigned, CachedLimit> > LimitMap;
+
+  for (ContactMap::iterator i = _cache->contacts.begin(); i != _cache->contacts.end(); )
+  {
+    if (i->second.first != _cache->call)
+      _cache->contacts.erase(i++);
+    else
+      i++;
+  }
+
+  for (LimitMap::iterator i = _cache->limits.begin(); i != _cache->limits.end(); )
+  {
+    if (i->second.first != _cache->call)
+      _cache->limits.erase(i++);
+    else
+      i++;
+  }
+}
+
+/// Finds the cached contact that matches a contact constraint
+/**
+ * \param sign set to -1 if the geometries of the constraint are ordered
+ *        opposite to the cached pair (normal, tangent and impulse must be
+ *        negated) and +1 otherwise
+ * \return the matching contact or NULL if there is no match
+ * \note must be called within the ImpactConstraintHandler_cache critical
+ *       section
+ */
+const ImpactConstraintHandler::CachedContact* ImpactConstraintHandler::find_cached_contact(const UnilateralConstraint& c, double& sign) const
+{
+  const double NORMAL_TOL = 0.9;
+
+  // look for the geometry pair
+  sorted_pair<CollisionGeometryPtr> key(c.contact_geom1, c.contact_geom2);
+  map<sorted_pair<CollisionGeometryPtr>, pair<unsigned, vector<CachedContact> > >::const_iterator iter = _cache->contacts.find(key);
+  if (iter == _cache->contacts.end())
+    return NULL;
+
+  // get the contact point and normal relative to the first geometry
+  sign = (c.contact_geom1 == key.first) ? 1.0 : -1.0;
+  Point3d p = Pose3d::transform_point(key.first->get_pose(), c.contact_point);
+  Vector3d normal = c.contact_normal * sign;
+
+  // find the closest contact with a similar normal
+  const vector<CachedContact>& cached = iter->second.second;
+  const CachedContact* closest = NULL;
+  double closest_dist = warm_start_tol;
+  for (unsigned i=0; i< cached.size(); i++)
+  {
+    if (Vector3d::dot(cached[i].normal, normal) < NORMAL_TOL)
+      continue;
+    double dist = (cached[i].p - p).norm();
+    if (dist <= closest_dist)
+    {
+      closest_dist = dist;
+      closest = &cached[i];
+    }
+  }
+
+  return closest;
+}
+
+/// Finds the cached limit that matches a limit constraint
+/**
+ * \note must be called within the ImpactConstraintHandler_cache critical
+ *       section
+ */
+const ImpactConstraintHandler::CachedLimit* ImpactConstraintHandler::find_cached_limit(const UnilateralConstraint& l) const
+{
+  pair<JointPtr, unsigned> key(l.limit_joint, l.limit_dof*2 + ((l.limit_upper) ? 1 : 0));
+  map<pair<JointPtr, unsigned>, pair<unsigned, CachedLimit> >::const_iterator iter = _cache->limits.find(key);
+  return (iter == _cache->limits.end()) ? NULL : &iter->second.second;
+}
+
+/// Gets the indices of the variables of the QP/LCP (see solve_qp_work()) that correspond to each contact and limit
+void ImpactConstraintHandler::get_qp_lcp_indices(const UnilateralConstraintProblemData& q, vector<vector<unsigned> >& contact_indices, vector<vector<unsigned> >& limit_indices)
+{
+  const unsigned N_CONTACTS = q.N_CONTACTS;
+  const unsigned N_LIMITS = q.N_LIMITS;
+  const unsigned N_VARS = N_CONTACTS*5 + N_LIMITS;
+  const unsigned CN_ROW = N_VARS;
+  const unsigned L_ROW = CN_ROW + N_CONTACTS;
+  unsigned friction_row = L_ROW + N_LIMITS;
+
+  // setup indices for contacts: cn, cs, ct, -cs, -ct, non-interpenetration
+  // multiplier, friction cone multipliers
+  contact_indices.resize(N_CONTACTS);
+  for (unsigned i=0; i< N_CONTACTS; i++)
+  {
+    vector<unsigned>& idx = contact_indices[i];
+    idx.clear();
+    for (unsigned j=0; j< 5; j++)
+      idx.push_back(N_CONTACTS*j + i);
+    idx.push_back(CN_ROW + i);
+    for (unsigned j=0; j< q.contact_constraints[i]->contact_NK/2; j++)
+      idx.push_back(friction_row++);
+  }
+
+  // setup indices for limits: l, limit multiplier
+  limit_indices.resize(N_LIMITS);
+  for (unsigned i=0; i< N_LIMITS; i++)
+  {
+    limit_indices[i].clear();
+    limit_indices[i].push_back(N_CONTACTS*5 + i);
+    limit_indices[i].push_back(L_ROW + i);
+  }
+}
+
+/// Gets the warm starting vector [cn; cs; ct; l] from the impulses cached for matching constraints
+/**
+ * z is set to zero length if no constraints match.
+ */
+void ImpactConstraintHandler::get_warm_start(const UnilateralConstraintProblemData& q, VectorNd& z) const
+{
+  const unsigned N_CONTACTS = q.N_CONTACTS;
+  const unsigned CS_IDX = N_CONTACTS;
+  const unsigned CT_IDX = CS_IDX + N_CONTACTS;
+  const unsigned L_IDX = CT_IDX + N_CONTACTS;
+  unsigned n_matched = 0;
+
+  z.set_zero(L_IDX + q.N_LIMITS);
+  if (!warm_start)
+  {
+    z.resize(0);
+    return;
+  }
+
+  #ifdef _OPENMP
+  #pragma omp critical (ImpactConstraintHandler_cache)
+  #endif
+  {
+    // project the cached impulses onto the current contact frames
+    for (unsigned i=0; i< N_CONTACTS; i++)
+    {
+      const UnilateralConstraint& c = *q.contact_constraints[i];
+      double sign;
+      const CachedContact* cc = find_cached_contact(c, sign);
+      if (!cc)
+        continue;
+      Vector3d j = cc->impulse * sign;
+      z[i] = std::max(0.0, c.contact_normal.dot(j));
+      z[CS_IDX+i] = c.contact_tan1.dot(j);
+      z[CT_IDX+i] = c.contact_tan2.dot(j);
+      n_matched++;
+    }
+
+    // get the limit impulses
+    for (unsigned i=0; i< q.N_LIMITS; i++)
+    {
+      const CachedLimit* cl = find_cached_limit(*q.limit_constraints[i]);
+      if (!cl)
+        continue;
+      z[L_IDX+i] = cl->impulse;
+      n_matched++;
+    }
+  }
+
+  FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::get_warm_start() - " << n_matched << " of " << (N_CONTACTS + q.N_LIMITS) << " constraints matched" << endl;
+  if (n_matched == 0)
+    z.resize(0);
+}
+
+/// Gets the warm starting vector [cn; l] for the LCPs over normal and limit impulses alone (see apply_no_slip_model() and solve_frictionless_lcp())
+/**
+ * z is set to zero length if no constraints match.
+ */
+void ImpactConstraintHandler::get_normal_warm_start(const UnilateralConstraintProblemData& q, VectorNd& z) const
+{
+  const unsigned N_CONTACTS = q.N_CONTACTS;
+  const unsigned L_IDX = N_CONTACTS*3;
+  VectorNd x;
+
+  // get the warm starting vector [cn; cs; ct; l]
+  get_warm_start(q, x);
+  if (x.size() == 0)
+  {
+    z.resize(0);
+    return;
+  }
+
+  // remove the tangential impulses
+  z.resize(N_CONTACTS + q.N_LIMITS);
+  z.set_sub_vec(0, x.segment(0, N_CONTACTS));
+  z.set_sub_vec(N_CONTACTS, x.segment(L_IDX, x.size()));
+}
+
+/// Gets the warm starting vector for the QP/LCP (see solve_qp_work()) from the data cached for matching constraints
+/**
+ * Values of all QP/LCP variables (and hence the active set) are carried over
+ * for contacts that match, have the same friction cone discretization, and
+ * have (nearly) the same tangent directions; the impulses alone are carried
+ * over for other matching contacts. z is set to zero length if no
+ * constraints match.
+ */
+void ImpactConstraintHandler::get_qp_warm_start(const UnilateralConstraintProblemData& q, VectorNd& z) const
+{
+  const double TAN_TOL = 1.0 - NEAR_ZERO;
+  const unsigned N_CONTACTS = q.N_CONTACTS;
+  vector<vector<unsigned> > cidx, lidx;
+  unsigned n_matched = 0;
+
+  if (!warm_start)
+  {
+    z.resize(0);
+    return;
+  }
+
+  // get the indices of the variables
+  get_qp_lcp_indices(q, cidx, lidx);
+  z.set_zero(z.size());
+
+  #ifdef _OPENMP
+  #pragma omp critical (ImpactConstraintHandler_cache)
+  #endif
+  {
+    for (unsigned i=0; i< N_CONTACTS; i++)
+    {
+      const UnilateralConstraint& c = *q.contact_constraints[i];
+      double sign;
+      const CachedContact* cc = find_cached_contact(c, sign);
+      if (!cc)
+        continue;
+      n_matched++;
+
+      // see whether the variables can be copied directly
+      if (cc->NK == c.contact_NK && cc->lcp.size() == cidx[i].size() &&
+          Vector3d::dot(cc->tan1*sign, c.contact_tan1) > TAN_TOL)
+      {
+        for (unsigned j=0; j< cidx[i].size(); j++)
+          z[cidx[i][j]] = cc->lcp[j];
+        continue;
+      }
+
+      // otherwise, project the impulse onto the contact frame
+      Vector3d j = cc->impulse * sign;
+      double cs = c.contact_tan1.dot(j), ct = c.contact_tan2.dot(j);
+      z[cidx[i][0]] = std::max(0.0, c.contact_normal.dot(j));
+      z[cidx[i][1]] = std::max(0.0, cs);
+      z[cidx[i][2]] = std::max(0.0, ct);
+      z[cidx[i][3]] = std::max(0.0, -cs);
+      z[cidx[i][4]] = std::max(0.0, -ct);
+    }
+
+    for (unsigned i=0; i< q.N_LIMITS; i++)
+    {
+      const CachedLimit* cl = find_cached_limit(*q.limit_constraints[i]);
+      if (!cl)
+        continue;
+      n_matched++;
+      if (cl->lcp.size() == lidx[i].size())
+      {
+        for (unsigned j=0; j< lidx[i].size(); j++)
+          z[lidx[i][j]] = cl->lcp[j];
+      }
+      else
+        z[lidx[i][0]] = cl->impulse;
+    }
+  }
+
+  FILE_LOG(LOG_CONSTRAINT) << "ImpactConstraintHandler::get_qp_warm_start() - " << n_matched << " of " << (N_CONTACTS + q.N_LIMITS) << " constraints matched" << endl;
+  if (n_matched == 0)
+    z.resize(0);
+}
+
+/// Stores the impulses (and, optionally, the QP/LCP solution) determined for a group of constraints
+/**
+ * \param cn the normal contact impulses
+ * \param cs the first tangential contact impulses
+ * \param ct the second tangential contact impulses
+ * \param l the limit impulses
+ * \param lcp the solution to the QP/LCP (see solve_qp_work()) or a zero
+ *        length vector
+ */
+void ImpactConstraintHandler::store_warm_start(const UnilateralConstraintProblemData& q, const VectorNd& cn, const VectorNd& cs, const VectorNd& ct, const VectorNd& l, const VectorNd& lcp)
+{
+  vector<vector<unsigned> > cidx, lidx;
+  map<sorted_pair<CollisionGeometryPtr>, vector<CachedContact> > contacts;
+
+  if (!warm_start)
+    return;
+
+  // get the indices of the QP/LCP variables
+  if (lcp.size() > 0)
+    get_qp_lcp_indices(q, cidx, lidx);
+
+  // setup the cached contacts (all contacts between a pair of geometries
+  // belong to the same group)
+  for (unsigned i=0; i< q.N_CONTACTS; i++)
+  {
+    const UnilateralConstraint& c = *q.contact_constraints[i];
+    sorted_pair<CollisionGeometryPtr> key(c.contact_geom1, c.contact_geom2);
+    const double sign = (c.contact_geom1 == key.first) ? 1.0 : -1.0;
+
+    CachedContact cc;
+    cc.p = Pose3d::transform_point(key.first->get_pose(), c.contact_point);
+    cc.normal = c.contact_normal * sign;
+    cc.tan1 = c.contact_tan1 * sign;
+    cc.impulse = (c.contact_normal*cn[i] + c.contact_tan1*cs[i] + c.contact_tan2*ct[i]) * sign;
+    cc.NK = c.contact_NK;
+    if (lcp.size() > 0)
+      for (unsigned j=0; j< cidx[i].size(); j++)
+        cc.lcp.push_back(lcp[cidx[i][j]]);
+    contacts[key].push_back(cc);
+  }
+
+  #ifdef _OPENMP
+  #pragma omp critical (ImpactConstraintHandler_cache)
+  #endif
+  {
+    // store the contacts
+    for (map<sorted_pair<CollisionGeometryPtr>, vector<CachedContact> >::iterator i = contacts.begin(); i != contacts.end(); i++)
+    {
+      pair<unsigned, vector<CachedContact> >& entry = _cache->contacts[i->first];
+      entry.first = _cache->call;
+      entry.second.swap(i->second);
+    }
+
+    // store the limits
+    for (unsigned i=0; i< q.N_LIMITS; i++)
+    {
+      const UnilateralConstraint& u = *q.limit_constraints[i];
+      pair<JointPtr, unsigned> key(u.limit_joint, u.limit_dof*2 + ((u.limit_upper) ? 1 : 0));
+      pair<unsigned, CachedLimit>& entry = _cache->limits[key];
+      entry.first = _cache->call;
+      entry.second.impulse = l[i];
+      entry.second.lcp.clear();
+      if (lcp.size() > 0)
+        for (unsigned j=0; j< lidx[i].size(); j++)
+          entry.second.lcp.push_back(lcp[lidx[i][j]]);
+    }
+  }
+}
+
+/// Writes the data cached for warm starting (see Simulator::save_state())
+void ImpactConstraintHandler::write_warm_start(StateWriter& out) const
+{
+  typedef map<sorted_pair<CollisionGeometryPtr>, pair<unsigned, vector<CachedContact> > > ContactMap;
+  typedef map<pair<JointPtr, unsigned>, pair<unsigned, CachedLimit> > LimitMap;
+
+  // write the contacts; points are relative to the first geometry of each pair
+  out.write_unsigned(_cache->contacts.size());
+  for (ContactMap::const_iterator i = _cache->contacts.begin(); i != _cache->contacts.end(); i++)
+  {
+    out.write_geometry(i->first.first);
+    out.write_geometry(i->first.second);
+    const vector<CachedContact>& cached = i->second.second;
+    out.write_unsigned(cached.size());
+    for (unsigned j=0; j< cached.size(); j++)
+    {
+      out.write_vector3d(cached[j].p);
+      out.write_vector3d(cached[j].normal);
+      out.write_vector3d(cached[j].tan1);
+      out.write_vector3d(cached[j].impulse);
+      out.write_unsigned(cached[j].NK);
+      out.write_unsigned(cached[j].lcp.size());
+      for (unsigned k=0; k< cached[j].lcp.size(); k++)
+        out.write_double(cached[j].lcp[k]);
+    }
+  }
+
+  // write the limits
+  out.write_unsigned(_cache->limits.size());
+  for (LimitMap::const_iterator i = _cache->limits.begin(); i != _cache->limits.end(); i++)
+  {
+    out.write_joint(i->first.first);
+    out.write_unsigned(i->first.second);
+    out.write_double(i->second.second.impulse);
+    out.write_unsigned(i->second.second.lcp.size());
+    for (unsigned k=0; k< i->second.second.lcp.size(); k++)
+      out.write_double(i->second.second.lcp[k]);
+  }
+}
+
+/// Reads the data cached for warm starting (see Simulator::restore_state())
+/**
+ * Geometry pairs are ordered by address, so the pairs may be ordered
+ * differently than when the data was written (e.g., by another process);
+ * the cached contacts of such pairs are made relative to the other geometry.
+ * Data for geometries and joints no longer in the simulator is discarded.
+ * The cache is modified only if apply is true and all of the data was read.
+ */
+void ImpactConstraintHandler::read_warm_start(StateReader& in, bool apply)
+{
+  typedef map<sorted_pair<CollisionGeometryPtr>, pair<unsigned, vector<CachedContact> > > ContactMap;
+  typedef map<pair<JointPtr, unsigned>, pair<unsigned, CachedLimit> > LimitMap;
+  ContactMap contacts;
+  LimitMap limits;
+
+  // read the contacts
+  const unsigned N_PAIRS = in.read_unsigned();
+  for (unsigned i=0; i< N_PAIRS && in.ok(); i++)
+  {
+    CollisionGeometryPtr g1 = in.read_geometry();
+    CollisionGeometryPtr g2 = in.read_geometry();
+    shared_ptr<const Pose3d> P1 = (g1) ? g1->get_pose() : GLOBAL;
+    vector<CachedContact> cached;
+    const unsigned N = in.read_unsigned();
+    for (unsigned j=0; j< N && in.ok(); j++)
+    {
+      CachedContact cc;
+      cc.p = in.read_vector3d(P1);
+      cc.normal = in.read_vector3d(GLOBAL);
+      cc.tan1 = in.read_vector3d(GLOBAL);
+      cc.impulse = in.read_vector3d(GLOBAL);
+      cc.NK = in.read_unsigned();
+      const unsigned NLCP = in.read_unsigned();
+      for (unsigned k=0; k< NLCP && in.ok(); k++)
+        cc.lcp.push_back(in.read_double());
+      cached.push_back(cc);
+    }
+    if (!g1 || !g2)
+      continue;
+
+    // make the contacts relative to the first geometry of the pair
+    sorted_pair<CollisionGeometryPtr> key(g1, g2);
+    if (key.first != g1)
+    {
+      for (unsigned j=0; j< cached.size(); j++)
+      {
+        cached[j].p = Pose3d::transform_point(key.first->get_pose(), cached[j].p);
+        cached[j].normal = -cached[j].normal;
+        cached[j].tan1 = -cached[j].tan1;
+        cached[j].impulse = -cached[j].impulse;
+      }
+    }
+
+    pair<unsigned, vector<CachedContact> >& entry = contacts[key];
+    entry.first = _cache->call;
+    entry.second.swap(cached);
+  }
+
+  // read the limits
+  const unsigned N_LIMITS = in.read_unsigned();
+  for (unsigned i=0; i< N_LIMITS && in.ok(); i++)
+  {
+    JointPtr joint = in.read_joint();
+    const unsigned DOF = in.read_unsigned();
+    CachedLimit cl;
+    cl.impulse = in.read_double();
+    const unsigned NLCP = in.read_unsigned();
+    for (unsigned k=0; k< NLCP && in.ok(); k++)
+      cl.lcp.push_back(in.read_double());
+    if (!joint)
+      continue;
+
+    pair<unsigned, CachedLimit>& entry = limits[make_pair(joint, DOF)];
+    entry.first = _cache->call;
+    entry.second = cl;
+  }
+
+  // replace the cached data
+  if (in.ok() && apply)
+  {
+    _cache->contacts.swap(contacts);
+    _cache->limits.swap(limits);
+  }
+}
@@ -5,6 +5,8 @@
  ****************************************************************************/
 
 #include <numeric>
+#include <algorithm>
+#include <limits>
 #include <cstring>
 #include <cmath>
 #include <cfloat>
@@ -35,6 +37,8 @@ using boost::shared_ptr;
 // Sole constructor
 LCP::LCP()
 {
+  iterations = 0;
+  total_pivots = 0;
 }
 
 /// Fast pivoting algorithm for denerate, monotone LCPs with few nonzero, nonbasic variables 
@@ -61,8 +65,10 @@ bool LCP::lcp_fast(const MatrixNd& M, const VectorNd& q, VectorNd& z, double zer
   _nonbas.clear();
   _bas.clear();
 
-  // see whether to warm-start
-  if (z.size() == q.size())
+  // see whether to warm-start (the nonbasic set is setup from the nonzero
+  // components of z, i.e., the basis of a previous solution)
+  const bool WARM = (z.size() == q.size());
+  if (WARM)
   {
     FILE_LOG(LOG_OPT) << "LCP::lcp_fast() - warm starting activated" << std::endl;
 
@@ -107,6 +113,8 @@ bool LCP::lcp_fast(const MatrixNd& M, const VectorNd& q, VectorNd& z, double zer
   const unsigned MAX_PIV = 2*N;
   for (pivots=0; pivots < MAX_PIV; pivots++)
   {
+    total_pivots++;
+
     // select nonbasic indices
     M.select_square(_nonbas.begin(), _nonbas.end(), _Msub);
     M.select(_bas.begin(), _bas.end(), _nonbas.begin(), _nonbas.end(), _Mmix);
@@ -122,6 +130,15 @@ bool LCP::lcp_fast(const MatrixNd& M, const VectorNd& q, VectorNd& z, double zer
     catch (SingularException e)
     {
       FILE_LOG(LOG_OPT) << "LCP::lcp_fast() - linear system solve failed" << std::endl;
+
+      // the warm starting basis may be singular; try again from scratch
+      if (WARM)
+      {
+        FILE_LOG(LOG_OPT) << "LCP::lcp_fast() - restarting without warm start" << std::endl;
+        z.resize(0);
+        return lcp_fast(M, q, z, zero_tol);
+      }
+
       return false;
     }
 
@@ -191,6 +208,14 @@ bool LCP::lcp_fast(const MatrixNd& M, const VectorNd& q, VectorNd& z, double zer
 
   FILE_LOG(LOG_OPT) << "LCP::lcp_fast() - maximum allowable pivots exceeded" << std::endl;
 
+  // try again from scratch if warm starting was used
+  if (WARM)
+  {
+    FILE_LOG(LOG_OPT) << "LCP::lcp_fast() - restarting without warm start" << std::endl;
+    z.resize(0);
+    return lcp_fast(M, q, z, zero_tol);
+  }
+
   // if we're here, then the maximum number of pivots has been exceeded
   return false;
 }
@@ -232,6 +257,9 @@ bool LCP::lcp_fast_regularized(const MatrixNd& M, const VectorNd& q, VectorNd& z
   // store the total pivots
   unsigned total_piv = 0;
 
+  // save the warm starting vector (if any) for the regularized attempts
+  _zwarm = z;
+
   // try non-regularized version first
   bool result = lcp_fast(_MM, q, z, zero_tol);
   if (result)
@@ -292,6 +320,7 @@ bool LCP::lcp_fast_regularized(const MatrixNd& M, const VectorNd& q, VectorNd& z
       _MM(i,i) += lambda;
 
     // try to solve the LCP
+    z = _zwarm;
     result = lcp_fast(_MM, q, z, zero_tol);
 
     // update total pivots
@@ -788,6 +817,8 @@ restart: // solver restarts from here when basis becomes bad
   // main iterations begin here
   for (pivots=0; pivots< MAXITER; pivots++)
   {
+    total_pivots++;
+
     if (LOGGING(LOG_OPT))
     {
       std::ostringstream basic;
@@ -1250,6 +1281,8 @@ bool LCP::lcp_lemke(const SparseMatrixNd& M, const VectorNd& q, VectorNd& z, dou
   // main iterations begin here
   for (unsigned iter=0; iter < MAXITER; iter++)
   {
+    total_pivots++;
+
     // check whether done; if not, get new entering variable
     if (leaving == t)
     {
@@ -1512,3 +1545,193 @@ bool LCP::fast_pivoting(const MatrixNd& M, const VectorNd& q, VectorNd& z, doubl
   return false;
 }
 
+
+/// Projected Gauss-Seidel solver for LCPs
+/**
+ * \param max_iter the maximum number of iterations
+ * \param tol the tolerance on the change in z between successive iterations
+ *        (relative to the magnitude of z)
+ * \param nncg if true, iterations are accelerated using nonsmooth nonlinear
+ *        conjugate gradients
+ * \return true if the solver converged; z contains a feasible (approximate)
+ *         solution either way
+ * \note warm starts using z if z has the same dimension as q
+ */
+bool LCP::lcp_pgs(const MatrixNd& M, const VectorNd& q, VectorNd& z, unsigned max_iter, double tol, bool nncg)
+{
+  return ncp_pgs(M, q, z, _no_cones, max_iter, tol, nncg);
+}
+
+/// Projected Gauss-Seidel solver for LCPs with (true) Coulomb friction cones
+/**
+ * Variables not referenced by any cone are constrained to be non-negative;
+ * tangential variables are projected onto their friction disks.
+ * \param max_iter the maximum number of iterations
+ * \param tol the tolerance on the change in z between successive iterations
+ *        (relative to the magnitude of z)
+ * \param nncg if true, iterations are accelerated using nonsmooth nonlinear
+ *        conjugate gradients (Silcowitz et al., 2010)
+ * \return true if the solver converged; z contains a feasible (approximate)
+ *         solution either way
+ * \note warm starts using z if z has the same dimension as q
+ */
+bool LCP::ncp_pgs(const MatrixNd& M, const VectorNd& q, VectorNd& z, const vector<FrictionCone>& cones, unsigned max_iter, double tol, bool nncg)
+{
+  const unsigned N = q.rows();
+  const unsigned UINF = std::numeric_limits<unsigned>::max();
+
+  FILE_LOG(LOG_OPT) << "LCP::ncp_pgs() entered" << std::endl;
+
+  // look for trivial solution
+  iterations = 0;
+  if (N == 0)
+  {
+    FILE_LOG(LOG_OPT) << "LCP::ncp_pgs() - empty problem" << std::endl;
+    z.set_zero(0);
+    return true;
+  }
+
+  // map variables to friction cones
+  _cone_idx.resize(N);
+  std::fill(_cone_idx.begin(), _cone_idx.end(), UINF);
+  for (unsigned k=0; k< cones.size(); k++)
+  {
+    _cone_idx[cones[k].normal] = k;
+    _cone_idx[cones[k].tan1] = k;
+    _cone_idx[cones[k].tan2] = k;
+  }
+
+  // see whether to warm-start
+  if (z.size() == N)
+  {
+    FILE_LOG(LOG_OPT) << "LCP::ncp_pgs() - warm starting activated" << std::endl;
+    pgs_project(z, cones);
+  }
+  else
+    z.set_zero(N);
+
+  // iterate
+  double dz_nsq_last = 0.0;
+  for (iterations = 1; iterations <= max_iter; iterations++)
+  {
+    total_pivots++;
+
+    // do a Gauss-Seidel sweep
+    _zprev = z;
+    pgs_sweep(M, q, z, cones);
+
+    // compute the change in z (the negated gradient of the merit function)
+    (_dz = z) -= _zprev;
+    const double dz_nsq = _dz.norm_sq();
+
+    // check for convergence
+    if (_dz.norm_inf() <= tol * std::max((double) 1.0, z.norm_inf()))
+    {
+      FILE_LOG(LOG_OPT) << "LCP::ncp_pgs() - converged after " << iterations << " iterations" << std::endl;
+      return true;
+    }
+
+    // accelerate using nonsmooth nonlinear conjugate gradients
+    if (nncg)
+    {
+      if (iterations == 1)
+        _p = _dz;
+      else if (dz_nsq > dz_nsq_last)
+      {
+        // restart
+        _p.set_zero(N);
+      }
+      else
+      {
+        _p *= dz_nsq / dz_nsq_last;
+        z += _p;
+        _p += _dz;
+      }
+      dz_nsq_last = dz_nsq;
+    }
+  }
+
+  // the extrapolation may leave z outside of the feasible set
+  if (nncg)
+    pgs_project(z, cones);
+
+  iterations = max_iter;
+  FILE_LOG(LOG_OPT) << "LCP::ncp_pgs() - maximum number of iterations (" << max_iter << ") exceeded" << std::endl;
+  return false;
+}
+
+/// Does a single projected Gauss-Seidel sweep through the variables
+void LCP::pgs_sweep(const MatrixNd& M, const VectorNd& q, VectorNd& z, const vector<FrictionCone>& cones) const
+{
+  const unsigned N = q.rows();
+  const unsigned UINF = std::numeric_limits<unsigned>::max();
+
+  for (unsigned i=0; i< N; i++)
+  {
+    // get the cone, if any
+    const unsigned k = _cone_idx[i];
+
+    // unilateral (or normal) variable
+    if (k == UINF || cones[k].normal == i)
+    {
+      // variables with no diagonal term are not updated, but they are still
+      // projected (a warm started value may be infeasible)
+      const double mii = M(i,i);
+      if (mii > 0.0)
+        z[i] -= (VectorNd::dot(M.row(i), z) + q[i])/mii;
+      z[i] = std::max((double) 0.0, z[i]);
+    }
+    else if (cones[k].tan1 == i)
+    {
+      // update both tangential variables using the same step size (the 
+      // fixed point of the projection is then the maximally dissipative
+      // friction; a different step for each variable would skew it)
+      const unsigned j = cones[k].tan2;
+      const double mmax = std::max(M(i,i), M(j,j));
+      if (mmax > 0.0)
+      {
+        const double ri = VectorNd::dot(M.row(i), z) + q[i];
+        const double rj = VectorNd::dot(M.row(j), z) + q[j];
+        z[i] -= ri/mmax;
+        z[j] -= rj/mmax;
+      }
+
+      // project onto the friction disk
+      const double r = cones[k].mu*z[cones[k].normal];
+      const double s = std::sqrt(z[i]*z[i] + z[j]*z[j]);
+      if (s > r)
+      {
+        const double scal = (s > 0.0) ? std::max((double) 0.0, r)/s : 0.0;
+        z[i] *= scal;
+        z[j] *= scal;
+      }
+    }
+    // second tangential variables are updated along with the first
+  }
+}
+
+/// Projects z onto the feasible set
+void LCP::pgs_project(VectorNd& z, const vector<FrictionCone>& cones) const
+{
+  const unsigned UINF = std::numeric_limits<unsigned>::max();
+
+  // project unilateral and normal variables
+  for (unsigned i=0; i< z.size(); i++)
+    if (_cone_idx[i] == UINF || cones[_cone_idx[i]].normal == i)
+      z[i] = std::max((double) 0.0, z[i]);
+
+  // project tangential variables
+  for (unsigned k=0; k< cones.size(); k++)
+  {
+    double& zs = z[cones[k].tan1];
+    double& zt = z[cones[k].tan2];
+    const double r = std::max((double) 0.0, cones[k].mu*z[cones[k].normal]);
+    const double s = std::sqrt(zs*zs + zt*zt);
+    if (s > r)
+    {
+      const double scal = (s > 0.0) ? r/s : 0.0;
+      zs *= scal;
+      zt *= scal;
+    }
+  }
+}
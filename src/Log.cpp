@@ -4,14 +4,25 @@ using namespace Moby;
 
 std::ofstream OutputToFile::stream;
 
+/// Writes a complete message to the log
+/**
+ * Messages are formatted in a per-message buffer (see Log), so writing them
+ * in a critical section keeps messages logged from parallel regions (e.g.,
+ * the parallel narrow phase) from interleaving or racing on the stream.
+ */
 void OutputToFile::output(const std::string& msg)
 {
-  if (!stream.is_open())
+  #ifdef _OPENMP
+  #pragma omp critical (OutputToFile_output)
+  #endif
   {
-    std::ofstream stderr_stream("/dev/stderr", std::ofstream::app);
-    stderr_stream << msg << std::flush;
+    if (!stream.is_open())
+    {
+      std::ofstream stderr_stream("/dev/stderr", std::ofstream::app);
+      stderr_stream << msg << std::flush;
+    }
+    else
+      stream << msg << std::flush;
   }
-  else
-    stream << msg << std::flush;
 }
 
@@ -0,0 +1,680 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <boost/cstdint.hpp>
+#include <Ravelin/sorted_pair>
+#include <Moby/Log.h>
+#include <Moby/QuickHull.h>
+#include <Moby/MeshCache.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using boost::shared_ptr;
+using boost::weak_ptr;
+using boost::uint32_t;
+using boost::uint64_t;
+using std::list;
+using std::map;
+using std::string;
+using std::vector;
+using std::endl;
+
+std::map<unsigned long long, weak_ptr<const MeshCache::Entry> > MeshCache::_entries;
+
+// serializes access to the entries loaded by this process
+static pthread_mutex_t _cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// identifies a mesh cache file and its format version
+static const char MAGIC[8] = { 'M', 'O', 'B', 'Y', 'M', 'E', 'S', 'H' };
+static const uint32_t VERSION = 2;
+
+// identifies the byte order of the machine that wrote the file
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// the counts stored in the file header
+enum CountIndex { eVertices, eFacets, eIncidentFacets, eCoplanarVertices, eCoplanarEdges, eDistNodes, eHullVertices, eHullFacets, eConvex, eOBBNodes, eOBBTris, eNumCounts };
+
+// hashes bytes using 64-bit FNV-1a
+static unsigned long long hash_bytes(const void* bytes, size_t n, unsigned long long h)
+{
+  const unsigned char* c = (const unsigned char*) bytes;
+  for (size_t i=0; i< n; i++)
+  {
+    h ^= (unsigned long long) c[i];
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+// appends raw bytes to a buffer
+static void append(vector<char>& buffer, const void* data, size_t n)
+{
+  const char* c = (const char*) data;
+  buffer.insert(buffer.end(), c, c+n);
+}
+
+// appends an unsigned integer to a buffer
+static void append_uint(vector<char>& buffer, unsigned x)
+{
+  uint32_t y = (uint32_t) x;
+  append(buffer, &y, sizeof(uint32_t));
+}
+
+// appends the coordinates of a point to a buffer
+static void append_origin(vector<char>& buffer, const Origin3d& x)
+{
+  const double data[3] = { x[0], x[1], x[2] };
+  append(buffer, data, sizeof(data));
+}
+
+// appends a 3x3 matrix to a buffer (row-major)
+static void append_matrix(vector<char>& buffer, const Matrix3d& R)
+{
+  double data[9];
+  for (unsigned i=0, k=0; i< 3; i++)
+    for (unsigned j=0; j< 3; j++)
+      data[k++] = R(i,j);
+  append(buffer, data, sizeof(data));
+}
+
+// pads a buffer so that the next section starts on an 8-byte boundary
+static void pad(vector<char>& buffer)
+{
+  while (buffer.size() % 8 != 0)
+    buffer.push_back(0);
+}
+
+// reads from a memory-mapped file, checking bounds
+class MappedReader
+{
+  public:
+    MappedReader(const char* data, size_t size) { _begin = _p = data; _end = data + size; _ok = true; }
+    bool ok() const { return _ok; }
+
+    void read(void* x, size_t n)
+    {
+      if (!_ok || (size_t) (_end - _p) < n)
+      {
+        _ok = false;
+        std::memset(x, 0, n);
+        return;
+      }
+      std::memcpy(x, _p, n);
+      _p += n;
+    }
+
+    unsigned read_uint()
+    {
+      uint32_t x;
+      read(&x, sizeof(uint32_t));
+      return (unsigned) x;
+    }
+
+    Origin3d read_origin()
+    {
+      double data[3];
+      read(data, sizeof(data));
+      return Origin3d(data[0], data[1], data[2]);
+    }
+
+    Matrix3d read_matrix()
+    {
+      double data[9];
+      read(data, sizeof(data));
+      Matrix3d R;
+      for (unsigned i=0, k=0; i< 3; i++)
+        for (unsigned j=0; j< 3; j++)
+          R(i,j) = data[k++];
+      return R;
+    }
+
+    // verifies that n records of a given size remain (guards against
+    // allocating for corrupt counts); n is 64-bit so that sums of counts 
+    // do not wrap
+    bool remaining(unsigned long long n, size_t record_size)
+    {
+      if (_ok && record_size > 0 && n > (unsigned long long) ((_end - _p)/record_size))
+        _ok = false;
+      return _ok;
+    }
+
+    void align()
+    {
+      while (_ok && (_p - _begin) % 8 != 0)
+      {
+        if (_p == _end)
+          _ok = false;
+        else
+          _p++;
+      }
+    }
+
+  private:
+    const char* _begin;
+    const char* _p;
+    const char* _end;
+    bool _ok;
+};
+
+/// Loads a mesh from an OBJ file, using the cache if possible
+/**
+ * \param obj_filename the OBJ file
+ * \param cache_dir the directory used to store the binary mesh files (an
+ *        empty string disables the on-disk cache)
+ * \return the entry for the mesh; if the file cannot be read, the mesh in
+ *         the entry is empty
+ */
+shared_ptr<const MeshCache::Entry> MeshCache::load(const string& obj_filename, const string& cache_dir)
+{
+  // read the OBJ file
+  vector<char> contents;
+  FILE* fp = std::fopen(obj_filename.c_str(), "rb");
+  if (!fp)
+    return build(obj_filename);
+  const size_t BUF_SIZE = 65536;
+  char buffer[BUF_SIZE];
+  size_t n;
+  while ((n = std::fread(buffer, 1, BUF_SIZE, fp)) > 0)
+    contents.insert(contents.end(), buffer, buffer+n);
+  std::fclose(fp);
+
+  // compute the hash of the contents
+  const unsigned long long OBJ_SIZE = contents.size();
+  unsigned long long h = hash_bytes(contents.empty() ? NULL : &contents.front(), contents.size(), 14695981039346656037ULL);
+
+  pthread_mutex_lock(&_cache_mutex);
+
+  // look for an entry already loaded by this process
+  shared_ptr<const Entry> entry;
+  map<unsigned long long, weak_ptr<const Entry> >::const_iterator i = _entries.find(h);
+  if (i != _entries.end())
+    entry = i->second.lock();
+
+  // look for the binary mesh file
+  string fname;
+  if (!entry && !cache_dir.empty())
+  {
+    const unsigned MAX_DIGITS = 16;
+    char digits[MAX_DIGITS+1];
+    std::sprintf(digits, "%016llx", h);
+    fname = cache_dir + "/mesh" + string(digits) + ".mcache";
+    entry = read(fname, h, OBJ_SIZE);
+    if (entry)
+      FILE_LOG(LOG_COLDET) << "MeshCache::load() - loaded " << obj_filename << " from " << fname << endl;
+  }
+
+  // build the entry, if necessary, and save it to the cache
+  if (!entry)
+  {
+    shared_ptr<Entry> new_entry = build(obj_filename);
+    if (!fname.empty() && new_entry->mesh->num_tris() > 0)
+      write(fname, *new_entry, h, OBJ_SIZE);
+    entry = new_entry;
+  }
+
+  // save the entry for this process
+  _entries[h] = entry;
+
+  pthread_mutex_unlock(&_cache_mutex);
+
+  return entry;
+}
+
+/// Builds an entry by parsing an OBJ file and precomputing all data
+shared_ptr<MeshCache::Entry> MeshCache::build(const string& obj_filename)
+{
+  shared_ptr<Entry> entry(new Entry);
+
+  // read the mesh
+  shared_ptr<IndexedTriArray> mesh(new IndexedTriArray(IndexedTriArray::read_from_obj(obj_filename)));
+  entry->mesh = mesh;
+
+  // build the distance hierarchy
+  shared_ptr<MeshDistTree> tree(new MeshDistTree);
+  tree->build(*mesh);
+  entry->dist_tree = tree;
+
+  // build the bounding volume tree
+  shared_ptr<MeshOBBTree> obb_tree(new MeshOBBTree);
+  obb_tree->build(*mesh);
+  entry->obb_tree = obb_tree;
+
+  // compute the convex hull; it is left empty if the mesh is degenerate
+  if (mesh->num_tris() > 0)
+  {
+    const vector<Origin3d>& verts = mesh->get_vertices();
+    if (QuickHull::get_thread_workspace().calc_convex_hull_3D(verts, entry->hull_facets))
+      QuickHull::compact(entry->hull_facets, verts.size(), entry->hull_vertices);
+    else
+      entry->hull_facets.clear();
+  }
+
+  return entry;
+}
+
+/// Writes an entry to a binary mesh file
+/**
+ * The file is written under a temporary name and then renamed, so other
+ * processes never map a partially written file.
+ */
+void MeshCache::write(const string& filename, const Entry& entry, unsigned long long hash, unsigned long long obj_size)
+{
+  const IndexedTriArray& mesh = *entry.mesh;
+  const MeshDistTree& tree = *entry.dist_tree;
+  const MeshOBBTree& obb_tree = *entry.obb_tree;
+  const vector<Origin3d>& verts = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+  const vector<list<unsigned> >& incident = *mesh._incident_facets;
+
+  // count the incident facets
+  unsigned n_incident = 0;
+  for (unsigned i=0; i< incident.size(); i++)
+    n_incident += incident[i].size();
+
+  // write the header
+  vector<char> buffer;
+  append(buffer, MAGIC, sizeof(MAGIC));
+  append(buffer, &VERSION, sizeof(uint32_t));
+  append(buffer, &BYTE_ORDER_MARK, sizeof(uint32_t));
+  uint64_t h = hash, sz = obj_size;
+  append(buffer, &h, sizeof(uint64_t));
+  append(buffer, &sz, sizeof(uint64_t));
+  unsigned counts[eNumCounts];
+  counts[eVertices] = verts.size();
+  counts[eFacets] = facets.size();
+  counts[eIncidentFacets] = n_incident;
+  counts[eCoplanarVertices] = mesh._coplanar_verts.size();
+  counts[eCoplanarEdges] = mesh._coplanar_edges.size();
+  counts[eDistNodes] = tree._nodes.size();
+  counts[eHullVertices] = entry.hull_vertices.size();
+  counts[eHullFacets] = entry.hull_facets.size();
+  counts[eConvex] = (tree._convex) ? 1 : 0;
+  counts[eOBBNodes] = obb_tree._nodes.size();
+  counts[eOBBTris] = obb_tree._tris.size();
+  for (unsigned i=0; i< eNumCounts; i++)
+    append_uint(buffer, counts[i]);
+  pad(buffer);
+
+  // write the vertices and facets
+  for (unsigned i=0; i< verts.size(); i++)
+    append_origin(buffer, verts[i]);
+  for (unsigned i=0; i< facets.size(); i++)
+  {
+    append_uint(buffer, facets[i].a);
+    append_uint(buffer, facets[i].b);
+    append_uint(buffer, facets[i].c);
+  }
+  pad(buffer);
+
+  // write the incident facets as offsets and indices
+  for (unsigned i=0, offset=0; i< incident.size(); i++)
+  {
+    append_uint(buffer, offset);
+    offset += incident[i].size();
+  }
+  append_uint(buffer, n_incident);
+  for (unsigned i=0; i< incident.size(); i++)
+    for (list<unsigned>::const_iterator j = incident[i].begin(); j != incident[i].end(); j++)
+      append_uint(buffer, *j);
+  pad(buffer);
+
+  // write the coplanar features
+  for (unsigned i=0; i< mesh._coplanar_verts.size(); i++)
+    append_uint(buffer, mesh._coplanar_verts[i]);
+  for (unsigned i=0; i< mesh._coplanar_edges.size(); i++)
+  {
+    append_uint(buffer, mesh._coplanar_edges[i].first);
+    append_uint(buffer, mesh._coplanar_edges[i].second);
+  }
+  pad(buffer);
+
+  // write the distance hierarchy
+  for (unsigned i=0; i< tree._nodes.size(); i++)
+  {
+    append_origin(buffer, tree._nodes[i].lo);
+    append_origin(buffer, tree._nodes[i].hi);
+    append_uint(buffer, tree._nodes[i].first);
+    append_uint(buffer, tree._nodes[i].n);
+  }
+  for (unsigned i=0; i< tree._tris.size(); i++)
+    append_uint(buffer, tree._tris[i]);
+  pad(buffer);
+  for (unsigned i=0; i< tree._tri_normals.size(); i++)
+    append_origin(buffer, tree._tri_normals[i]);
+  for (unsigned i=0; i< tree._vertex_normals.size(); i++)
+    append_origin(buffer, tree._vertex_normals[i]);
+  for (unsigned i=0; i< tree._edge_normals.size(); i++)
+    append_origin(buffer, tree._edge_normals[i]);
+
+  // write the convex hull
+  for (unsigned i=0; i< entry.hull_vertices.size(); i++)
+    append_uint(buffer, entry.hull_vertices[i]);
+  for (unsigned i=0; i< entry.hull_facets.size(); i++)
+  {
+    append_uint(buffer, entry.hull_facets[i].a);
+    append_uint(buffer, entry.hull_facets[i].b);
+    append_uint(buffer, entry.hull_facets[i].c);
+  }
+  pad(buffer);
+
+  // write the bounding volume tree
+  for (unsigned i=0; i< obb_tree._nodes.size(); i++)
+  {
+    const MeshOBBTree::Node& node = obb_tree._nodes[i];
+    append_origin(buffer, node.center);
+    append_matrix(buffer, node.R);
+    append_origin(buffer, node.l);
+    append_uint(buffer, node.first_child);
+    append_uint(buffer, node.n_children);
+    append_uint(buffer, node.first_tri);
+    append_uint(buffer, node.n_tris);
+  }
+  for (unsigned i=0; i< obb_tree._tris.size(); i++)
+    append_uint(buffer, obb_tree._tris[i]);
+
+  // write the file under a temporary name
+  char pid[32];
+  std::sprintf(pid, ".%d", (int) getpid());
+  string tmp_filename = filename + pid;
+  FILE* fp = std::fopen(tmp_filename.c_str(), "wb");
+  if (!fp)
+  {
+    FILE_LOG(LOG_COLDET) << "MeshCache::write() - unable to open " << tmp_filename << endl;
+    return;
+  }
+  bool written = (std::fwrite(&buffer.front(), 1, buffer.size(), fp) == buffer.size());
+  written = (std::fclose(fp) == 0) && written;
+
+  // move it into place
+  if (!written || std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+  {
+    FILE_LOG(LOG_COLDET) << "MeshCache::write() - unable to write " << filename << endl;
+    std::remove(tmp_filename.c_str());
+  }
+}
+
+/// Reads an entry from a memory-mapped binary mesh file
+/**
+ * The data are validated and copied out of the mapping, which is released
+ * before returning; the entry does not refer to the file.
+ * \return the entry, or a null pointer if the file does not exist, was
+ *         written for different OBJ contents or a different machine, or is
+ *         corrupt
+ */
+shared_ptr<MeshCache::Entry> MeshCache::read(const string& filename, unsigned long long hash, unsigned long long obj_size)
+{
+  // map the file
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return shared_ptr<Entry>();
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    close(fd);
+    return shared_ptr<Entry>();
+  }
+  const size_t SIZE = (size_t) st.st_size;
+  void* addr = mmap(NULL, SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return shared_ptr<Entry>();
+  MappedReader in((const char*) addr, SIZE);
+
+  // verify the header
+  char magic[sizeof(MAGIC)];
+  in.read(magic, sizeof(MAGIC));
+  uint32_t version, bom;
+  in.read(&version, sizeof(uint32_t));
+  in.read(&bom, sizeof(uint32_t));
+  uint64_t h, sz;
+  in.read(&h, sizeof(uint64_t));
+  in.read(&sz, sizeof(uint64_t));
+  if (!in.ok() || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || bom != BYTE_ORDER_MARK || h != hash || sz != obj_size)
+  {
+    munmap(addr, SIZE);
+    return shared_ptr<Entry>();
+  }
+  unsigned counts[eNumCounts];
+  for (unsigned i=0; i< eNumCounts; i++)
+    counts[i] = in.read_uint();
+  in.align();
+  const unsigned NV = counts[eVertices], NF = counts[eFacets];
+  const unsigned NHV = counts[eHullVertices];
+
+  // read the vertices and facets
+  shared_ptr<vector<Origin3d> > verts(new vector<Origin3d>);
+  shared_ptr<vector<IndexedTri> > facets(new vector<IndexedTri>);
+  if (in.remaining(NV, sizeof(double)*3))
+  {
+    verts->resize(NV);
+    for (unsigned i=0; i< NV; i++)
+      (*verts)[i] = in.read_origin();
+  }
+  if (in.remaining(NF, sizeof(uint32_t)*3))
+  {
+    facets->resize(NF);
+    for (unsigned i=0; i< NF; i++)
+    {
+      (*facets)[i].a = in.read_uint();
+      (*facets)[i].b = in.read_uint();
+      (*facets)[i].c = in.read_uint();
+      if ((*facets)[i].a >= NV || (*facets)[i].b >= NV || (*facets)[i].c >= NV)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+    }
+  }
+  in.align();
+
+  // read the incident facets
+  shared_ptr<vector<list<unsigned> > > incident(new vector<list<unsigned> >);
+  vector<unsigned> offsets;
+  if (in.remaining((unsigned long long) NV+1, sizeof(uint32_t)))
+  {
+    offsets.resize((size_t) NV+1);
+    for (unsigned i=0; i<= NV; i++)
+      offsets[i] = in.read_uint();
+  }
+  if (in.ok() && in.remaining(counts[eIncidentFacets], sizeof(uint32_t)) && offsets.back() == counts[eIncidentFacets])
+  {
+    incident->resize(NV);
+    for (unsigned i=0; i< NV; i++)
+    {
+      if (offsets[i] > offsets[i+1])
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+      for (unsigned j=offsets[i]; j< offsets[i+1]; j++)
+      {
+        const unsigned F = in.read_uint();
+        if (F >= NF)
+        {
+          munmap(addr, SIZE);
+          return shared_ptr<Entry>();
+        }
+        (*incident)[i].push_back(F);
+      }
+    }
+  }
+  in.align();
+
+  // read the coplanar features
+  vector<unsigned> coplanar_verts;
+  vector<sorted_pair<unsigned> > coplanar_edges;
+  if (in.remaining(counts[eCoplanarVertices], sizeof(uint32_t)))
+  {
+    coplanar_verts.resize(counts[eCoplanarVertices]);
+    for (unsigned i=0; i< coplanar_verts.size(); i++)
+      if ((coplanar_verts[i] = in.read_uint()) >= NV)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+  }
+  if (in.remaining(counts[eCoplanarEdges], sizeof(uint32_t)*2))
+  {
+    coplanar_edges.reserve(counts[eCoplanarEdges]);
+    for (unsigned i=0; i< counts[eCoplanarEdges]; i++)
+    {
+      unsigned v1 = in.read_uint();
+      unsigned v2 = in.read_uint();
+      if (v1 >= NV || v2 >= NV)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+      coplanar_edges.push_back(make_sorted_pair(v1, v2));
+    }
+  }
+  in.align();
+
+  // read the distance hierarchy
+  shared_ptr<MeshDistTree> tree(new MeshDistTree);
+  const unsigned NN = counts[eDistNodes];
+  if (in.remaining(NN, sizeof(double)*6 + sizeof(uint32_t)*2))
+  {
+    tree->_nodes.resize(NN);
+    for (unsigned i=0; i< NN; i++)
+    {
+      MeshDistTree::Node& node = tree->_nodes[i];
+      node.lo = in.read_origin();
+      node.hi = in.read_origin();
+      node.first = in.read_uint();
+      node.n = in.read_uint();
+      // children of an internal node follow it (so the hierarchy has no
+      // cycles) and leaves index valid ranges of triangles
+      if ((node.n == 0 && (node.first <= i || node.first >= NN-1)) || (node.n > 0 && (node.first > NF || node.n > NF - node.first)))
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+    }
+  }
+  if (in.remaining(NF, sizeof(uint32_t)))
+  {
+    tree->_tris.resize(NF);
+    for (unsigned i=0; i< NF; i++)
+      if ((tree->_tris[i] = in.read_uint()) >= NF)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+  }
+  in.align();
+  if (in.remaining((unsigned long long) NF*4 + NV, sizeof(double)*3))
+  {
+    tree->_tri_normals.resize(NF);
+    for (unsigned i=0; i< NF; i++)
+      tree->_tri_normals[i] = in.read_origin();
+    tree->_vertex_normals.resize(NV);
+    for (unsigned i=0; i< NV; i++)
+      tree->_vertex_normals[i] = in.read_origin();
+    tree->_edge_normals.resize(NF*3);
+    for (unsigned i=0; i< NF*3; i++)
+      tree->_edge_normals[i] = in.read_origin();
+  }
+  tree->_convex = (counts[eConvex] != 0);
+
+  // read the convex hull
+  shared_ptr<Entry> entry(new Entry);
+  if (in.remaining(NHV, sizeof(uint32_t)))
+  {
+    entry->hull_vertices.resize(NHV);
+    for (unsigned i=0; i< NHV; i++)
+      if ((entry->hull_vertices[i] = in.read_uint()) >= NV)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+  }
+  if (in.remaining(counts[eHullFacets], sizeof(uint32_t)*3))
+  {
+    entry->hull_facets.resize(counts[eHullFacets]);
+    for (unsigned i=0; i< entry->hull_facets.size(); i++)
+    {
+      IndexedTri& f = entry->hull_facets[i];
+      f.a = in.read_uint();
+      f.b = in.read_uint();
+      f.c = in.read_uint();
+      if (f.a >= NHV || f.b >= NHV || f.c >= NHV)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+    }
+  }
+  in.align();
+
+  // read the bounding volume tree
+  shared_ptr<MeshOBBTree> obb_tree(new MeshOBBTree);
+  const unsigned NON = counts[eOBBNodes], NOT = counts[eOBBTris];
+  if (in.remaining(NON, sizeof(double)*15 + sizeof(uint32_t)*4))
+  {
+    obb_tree->_nodes.resize(NON);
+    for (unsigned i=0; i< NON; i++)
+    {
+      MeshOBBTree::Node& node = obb_tree->_nodes[i];
+      node.center = in.read_origin();
+      node.R = in.read_matrix();
+      node.l = in.read_origin();
+      node.first_child = in.read_uint();
+      node.n_children = in.read_uint();
+      node.first_tri = in.read_uint();
+      node.n_tris = in.read_uint();
+      // children of a node follow it (so the tree has no cycles) and every
+      // node indexes a valid range of triangles
+      if ((node.n_children > 0 && (node.first_child <= i || node.first_child >= NON || node.n_children > NON - node.first_child)) || node.first_tri > NOT || node.n_tris > NOT - node.first_tri)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+    }
+  }
+  if (in.remaining(NOT, sizeof(uint32_t)))
+  {
+    obb_tree->_tris.resize(NOT);
+    for (unsigned i=0; i< NOT; i++)
+      if ((obb_tree->_tris[i] = in.read_uint()) >= NF)
+      {
+        munmap(addr, SIZE);
+        return shared_ptr<Entry>();
+      }
+  }
+
+  // done with the file
+  munmap(addr, SIZE);
+  if (!in.ok())
+  {
+    FILE_LOG(LOG_COLDET) << "MeshCache::read() - " << filename << " is truncated" << endl;
+    return shared_ptr<Entry>();
+  }
+
+  // setup the mesh without recomputing incident facets or coplanar features
+  shared_ptr<IndexedTriArray> mesh(new IndexedTriArray);
+  mesh->_vertices = verts;
+  mesh->_facets = facets;
+  mesh->_incident_facets = incident;
+  mesh->_coplanar_verts = coplanar_verts;
+  mesh->_coplanar_edges = coplanar_edges;
+  entry->mesh = mesh;
+  entry->dist_tree = tree;
+  entry->obb_tree = obb_tree;
+
+  return entry;
+}
+
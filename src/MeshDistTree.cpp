@@ -0,0 +1,666 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <cmath>
+#include <map>
+#include <stack>
+#include <limits>
+#include <algorithm>
+#include <boost/tuple/tuple.hpp>
+#include <Ravelin/sorted_pair>
+#include <Moby/Constants.h>
+#include <Moby/Triangle.h>
+#include <Moby/MeshDistTree.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using std::map;
+using std::vector;
+using std::stack;
+
+// computes the dot product of two origins
+static double dot3(const Origin3d& a, const Origin3d& b)
+{
+  return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// computes the cross product of two origins
+static Origin3d cross3(const Origin3d& a, const Origin3d& b)
+{
+  return Origin3d(a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]);
+}
+
+// normalizes an origin (leaves zero vectors unchanged)
+static Origin3d normalize3(const Origin3d& a)
+{
+  double nrm = std::sqrt(dot3(a, a));
+  return (nrm > 0.0) ? a*(1.0/nrm) : a;
+}
+
+// computes the squared distance from a point to an axis-aligned box
+static double calc_box_sq_dist(const Origin3d& p, const Origin3d& lo, const Origin3d& hi)
+{
+  double dist_sq = 0.0;
+  for (unsigned i=0; i< 3; i++)
+  {
+    if (p[i] < lo[i])
+      dist_sq += (lo[i] - p[i])*(lo[i] - p[i]);
+    else if (p[i] > hi[i])
+      dist_sq += (p[i] - hi[i])*(p[i] - hi[i]);
+  }
+
+  return dist_sq;
+}
+
+// computes the closest point on a triangle to a point (Ericson, Real-Time 
+// Collision Detection, 5.1.5) and determines the feature of the triangle 
+// that the closest point lies on (one of the Triangle::FeatureType values)
+static Origin3d calc_closest_point_on_tri(const Origin3d& p, const Origin3d& a, const Origin3d& b, const Origin3d& c, Triangle::FeatureType& feature)
+{
+  // check whether p lies in the vertex region outside of a
+  Origin3d ab = b - a, ac = c - a, ap = p - a;
+  double d1 = dot3(ab, ap), d2 = dot3(ac, ap);
+  if (d1 <= 0.0 && d2 <= 0.0)
+  {
+    feature = Triangle::eVertexA;
+    return a;
+  }
+
+  // check whether p lies in the vertex region outside of b
+  Origin3d bp = p - b;
+  double d3 = dot3(ab, bp), d4 = dot3(ac, bp);
+  if (d3 >= 0.0 && d4 <= d3)
+  {
+    feature = Triangle::eVertexB;
+    return b;
+  }
+
+  // check whether p lies in the edge region of ab
+  double vc = d1*d4 - d3*d2;
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+  {
+    feature = Triangle::eEdgeAB;
+    return a + ab*(d1/(d1 - d3));
+  }
+
+  // check whether p lies in the vertex region outside of c
+  Origin3d cp = p - c;
+  double d5 = dot3(ab, cp), d6 = dot3(ac, cp);
+  if (d6 >= 0.0 && d5 <= d6)
+  {
+    feature = Triangle::eVertexC;
+    return c;
+  }
+
+  // check whether p lies in the edge region of ac
+  double vb = d5*d2 - d1*d6;
+  if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+  {
+    feature = Triangle::eEdgeAC;
+    return a + ac*(d2/(d2 - d6));
+  }
+
+  // check whether p lies in the edge region of bc
+  double va = d3*d6 - d5*d4;
+  if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+  {
+    feature = Triangle::eEdgeBC;
+    return b + (c - b)*((d4 - d3)/((d4 - d3) + (d5 - d6)));
+  }
+
+  // p lies in the face region; degenerate triangles are handled by the
+  // edge and vertex regions above
+  double denom = va + vb + vc;
+  if (std::fabs(denom) < std::numeric_limits<double>::epsilon())
+  {
+    feature = Triangle::eVertexA;
+    return a;
+  }
+  feature = Triangle::eFace;
+  return a + ab*(vb/denom) + ac*(vc/denom);
+}
+
+// computes the closest points between segments p1q1 and p2q2 (Ericson, 
+// Real-Time Collision Detection, 5.1.9); returns the squared distance 
+// between them and the segment parameters of the closest points
+static double calc_closest_points_seg_seg(const Origin3d& p1, const Origin3d& q1, const Origin3d& p2, const Origin3d& q2, double& s, double& t, Origin3d& c1, Origin3d& c2)
+{
+  const double EPS = std::numeric_limits<double>::epsilon();
+  Origin3d d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+  double a = dot3(d1, d1), e = dot3(d2, d2), f = dot3(d2, r);
+
+  // check whether both segments degenerate into points
+  if (a <= EPS && e <= EPS)
+  {
+    s = t = 0.0;
+    c1 = p1;
+    c2 = p2;
+    return dot3(c1 - c2, c1 - c2);
+  }
+
+  if (a <= EPS)
+  {
+    // the first segment degenerates into a point
+    s = 0.0;
+    t = std::max(0.0, std::min(1.0, f/e));
+  }
+  else
+  {
+    double c = dot3(d1, r);
+    if (e <= EPS)
+    {
+      // the second segment degenerates into a point
+      t = 0.0;
+      s = std::max(0.0, std::min(1.0, -c/a));
+    }
+    else
+    {
+      // the general case; pick an arbitrary s if the segments are parallel
+      double b = dot3(d1, d2);
+      double denom = a*e - b*b;
+      s = (denom > 0.0) ? std::max(0.0, std::min(1.0, (b*f - c*e)/denom)) : 0.0;
+      t = (b*s + f)/e;
+      if (t < 0.0)
+      {
+        t = 0.0;
+        s = std::max(0.0, std::min(1.0, -c/a));
+      }
+      else if (t > 1.0)
+      {
+        t = 1.0;
+        s = std::max(0.0, std::min(1.0, (b - c)/a));
+      }
+    }
+  }
+
+  c1 = p1 + d1*s;
+  c2 = p2 + d2*t;
+  return dot3(c1 - c2, c1 - c2);
+}
+
+// computes the squared distance between two axis-aligned boxes
+static double calc_box_box_sq_dist(const Origin3d& lo1, const Origin3d& hi1, const Origin3d& lo2, const Origin3d& hi2)
+{
+  double dist_sq = 0.0;
+  for (unsigned i=0; i< 3; i++)
+  {
+    if (hi1[i] < lo2[i])
+      dist_sq += (lo2[i] - hi1[i])*(lo2[i] - hi1[i]);
+    else if (hi2[i] < lo1[i])
+      dist_sq += (lo1[i] - hi2[i])*(lo1[i] - hi2[i]);
+  }
+
+  return dist_sq;
+}
+
+// compares triangles using their centroids along an axis
+struct CentroidLess
+{
+  CentroidLess(const vector<Origin3d>& centroids, unsigned axis) : _centroids(centroids), _axis(axis) {}
+  bool operator()(unsigned i, unsigned j) const { return _centroids[i][_axis] < _centroids[j][_axis]; }
+
+  private:
+    const vector<Origin3d>& _centroids;
+    unsigned _axis;
+};
+
+/// Builds the hierarchy and pseudo-normals for a mesh and determines whether the mesh is convex
+/**
+ * The hierarchy is an axis-aligned box tree, built top-down by splitting 
+ * triangles at the median centroid along the longest axis. Pseudo-normals
+ * (Baerentzen and Aanaes, 2005) permit determining whether a point is inside
+ * a closed (and possibly non-convex) mesh from the feature closest to the 
+ * point. 
+ */
+void MeshDistTree::build(const IndexedTriArray& mesh)
+{
+  const unsigned LEAF_TRIS = 4;
+  const double INF = std::numeric_limits<double>::max();
+
+  // clear existing data
+  _nodes.clear();
+  _tris.clear();
+  _tri_normals.clear();
+  _vertex_normals.clear();
+  _edge_normals.clear();
+  _convex = true;
+
+  // if there are no triangles, quit now
+  if (mesh.num_tris() == 0)
+    return;
+
+  // get the vertices and facets
+  const vector<Origin3d>& verts = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+  const unsigned NT = facets.size();
+
+  // compute the triangle normals and vertex pseudo-normals
+  _tri_normals.resize(NT);
+  _vertex_normals.resize(verts.size(), Origin3d(0.0, 0.0, 0.0));
+  for (unsigned i=0; i< NT; i++)
+  {
+    const unsigned idx[3] = { facets[i].a, facets[i].b, facets[i].c };
+    _tri_normals[i] = normalize3(cross3(verts[idx[1]] - verts[idx[0]], verts[idx[2]] - verts[idx[0]]));
+
+    // weight the normal by the angle of the triangle at each vertex
+    for (unsigned j=0; j< 3; j++)
+    {
+      Origin3d e1 = normalize3(verts[idx[(j+1)%3]] - verts[idx[j]]);
+      Origin3d e2 = normalize3(verts[idx[(j+2)%3]] - verts[idx[j]]);
+      double angle = std::acos(std::max(-1.0, std::min(1.0, dot3(e1, e2))));
+      _vertex_normals[idx[j]] += _tri_normals[i]*angle;
+    }
+  }
+  for (unsigned i=0; i< _vertex_normals.size(); i++)
+    _vertex_normals[i] = normalize3(_vertex_normals[i]);
+
+  // determine the triangles incident to each edge 
+  map<sorted_pair<unsigned>, vector<unsigned> > edge_tris;
+  for (unsigned i=0; i< NT; i++)
+  {
+    edge_tris[make_sorted_pair(facets[i].a, facets[i].b)].push_back(i);
+    edge_tris[make_sorted_pair(facets[i].b, facets[i].c)].push_back(i);
+    edge_tris[make_sorted_pair(facets[i].c, facets[i].a)].push_back(i);
+  }
+
+  // compute the edge pseudo-normals 
+  _edge_normals.resize(NT*3);
+  for (unsigned i=0; i< NT; i++)
+  {
+    const unsigned idx[3] = { facets[i].a, facets[i].b, facets[i].c };
+    for (unsigned j=0; j< 3; j++)
+    {
+      const vector<unsigned>& tris = edge_tris[make_sorted_pair(idx[j], idx[(j+1)%3])];
+      Origin3d n(0.0, 0.0, 0.0);
+      for (unsigned k=0; k< tris.size(); k++)
+        n += _tri_normals[tris[k]];
+      _edge_normals[i*3+j] = normalize3(n);
+    }
+  }
+
+  // compute the bounding box of the mesh (for the convexity tolerance)
+  Origin3d lo(INF, INF, INF), hi(-INF, -INF, -INF);
+  for (unsigned i=0; i< verts.size(); i++)
+    for (unsigned j=0; j< 3; j++)
+    {
+      lo[j] = std::min(lo[j], verts[i][j]);
+      hi[j] = std::max(hi[j], verts[i][j]);
+    }
+  const double CVX_TOL = NEAR_ZERO * std::max(1.0, std::sqrt(dot3(hi - lo, hi - lo)));
+
+  // the mesh is convex if it is closed and the dihedral angle at every edge 
+  // is convex
+  for (map<sorted_pair<unsigned>, vector<unsigned> >::const_iterator i = edge_tris.begin(); i != edge_tris.end() && _convex; i++)
+  {
+    // open and non-manifold meshes are treated as non-convex
+    if (i->second.size() != 2)
+    {
+      _convex = false;
+      break;
+    }
+
+    // get the vertex of the second triangle that is not on the edge 
+    const IndexedTri& f1 = facets[i->second[0]];
+    const IndexedTri& f2 = facets[i->second[1]];
+    unsigned opp = f2.a;
+    if (opp == i->first.first || opp == i->first.second)
+      opp = f2.b;
+    if (opp == i->first.first || opp == i->first.second)
+      opp = f2.c;
+
+    // that vertex must not be in front of the first triangle
+    if (dot3(_tri_normals[i->second[0]], verts[opp] - verts[f1.a]) > CVX_TOL)
+      _convex = false;
+  }
+
+  // compute the triangle centroids
+  vector<Origin3d> centroids(NT);
+  for (unsigned i=0; i< NT; i++)
+    centroids[i] = (verts[facets[i].a] + verts[facets[i].b] + verts[facets[i].c])*(1.0/3.0);
+
+  // setup the triangle indices
+  _tris.resize(NT);
+  for (unsigned i=0; i< NT; i++)
+    _tris[i] = i;
+
+  // build the tree top-down; each stack entry holds a node index and the
+  // range of triangles that it covers
+  _nodes.reserve(2*NT);
+  _nodes.push_back(Node());
+  stack<boost::tuple<unsigned, unsigned, unsigned> > S;
+  S.push(boost::make_tuple(0, 0, NT));
+  while (!S.empty())
+  {
+    const unsigned NODE = S.top().get<0>();
+    const unsigned BEGIN = S.top().get<1>();
+    const unsigned END = S.top().get<2>();
+    S.pop();
+
+    // compute the bounds of the triangles and of their centroids
+    Origin3d blo(INF, INF, INF), bhi(-INF, -INF, -INF);
+    Origin3d clo(INF, INF, INF), chi(-INF, -INF, -INF);
+    for (unsigned i=BEGIN; i< END; i++)
+    {
+      const IndexedTri& f = facets[_tris[i]];
+      const unsigned idx[3] = { f.a, f.b, f.c };
+      for (unsigned j=0; j< 3; j++)
+      {
+        blo[j] = std::min(blo[j], std::min(verts[idx[0]][j], std::min(verts[idx[1]][j], verts[idx[2]][j])));
+        bhi[j] = std::max(bhi[j], std::max(verts[idx[0]][j], std::max(verts[idx[1]][j], verts[idx[2]][j])));
+        clo[j] = std::min(clo[j], centroids[_tris[i]][j]);
+        chi[j] = std::max(chi[j], centroids[_tris[i]][j]);
+      }
+    }
+    _nodes[NODE].lo = blo;
+    _nodes[NODE].hi = bhi;
+
+    // create a leaf if there are few triangles 
+    if (END - BEGIN <= LEAF_TRIS)
+    {
+      _nodes[NODE].first = BEGIN;
+      _nodes[NODE].n = END - BEGIN;
+      continue;
+    }
+
+    // split at the median centroid along the longest axis
+    unsigned axis = 0;
+    for (unsigned j=1; j< 3; j++)
+      if (chi[j] - clo[j] > chi[axis] - clo[axis])
+        axis = j;
+    const unsigned MID = (BEGIN + END)/2;
+    std::nth_element(_tris.begin()+BEGIN, _tris.begin()+MID, _tris.begin()+END, CentroidLess(centroids, axis));
+
+    // create the children
+    const unsigned CHILD = _nodes.size();
+    _nodes[NODE].first = CHILD;
+    _nodes[NODE].n = 0;
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+    S.push(boost::make_tuple(CHILD, BEGIN, MID));
+    S.push(boost::make_tuple(CHILD+1, MID, END));
+  }
+}
+
+/// Finds the closest point on the mesh to a point (in the mesh frame)
+/**
+ * \param mesh the mesh that the hierarchy was built for
+ * \param p the query point 
+ * \param closest the closest point on the mesh on return
+ * \param normal on return, the pseudo-normal of the feature that the closest
+ *        point lies on
+ * \return the signed distance from the mesh (negative if p is inside)
+ */
+double MeshDistTree::calc_closest_point(const IndexedTriArray& mesh, const Origin3d& p, Origin3d& closest, Origin3d& normal) const
+{
+  double min_dist_sq = std::numeric_limits<double>::max();
+  unsigned closest_tri = 0;
+  Triangle::FeatureType closest_feat = Triangle::eNone;
+
+  // if there is no mesh, the point is infinitely far away
+  if (_nodes.empty())
+    return std::numeric_limits<double>::max();
+
+  // get the vertices and facets
+  const vector<Origin3d>& verts = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+
+  // traverse the hierarchy, visiting nearer children first
+  vector<unsigned> S;
+  S.reserve(64);
+  S.push_back(0);
+  while (!S.empty())
+  {
+    const Node& node = _nodes[S.back()];
+    S.pop_back();
+    if (calc_box_sq_dist(p, node.lo, node.hi) >= min_dist_sq)
+      continue;
+
+    // check triangles in leafs
+    if (node.n > 0)
+    {
+      for (unsigned i=node.first; i< node.first + node.n; i++)
+      {
+        const IndexedTri& f = facets[_tris[i]];
+        Triangle::FeatureType feat;
+        Origin3d cp = calc_closest_point_on_tri(p, verts[f.a], verts[f.b], verts[f.c], feat);
+        double dist_sq = dot3(p - cp, p - cp);
+        if (dist_sq < min_dist_sq)
+        {
+          min_dist_sq = dist_sq;
+          closest = cp;
+          closest_tri = _tris[i];
+          closest_feat = feat;
+        }
+      }
+      continue;
+    }
+
+    // push the farther child first
+    const unsigned C1 = node.first, C2 = node.first + 1;
+    double d1 = calc_box_sq_dist(p, _nodes[C1].lo, _nodes[C1].hi);
+    double d2 = calc_box_sq_dist(p, _nodes[C2].lo, _nodes[C2].hi);
+    if (d1 < d2)
+    {
+      S.push_back(C2);
+      S.push_back(C1);
+    }
+    else
+    {
+      S.push_back(C1);
+      S.push_back(C2);
+    }
+  }
+
+  // get the pseudo-normal of the closest feature
+  const IndexedTri& f = facets[closest_tri];
+  switch (closest_feat)
+  {
+    case Triangle::eVertexA:  normal = _vertex_normals[f.a]; break;
+    case Triangle::eVertexB:  normal = _vertex_normals[f.b]; break;
+    case Triangle::eVertexC:  normal = _vertex_normals[f.c]; break;
+    case Triangle::eEdgeAB:   normal = _edge_normals[closest_tri*3]; break;
+    case Triangle::eEdgeBC:   normal = _edge_normals[closest_tri*3+1]; break;
+    case Triangle::eEdgeAC:   normal = _edge_normals[closest_tri*3+2]; break;
+    default:                  normal = _tri_normals[closest_tri]; break;
+  }
+
+  // the point is inside if it is behind the pseudo-normal
+  double dist = std::sqrt(min_dist_sq);
+  return (dot3(p - closest, normal) < 0.0) ? -dist : dist;
+}
+
+/// Finds the closest points between a segment and the mesh (in the mesh frame)
+/**
+ * Used to find edge crossings, which vertex queries miss: a segment that
+ * passes through a triangle has zero distance even if both of its endpoints
+ * are outside of the mesh.
+ * \param mesh the mesh that the hierarchy was built for
+ * \param p the first endpoint of the segment
+ * \param q the second endpoint of the segment
+ * \param cseg the closest point on the segment on return
+ * \param cmesh the closest point on the mesh on return
+ * \param normal on return, the unit normal of the triangle that the closest
+ *        point on the mesh lies on 
+ * \param t on return, the parameter of cseg along the segment (0 at p and 1 at q)
+ * \return the (unsigned) distance between the segment and the mesh 
+ */
+double MeshDistTree::calc_closest_points(const IndexedTriArray& mesh, const Origin3d& p, const Origin3d& q, Origin3d& cseg, Origin3d& cmesh, Origin3d& normal, double& t) const
+{
+  double min_dist_sq = std::numeric_limits<double>::max();
+
+  // if there is no mesh, the segment is infinitely far away
+  if (_nodes.empty())
+    return std::numeric_limits<double>::max();
+
+  // get the vertices and facets
+  const vector<Origin3d>& verts = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+
+  // get the bounding box of the segment
+  Origin3d slo, shi;
+  for (unsigned i=0; i< 3; i++)
+  {
+    slo[i] = std::min(p[i], q[i]);
+    shi[i] = std::max(p[i], q[i]);
+  }
+
+  // traverse the hierarchy; the box of the segment gives a lower bound on 
+  // the distance to a node
+  vector<unsigned> S;
+  S.reserve(64);
+  S.push_back(0);
+  while (!S.empty() && min_dist_sq > 0.0)
+  {
+    const Node& node = _nodes[S.back()];
+    S.pop_back();
+    if (calc_box_box_sq_dist(slo, shi, node.lo, node.hi) >= min_dist_sq)
+      continue;
+    if (node.n == 0)
+    {
+      S.push_back(node.first);
+      S.push_back(node.first+1);
+      continue;
+    }
+
+    // check triangles in the leaf
+    for (unsigned i=node.first; i< node.first + node.n && min_dist_sq > 0.0; i++)
+    {
+      const unsigned TRI = _tris[i];
+      const IndexedTri& f = facets[TRI];
+      const Origin3d* v[3] = { &verts[f.a], &verts[f.b], &verts[f.c] };
+      const Origin3d& n = _tri_normals[TRI];
+
+      // degenerate triangles have no normal (and are covered by their 
+      // neighbors)
+      if (dot3(n, n) == 0.0)
+        continue;
+
+      // see whether the segment crosses the triangle 
+      double dp = dot3(n, p - *v[0]), dq = dot3(n, q - *v[0]);
+      if ((dp <= 0.0 && dq >= 0.0) || (dp >= 0.0 && dq <= 0.0))
+      {
+        double s = (dp != dq) ? dp/(dp - dq) : 0.0;
+        Origin3d x = p + (q - p)*s;
+        Triangle::FeatureType feat;
+        Origin3d cp = calc_closest_point_on_tri(x, *v[0], *v[1], *v[2], feat);
+        if (feat == Triangle::eFace)
+        {
+          min_dist_sq = 0.0;
+          cseg = cmesh = cp;
+          normal = n;
+          t = s;
+          break;
+        }
+      }
+
+      // otherwise, the closest points lie on the boundary of the segment or
+      // of the triangle
+      for (unsigned j=0; j< 2; j++)
+      {
+        const Origin3d& x = (j == 0) ? p : q;
+        Triangle::FeatureType feat;
+        Origin3d cp = calc_closest_point_on_tri(x, *v[0], *v[1], *v[2], feat);
+        double dist_sq = dot3(x - cp, x - cp);
+        if (dist_sq < min_dist_sq)
+        {
+          min_dist_sq = dist_sq;
+          cseg = x;
+          cmesh = cp;
+          normal = n;
+          t = (double) j;
+        }
+      }
+      for (unsigned j=0; j< 3; j++)
+      {
+        double s, u;
+        Origin3d c1, c2;
+        double dist_sq = calc_closest_points_seg_seg(p, q, *v[j], *v[(j+1)%3], s, u, c1, c2);
+        if (dist_sq < min_dist_sq)
+        {
+          min_dist_sq = dist_sq;
+          cseg = c1;
+          cmesh = c2;
+          normal = n;
+          t = s;
+        }
+      }
+    }
+  }
+
+  return std::sqrt(min_dist_sq);
+}
+
+/// Translates the hierarchy along with its mesh
+/**
+ * Pseudo-normals and convexity are unaffected by translation, so this is
+ * much cheaper than rebuilding the hierarchy for the translated mesh.
+ */
+void MeshDistTree::translate(const Origin3d& dx)
+{
+  for (unsigned i=0; i< _nodes.size(); i++)
+  {
+    _nodes[i].lo += dx;
+    _nodes[i].hi += dx;
+  }
+}
+
+/// Gets the indices of the vertices of the mesh that lie within an axis-aligned box
+/**
+ * \param mesh the mesh that the hierarchy was built for
+ * \param lo the lower corner of the box
+ * \param hi the upper corner of the box
+ * \param vertices the sorted indices of the vertices within the box on return
+ */
+void MeshDistTree::get_vertices(const IndexedTriArray& mesh, const Origin3d& lo, const Origin3d& hi, vector<unsigned>& vertices) const
+{
+  vertices.clear();
+  if (_nodes.empty())
+    return;
+
+  // get the vertices and facets
+  const vector<Origin3d>& verts = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+
+  // collect vertices of triangles in leafs that intersect the box
+  vector<unsigned> vidx;
+  stack<unsigned> S;
+  S.push(0);
+  while (!S.empty())
+  {
+    const Node& node = _nodes[S.top()];
+    S.pop();
+    if (node.lo[0] > hi[0] || node.lo[1] > hi[1] || node.lo[2] > hi[2] ||
+        node.hi[0] < lo[0] || node.hi[1] < lo[1] || node.hi[2] < lo[2])
+      continue;
+    if (node.n > 0)
+    {
+      for (unsigned i=node.first; i< node.first + node.n; i++)
+      {
+        const IndexedTri& f = facets[_tris[i]];
+        vidx.push_back(f.a);
+        vidx.push_back(f.b);
+        vidx.push_back(f.c);
+      }
+    }
+    else
+    {
+      S.push(node.first);
+      S.push(node.first+1);
+    }
+  }
+
+  // remove duplicates and keep only vertices in the box
+  std::sort(vidx.begin(), vidx.end());
+  vidx.erase(std::unique(vidx.begin(), vidx.end()), vidx.end());
+  for (unsigned i=0; i< vidx.size(); i++)
+  {
+    const Origin3d& v = verts[vidx[i]];
+    if (v[0] >= lo[0] && v[1] >= lo[1] && v[2] >= lo[2] &&
+        v[0] <= hi[0] && v[1] <= hi[1] && v[2] <= hi[2])
+      vertices.push_back(vidx[i]);
+  }
+}
+
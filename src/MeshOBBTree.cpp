@@ -0,0 +1,300 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <map>
+#include <list>
+#include <queue>
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <Moby/Constants.h>
+#include <Moby/Log.h>
+#include <Moby/Plane.h>
+#include <Moby/Triangle.h>
+#include <Moby/CompGeom.h>
+#include <Moby/OBB.h>
+#include <Moby/MeshOBBTree.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using boost::dynamic_pointer_cast;
+using std::endl;
+using std::list;
+using std::map;
+using std::queue;
+using std::vector;
+
+// gets the (unique) vertices of selected facets of a mesh
+static void get_vertices(const IndexedTriArray& mesh, const list<unsigned>& fselect, vector<Point3d>& output)
+{
+  // get the vertex indices from the facets
+  const vector<IndexedTri>& facets = mesh.get_facets();
+  vector<unsigned> verts;
+  verts.reserve(fselect.size()*3);
+  BOOST_FOREACH(unsigned i, fselect)
+  {
+    verts.push_back(facets[i].a);
+    verts.push_back(facets[i].b);
+    verts.push_back(facets[i].c);
+  }
+
+  // remove repeated vertices
+  std::sort(verts.begin(), verts.end());
+  verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+
+  // copy the vertices to the output
+  const vector<Origin3d>& vertices = mesh.get_vertices();
+  output.clear();
+  output.reserve(verts.size());
+  for (unsigned i=0; i< verts.size(); i++)
+    output.push_back(Point3d(vertices[verts[i]], GLOBAL));
+}
+
+// splits a collection of triangles along a splitting plane
+static void split_tris(const Point3d& point, const Vector3d& normal, const IndexedTriArray& mesh, const list<unsigned>& ofacets, list<unsigned>& pfacets, list<unsigned>& nfacets)
+{
+  // get original vertices and facets
+  const vector<Origin3d>& vertices = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+
+  // determine the splitting plane: ax + by + cz = d
+  double offset = Vector3d::dot(point, normal);
+
+  // determine the side of the splitting plane of the triangles
+  Plane plane(normal, offset);
+  BOOST_FOREACH(unsigned i, ofacets)
+  {
+    // setup the vertices in the same pose as the normal
+    Point3d pa(vertices[facets[i].a], normal.pose);
+    Point3d pb(vertices[facets[i].b], normal.pose);
+    Point3d pc(vertices[facets[i].c], normal.pose);
+
+    // get the three signed distances
+    double sa = plane.calc_signed_distance(pa);
+    double sb = plane.calc_signed_distance(pb);
+    double sc = plane.calc_signed_distance(pc);
+    double min_s = std::min(sa, std::min(sb, sc));
+    double max_s = std::max(sa, std::max(sb, sc));
+
+    // see whether we can cleanly put the triangle into one side
+    if (min_s > 0)
+      pfacets.push_back(i);
+    else if (max_s < 0)
+      nfacets.push_back(i);
+    else
+    {
+      // triangle is split down the middle; get its centroid
+      Triangle tri(pa, pb, pc);
+      Point3d tri_centroid = tri.calc_centroid();
+      double scent = plane.calc_signed_distance(tri_centroid);
+      if (scent > 0)
+        pfacets.push_back(i);
+      else
+        nfacets.push_back(i);
+    }
+  }
+}
+
+// splits a bounding box along a given axis into two new bounding boxes; returns true if split successful
+static bool split(const IndexedTriArray& mesh, map<BVPtr, list<unsigned> >& mesh_tris, BVPtr source, BVPtr& tgt1, BVPtr& tgt2, const Vector3d& axis)
+{
+  // setup two lists of triangles
+  list<unsigned> ptris, ntris;
+
+  // clear both targets
+  tgt1 = BVPtr();
+  tgt2 = BVPtr();
+
+  // get the list of triangles
+  assert(mesh_tris.find(source) != mesh_tris.end());
+  const list<unsigned>& tris = mesh_tris.find(source)->second;
+
+  // make sure that not trying to split a single triangle
+  assert(tris.size() > 1);
+
+  // determine the centroid of this set of triangles
+  list<Triangle> t_tris;
+  BOOST_FOREACH(unsigned idx, tris)
+    t_tris.push_back(mesh.get_triangle(idx, source->get_relative_pose()));
+  Point3d centroid = CompGeom::calc_centroid_3D(t_tris.begin(), t_tris.end());
+
+  // get the side of the splitting plane of the triangles
+  split_tris(centroid, axis, mesh, tris, ptris, ntris);
+  if (ptris.empty() || ntris.empty())
+    return false;
+
+  // get vertices from both sides
+  vector<Point3d> pverts, nverts;
+  get_vertices(mesh, ptris, pverts);
+  get_vertices(mesh, ntris, nverts);
+
+  // create two new BVs
+  tgt1 = OBBPtr(new OBB(pverts.begin(), pverts.end()));
+  tgt2 = OBBPtr(new OBB(nverts.begin(), nverts.end()));
+
+  // setup mesh data for the BVs
+  mesh_tris[tgt1] = ptris;
+  mesh_tris[tgt2] = ntris;
+
+  return true;
+}
+
+/// Builds the tree for a mesh using a top-down approach
+/**
+ * Boxes are split across their principal axes at the centroid of the
+ * triangles they cover until they cover a single triangle; children with
+ * greater volume than their parents are then collapsed into the parents.
+ */
+void MeshOBBTree::build(const IndexedTriArray& mesh)
+{
+  BVPtr child1, child2;
+
+  FILE_LOG(LOG_BV) << "MeshOBBTree::build() entered" << endl;
+
+  _nodes.clear();
+  _tris.clear();
+
+  // if there are no triangles, there is no tree
+  const vector<Origin3d>& verts = mesh.get_vertices();
+  const vector<IndexedTri>& facets = mesh.get_facets();
+  if (facets.empty())
+    return;
+
+  // transform the vertices into Point3d objects
+  vector<Point3d> vertices(verts.size());
+  for (unsigned i=0; i< verts.size(); i++)
+    vertices[i] = Point3d(verts[i], GLOBAL);
+
+  // build an OBB around all vertices
+  BVPtr root = BVPtr(new OBB(vertices.begin(), vertices.end()));
+
+  // set root to point to all facet indices
+  map<BVPtr, list<unsigned> > mesh_tris;
+  list<unsigned>& tris_idx = mesh_tris[root];
+  for (unsigned i=0; i< facets.size(); i++)
+    tris_idx.push_back(i);
+
+  // add the root to a splitting queue
+  queue<BVPtr> Q;
+  Q.push(root);
+
+  // split until we can't split further
+  while (!Q.empty())
+  {
+    // get the bounding box off of the top of the queue
+    BVPtr bb = Q.front();
+    Q.pop();
+
+    // split the bounding box across each of the three axes
+    for (unsigned i=0; i< 3; i++)
+    {
+      Vector3d axis(GLOBAL);
+
+      // get the i'th column of R
+      OBBPtr obb = dynamic_pointer_cast<OBB>(bb);
+      assert(obb);
+      obb->R.get_column(i, axis);
+
+      // split the bounding box across the axis
+      if (split(mesh, mesh_tris, bb, child1, child2, axis))
+        break;
+    }
+
+    // make sure that this BV was divisible
+    if (!child1)
+      continue;
+
+    // setup child pointers
+    bb->children.push_back(child1);
+    bb->children.push_back(child2);
+
+    // add children to the queue for processing if they have more than one tri
+    if (mesh_tris[child1].size() > 1)
+      Q.push(child1);
+    if (mesh_tris[child2].size() > 1)
+      Q.push(child2);
+  }
+
+  // now, collapse the tree
+  Q.push(root);
+  while (!Q.empty())
+  {
+    // for any children with a greater volume than the obb in question,
+    // remove the grandchildren and add them as children
+    BVPtr bb = Q.front();
+    double vol = bb->calc_volume();
+    bool erased_one = false;
+    for (list<BVPtr>::iterator i = bb->children.begin(); i != bb->children.end(); )
+    {
+      // get the volume of this child
+      double voli = (*i)->calc_volume();
+      if (!(*i)->is_leaf() && voli > vol + NEAR_ZERO)
+      {
+        erased_one = true;
+        BOOST_FOREACH(BVPtr gchild, (*i)->children)
+          bb->children.push_back(gchild);
+        i = bb->children.erase(i);
+      }
+      else
+        i++;
+    }
+
+    if (!erased_one)
+    {
+      Q.pop();
+      BOOST_FOREACH(BVPtr child, bb->children)
+        if (!child->is_leaf())
+          Q.push(child);
+    }
+  }
+
+  // flatten the tree in breadth-first order, so that the children of each
+  // node are stored consecutively
+  queue<std::pair<BVPtr, unsigned> > F;
+  _nodes.push_back(Node());
+  F.push(std::make_pair(root, 0));
+  while (!F.empty())
+  {
+    BVPtr bb = F.front().first;
+    const unsigned IDX = F.front().second;
+    F.pop();
+
+    // setup the box
+    OBBPtr obb = dynamic_pointer_cast<OBB>(bb);
+    Node& node = _nodes[IDX];
+    node.center = Origin3d(obb->center);
+    node.R = obb->R;
+    node.l = Origin3d(obb->l);
+
+    // setup the triangles covered by the box
+    const list<unsigned>& tris = mesh_tris.find(bb)->second;
+    node.first_tri = _tris.size();
+    node.n_tris = tris.size();
+    _tris.insert(_tris.end(), tris.begin(), tris.end());
+
+    // setup the children
+    node.first_child = _nodes.size();
+    node.n_children = bb->children.size();
+    BOOST_FOREACH(BVPtr child, bb->children)
+    {
+      F.push(std::make_pair(child, (unsigned) _nodes.size()));
+      _nodes.push_back(Node());
+    }
+  }
+
+  FILE_LOG(LOG_BV) << "MeshOBBTree::build() exited (" << _nodes.size() << " nodes)" << endl;
+}
+
+/// Translates the tree along with its mesh
+/**
+ * Translating the boxes gives the tree that would be built for the
+ * translated mesh, much more cheaply than rebuilding it.
+ */
+void MeshOBBTree::translate(const Origin3d& dx)
+{
+  for (unsigned i=0; i< _nodes.size(); i++)
+    _nodes[i].center += dx;
+}
+
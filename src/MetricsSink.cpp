@@ -0,0 +1,155 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0 
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <iostream>
+#include <Moby/MetricsSink.h>
+
+using namespace Moby;
+
+MetricsSink::MetricsSink()
+{
+  _fp = NULL;
+  _buffer_size = 0;
+  _stop = false;
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_cond, NULL);
+}
+
+MetricsSink::~MetricsSink()
+{
+  close();
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_mutex);
+}
+
+/// Opens the sink, truncating the file and writing the column names
+/**
+ * \param filename the name of the file to write to
+ * \param buffer_size the number of bytes of records buffered before the 
+ *        records are handed to the writer thread
+ * \return <b>true</b> if the file was opened and the writer thread started
+ */
+bool MetricsSink::open(const std::string& filename, unsigned buffer_size)
+{
+  // close any open file first
+  close();
+
+  // open the file
+  _fp = std::fopen(filename.c_str(), "w");
+  if (!_fp)
+  {
+    std::cerr << "MetricsSink::open() - unable to open " << filename << " for writing" << std::endl;
+    return false;
+  }
+  _filename = filename;
+
+  // setup the buffers
+  _buffer_size = buffer_size;
+  _buffer.reserve(buffer_size + 256);
+  _buffer = "time,min_dist,max_bilateral_vio,stabilization_iterations\n";
+  _pending.clear();
+  _stop = false;
+
+  // start the writer thread
+  if (pthread_create(&_thread, NULL, &write_thread, this) != 0)
+  {
+    std::cerr << "MetricsSink::open() - unable to start writer thread" << std::endl;
+    std::fclose(_fp);
+    _fp = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+/// Writes all records and closes the sink
+void MetricsSink::close()
+{
+  if (!_fp)
+    return;
+
+  // hand off the remaining records and stop the writer thread
+  pthread_mutex_lock(&_mutex);
+  _pending += _buffer;
+  _stop = true;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+  pthread_join(_thread, NULL);
+  _buffer.clear();
+
+  // close the file
+  std::fclose(_fp);
+  _fp = NULL;
+}
+
+/// Hands all buffered records to the writer thread
+void MetricsSink::flush()
+{
+  if (!_fp || _buffer.empty())
+    return;
+
+  pthread_mutex_lock(&_mutex);
+  _pending += _buffer;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+  _buffer.clear();
+}
+
+/// Records the diagnostics for a step
+/**
+ * \param time the simulation time at the end of the step
+ * \param min_dist the minimum signed distance between geometries
+ * \param max_bilateral_vio the maximum bilateral constraint violation
+ * \param stabilization_iterations the number of constraint stabilization 
+ *        iterations
+ */
+void MetricsSink::record(double time, double min_dist, double max_bilateral_vio, unsigned stabilization_iterations)
+{
+  if (!_fp)
+    return;
+
+  // format the record
+  char line[128];
+  snprintf(line, sizeof(line), "%.17g,%.17g,%.17g,%u\n", time, min_dist, max_bilateral_vio, stabilization_iterations);
+  _buffer += line;
+
+  // hand off the records once the buffer is full
+  if (_buffer.size() >= _buffer_size)
+    flush();
+}
+
+/// Writes records handed off by the simulation thread until the sink is closed
+void* MetricsSink::write_thread(void* arg)
+{
+  MetricsSink* sink = (MetricsSink*) arg;
+  std::string records;
+
+  while (true)
+  {
+    // wait for records (or for the sink to close)
+    pthread_mutex_lock(&sink->_mutex);
+    while (sink->_pending.empty() && !sink->_stop)
+      pthread_cond_wait(&sink->_cond, &sink->_mutex);
+    records.swap(sink->_pending);
+    bool stop = sink->_stop;
+    pthread_mutex_unlock(&sink->_mutex);
+
+    // write the records outside of the lock
+    if (!records.empty())
+    {
+      std::fwrite(records.data(), 1, records.size(), sink->_fp);
+      std::fflush(sink->_fp);
+      records.clear();
+    }
+
+    // records are handed off before the stop flag is set, so none remain
+    if (stop)
+      break;
+  }
+
+  return NULL;
+}
+
@@ -40,11 +40,13 @@ using std::make_pair;
 /// Initializes the heightmap primitive
 PlanePrimitive::PlanePrimitive()
 {
+  _type = ePlane;
 }
 
 /// Initializes the heightmap primitive
 PlanePrimitive::PlanePrimitive(const Ravelin::Pose3d& T) : Primitive(T)
 {
+  _type = ePlane;
 }
 
 /// Gets the mesh of the heightmap
@@ -227,6 +229,29 @@ double PlanePrimitive::calc_signed_dist(const Point3d& p) const
   return calc_height(p);
 }
 
+/// Computes the signed distances of a batch of points from the plane
+/**
+ * \see Primitive::calc_signed_dist_batch()
+ */
+void PlanePrimitive::calc_signed_dist_batch(shared_ptr<const Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const
+{
+  assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
+  calc_height_batch(x, y, z, n, dist);
+}
+
+/// Computes the heights of a batch of points above the plane
+/**
+ * \param x the x coordinates of the n points (in a pose of this primitive)
+ * \param y the y coordinates of the n points
+ * \param z the z coordinates of the n points
+ * \param n the number of points
+ * \param height the n heights, on return
+ */
+void PlanePrimitive::calc_height_batch(const double* x, const double* y, const double* z, unsigned n, double* height) const
+{
+  std::copy(y, y+n, height);
+}
+
 /// Gets the distance from a cylinder primitive
 double PlanePrimitive::calc_signed_dist(shared_ptr<const CylinderPrimitive> pA, Point3d& pthis, Point3d& pcyl) const
 {
@@ -14,6 +14,7 @@
 #include <Moby/PlanePrimitive.h>
 #include <Moby/GJK.h>
 #include <Moby/XMLTree.h>
+#include <Moby/MeshCache.h>
 #include <Moby/PolyhedralPrimitive.h>
 
 using std::cerr;
@@ -41,6 +42,15 @@ double PolyhedralPrimitive::calc_dist_and_normal(const Point3d& p, std::vector<V
   // verify that the primitive knows about this pose 
   assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end()); 
 
+  // use the signed distance field, if possible
+  double sdf_dist;
+  Vector3d sdf_normal;
+  if (calc_sdf_dist_and_normal(p, sdf_dist, sdf_normal))
+  {
+    normals.push_back(sdf_normal);
+    return sdf_dist;
+  }
+
   // see whether the point is inside or outside the primitive
   unsigned closest_facet;
   double dist = _poly.calc_signed_distance(Origin3d(p), closest_facet);
@@ -107,6 +117,25 @@ double PolyhedralPrimitive::calc_dist_and_normal(const Point3d& p, std::vector<V
   return dist;
 }
 
+/// Computes the exact signed distance used to build the signed distance field
+double PolyhedralPrimitive::calc_sdf_sample(const Origin3d& p) const
+{
+  return _poly.calc_signed_distance(p);
+}
+
+/// Gets the geometry represented by the signed distance field
+/**
+ * The polyhedron is the convex hull of its vertices, so the vertices alone
+ * identify the geometry.
+ */
+void PolyhedralPrimitive::get_sdf_geometry(std::vector<Origin3d>& verts, std::vector<IndexedTri>& facets) const
+{
+  const std::vector<shared_ptr<Polyhedron::Vertex> >& v = _poly.get_vertices();
+  verts.resize(v.size());
+  for (unsigned i=0; i< v.size(); i++)
+    verts[i] = v[i]->o;
+}
+
 /// creates the visualization for the primitive
 osg::Node* PolyhedralPrimitive::create_visualization()
 {
@@ -224,8 +253,39 @@ void PolyhedralPrimitive::set_pose(const Pose3d& P)
 
   // transform the polyhedron
   _poly = _poly.transform(T);
+
+  // the signed distance field and cached features no longer match the 
+  // polyhedron
+  polyhedron_changed();
 } 
 
+/// Gets a new polyhedron identifier (see get_polyhedron_id())
+unsigned long PolyhedralPrimitive::next_polyhedron_id()
+{
+  static unsigned long next_id = 0;
+  unsigned long id;
+
+  // primitives may be constructed from multiple threads
+  #ifdef _OPENMP
+  #pragma omp critical (PolyhedralPrimitive_next_polyhedron_id)
+  #endif
+  id = ++next_id;
+
+  return id;
+}
+
+/// Records that the polyhedron has been rebuilt or replaced
+/**
+ * Invalidates the signed distance field and changes the polyhedron
+ * identifier, so that features cached from the old polyhedron (e.g., for 
+ * warm starting V-Clip) are no longer used.
+ */
+void PolyhedralPrimitive::polyhedron_changed()
+{
+  invalidate_sdf();
+  _poly_id = next_polyhedron_id();
+}
+
 /// Sets the polyhedron corresponding to this primitive
 /**
  * Should only be done when the primitive hasn't been transformed.
@@ -242,6 +302,7 @@ void PolyhedralPrimitive::set_polyhedron(const Polyhedron& p)
 
   // set the polyhedron
   _poly = p;
+  polyhedron_changed();
 
   // calculate mass properties
   calc_mass_properties();
@@ -255,6 +316,20 @@ void PolyhedralPrimitive::calc_mass_properties()
 
 /// Computes the signed distance between two polyhedra
 double PolyhedralPrimitive::calc_signed_dist(shared_ptr<const PolyhedralPrimitive> p, Point3d& pthis, Point3d& pp) const
+{
+  shared_ptr<const Polyhedron::Feature> closestA, closestB;
+  return calc_signed_dist(p, pthis, pp, closestA, closestB);
+}
+
+/// Computes the signed distance between two polyhedra, warm starting V-Clip from the given features
+/**
+ * \param closestA on entry, the feature of this polyhedron to start V-Clip
+ *        from (or null to start from an arbitrary feature); on return, the
+ *        closest feature of this polyhedron
+ * \param closestB on entry, the feature of p to start V-Clip from (or null);
+ *        on return, the closest feature of p
+ */
+double PolyhedralPrimitive::calc_signed_dist(shared_ptr<const PolyhedralPrimitive> p, Point3d& pthis, Point3d& pp, shared_ptr<const Polyhedron::Feature>& closestA, shared_ptr<const Polyhedron::Feature>& closestB) const
 {
   const double INF = std::numeric_limits<double>::max();
   shared_ptr<TessellatedPolyhedron> tpoly;
@@ -267,7 +342,6 @@ double PolyhedralPrimitive::calc_signed_dist(shared_ptr<const PolyhedralPrimitiv
   shared_ptr<const PolyhedralPrimitive> bthis = dynamic_pointer_cast<const PolyhedralPrimitive>(shared_from_this());
   shared_ptr<const Pose3d> poseA = pthis.pose;
   shared_ptr<const Pose3d> poseB = pp.pose;
-  shared_ptr<const Polyhedron::Feature> closestA, closestB;
 
   // attempt to use vclip
   double dist = Polyhedron::vclip(bthis, p, poseA, poseB, closestA, closestB); 
@@ -417,17 +491,39 @@ void PolyhedralPrimitive::load_from_xml(shared_ptr<const XMLTree> node, std::map
     // setup a transform
     Transform3d T = Pose3d::calc_relative_pose(_F, GLOBAL);
 
-    // read in the file using an indexed triangle array
-    IndexedTriArray ita = IndexedTriArray::read_from_obj(fname).transform(T);
+    // read in the file (or its cached version)
+    shared_ptr<const MeshCache::Entry> entry = MeshCache::load(fname, _mesh_cache_dir);
 
-    // get all of the vertices and compute the convex hull (yielding a
-    // tessellated polyhedron)
-    const std::vector<Origin3d>& vertices = ita.get_vertices();
-    TessellatedPolyhedronPtr tessellated_poly = CompGeom::calc_convex_hull(vertices.begin(), vertices.end());   
+    // use the cached convex hull, if possible; the hull is invariant to
+    // rigid transforms, so only its vertices need to be transformed
+    TessellatedPolyhedronPtr tessellated_poly;
+    if (!entry->hull_facets.empty())
+    {
+      const std::vector<Origin3d>& mesh_vertices = entry->mesh->get_vertices();
+      std::vector<Origin3d> vertices(entry->hull_vertices.size());
+      for (unsigned i=0; i< vertices.size(); i++)
+        vertices[i] = Origin3d(T.transform_point(Point3d(mesh_vertices[entry->hull_vertices[i]], T.source)));
+      tessellated_poly = TessellatedPolyhedronPtr(new TessellatedPolyhedron(vertices.begin(), vertices.end(), entry->hull_facets.begin(), entry->hull_facets.end()));
+    }
+    else if (entry->mesh->num_tris() > 0)
+    {
+      // get all of the vertices and compute the convex hull (yielding a
+      // tessellated polyhedron)
+      IndexedTriArray ita = entry->mesh->transform(T);
+      const std::vector<Origin3d>& vertices = ita.get_vertices();
+      tessellated_poly = CompGeom::calc_convex_hull(vertices.begin(), vertices.end());   
+    }
+    else
+    {
+      cerr << "PolyhedralPrimitive::load_from_xml() - unable to read mesh from " << fname << endl;
+      update_visualization();
+      return;
+    }
 
     // convert the tessellated polyhedron to a standard polyhedron and set it
     // NOTE: we avoid the set function b/c a transform may have been applied
     tessellated_poly->to_polyhedron(_poly);
+    polyhedron_changed();
   }
   else
   {
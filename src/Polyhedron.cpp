@@ -318,6 +318,11 @@ Polyhedron Polyhedron::calc_minkowski_diff(shared_ptr<const PolyhedralPrimitive>
   if (N_POINTS < 4)
     return Polyhedron();
 
+  // use the reentrant engine, if selected
+  Polyhedron hull;
+  if (calc_convex_hull_reentrant(verts, hull))
+    return hull;
+
   // setup qhull outputs
   if (LOGGING(LOG_COMPGEOM))
   {
@@ -331,6 +336,9 @@ Polyhedron Polyhedron::calc_minkowski_diff(shared_ptr<const PolyhedralPrimitive>
     assert(errfile);
   } 
 
+  // lock the qhull mutex -- qhull is non-reentrant
+  lock_qhull();
+
   // construct the convex hull
   // execute qhull  
   exit_code = qh_new_qhull(DIM, N_POINTS, points_begin, IS_MALLOC, flags, outfile, errfile);
@@ -340,6 +348,9 @@ Polyhedron Polyhedron::calc_minkowski_diff(shared_ptr<const PolyhedralPrimitive>
     qh_freeqhull(!qh_ALL);
     qh_memfreeshort(&curlong, &totlong);
 
+    // release the mutex, since we're not using qhull anymore
+    unlock_qhull();
+
     // close the error stream, if necessary
     if (!LOGGING(LOG_COMPGEOM))
       fclose(errfile);
@@ -569,6 +580,9 @@ Polyhedron Polyhedron::calc_minkowski_diff(shared_ptr<const PolyhedralPrimitive>
   qh_freeqhull(!qh_ALL);
   qh_memfreeshort(&curlong, &totlong);
 
+  // release the qhull mutex
+  unlock_qhull();
+
   // close the error stream, if necessary
   if (!LOGGING(LOG_COMPGEOM))
     fclose(errfile);
@@ -583,6 +597,113 @@ Polyhedron Polyhedron::calc_minkowski_diff(shared_ptr<const PolyhedralPrimitive>
   return poly;
 }
 
+/// Locks the qhull mutex (qhull is non-reentrant)
+void Polyhedron::lock_qhull()
+{
+  #ifdef THREADSAFE
+  pthread_mutex_lock(&CompGeom::_qhull_mutex);
+  #endif
+}
+
+/// Releases the qhull mutex
+void Polyhedron::unlock_qhull()
+{
+  #ifdef THREADSAFE
+  pthread_mutex_unlock(&CompGeom::_qhull_mutex);
+  #endif
+}
+
+/// Computes the convex hull of a set of vertices using the reentrant engine
+/**
+ * \param verts the vertices
+ * \param poly the (empty) polyhedron to build
+ * \return <b>false</b> if qhull is the selected engine (poly is not built)
+ */
+bool Polyhedron::calc_convex_hull_reentrant(const vector<shared_ptr<Polyhedron::Vertex> >& verts, Polyhedron& poly)
+{
+  if (CompGeom::hull_engine != CompGeom::eQuickHull)
+    return false;
+
+  // compute the hull
+  vector<Origin3d> points(verts.size());
+  for (unsigned i=0; i< verts.size(); i++)
+    points[i] = verts[i]->o;
+  vector<IndexedTri> facets;
+  if (!QuickHull::get_thread_workspace().calc_convex_hull_3D(points, facets))
+  {
+    FILE_LOG(LOG_COMPGEOM) << "Polyhedron::calc_convex_hull_reentrant() - unable to compute hull using QuickHull" << endl;
+    throw NumericalException();
+  }
+
+  // build the polyhedron
+  build_from_hull(poly, verts, facets);
+  return true;
+}
+
+/// Builds a convex polyhedron from the triangles of a hull
+/**
+ * \param poly the (empty) polyhedron to build
+ * \param verts the vertices indexed by the triangles
+ * \param facets the hull triangles, each oriented counter-clockwise when
+ *        viewed from outside the hull; edges follow the same convention
+ *        as calc_convex_hull() (face2 is the face that traverses the edge
+ *        from v1 to v2)
+ */
+void Polyhedron::build_from_hull(Polyhedron& poly, const vector<shared_ptr<Polyhedron::Vertex> >& verts, const vector<IndexedTri>& facets)
+{
+  map<std::pair<unsigned, unsigned>, shared_ptr<Polyhedron::Edge> > v_edges;
+  map<std::pair<unsigned, unsigned>, shared_ptr<Polyhedron::Edge> >::const_iterator vei;
+  vector<bool> used(verts.size(), false);
+
+  for (unsigned i=0; i< facets.size(); i++)
+  {
+    // create a new face
+    shared_ptr<Polyhedron::Face> f(new Polyhedron::Face);
+    const unsigned v[3] = { facets[i].a, facets[i].b, facets[i].c };
+
+    // create / lookup the three edges, in counter-clockwise order
+    for (unsigned j=0; j< 3; j++)
+    {
+      const unsigned vA = v[j], vB = v[(j+1) % 3];
+      shared_ptr<Polyhedron::Edge> e;
+      if ((vei = v_edges.find(make_pair(vB, vA))) != v_edges.end())
+      {
+        e = vei->second;
+        assert(!e->face1);
+        e->face1 = f;
+      }
+      else
+      {
+        e = shared_ptr<Polyhedron::Edge>(new Polyhedron::Edge);
+        v_edges[make_pair(vA, vB)] = e;
+        e->face2 = f;
+        e->v1 = verts[vA];
+        e->v2 = verts[vB];
+        poly._edges.push_back(e);
+        e->v1->e.push_back(e);
+        e->v2->e.push_back(e);
+      }
+      f->e.push_back(e);
+      used[vA] = true;
+    }
+
+    // add the face to the polyhedron
+    poly._faces.push_back(f);
+  }
+
+  // add the vertices on the hull
+  for (unsigned i=0; i< verts.size(); i++)
+    if (used[i])
+      poly._vertices.push_back(verts[i]);
+
+  // mark the polyhedron as convex
+  poly._convexity_computed = true;
+  poly._convexity = -1.0;
+
+  // calculate the axis-aligned bounding box
+  poly.calc_bounding_box();
+}
+
 /// Calculates the bounding box
 void Polyhedron::calc_bounding_box()
 {
@@ -1239,9 +1360,8 @@ double Polyhedron::vclip(shared_ptr<const PolyhedralPrimitive> pA, shared_ptr<co
 {
  // return -1.0;
   FeatureType fA, fB;
-  Polyhedron polyA, polyB;
-  polyA = pA->get_polyhedron();
-  polyB = pB->get_polyhedron();
+  const Polyhedron& polyA = pA->get_polyhedron();
+  const Polyhedron& polyB = pB->get_polyhedron();
 
   // defining the maximum iteration based on the number of total features 
   // in the two polyhedra
@@ -1258,14 +1378,13 @@ double Polyhedron::vclip(shared_ptr<const PolyhedralPrimitive> pA, shared_ptr<co
   FILE_LOG(LOG_COLDET) << "poseB: "<< *poseB << std::endl;
   FILE_LOG(LOG_COLDET) << "aTb: " << aTb << std::endl;
 
-  // if closest feature of A is null, pick features for A and B arbitrarily
-  if(!closestA){
-    std::vector<boost::shared_ptr<Face> >::const_iterator vi = pA->get_polyhedron().get_faces().begin();
-    closestA = boost::shared_ptr<Feature>(*vi);
-
-    vi = pB->get_polyhedron().get_faces().begin();
-    closestB = boost::shared_ptr<Feature>(*vi);
-  
+  // if either closest feature is null (no warm start available), pick 
+  // features for A and B arbitrarily; otherwise, start from the features 
+  // passed in (typically the closest features from the last query)
+  if (!closestA || !closestB)
+  {
+    closestA = boost::shared_ptr<Feature>(polyA.get_faces().front());
+    closestB = boost::shared_ptr<Feature>(polyB.get_faces().front());
   }
 
   // determine feature type for A
@@ -9,9 +9,13 @@
 #include <osg/Material>
 #include <osg/Matrixd>
 #endif
+#include <pthread.h>
 #include <queue>
+#include <cstdio>
 #include <stdexcept>
 #include <Moby/Constants.h>
+#include <Moby/Log.h>
+#include <Moby/ADF.h>
 #include <Moby/XMLTree.h>
 #include <Moby/CollisionGeometry.h>
 #include <Moby/Primitive.h>
@@ -54,6 +58,26 @@ static void to_osg_matrix(const Pose3d& src, osg::Matrixd& tgt)
 }
 #endif
 
+// serializes registration of primitive types
+static pthread_mutex_t _register_type_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// Gets a new primitive type (for primitives defined outside of Moby)
+/**
+ * Safe to call from multiple threads.
+ */
+unsigned Primitive::register_type()
+{
+  static unsigned next_type = eNumPrimitiveTypes;
+  pthread_mutex_lock(&_register_type_mutex);
+  unsigned type = next_type++;
+  pthread_mutex_unlock(&_register_type_mutex);
+  return type;
+}
+
+// default signed distance field parameters
+const unsigned DEFAULT_SDF_MAX_RECURSION = 7;
+const double DEFAULT_SDF_EPSILON = 1e-4;
+
 /// Constructs a primitive under the identity transformation
 Primitive::Primitive()
 {
@@ -62,6 +86,17 @@ Primitive::Primitive()
   _jF->rpose = _F;
   _J.pose = _jF;
 
+  // type is set by derived classes
+  _type = eUnknown;
+
+  // signed distance fields are disabled by default
+  _sdf_enabled = false;
+  _sdf_max_recursion = DEFAULT_SDF_MAX_RECURSION;
+  _sdf_epsilon = DEFAULT_SDF_EPSILON;
+  _sdf_cache_dir = "";
+  _mesh_cache_dir = "";
+  _sdf_built = false;
+
   // set visualization members to NULL
   _vtransform = NULL;
 }
@@ -75,6 +110,17 @@ Primitive::Primitive(const Pose3d& F)
   _J.pose = _jF;
   *_F = F; 
 
+  // type is set by derived classes
+  _type = eUnknown;
+
+  // signed distance fields are disabled by default
+  _sdf_enabled = false;
+  _sdf_max_recursion = DEFAULT_SDF_MAX_RECURSION;
+  _sdf_epsilon = DEFAULT_SDF_EPSILON;
+  _sdf_cache_dir = "";
+  _mesh_cache_dir = "";
+  _sdf_built = false;
+
   // set visualization members to NULL
   _vtransform = NULL;
 }
@@ -128,6 +174,169 @@ double Primitive::calc_signed_dist(const Point3d& p) const
   return 0.0; 
 }
 
+/// Computes the signed distances of a batch of points from this primitive
+/**
+ * The points are given as separate coordinate arrays (structure of arrays)
+ * so that primitives can evaluate them with vectorizable loops; this
+ * default implementation evaluates them one at a time.
+ * \param P the pose of the points (one of the poses of this primitive)
+ * \param x the x coordinates of the n points
+ * \param y the y coordinates of the n points
+ * \param z the z coordinates of the n points
+ * \param n the number of points
+ * \param dist the n signed distances (the distances computed by
+ *        calc_dist_and_normal()), on return
+ */
+void Primitive::calc_signed_dist_batch(shared_ptr<const Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const
+{
+  vector<Vector3d> normals;
+  for (unsigned i=0; i< n; i++)
+  {
+    normals.clear();
+    dist[i] = calc_dist_and_normal(Point3d(x[i], y[i], z[i], P), normals);
+  }
+}
+
+/// Sets whether point queries use a precomputed signed distance field
+/**
+ * The field is built (or loaded from the cache directory) the first time that
+ * it is queried. Primitives that do not provide exact distances for building
+ * the field ignore this setting.
+ */
+void Primitive::set_sdf_enabled(bool flag)
+{
+  _sdf_enabled = flag;
+  invalidate_sdf();
+}
+
+/// Distance function used to build the signed distance field
+double Primitive::sdf_distance_function(const Vector3d& p, void* data)
+{
+  const Primitive* primitive = (const Primitive*) data;
+  return primitive->calc_sdf_sample(Origin3d(p[0], p[1], p[2]));
+}
+
+// hashes bytes using 64-bit FNV-1a
+static unsigned long long hash_bytes(const void* bytes, unsigned n, unsigned long long h)
+{
+  const unsigned char* c = (const unsigned char*) bytes;
+  for (unsigned i=0; i< n; i++)
+  {
+    h ^= (unsigned long long) c[i];
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+/// Builds the signed distance field, loading it from the cache if possible
+/**
+ * Cached fields are keyed by a hash of the geometry and of the field 
+ * parameters, so a geometry that changes is never matched with a stale field.
+ */
+void Primitive::build_sdf() const
+{
+  const double INF = std::numeric_limits<double>::max();
+
+  // only attempt to build once
+  _sdf_built = true;
+
+  // get the geometry
+  vector<Origin3d> verts;
+  vector<IndexedTri> facets;
+  get_sdf_geometry(verts, facets);
+  if (verts.empty())
+    return;
+
+  // compute the bounding box and the hash of the geometry
+  Origin3d lo(INF, INF, INF), hi(-INF, -INF, -INF);
+  unsigned long long h = 14695981039346656037ULL;
+  for (unsigned i=0; i< verts.size(); i++)
+  {
+    for (unsigned j=0; j< 3; j++)
+    {
+      lo[j] = std::min(lo[j], verts[i][j]);
+      hi[j] = std::max(hi[j], verts[i][j]);
+      double x = verts[i][j];
+      h = hash_bytes(&x, sizeof(double), h);
+    }
+  }
+  for (unsigned i=0; i< facets.size(); i++)
+  {
+    h = hash_bytes(&facets[i].a, sizeof(unsigned), h);
+    h = hash_bytes(&facets[i].b, sizeof(unsigned), h);
+    h = hash_bytes(&facets[i].c, sizeof(unsigned), h);
+  }
+  h = hash_bytes(&_sdf_max_recursion, sizeof(unsigned), h);
+  h = hash_bytes(&_sdf_epsilon, sizeof(double), h);
+
+  // attempt to load the field from the cache
+  std::string fname;
+  if (!_sdf_cache_dir.empty())
+  {
+    const unsigned MAX_DIGITS = 16;
+    char buffer[MAX_DIGITS+1];
+    std::sprintf(buffer, "%016llx", h);
+    fname = _sdf_cache_dir + "/sdf" + std::string(buffer) + ".adf";
+    _sdf = ADF::load_from_file(fname);
+    if (_sdf)
+    {
+      FILE_LOG(LOG_ADF) << "Primitive::build_sdf() - loaded signed distance field from " << fname << endl;
+      return;
+    }
+  }
+
+  // build the field
+  Vector3d vlo(lo[0], lo[1], lo[2]), vhi(hi[0], hi[1], hi[2]);
+  _sdf = ADF::build_ADF(vlo, vhi, &sdf_distance_function, _sdf_max_recursion, _sdf_epsilon, -1.0, INF, (void*) this);
+  FILE_LOG(LOG_ADF) << "Primitive::build_sdf() - built signed distance field with " << _sdf->count_cells() << " cells" << endl;
+
+  // save the field to the cache
+  if (!fname.empty())
+    _sdf->save_to_file(fname);
+}
+
+/// Computes the distance and normal from a point using the signed distance field
+/**
+ * \param p the query point (defined in one of the poses of this primitive)
+ * \param dist the interpolated signed distance on return
+ * \param normal the gradient of the field (pointing outward) on return
+ * \return <b>false</b> if the field is disabled or does not contain the point,
+ *         in which case the caller should compute the distance exactly
+ */
+bool Primitive::calc_sdf_dist_and_normal(const Point3d& p, double& dist, Vector3d& normal) const
+{
+  // see whether the field is enabled
+  if (!_sdf_enabled)
+    return false;
+
+  // build the field, if necessary, and get a reference to it; both are done
+  // under the lock, so that no thread sees the field before it is assigned
+  shared_ptr<const ADF> sdf;
+  #ifdef _OPENMP
+  #pragma omp critical (Primitive_sdf)
+  #endif
+  {
+    if (!_sdf_built)
+      build_sdf();
+    sdf = _sdf;
+  }
+
+  // the field is defined in the primitive frame
+  Vector3d x(p[0], p[1], p[2]);
+  if (!sdf || !sdf->contains(x))
+    return false;
+
+  // compute the distance and the normal
+  dist = sdf->calc_signed_distance(x);
+  Vector3d n = sdf->determine_normal(x);
+  if (!(n.norm_sq() > 0.0) || n.norm_sq() > 2.0)
+    return false;
+  normal = Vector3d(n[0], n[1], n[2], p.pose);
+
+  return true;
+}
+
 /// Gets a supporting point from a primitive
 Point3d Primitive::get_supporting_point(const Vector3d& dir) const
 {
@@ -265,6 +474,23 @@ void Primitive::load_from_xml(shared_ptr<const XMLTree> node, std::map<std::stri
       throw std::runtime_error("Attempting to set primitive density to negative value");
   }
 
+  // read in signed distance field parameters, if specified
+  XMLAttrib* sdf_recursion_attr = node->get_attrib("sdf-max-recursion");
+  if (sdf_recursion_attr)
+    _sdf_max_recursion = sdf_recursion_attr->get_unsigned_value();
+  XMLAttrib* sdf_eps_attr = node->get_attrib("sdf-epsilon");
+  if (sdf_eps_attr)
+    _sdf_epsilon = sdf_eps_attr->get_real_value();
+  XMLAttrib* sdf_cache_attr = node->get_attrib("sdf-cache-dir");
+  if (sdf_cache_attr)
+    _sdf_cache_dir = sdf_cache_attr->get_string_value();
+  XMLAttrib* mesh_cache_attr = node->get_attrib("mesh-cache-dir");
+  if (mesh_cache_attr)
+    _mesh_cache_dir = mesh_cache_attr->get_string_value();
+  XMLAttrib* sdf_attr = node->get_attrib("sdf");
+  if (sdf_attr)
+    set_sdf_enabled(sdf_attr->get_bool_value());
+
   // read in transformation, if specified
   Pose3d F;
   XMLAttrib* xlat_attr = node->get_attrib("position");
@@ -338,6 +564,13 @@ void Primitive::save_to_xml(XMLTreePtr node, std::list<shared_ptr<const Base> >&
   F0.update_relative_pose(GLOBAL);
   node->attribs.insert(XMLAttrib("position", F0.x));
   node->attribs.insert(XMLAttrib("quat", F0.q));
+
+  // save the signed distance field parameters
+  node->attribs.insert(XMLAttrib("sdf", _sdf_enabled));
+  node->attribs.insert(XMLAttrib("sdf-max-recursion", _sdf_max_recursion));
+  node->attribs.insert(XMLAttrib("sdf-epsilon", _sdf_epsilon));
+  node->attribs.insert(XMLAttrib("sdf-cache-dir", _sdf_cache_dir));
+  node->attribs.insert(XMLAttrib("mesh-cache-dir", _mesh_cache_dir));
 }
 
 /// Sets the transform for this primitive -- transforms mesh and inertial properties (if calculated)
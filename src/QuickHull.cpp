@@ -0,0 +1,549 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <Moby/QuickHull.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using std::vector;
+using std::pair;
+
+// key for the per-thread workspaces
+static pthread_key_t _workspace_key;
+static pthread_once_t _workspace_once = PTHREAD_ONCE_INIT;
+
+/// Destroys a thread's workspace when the thread exits
+static void destroy_workspace(void* workspace)
+{
+  delete (QuickHull*) workspace;
+}
+
+/// Creates the key for the per-thread workspaces
+static void create_workspace_key()
+{
+  pthread_key_create(&_workspace_key, &destroy_workspace);
+}
+
+QuickHull::QuickHull()
+{
+  _eps = NEAR_ZERO;
+  _n_facets = 0;
+}
+
+/// Gets the workspace for the calling thread (created on first use)
+QuickHull& QuickHull::get_thread_workspace()
+{
+  pthread_once(&_workspace_once, &create_workspace_key);
+  QuickHull* workspace = (QuickHull*) pthread_getspecific(_workspace_key);
+  if (!workspace)
+  {
+    workspace = new QuickHull;
+    pthread_setspecific(_workspace_key, workspace);
+  }
+
+  return *workspace;
+}
+
+/// Compares two points lexicographically
+bool QuickHull::LexLess::operator()(unsigned i, unsigned j) const
+{
+  const Origin2d& a = _points[i];
+  const Origin2d& b = _points[j];
+  return (a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]));
+}
+
+/// Computes twice the signed area of the triangle (o, a, b)
+double QuickHull::cross2(const Origin2d& o, const Origin2d& a, const Origin2d& b)
+{
+  return (a[0] - o[0])*(b[1] - o[1]) - (a[1] - o[1])*(b[0] - o[0]);
+}
+
+/// Computes the convex hull of a set of 2D points
+/**
+ * \param points the points
+ * \param hull the indices of the hull vertices, in counter-clockwise order,
+ *        on return
+ * \param tol the tolerance below which points are considered to be collinear
+ *        (scaled by the magnitude of the coordinates)
+ * \return <b>false</b> if the points are degenerate (fewer than three points
+ *         or all points collinear)
+ */
+bool QuickHull::calc_convex_hull_2D(const vector<Origin2d>& points, vector<unsigned>& hull, double tol)
+{
+  const unsigned N = points.size();
+
+  hull.clear();
+  if (N < 3)
+    return false;
+
+  // determine the tolerance
+  double scale = 1.0;
+  for (unsigned i=0; i< N; i++)
+    scale = std::max(scale, std::max(std::fabs(points[i][0]), std::fabs(points[i][1])));
+  const double EPS = tol * scale * scale;
+
+  // sort the points
+  _order.resize(N);
+  for (unsigned i=0; i< N; i++)
+    _order[i] = i;
+  std::sort(_order.begin(), _order.end(), LexLess(points));
+
+  // build the lower hull
+  for (unsigned i=0; i< N; i++)
+  {
+    while (hull.size() >= 2 && cross2(points[hull[hull.size()-2]], points[hull.back()], points[_order[i]]) <= EPS)
+      hull.pop_back();
+    hull.push_back(_order[i]);
+  }
+
+  // build the upper hull
+  const unsigned LOWER_SIZE = hull.size() + 1;
+  for (unsigned i=N-1; i > 0; i--)
+  {
+    const unsigned k = _order[i-1];
+    while (hull.size() >= LOWER_SIZE && cross2(points[hull[hull.size()-2]], points[hull.back()], points[k]) <= EPS)
+      hull.pop_back();
+    hull.push_back(k);
+  }
+
+  // the first point is repeated at the end
+  hull.pop_back();
+  if (hull.size() < 3)
+  {
+    hull.clear();
+    return false;
+  }
+
+  return true;
+}
+
+/// Computes the signed distance of a point above a facet
+double QuickHull::calc_dist(unsigned f, unsigned p) const
+{
+  const Facet& facet = _facets[f];
+  const double* x = point(p);
+  return facet.n[0]*x[0] + facet.n[1]*x[1] + facet.n[2]*x[2] - facet.d;
+}
+
+/// Computes the plane of a facet
+void QuickHull::calc_plane(unsigned f)
+{
+  Facet& facet = _facets[f];
+  const double* a = point(facet.v[0]);
+  const double* b = point(facet.v[1]);
+  const double* c = point(facet.v[2]);
+
+  // compute the normal
+  const double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+  const double w[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+  facet.n[0] = u[1]*w[2] - u[2]*w[1];
+  facet.n[1] = u[2]*w[0] - u[0]*w[2];
+  facet.n[2] = u[0]*w[1] - u[1]*w[0];
+
+  // normalize it; a degenerate facet keeps a zero normal, so no point will
+  // ever be above it
+  double nrm = std::sqrt(facet.n[0]*facet.n[0] + facet.n[1]*facet.n[1] + facet.n[2]*facet.n[2]);
+  if (nrm > std::numeric_limits<double>::min())
+  {
+    facet.n[0] /= nrm;
+    facet.n[1] /= nrm;
+    facet.n[2] /= nrm;
+  }
+  facet.d = facet.n[0]*a[0] + facet.n[1]*a[1] + facet.n[2]*a[2];
+}
+
+/// Creates a facet, reusing storage when possible
+unsigned QuickHull::new_facet(unsigned a, unsigned b, unsigned c)
+{
+  if (_n_facets == _facets.size())
+    _facets.push_back(Facet());
+  const unsigned f = _n_facets++;
+
+  Facet& facet = _facets[f];
+  facet.v[0] = a;
+  facet.v[1] = b;
+  facet.v[2] = c;
+  facet.adj[0] = facet.adj[1] = facet.adj[2] = std::numeric_limits<unsigned>::max();
+  facet.outside.clear();
+  facet.farthest_dist = -1.0;
+  facet.deleted = false;
+  facet.visible = false;
+  calc_plane(f);
+  return f;
+}
+
+/// Adds a point to the outside set of a facet
+void QuickHull::add_outside(unsigned f, unsigned p, double dist)
+{
+  Facet& facet = _facets[f];
+  facet.outside.push_back(p);
+  if (dist > facet.farthest_dist)
+  {
+    facet.farthest_dist = dist;
+    facet.farthest = p;
+  }
+}
+
+/// Assigns each point to the outside set of the first facet that it is above; points above no facet are inside the hull
+void QuickHull::assign_points(const vector<unsigned>& points, const vector<unsigned>& facets)
+{
+  for (unsigned i=0; i< points.size(); i++)
+    for (unsigned j=0; j< facets.size(); j++)
+    {
+      double dist = calc_dist(facets[j], points[i]);
+      if (dist > _eps)
+      {
+        add_outside(facets[j], points[i], dist);
+        break;
+      }
+    }
+}
+
+/// Creates the initial tetrahedron
+/**
+ * \return <b>false</b> if the points do not span three dimensions
+ */
+bool QuickHull::create_simplex()
+{
+  const unsigned N = _pts.size()/3;
+
+  // find the extreme points along each axis
+  unsigned extreme[6] = { 0, 0, 0, 0, 0, 0 };
+  for (unsigned i=1; i< N; i++)
+    for (unsigned k=0; k< 3; k++)
+    {
+      if (point(i)[k] < point(extreme[k*2])[k])
+        extreme[k*2] = i;
+      if (point(i)[k] > point(extreme[k*2+1])[k])
+        extreme[k*2+1] = i;
+    }
+
+  // the first two vertices are the most distant pair of extreme points
+  unsigned i0 = 0, i1 = 0;
+  double max_dist = -1.0;
+  for (unsigned i=0; i< 6; i++)
+    for (unsigned j=i+1; j< 6; j++)
+    {
+      const double* a = point(extreme[i]);
+      const double* b = point(extreme[j]);
+      double dist = (a[0]-b[0])*(a[0]-b[0]) + (a[1]-b[1])*(a[1]-b[1]) + (a[2]-b[2])*(a[2]-b[2]);
+      if (dist > max_dist)
+      {
+        max_dist = dist;
+        i0 = extreme[i];
+        i1 = extreme[j];
+      }
+    }
+  if (std::sqrt(max_dist) <= _eps)
+    return false;
+
+  // the third vertex is the point farthest from the line through the first two
+  const double* a = point(i0);
+  const double* b = point(i1);
+  const double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+  const double u_len = std::sqrt(u[0]*u[0] + u[1]*u[1] + u[2]*u[2]);
+  unsigned i2 = 0;
+  max_dist = -1.0;
+  for (unsigned i=0; i< N; i++)
+  {
+    const double* x = point(i);
+    const double w[3] = { x[0] - a[0], x[1] - a[1], x[2] - a[2] };
+    const double c[3] = { u[1]*w[2] - u[2]*w[1], u[2]*w[0] - u[0]*w[2], u[0]*w[1] - u[1]*w[0] };
+    double dist = std::sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2])/u_len;
+    if (dist > max_dist)
+    {
+      max_dist = dist;
+      i2 = i;
+    }
+  }
+  if (max_dist <= _eps)
+    return false;
+
+  // the fourth vertex is the point farthest from the plane of the first three
+  _n_facets = 0;
+  unsigned base = new_facet(i0, i1, i2);
+  unsigned i3 = 0;
+  max_dist = -1.0;
+  for (unsigned i=0; i< N; i++)
+  {
+    double dist = std::fabs(calc_dist(base, i));
+    if (dist > max_dist)
+    {
+      max_dist = dist;
+      i3 = i;
+    }
+  }
+  if (max_dist <= _eps)
+    return false;
+
+  // orient the base so that the fourth vertex is behind it
+  if (calc_dist(base, i3) > 0.0)
+    std::swap(i1, i2);
+
+  // create the tetrahedron; every edge of a facet appears reversed in its
+  // neighbor
+  _n_facets = 0;
+  new_facet(i0, i1, i2);
+  new_facet(i1, i0, i3);
+  new_facet(i2, i1, i3);
+  new_facet(i0, i2, i3);
+  for (unsigned f=0; f< 4; f++)
+    for (unsigned e=0; e< 3; e++)
+    {
+      const unsigned va = _facets[f].v[e], vb = _facets[f].v[(e+1) % 3];
+      for (unsigned g=0; g< 4; g++)
+        for (unsigned k=0; k< 3; k++)
+          if (_facets[g].v[k] == vb && _facets[g].v[(k+1) % 3] == va)
+            _facets[f].adj[e] = g;
+    }
+
+  // assign the remaining points to the facets
+  _points.clear();
+  for (unsigned i=0; i< N; i++)
+    if (i != i0 && i != i1 && i != i2 && i != i3)
+      _points.push_back(i);
+  _new_facets.clear();
+  for (unsigned f=0; f< 4; f++)
+    _new_facets.push_back(f);
+  assign_points(_points, _new_facets);
+
+  return true;
+}
+
+/// Finds the facets visible from a point and the horizon around them
+/**
+ * The horizon edges (pairs of visible facet and edge index) are found in
+ * counter-clockwise order (viewed from the point).
+ * \param p the eye point
+ * \param f a visible facet
+ * \param entry the edge of f through which f was reached
+ */
+void QuickHull::find_horizon(unsigned p, unsigned f, unsigned entry)
+{
+  _facets[f].visible = true;
+  _visible.push_back(f);
+
+  for (unsigned k=0; k< 3; k++)
+  {
+    const unsigned e = (entry + k) % 3;
+    const unsigned g = _facets[f].adj[e];
+    if (_facets[g].visible)
+      continue;
+
+    if (calc_dist(g, p) > _eps)
+    {
+      // find the edge of g shared with f and continue the search from there
+      unsigned ge = 0;
+      while (_facets[g].adj[ge] != f)
+        ge++;
+      find_horizon(p, g, ge);
+    }
+    else
+      _horizon.push_back(std::make_pair(f, e));
+  }
+}
+
+/// Adds the farthest point above a facet to the hull
+/**
+ * \return <b>false</b> if the horizon is inconsistent (due to numerical
+ *         error)
+ */
+bool QuickHull::add_point(unsigned f)
+{
+  const unsigned p = _facets[f].farthest;
+
+  // find the visible facets and the horizon
+  _visible.clear();
+  _horizon.clear();
+  find_horizon(p, f, 0);
+
+  // create a new facet for each horizon edge
+  const unsigned NH = _horizon.size();
+  _new_facets.clear();
+  for (unsigned i=0; i< NH; i++)
+  {
+    const unsigned vf = _horizon[i].first, e = _horizon[i].second;
+    const unsigned a = _facets[vf].v[e], b = _facets[vf].v[(e+1) % 3];
+    const unsigned h = _facets[vf].adj[e];
+
+    // create the facet and attach it to the facet beyond the horizon
+    const unsigned nf = new_facet(a, b, p);
+    _facets[nf].adj[0] = h;
+    for (unsigned k=0; k< 3; k++)
+      if (_facets[h].adj[k] == vf)
+        _facets[h].adj[k] = nf;
+    _new_facets.push_back(nf);
+  }
+
+  // connect the new facets to each other
+  for (unsigned i=0; i< NH; i++)
+  {
+    const unsigned f1 = _new_facets[i], f2 = _new_facets[(i+1) % NH];
+    if (_facets[f1].v[1] != _facets[f2].v[0])
+      return false;
+    _facets[f1].adj[1] = f2;
+    _facets[f2].adj[2] = f1;
+  }
+
+  // reassign the points outside of the visible facets
+  _points.clear();
+  for (unsigned i=0; i< _visible.size(); i++)
+  {
+    Facet& vf = _facets[_visible[i]];
+    for (unsigned j=0; j< vf.outside.size(); j++)
+      if (vf.outside[j] != p)
+        _points.push_back(vf.outside[j]);
+    vf.outside.clear();
+    vf.deleted = true;
+  }
+  assign_points(_points, _new_facets);
+
+  // process new facets with points outside of them
+  for (unsigned i=0; i< NH; i++)
+    if (!_facets[_new_facets[i]].outside.empty())
+      _stack.push_back(_new_facets[i]);
+
+  return true;
+}
+
+/// Computes the convex hull of a set of 3D points
+/**
+ * \param points the points
+ * \param facets the triangles of the hull on return; each triangle indexes
+ *        points and is oriented counter-clockwise when viewed from outside
+ *        the hull
+ * \param tol the tolerance within which points are considered to lie on a
+ *        facet (scaled by the magnitude of the coordinates)
+ * \return <b>false</b> if the points do not span three dimensions or the
+ *         hull could not be computed due to numerical error
+ */
+bool QuickHull::calc_convex_hull_3D(const vector<Origin3d>& points, vector<IndexedTri>& facets, double tol)
+{
+  const unsigned N = points.size();
+
+  facets.clear();
+  if (N < 4)
+    return false;
+
+  // copy the points and determine the tolerance
+  double scale = 1.0;
+  _pts.resize(N*3);
+  for (unsigned i=0, j=0; i< N; i++)
+    for (unsigned k=0; k< 3; k++, j++)
+    {
+      _pts[j] = points[i][k];
+      scale = std::max(scale, std::fabs(_pts[j]));
+    }
+  _eps = tol * scale;
+
+  // create the initial simplex
+  if (!create_simplex())
+    return false;
+
+  // add points until no point is outside of the hull
+  _stack.clear();
+  for (unsigned f=0; f< _n_facets; f++)
+    if (!_facets[f].outside.empty())
+      _stack.push_back(f);
+  while (!_stack.empty())
+  {
+    const unsigned f = _stack.back();
+    _stack.pop_back();
+    if (_facets[f].deleted || _facets[f].outside.empty())
+      continue;
+    if (!add_point(f))
+      return false;
+  }
+
+  // get the facets
+  for (unsigned f=0; f< _n_facets; f++)
+    if (!_facets[f].deleted)
+      facets.push_back(IndexedTri(_facets[f].v[0], _facets[f].v[1], _facets[f].v[2]));
+
+  return true;
+}
+
+/// Computes the vertices of the intersection of a set of halfspaces
+/**
+ * Uses duality: each halfspace n'x <= d maps to the point n/(d - n'p), where
+ * p is the interior point, and each facet of the convex hull of these points
+ * maps back to a vertex of the intersection.
+ * \param halfspaces the halfspaces (normal, offset), each satisfying the
+ *        equation n'x <= d
+ * \param interior_point a point strictly inside all halfspaces
+ * \param vertices the vertices of the intersection on return (vertices
+ *        where more than three halfspaces meet may be repeated)
+ * \return <b>false</b> if the interior point is not strictly inside all
+ *         halfspaces, the intersection is unbounded, or the dual hull could
+ *         not be computed
+ */
+bool QuickHull::calc_hs_intersection(const vector<pair<Origin3d, double> >& halfspaces, const Origin3d& interior_point, vector<Origin3d>& vertices, double tol)
+{
+  vertices.clear();
+
+  // compute the dual points
+  _dual.resize(halfspaces.size());
+  for (unsigned i=0; i< halfspaces.size(); i++)
+  {
+    const Origin3d& n = halfspaces[i].first;
+    double d = halfspaces[i].second - n.dot(interior_point);
+    if (d <= 0.0)
+      return false;
+    _dual[i] = n/d;
+  }
+
+  // compute the hull of the dual points
+  if (!calc_convex_hull_3D(_dual, _dual_facets, tol))
+    return false;
+
+  // each facet of the dual hull is a vertex of the intersection
+  for (unsigned i=0; i< _dual_facets.size(); i++)
+  {
+    const Origin3d& a = _dual[_dual_facets[i].a];
+    const Origin3d& b = _dual[_dual_facets[i].b];
+    const Origin3d& c = _dual[_dual_facets[i].c];
+    Origin3d n = Origin3d::cross(b - a, c - a);
+    double d = n.dot(a);
+    if (d <= _eps * n.norm())
+      return false;
+    vertices.push_back(interior_point + n/d);
+  }
+
+  return true;
+}
+
+/// Compacts the vertices used by a set of triangles
+/**
+ * \param facets triangles indexing a set of points; on return, the triangles
+ *        index vertices
+ * \param n_points the number of points
+ * \param vertices the indices of the points used by the triangles on return
+ */
+void QuickHull::compact(vector<IndexedTri>& facets, unsigned n_points, vector<unsigned>& vertices)
+{
+  const unsigned UNUSED = std::numeric_limits<unsigned>::max();
+  vector<unsigned> vertex_map(n_points, UNUSED);
+
+  vertices.clear();
+  for (unsigned i=0; i< facets.size(); i++)
+  {
+    unsigned* v[3] = { &facets[i].a, &facets[i].b, &facets[i].c };
+    for (unsigned k=0; k< 3; k++)
+    {
+      if (vertex_map[*v[k]] == UNUSED)
+      {
+        vertex_map[*v[k]] = vertices.size();
+        vertices.push_back(*v[k]);
+      }
+      *v[k] = vertex_map[*v[k]];
+    }
+  }
+}
+
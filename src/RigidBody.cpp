@@ -48,11 +48,19 @@ RigidBody::RigidBody()
 {
   // setup visualization pose
   _vF->rpose = _F;
+
+  // the body is awake
+  _sleeping = false;
 }
 
 /// Applies a generalized impulse to the rigid body (calls the simulator)
+/**
+ * An impulse wakes a sleeping body; the simulator wakes the rest of the 
+ * body's island.
+ */
 void RigidBody::apply_generalized_impulse(const SharedVectorNd& gj)
 {
+  _sleeping = false;
   shared_ptr<Simulator> s(simulator);
   s->apply_impulse(RigidBodyd::get_this(), gj);
 }
@@ -553,6 +561,9 @@ std::ostream& Moby::operator<<(std::ostream& out, Moby::RigidBody& rb)
   // indicate whether the body is enabled
   out << "  enabled? " << rb.is_enabled() << endl;
 
+  // indicate whether the body is asleep
+  out << "  sleeping? " << rb.is_sleeping() << endl;
+
   // write the computation frame
   out << "  computation frame: ";
   switch (rb.get_computation_frame_type())
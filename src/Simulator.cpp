@@ -4,6 +4,10 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <cstdio>
 #include <map>
 #include <iostream>
 #ifdef USE_OSG
@@ -17,6 +21,7 @@
 #include <Moby/Joint.h>
 #include <Moby/XMLTree.h>
 #include <Moby/SparseJacobian.h>
+#include <Moby/StateBuffer.h>
 #include <Moby/Simulator.h>
 
 using std::list;
@@ -42,6 +47,7 @@ Simulator::Simulator()
 {
   this->current_time = 0;
   post_step_callback_fn = NULL;
+  parallel_islands = false;
 
   // clear dynamics timings
   dynamics_time = (double) 0.0;
@@ -478,53 +484,71 @@ void Simulator::apply_impulse(shared_ptr<DynamicBodyd> db, const SharedVectorNd&
   }
 }
 
-/// Calculates forward dynamics for bodies (does not consider unilateral constraints)
-void Simulator::calc_fwd_dyn(double dt)
+/// Updates the islands and the implicit joints belonging to each island, if the topology has changed
+/**
+ * \return <b>true</b> if the islands were recomputed
+ */
+bool Simulator::update_island_cache()
 {
-  VectorNd v, a, lambda, f;
-  MatrixNd M;
-  vector<JointPtr> island_ijoints; 
+  // see whether the bodies, implicit joints, or enabled states have changed
+  bool changed = (_bodies != _island_bodies || 
+                  implicit_joints != _island_implicit_joints ||
+                  _bodies.size() != _island_enabled.size());
+  for (unsigned i=0; i< _bodies.size() && !changed; i++)
+  {
+    shared_ptr<RigidBodyd> rb = dynamic_pointer_cast<RigidBodyd>(_bodies[i]);
+    if (rb && rb->is_enabled() != _island_enabled[i])
+      changed = true;
+  }
+  if (!changed)
+    return false;
 
-  // get the simulator pointer
-  shared_ptr<Simulator> shared_this = dynamic_pointer_cast<Simulator>(shared_from_this());
+  // save the topology
+  _island_bodies = _bodies;
+  _island_implicit_joints = implicit_joints;
+  _island_enabled.resize(_bodies.size());
+  for (unsigned i=0; i< _bodies.size(); i++)
+  {
+    shared_ptr<RigidBodyd> rb = dynamic_pointer_cast<RigidBodyd>(_bodies[i]);
+    _island_enabled[i] = (!rb || rb->is_enabled());
+  }
 
   // find islands
-  vector<vector<shared_ptr<DynamicBodyd> > > islands; 
-  find_islands(islands);
-
-  // calculate forward dynamics for each island 
-  for (unsigned i=0; i< islands.size(); i++)
+  find_islands(_islands);
+  _island_ijoints.clear();
+  _island_ijoints.resize(_islands.size());
+  _island_workspaces.resize(_islands.size());
+
+  // map bodies to islands
+  map<shared_ptr<DynamicBodyd>, unsigned> island_map;
+  for (unsigned i=0; i< _islands.size(); i++)
+    for (unsigned j=0; j< _islands[i].size(); j++)
+      island_map[_islands[i][j]] = i;
+
+  // get the implicit joints in each island
+  for (unsigned j=0; j< implicit_joints.size(); j++)
   {
-    // get the i'th island
-    vector<shared_ptr<DynamicBodyd> >& island = islands[i];
-
-    // sort the island so that we can search it
-    std::sort(island.begin(), island.end());
-
-    // clear the set of implicit joints 
-    island_ijoints.clear();
-
-    // get the implicit joints in the island
-    for (unsigned j=0; j< implicit_joints.size(); j++)
-    {
-      // get the inboard and outboard links for the joint
-      shared_ptr<RigidBodyd> ib = implicit_joints[j]->get_inboard_link();
-      shared_ptr<RigidBodyd> ob = implicit_joints[j]->get_outboard_link();
-
-      // get the super bodies 
-      shared_ptr<DynamicBodyd> ib_super = ib->get_super_body(); 
-      shared_ptr<DynamicBodyd> ob_super = ob->get_super_body(); 
-
-      if (std::binary_search(island.begin(), island.end(), ib_super) ||
-          std::binary_search(island.begin(), island.end(), ob_super))
-        island_ijoints.push_back(implicit_joints[j]);
-    }
+    // get the inboard and outboard links for the joint
+    shared_ptr<RigidBodyd> ib = implicit_joints[j]->get_inboard_link();
+    shared_ptr<RigidBodyd> ob = implicit_joints[j]->get_outboard_link();
+
+    // get the super bodies 
+    shared_ptr<DynamicBodyd> ib_super = ib->get_super_body(); 
+    shared_ptr<DynamicBodyd> ob_super = ob->get_super_body(); 
+
+    // add the joint to the island of either body 
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator iter;
+    if ((iter = island_map.find(ib_super)) != island_map.end() ||
+        (iter = island_map.find(ob_super)) != island_map.end())
+      _island_ijoints[iter->second].push_back(implicit_joints[j]);
+  }
 
-    // get all implicit joints from articulated bodies in the island
-    for (unsigned j=0; j< island.size(); j++)
+  // get all implicit joints from articulated bodies in each island
+  for (unsigned i=0; i< _islands.size(); i++)
+    for (unsigned j=0; j< _islands[i].size(); j++)
     {
       // see whether the body is articulated
-      shared_ptr<ArticulatedBodyd> ab = dynamic_pointer_cast<ArticulatedBodyd>(island[j]);
+      shared_ptr<ArticulatedBodyd> ab = dynamic_pointer_cast<ArticulatedBodyd>(_islands[i][j]);
       if (!ab)
         continue;
 
@@ -533,71 +557,100 @@ void Simulator::calc_fwd_dyn(double dt)
 
       // add the joints
       for (unsigned k=0; k< ijoints.size(); k++)
-        island_ijoints.push_back(dynamic_pointer_cast<Joint>(ijoints[k]));
+        _island_ijoints[i].push_back(dynamic_pointer_cast<Joint>(ijoints[k]));
     }
 
-    // get number of implicit constraints
-    const unsigned N_IMPLICIT = island_ijoints.size();
-  
-    // if there are no implicit constraints, just call calc_fwd_dyn(.) on
-    // each body
-    if (N_IMPLICIT == 0)
+  return true;
+}
+
+/// Calculates forward dynamics for bodies (does not consider unilateral constraints)
+void Simulator::calc_fwd_dyn(double dt)
+{
+  // update the islands, if necessary
+  update_island_cache();
+
+  // calculate forward dynamics for each island; islands share no bodies,
+  // so they may be processed in parallel
+  const int N_ISLANDS = (int) _islands.size();
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) if (parallel_islands && N_ISLANDS > 1)
+  #endif
+  for (int i=0; i< N_ISLANDS; i++)
+    calc_fwd_dyn(dt, (unsigned) i);
+}
+
+/// Calculates forward dynamics for a single island (does not consider unilateral constraints)
+void Simulator::calc_fwd_dyn(double dt, unsigned island_idx)
+{
+  // get the island, its implicit joints, and the workspace
+  const vector<shared_ptr<DynamicBodyd> >& island = _islands[island_idx];
+  const vector<JointPtr>& island_ijoints = _island_ijoints[island_idx];
+  IslandWorkspace& work = _island_workspaces[island_idx];
+
+  // get number of implicit constraints
+  const unsigned N_IMPLICIT = island_ijoints.size();
+
+  // if there are no implicit constraints, just call calc_fwd_dyn(.) on
+  // each body
+  if (N_IMPLICIT == 0)
+  {
+    for (unsigned j=0; j< island.size(); j++)
     {
-      for (unsigned j=0; j< island.size(); j++)
-      {
-        // get the body
-        shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(island[j]); 
+      // sleeping bodies are not integrated
+      RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(island[j]);
+      if (rb && rb->is_sleeping())
+        continue;
 
-        // no implicit constraints? just calculate forward dynamics for the body
-        db->calc_fwd_dyn();
-      }
+      // no implicit constraints? just calculate forward dynamics for the body
+      island[j]->calc_fwd_dyn();
     }
-    else // there are implicit constraints - must go through the solve process
-    {
-      // get the total number of generalized coordinates for the island
-      const unsigned NGC_TOTAL = num_generalized_coordinates(island);
 
-      // setup f
-      f.resize(NGC_TOTAL);
-      for (unsigned i=0, gc_index = 0; i< island.size(); i++)
-      {
-        const unsigned NGC = island[i]->num_generalized_coordinates(DynamicBodyd::eSpatial);
-        SharedVectorNd f_sub = f.segment(gc_index, gc_index + NGC);
-        island[i]->get_generalized_forces(f_sub);
-        gc_index += NGC;
-      }
+    return;
+  }
 
-      // get current velocities 
-      v.resize(NGC_TOTAL);
-      for (unsigned i=0, gc_index = 0; i< island.size(); i++)
-      {
-        const unsigned NGC = island[i]->num_generalized_coordinates(DynamicBodyd::eSpatial);
-        SharedVectorNd v_sub = v.segment(gc_index, gc_index + NGC);
-        island[i]->get_generalized_velocity(DynamicBodyd::eSpatial, v_sub);
-        gc_index += NGC;
-      }
+  // there are implicit constraints - must go through the solve process
+  // get the total number of generalized coordinates for the island
+  const unsigned NGC_TOTAL = num_generalized_coordinates(island);
 
-      // compute acceleration and constraint forces
-      solve(island, island_ijoints, v, f, dt, a, lambda);
+  // setup f
+  work.f.resize(NGC_TOTAL);
+  for (unsigned i=0, gc_index = 0; i< island.size(); i++)
+  {
+    const unsigned NGC = island[i]->num_generalized_coordinates(DynamicBodyd::eSpatial);
+    SharedVectorNd f_sub = work.f.segment(gc_index, gc_index + NGC);
+    island[i]->get_generalized_forces(f_sub);
+    gc_index += NGC;
+  }
 
-      // set accelerations
-      for (unsigned i=0, gc_index = 0; i< island.size(); i++)
-      {
-        const unsigned NGC = island[i]->num_generalized_coordinates(DynamicBodyd::eSpatial);
-        SharedConstVectorNd a_sub = a.segment(gc_index, gc_index + NGC);
-        island[i]->set_generalized_acceleration(a_sub);
-        gc_index += NGC;
-      }
+  // get current velocities 
+  work.v.resize(NGC_TOTAL);
+  for (unsigned i=0, gc_index = 0; i< island.size(); i++)
+  {
+    const unsigned NGC = island[i]->num_generalized_coordinates(DynamicBodyd::eSpatial);
+    SharedVectorNd v_sub = work.v.segment(gc_index, gc_index + NGC);
+    island[i]->get_generalized_velocity(DynamicBodyd::eSpatial, v_sub);
+    gc_index += NGC;
+  }
 
-      // populate constraint forces
-      for (unsigned i=0, c_index = 0; i< island_ijoints.size(); i++)
-      {
-        const unsigned NEQ = island_ijoints[i]->num_constraint_eqns();
-        SharedConstVectorNd lambda_sub = lambda.segment(c_index, c_index + NEQ);
-        island_ijoints[i]->lambda = lambda_sub;
-        c_index += NEQ;
-      }
-    }
+  // compute acceleration and constraint forces
+  solve(island, island_ijoints, work.v, work.f, dt, work.a, work.lambda);
+
+  // set accelerations
+  for (unsigned i=0, gc_index = 0; i< island.size(); i++)
+  {
+    const unsigned NGC = island[i]->num_generalized_coordinates(DynamicBodyd::eSpatial);
+    SharedConstVectorNd a_sub = work.a.segment(gc_index, gc_index + NGC);
+    island[i]->set_generalized_acceleration(a_sub);
+    gc_index += NGC;
+  }
+
+  // populate constraint forces
+  for (unsigned i=0, c_index = 0; i< island_ijoints.size(); i++)
+  {
+    const unsigned NEQ = island_ijoints[i]->num_constraint_eqns();
+    SharedConstVectorNd lambda_sub = work.lambda.segment(c_index, c_index + NEQ);
+    island_ijoints[i]->lambda = lambda_sub;
+    c_index += NEQ;
   }
 }
 
@@ -831,6 +884,11 @@ void Simulator::load_from_xml(shared_ptr<const XMLTree> node, std::map<std::stri
   if (time_attr)
     this->current_time = time_attr->get_real_value();
 
+  // see whether islands should be processed in parallel 
+  XMLAttrib* parallel_islands_attr = node->get_attrib("parallel-islands");
+  if (parallel_islands_attr)
+    this->parallel_islands = parallel_islands_attr->get_bool_value();
+
   // get the dissipator, if any
   XMLAttrib* diss_attr = node->get_attrib("dissipator-id");
   if (diss_attr)
@@ -1056,6 +1114,9 @@ void Simulator::save_to_xml(XMLTreePtr node, std::list<shared_ptr<const Base> >&
   // save the current time 
   node->attribs.insert(XMLAttrib("current-time", this->current_time));
 
+  // save whether islands are processed in parallel
+  node->attribs.insert(XMLAttrib("parallel-islands", this->parallel_islands));
+
   // save the ID of the dissipator
   if (dissipator)
   {
@@ -1075,3 +1136,257 @@ void Simulator::save_to_xml(XMLTreePtr node, std::list<shared_ptr<const Base> >&
   }
 }
 
+/// Gets the tables of geometries and joints referenced by the simulation state and a hash of the simulator layout
+/**
+ * The layout hash identifies the bodies (by ID and number of generalized
+ * coordinates) and the sizes of the tables; state can only be restored
+ * into a simulator with the same layout.
+ */
+void Simulator::get_state_tables(vector<CollisionGeometryPtr>& geoms, vector<JointPtr>& joints, unsigned long long& layout) const
+{
+  geoms.clear();
+  joints.clear();
+  layout = StateWriter::hash(NULL, 0);
+
+  BOOST_FOREACH(ControlledBodyPtr cb, _bodies)
+  {
+    // hash the body ID and its numbers of generalized coordinates
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(cb);
+    unsigned ngc[2];
+    ngc[0] = db->num_generalized_coordinates(DynamicBodyd::eEuler);
+    ngc[1] = db->num_generalized_coordinates(DynamicBodyd::eSpatial);
+    layout = StateWriter::hash(cb->id.c_str(), cb->id.size()+1, layout);
+    layout = StateWriter::hash(ngc, sizeof(ngc), layout);
+
+    // add the geometries and joints
+    RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(cb);
+    if (rb)
+      geoms.insert(geoms.end(), rb->geometries.begin(), rb->geometries.end());
+    else
+    {
+      ArticulatedBodyPtr ab = dynamic_pointer_cast<ArticulatedBody>(cb);
+      BOOST_FOREACH(shared_ptr<RigidBodyd> rbd, ab->get_links())
+      {
+        RigidBodyPtr link = dynamic_pointer_cast<RigidBody>(rbd);
+        geoms.insert(geoms.end(), link->geometries.begin(), link->geometries.end());
+      }
+      BOOST_FOREACH(shared_ptr<Jointd> jd, ab->get_joints())
+        joints.push_back(dynamic_pointer_cast<Joint>(jd));
+    }
+  }
+
+  // add the implicit joints
+  joints.insert(joints.end(), implicit_joints.begin(), implicit_joints.end());
+
+  // hash the sizes of the tables
+  unsigned sizes[2];
+  sizes[0] = geoms.size();
+  sizes[1] = joints.size();
+  layout = StateWriter::hash(sizes, sizeof(sizes), layout);
+}
+
+/// Saves the state of the simulation to a flat binary buffer
+/**
+ * The state consists of the current time and the generalized coordinates
+ * and velocities of all bodies, along with any state that derived 
+ * simulators carry between steps (see write_state()). The model itself 
+ * (bodies, geometries, joints, and parameters) is not saved; use 
+ * save_to_xml() for that.
+ * \param buffer the buffer (reusing a buffer avoids reallocation)
+ */
+void Simulator::save_state(vector<char>& buffer) const
+{
+  vector<CollisionGeometryPtr> geoms;
+  vector<JointPtr> joints;
+  unsigned long long layout;
+
+  // get the tables and the layout
+  get_state_tables(geoms, joints, layout);
+
+  // write the state
+  StateWriter out(buffer, geoms, joints, layout);
+  write_state(out);
+  out.finish();
+}
+
+/// Restores the state of the simulation from a buffer written by save_state()
+/**
+ * The whole buffer is parsed and verified before any of it is applied, so
+ * the simulation is unchanged when the buffer is rejected.
+ * \return <b>false</b> if the buffer was not written by a simulator with the
+ *         same layout (the same bodies, geometries, and joints) or is 
+ *         corrupt
+ */
+bool Simulator::restore_state(const vector<char>& buffer)
+{
+  vector<CollisionGeometryPtr> geoms;
+  vector<JointPtr> joints;
+  unsigned long long layout;
+
+  // get the tables and the layout
+  get_state_tables(geoms, joints, layout);
+
+  // verify the buffer
+  StateReader in((buffer.empty()) ? NULL : &buffer.front(), buffer.size(), geoms, joints, layout);
+  if (!in.ok())
+  {
+    FILE_LOG(LOG_SIMULATOR) << "Simulator::restore_state() - state was written for a different simulator or is corrupt" << std::endl;
+    return false;
+  }
+
+  // parse all of the state without modifying the simulation
+  read_state(in, false);
+  if (!in.ok() || !in.at_end())
+  {
+    FILE_LOG(LOG_SIMULATOR) << "Simulator::restore_state() - state does not match the simulator" << std::endl;
+    return false;
+  }
+
+  // the state matches; read it again, this time applying it
+  StateReader apply_in(&buffer.front(), buffer.size(), geoms, joints, layout);
+  read_state(apply_in, true);
+  assert(apply_in.ok() && apply_in.at_end());
+
+  return true;
+}
+
+/// Saves the state of the simulation to a file (e.g., for restarting a long simulation)
+/**
+ * \return <b>false</b> if the file could not be written
+ * \sa save_state(std::vector<char>&)
+ */
+bool Simulator::save_state(const std::string& filename) const
+{
+  vector<char> buffer;
+  save_state(buffer);
+
+  // write the file under a temporary name
+  std::string tmp_filename = filename + ".tmp";
+  FILE* fp = std::fopen(tmp_filename.c_str(), "wb");
+  if (!fp)
+  {
+    FILE_LOG(LOG_SIMULATOR) << "Simulator::save_state() - unable to open " << tmp_filename << std::endl;
+    return false;
+  }
+  bool written = (std::fwrite(&buffer.front(), 1, buffer.size(), fp) == buffer.size());
+  written = (std::fclose(fp) == 0) && written;
+
+  // move it into place, so that an interrupted write never replaces a good file
+  if (!written || std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+  {
+    FILE_LOG(LOG_SIMULATOR) << "Simulator::save_state() - unable to write " << filename << std::endl;
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+/// Restores the state of the simulation from a file written by save_state()
+/**
+ * \return <b>false</b> if the file could not be read or does not match the
+ *         simulator
+ * \sa restore_state(const std::vector<char>&)
+ */
+bool Simulator::restore_state(const std::string& filename)
+{
+  // read the file
+  FILE* fp = std::fopen(filename.c_str(), "rb");
+  if (!fp)
+  {
+    FILE_LOG(LOG_SIMULATOR) << "Simulator::restore_state() - unable to open " << filename << std::endl;
+    return false;
+  }
+  vector<char> buffer;
+  long size = -1;
+  if (std::fseek(fp, 0, SEEK_END) == 0 && (size = std::ftell(fp)) > 0 && std::fseek(fp, 0, SEEK_SET) == 0)
+  {
+    buffer.resize(size);
+    if (std::fread(&buffer.front(), 1, buffer.size(), fp) != buffer.size())
+      buffer.clear();
+  }
+  std::fclose(fp);
+
+  return restore_state(buffer);
+}
+
+/// Writes the state of the simulation that is not part of the model
+/**
+ * Derived simulators that carry state between steps should call this
+ * method and then write their own state.
+ */
+void Simulator::write_state(StateWriter& out) const
+{
+  VectorNd q, qd;
+
+  // write the current time
+  out.write_double(current_time);
+
+  // write the generalized coordinates and velocities of all bodies
+  BOOST_FOREACH(ControlledBodyPtr cb, _bodies)
+  {
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(cb);
+    db->get_generalized_coordinates_euler(q);
+    db->get_generalized_velocity(DynamicBodyd::eSpatial, qd);
+    out.write_vector(q);
+    out.write_vector(qd);
+
+    // write whether the body is enabled
+    RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(cb);
+    out.write_unsigned((!rb || rb->is_enabled()) ? 1 : 0);
+  }
+}
+
+/// Reads the state of the simulation written by write_state()
+/**
+ * restore_state() calls this method twice: first with apply false, to
+ * parse and verify all of the state, and then, only if that succeeds, 
+ * with apply true. Derived simulators should call this method and then 
+ * read their own state into temporaries, calling StateReader::fail() if 
+ * the state does not match; the simulation must be modified only when 
+ * apply is true (and only once all of the state has been read).
+ */
+void Simulator::read_state(StateReader& in, bool apply)
+{
+  const unsigned NBODIES = _bodies.size();
+  vector<VectorNd> q(NBODIES), qd(NBODIES);
+  vector<bool> enabled(NBODIES);
+
+  // read the current time
+  const double TIME = in.read_double();
+
+  // read the generalized coordinates and velocities of all bodies
+  for (unsigned i=0; i< NBODIES; i++)
+  {
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(_bodies[i]);
+    in.read_vector(q[i]);
+    in.read_vector(qd[i]);
+    enabled[i] = (in.read_unsigned() != 0);
+    if (!in.ok() || q[i].size() != db->num_generalized_coordinates(DynamicBodyd::eEuler) || qd[i].size() != db->num_generalized_coordinates(DynamicBodyd::eSpatial))
+    {
+      in.fail();
+      return;
+    }
+  }
+  if (!apply)
+    return;
+
+  // set the time
+  current_time = TIME;
+
+  // set the coordinates and velocity of each body with the body enabled
+  for (unsigned i=0; i< NBODIES; i++)
+  {
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(_bodies[i]);
+    RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(_bodies[i]);
+    if (rb)
+      rb->set_enabled(true);
+    db->set_generalized_coordinates_euler(q[i]);
+    db->set_generalized_velocity(DynamicBodyd::eSpatial, qd[i]);
+    if (rb)
+      rb->set_enabled(enabled[i]);
+  }
+
+  // stored derivatives are no longer valid
+  _current_dx.resize(0);
+}
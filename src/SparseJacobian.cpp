@@ -4,10 +4,13 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 
+#include <map>
+#include <algorithm>
 #include <Ravelin/MissizeException.h>
 #include <Moby/SparseJacobian.h>
 
 using std::vector;
+using std::map;
 using namespace Ravelin;
 using namespace Moby;
 
@@ -131,6 +134,16 @@ MatrixNd& SparseJacobian::mult_transpose(const SparseJacobian& M, MatrixNd& resu
   if (blocks.size() == 0 || x.size() == 0)
     return result;
 
+  // index the blocks of M by starting column, so that only blocks that may
+  // overlap a given block need to be examined
+  map<unsigned, vector<unsigned> > col_index;
+  unsigned max_cols = 0;
+  for (unsigned j=0; j< x.size(); j++)
+  {
+    col_index[x[j].st_col_idx].push_back(j);
+    max_cols = std::max(max_cols, x[j].columns());
+  }
+
   // loop over each block
   for (unsigned i=0; i< blocks.size(); i++)
   {
@@ -142,15 +155,22 @@ MatrixNd& SparseJacobian::mult_transpose(const SparseJacobian& M, MatrixNd& resu
     const unsigned REND = RSTART + blocks[i].rows();
     const unsigned CEND = CSTART + blocks[i].columns();
 
-    // loop over each input block
-    for (unsigned j=0; j< x.size(); j++)
+    // input blocks starting before this column cannot overlap
+    const unsigned X_CSTART_MIN = (CSTART + 1 > max_cols) ? CSTART + 1 - max_cols : 0;
+
+    // loop over each input block that may overlap
+    for (map<unsigned, vector<unsigned> >::const_iterator k = col_index.lower_bound(X_CSTART_MIN); k != col_index.end() && k->first < CEND; k++)
+    for (unsigned m=0; m< k->second.size(); m++)
     {
+      // get the input block
+      const unsigned j = k->second[m];
+
       // get x column start and end
       const unsigned X_CSTART = x[j].st_col_idx;
       const unsigned X_CEND = X_CSTART + x[j].columns();
 
       // see whether the two blocks overlap 
-      if (X_CEND < CSTART || X_CSTART >= CEND)
+      if (X_CEND <= CSTART || X_CSTART >= CEND)
         continue;
 
       // get x row start and end
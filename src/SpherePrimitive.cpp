@@ -36,6 +36,7 @@ using std::make_pair;
 /// Creates a sphere with radius 1.0 and 100 points 
 SpherePrimitive::SpherePrimitive()
 {
+  _type = eSphere;
   _radius = 1.0;
   _npoints = 100;
   calc_mass_properties();
@@ -44,6 +45,7 @@ SpherePrimitive::SpherePrimitive()
 /// Creates a sphere with radius 1.0 and 100 points at the given transform
 SpherePrimitive::SpherePrimitive(const Pose3d& T) : Primitive(T)
 {
+  _type = eSphere;
   _radius = 1.0;
   _npoints = 100;
   calc_mass_properties();
@@ -52,6 +54,7 @@ SpherePrimitive::SpherePrimitive(const Pose3d& T) : Primitive(T)
 /// Creates a sphere with the specified radius and 100 points 
 SpherePrimitive::SpherePrimitive(double radius)
 {
+  _type = eSphere;
   _radius = radius;
   _npoints = 100;
   calc_mass_properties();
@@ -60,6 +63,7 @@ SpherePrimitive::SpherePrimitive(double radius)
 /// Creates a sphere with the specified radius and number of points
 SpherePrimitive::SpherePrimitive(double radius, unsigned n)
 {
+  _type = eSphere;
   _radius = radius;
   _npoints = n;
   calc_mass_properties();
@@ -71,6 +75,7 @@ SpherePrimitive::SpherePrimitive(double radius, unsigned n)
  */
 SpherePrimitive::SpherePrimitive(double radius, const Pose3d& T) : Primitive(T)
 {
+  _type = eSphere;
   _radius = radius;
   _npoints = 100;
   calc_mass_properties();
@@ -79,6 +84,7 @@ SpherePrimitive::SpherePrimitive(double radius, const Pose3d& T) : Primitive(T)
 /// Creates a sphere with the specified radius, transform, and number of points 
 SpherePrimitive::SpherePrimitive(double radius, unsigned n, const Pose3d& T) : Primitive(T)
 {
+  _type = eSphere;
   _radius = radius;
   _npoints = n;  
   calc_mass_properties();
@@ -100,6 +106,20 @@ double SpherePrimitive::calc_signed_dist(const Point3d& p) const
   return p.norm() - _radius;
 }
 
+/// Computes the signed distances of a batch of points from the sphere
+/**
+ * \see Primitive::calc_signed_dist_batch()
+ */
+void SpherePrimitive::calc_signed_dist_batch(shared_ptr<const Pose3d> P, const double* x, const double* y, const double* z, unsigned n, double* dist) const
+{
+  assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
+
+  // the loop has no branches, so that the compiler can vectorize it
+  const double R = _radius;
+  for (unsigned i=0; i< n; i++)
+    dist[i] = std::sqrt(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]) - R;
+}
+
 /// Computes the distance from another sphere primitive
 double SpherePrimitive::calc_signed_dist(shared_ptr<const SpherePrimitive> s, Point3d& pthis, Point3d& ps) const
 {
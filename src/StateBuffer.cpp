@@ -0,0 +1,250 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <cstring>
+#include <limits>
+#include <Moby/StateBuffer.h>
+
+using namespace Ravelin;
+using namespace Moby;
+using boost::shared_ptr;
+using boost::uint32_t;
+using boost::uint64_t;
+using std::vector;
+
+// identifies a state buffer and its format version
+static const char MAGIC[8] = { 'M', 'O', 'B', 'Y', 'S', 'T', 'A', 'T' };
+static const uint32_t VERSION = 1;
+
+// identifies the byte order of the machine that wrote the state
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// offsets of the fields in the header
+enum HeaderOffset { eMagic = 0, eVersion = 8, eByteOrder = 12, eLayout = 16, eSize = 24, eChecksum = 32, eHeaderSize = 40 };
+
+// the index written for a geometry or joint that is not in the tables
+static const uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+/// Hashes bytes using 64-bit FNV-1a
+unsigned long long StateWriter::hash(const void* data, size_t n, unsigned long long h)
+{
+  const unsigned char* c = (const unsigned char*) data;
+  for (size_t i=0; i< n; i++)
+  {
+    h ^= (unsigned long long) c[i];
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+/// Starts writing state to a buffer
+/**
+ * \param buffer the buffer, which is cleared (its capacity is retained, so
+ *        that reusing a buffer avoids reallocation)
+ * \param geoms the geometry table
+ * \param joints the joint table
+ * \param layout a hash identifying the layout of the simulator
+ */
+StateWriter::StateWriter(vector<char>& buffer, const vector<CollisionGeometryPtr>& geoms, const vector<JointPtr>& joints, unsigned long long layout) : _buffer(buffer)
+{
+  // setup the index maps
+  for (unsigned i=0; i< geoms.size(); i++)
+    _geom_index[geoms[i]] = i;
+  for (unsigned i=0; i< joints.size(); i++)
+    _joint_index[joints[i]] = i;
+
+  // write the header; the size and checksum are written by finish()
+  uint64_t L = layout, zero = 0;
+  _buffer.clear();
+  write(MAGIC, sizeof(MAGIC));
+  write(&VERSION, sizeof(uint32_t));
+  write(&BYTE_ORDER_MARK, sizeof(uint32_t));
+  write(&L, sizeof(uint64_t));
+  write(&zero, sizeof(uint64_t));
+  write(&zero, sizeof(uint64_t));
+  _start = _buffer.size();
+}
+
+/// Writes the size and checksum of the state into the header
+/**
+ * Must be called after all state has been written.
+ */
+void StateWriter::finish()
+{
+  uint64_t size = _buffer.size() - _start;
+  uint64_t checksum = (size > 0) ? hash(&_buffer[_start], size) : hash(NULL, 0);
+  std::memcpy(&_buffer[eSize], &size, sizeof(uint64_t));
+  std::memcpy(&_buffer[eChecksum], &checksum, sizeof(uint64_t));
+}
+
+/// Writes a vector (preceded by its size)
+void StateWriter::write_vector(const VectorNd& v)
+{
+  write_unsigned(v.size());
+  if (v.size() > 0)
+    write(v.data(), sizeof(double)*v.size());
+}
+
+/// Writes the components of a three-dimensional vector (the pose is not written)
+void StateWriter::write_vector3d(const Vector3d& v)
+{
+  const unsigned X = 0, Y = 1, Z = 2;
+
+  write_double(v[X]);
+  write_double(v[Y]);
+  write_double(v[Z]);
+}
+
+/// Writes the index of a geometry in the geometry table
+void StateWriter::write_geometry(CollisionGeometryPtr cg)
+{
+  std::map<CollisionGeometryPtr, unsigned>::const_iterator iter = _geom_index.find(cg);
+  write_unsigned((iter == _geom_index.end()) ? NO_INDEX : iter->second);
+}
+
+/// Writes the index of a joint in the joint table
+void StateWriter::write_joint(JointPtr joint)
+{
+  std::map<JointPtr, unsigned>::const_iterator iter = _joint_index.find(joint);
+  write_unsigned((iter == _joint_index.end()) ? NO_INDEX : iter->second);
+}
+
+/// Starts reading state from a buffer
+/**
+ * The reader fails (see ok()) if the header is not that of a state buffer
+ * written by this version on a machine of the same byte order, if the
+ * state was written for a simulator with a different layout, or if the
+ * state is truncated or corrupt.
+ * \param data the buffer
+ * \param size the size of the buffer
+ * \param geoms the geometry table
+ * \param joints the joint table
+ * \param layout a hash identifying the layout of the simulator
+ */
+StateReader::StateReader(const char* data, size_t size, const vector<CollisionGeometryPtr>& geoms, const vector<JointPtr>& joints, unsigned long long layout) : _geoms(geoms), _joints(joints)
+{
+  _ptr = _end = data;
+  _ok = false;
+
+  // verify the header
+  if (size < eHeaderSize)
+    return;
+  uint32_t version, bom;
+  uint64_t L, state_size, checksum;
+  std::memcpy(&version, data+eVersion, sizeof(uint32_t));
+  std::memcpy(&bom, data+eByteOrder, sizeof(uint32_t));
+  std::memcpy(&L, data+eLayout, sizeof(uint64_t));
+  std::memcpy(&state_size, data+eSize, sizeof(uint64_t));
+  std::memcpy(&checksum, data+eChecksum, sizeof(uint64_t));
+  if (std::memcmp(data+eMagic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || bom != BYTE_ORDER_MARK || L != layout || state_size != size - eHeaderSize)
+    return;
+
+  // verify the checksum
+  if (StateWriter::hash(data+eHeaderSize, state_size) != checksum)
+    return;
+
+  _ptr = data+eHeaderSize;
+  _end = data+size;
+  _ok = true;
+}
+
+/// Reads raw bytes
+void StateReader::read(void* data, size_t n)
+{
+  if (!_ok || (size_t) (_end - _ptr) < n)
+  {
+    _ok = false;
+    std::memset(data, 0, n);
+    return;
+  }
+
+  std::memcpy(data, _ptr, n);
+  _ptr += n;
+}
+
+/// Reads an unsigned integer
+unsigned StateReader::read_unsigned()
+{
+  uint32_t x;
+  read(&x, sizeof(uint32_t));
+  return x;
+}
+
+/// Reads a floating point value
+double StateReader::read_double()
+{
+  double x;
+  read(&x, sizeof(double));
+  return x;
+}
+
+/// Reads a vector (preceded by its size)
+void StateReader::read_vector(VectorNd& v)
+{
+  const unsigned N = read_unsigned();
+  if (!_ok || (size_t) (_end - _ptr) < sizeof(double)*N)
+  {
+    _ok = false;
+    v.resize(0);
+    return;
+  }
+
+  v.resize(N);
+  if (N > 0)
+    read(v.data(), sizeof(double)*N);
+}
+
+/// Reads the components of a three-dimensional vector
+/**
+ * \param P the pose of the vector
+ */
+Vector3d StateReader::read_vector3d(shared_ptr<const Pose3d> P)
+{
+  double x = read_double();
+  double y = read_double();
+  double z = read_double();
+  return Vector3d(x, y, z, P);
+}
+
+/// Reads a geometry from its index in the geometry table
+/**
+ * \return the geometry, or a null pointer if the geometry was not in the
+ *         table when the state was written
+ */
+CollisionGeometryPtr StateReader::read_geometry()
+{
+  const unsigned IDX = read_unsigned();
+  if (IDX == NO_INDEX)
+    return CollisionGeometryPtr();
+  if (IDX >= _geoms.size())
+  {
+    _ok = false;
+    return CollisionGeometryPtr();
+  }
+
+  return _geoms[IDX];
+}
+
+/// Reads a joint from its index in the joint table
+/**
+ * \return the joint, or a null pointer if the joint was not in the table
+ *         when the state was written
+ */
+JointPtr StateReader::read_joint()
+{
+  const unsigned IDX = read_unsigned();
+  if (IDX == NO_INDEX)
+    return JointPtr();
+  if (IDX >= _joints.size())
+  {
+    _ok = false;
+    return JointPtr();
+  }
+
+  return _joints[IDX];
+}
+
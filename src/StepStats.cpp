@@ -0,0 +1,96 @@
+/****************************************************************************
+ * Copyright 2016 Evan Drumwright
+ * This library is distributed under the terms of the Apache V2.0 
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+
+#include <time.h>
+#include <sys/time.h>
+#include <Moby/StepStats.h>
+
+using namespace Moby;
+
+/// Resets all timings and counters
+void StepStats::reset()
+{
+  sim_time = 0.0;
+  for (unsigned i=0; i< eNumPhases; i++)
+    phase_time[i] = 0.0;
+  n_pairs_checked = 0;
+  n_contacts = 0;
+  n_limits = 0;
+  n_islands = 0;
+  n_lcp_pivots = 0;
+  n_stabilization_iterations = 0;
+  n_mini_steps = 0;
+  n_mini_step_fallbacks = 0;
+  n_sleeping_bodies = 0;
+}
+
+/// Gets the name of a phase (used for CSV column and JSON key names)
+const char* StepStats::get_phase_name(Phase phase)
+{
+  switch (phase)
+  {
+    case eBroadPhase:               return "broad_phase";
+    case ePairwiseDistances:        return "pairwise_distances";
+    case eConservativeAdvancement:  return "conservative_advancement";
+    case eFindConstraints:          return "find_constraints";
+    case ePenalty:                  return "penalty";
+    case eDynamics:                 return "dynamics";
+    case eImpacts:                  return "impacts";
+    case eStabilization:            return "stabilization";
+    case eStep:                     return "step";
+    default:                        return "unknown";
+  }
+}
+
+/// Gets the current (monotonic, wall-clock) time in seconds
+double StepStats::get_time()
+{
+  #ifdef CLOCK_MONOTONIC
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+  #else
+  timeval t;
+  gettimeofday(&t, NULL);
+  return (double) t.tv_sec + (double) t.tv_usec * 1e-6;
+  #endif
+}
+
+/// Writes the names of the columns written by write_csv()
+void StepStats::write_csv_header(std::ostream& out)
+{
+  out << "sim_time";
+  for (unsigned i=0; i< eNumPhases; i++)
+    out << "," << get_phase_name((Phase) i) << "_time";
+  out << ",pairs_checked,contacts,limits,islands,lcp_pivots,stabilization_iterations,mini_steps,mini_step_fallbacks,sleeping_bodies" << std::endl;
+}
+
+/// Writes the statistics as a single comma-separated line
+void StepStats::write_csv(std::ostream& out) const
+{
+  out << sim_time;
+  for (unsigned i=0; i< eNumPhases; i++)
+    out << "," << phase_time[i];
+  out << "," << n_pairs_checked << "," << n_contacts << "," << n_limits << "," << n_islands << "," << n_lcp_pivots << "," << n_stabilization_iterations << "," << n_mini_steps << "," << n_mini_step_fallbacks << "," << n_sleeping_bodies << std::endl;
+}
+
+/// Writes the statistics as a single-line JSON object
+void StepStats::write_json(std::ostream& out) const
+{
+  out << "{\"sim_time\": " << sim_time << ", \"time\": {";
+  for (unsigned i=0; i< eNumPhases; i++)
+    out << (i > 0 ? ", " : "") << "\"" << get_phase_name((Phase) i) << "\": " << phase_time[i];
+  out << "}, \"pairs_checked\": " << n_pairs_checked;
+  out << ", \"contacts\": " << n_contacts;
+  out << ", \"limits\": " << n_limits;
+  out << ", \"islands\": " << n_islands;
+  out << ", \"lcp_pivots\": " << n_lcp_pivots;
+  out << ", \"stabilization_iterations\": " << n_stabilization_iterations;
+  out << ", \"mini_steps\": " << n_mini_steps;
+  out << ", \"mini_step_fallbacks\": " << n_mini_step_fallbacks;
+  out << ", \"sleeping_bodies\": " << n_sleeping_bodies << "}" << std::endl;
+}
+
@@ -5,12 +5,14 @@
  ****************************************************************************/
 
 #include <unistd.h>
+#include <strings.h>
 #include <boost/tuple/tuple.hpp>
 #include <Moby/XMLTree.h>
 #include <Moby/ArticulatedBody.h>
 #include <Moby/RigidBody.h>
 #include <Moby/Dissipation.h>
 #include <Moby/ControlledBody.h>
+#include <Moby/RecurrentForce.h>
 #include <Moby/CollisionGeometry.h>
 #include <Moby/CollisionDetection.h>
 #include <Moby/ContactParameters.h>
@@ -18,6 +20,7 @@
 #include <Moby/SustainedUnilateralConstraintSolveFailException.h>
 #include <Moby/InvalidStateException.h>
 #include <Moby/InvalidVelocityException.h>
+#include <Moby/StateBuffer.h>
 #include <Moby/TimeSteppingSimulator.h>
 
 #ifdef USE_OSG
@@ -46,6 +49,12 @@ using namespace Moby;
 TimeSteppingSimulator::TimeSteppingSimulator()
 {
   min_step_size = NEAR_ZERO;
+  max_mini_steps = std::numeric_limits<unsigned>::max();
+  mini_step_fallback = eAcceptPenetration;
+  sleeping = false;
+  sleep_ke_thresh = 1e-4;
+  sleep_vel_thresh = 1e-2;
+  sleep_time = 0.5;
 }
 
 /// Steps the simulator forward by the given step size
@@ -53,8 +62,17 @@ double TimeSteppingSimulator::step(double step_size)
 {
   const double INF = std::numeric_limits<double>::max();
 
-  // determine the set of collision geometries
+  // reset the timings and counters
+  _step_stats.reset();
+  const double STEP_START = StepStats::get_time();
+
+  // determine the set of collision geometries; bodies may have been moved
+  // since the last step, so the transform snapshot is not valid (and it is
+  // invalidated again on return, since bodies may be moved before the next
+  // step)
   determine_geometries();
+  _coldet->invalidate_transforms();
+  CollisionDetection::SnapshotGuard snapshot_guard(_coldet);
 
   // clear one-step visualization data
   #ifdef USE_OSG
@@ -64,6 +82,14 @@ double TimeSteppingSimulator::step(double step_size)
   // clear stored derivatives
   _current_dx.resize(0);
 
+  // wake any sleeping islands on which the applied forces have changed or
+  // in which a body has been moved or given velocity since the last step
+  if (!_sleeping_island_map.empty())
+  {
+    check_sleeping_forces();
+    check_sleeping_states();
+  }
+
   FILE_LOG(LOG_SIMULATOR) << "+stepping simulation from time: " << this->current_time << " by " << step_size << std::endl;
   if (LOGGING(LOG_SIMULATOR))
   {
@@ -84,38 +110,64 @@ double TimeSteppingSimulator::step(double step_size)
   // compute pairwise distances at the current configuration
   calc_pairwise_distances();
 
-  // do the Euler step
-  step_si_Euler(step_size);
+  // do the Euler step (which may be truncated by the mini-step budget)
+  step_size = step_si_Euler(step_size);
 
-  // call the callback
+  // call the callback (which may move bodies)
   if (post_step_callback_fn)
+  {
     post_step_callback_fn(this);
+    _coldet->invalidate_transforms();
+  }
 
   // do constraint stabilization
   shared_ptr<ConstraintSimulator> simulator = dynamic_pointer_cast<ConstraintSimulator>(shared_from_this());
   FILE_LOG(LOG_SIMULATOR) << "stabilization started" << std::endl;
-  cstab.stabilize(simulator);
-  FILE_LOG(LOG_SIMULATOR) << "stabilization done" << std::endl;
+  {
+    ScopedPhaseTimer timer(_step_stats, StepStats::eStabilization);
+    cstab.stabilize(simulator);
+  }
+  const ConstraintStabilization::Report& cstab_report = cstab.get_report();
+  _step_stats.n_stabilization_iterations = cstab_report.iterations;
+  FILE_LOG(LOG_SIMULATOR) << "stabilization done (" << cstab_report.n_violated << "/" << cstab_report.n_islands << " islands, " << cstab_report.iterations << " iterations, " << cstab_report.time << "s" << (cstab_report.budget_exhausted ? ", budget exhausted" : "") << ")" << std::endl;
 
-  // write out constraint violation
-  #ifndef NDEBUG
-  std::ofstream cvio("cvio.dat", std::ostream::app);
-  double vio = 0.0;
-  for (unsigned i=0; i< _pairwise_distances.size(); i++)
-    vio = std::min(vio, _pairwise_distances[i].dist);
-  cvio << vio << std::endl;
-  cvio.close();
-  #endif
+  // put resting islands to sleep and wake islands touched by moving bodies
+  update_sleeping(step_size);
+  _step_stats.n_sleeping_bodies = _sleeping_island_map.size();
+
+  // record constraint violation, if desired
+  if (metrics_sink && metrics_sink->is_open())
+  {
+    double min_dist = std::numeric_limits<double>::infinity();
+    for (unsigned i=0; i< _pairwise_distances.size(); i++)
+      min_dist = std::min(min_dist, _pairwise_distances[i].dist);
+    metrics_sink->record(current_time, min_dist, cstab_report.max_bilateral_vio, cstab_report.iterations);
+  }
+
+  // record the step time
+  _step_stats.sim_time = current_time;
+  _step_stats.phase_time[StepStats::eStep] = StepStats::get_time() - STEP_START;
 
   return step_size;
 }
 
 /// Does a full integration cycle (but not necessarily a full step)
-double TimeSteppingSimulator::do_mini_step(double dt)
+/**
+ * \param dt the maximum amount of time to integrate
+ * \param budget the number of position integration iterations remaining in
+ *        the step's budget (see max_mini_steps); decremented by each 
+ *        iteration. The last iteration permitted by the budget uses 
+ *        mini_step_fallback.
+ * \return the amount of time integrated
+ */
+double TimeSteppingSimulator::do_mini_step(double dt, unsigned& budget)
 {
   VectorNd q, qd, qdd;
   std::vector<VectorNd> qsave;
 
+  // update the number of mini-steps
+  _step_stats.n_mini_steps++;
+
   // init qsave to proper size
   qsave.resize(_bodies.size());
 
@@ -135,26 +187,49 @@ double TimeSteppingSimulator::do_mini_step(double dt)
     // do broad phase collision detection
     broad_phase(dt-h);
 
-    // compute pairwise distances
-    calc_pairwise_distances();
+    // the last iteration permitted by the budget uses the fallback
+    const bool LAST = (budget <= 1);
+    if (budget > 0)
+      budget--;
+    if (LAST)
+    {
+      FILE_LOG(LOG_SIMULATOR) << " -- mini-step budget (" << max_mini_steps << ") exhausted" << std::endl;
+      _step_stats.n_mini_step_fallbacks++;
+    }
+
+    // integrate over all remaining time if not doing conservative advancement
+    double tc = dt-h;
+    if (!(LAST && mini_step_fallback == eAcceptPenetration))
+    {
+      // compute pairwise distances
+      calc_pairwise_distances();
 
-    // get the conservative step 
-    double CA_step = calc_next_CA_Euler_step(contact_dist_thresh);
+      // get the conservative step 
+      double CA_step;
+      {
+        ScopedPhaseTimer timer(_step_stats, StepStats::eConservativeAdvancement);
+        CA_step = calc_next_CA_Euler_step(contact_dist_thresh);
+      }
 
-    // look for impact
-    if (CA_step <= 0.0)
-      break;
+      // look for impact
+      if (CA_step <= 0.0)
+        break;
 
-    // get the conservative advancement step
-    double tc = std::max(min_step_size, CA_step);
-    FILE_LOG(LOG_SIMULATOR) << "Conservative advancement step: " << tc << std::endl;
+      // get the conservative advancement step
+      tc = std::max(min_step_size, CA_step);
+      FILE_LOG(LOG_SIMULATOR) << "Conservative advancement step: " << tc << std::endl;
 
-    // don't take too large a step
-    tc = std::min(dt-h, tc); 
+      // don't take too large a step
+      tc = std::min(dt-h, tc); 
+    }
 
     // integrate the bodies' positions by h + conservative advancement step
+    // (sleeping bodies do not move)
     for (unsigned i=0; i< _bodies.size(); i++)
     {
+      RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(_bodies[i]);
+      if (rb && rb->is_sleeping())
+        continue;
       shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(_bodies[i]);
       db->set_generalized_coordinates_euler(qsave[i]);
       db->get_generalized_velocity(DynamicBodyd::eEuler, q);
@@ -162,25 +237,41 @@ double TimeSteppingSimulator::do_mini_step(double dt)
       q += qsave[i];
       db->set_generalized_coordinates_euler(q);
     }
+    _coldet->invalidate_transforms();
 
     // update h
     h += tc;
+
+    // stop if the budget is exhausted
+    if (LAST)
+      break;
   }
 
   FILE_LOG(LOG_SIMULATOR) << "Position integration ended w/h = " << h << std::endl;
 
   // prepare to calculate forward dynamics
-  precalc_fwd_dyn();
+  {
+    ScopedPhaseTimer timer(_step_stats, StepStats::eDynamics);
+    precalc_fwd_dyn();
+  }
 
   // apply compliant unilateral constraint forces
   calc_compliant_unilateral_constraint_forces();
 
   // compute forward dynamics
-  calc_fwd_dyn(h);
+  {
+    ScopedPhaseTimer timer(_step_stats, StepStats::eDynamics);
+    calc_fwd_dyn(h);
+  }
+  _step_stats.n_islands = num_islands();
 
-  // integrate the bodies' velocities forward by h
+  // integrate the bodies' velocities forward by h (forward dynamics is not
+  // computed for sleeping bodies)
   for (unsigned i=0; i< _bodies.size(); i++)
   {
+    RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(_bodies[i]);
+    if (rb && rb->is_sleeping())
+      continue;
     shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(_bodies[i]);
     db->get_generalized_acceleration(qdd);
     qdd *= h;
@@ -221,6 +312,279 @@ double TimeSteppingSimulator::do_mini_step(double dt)
   return h;
 }
 
+/// Finds the representative of the set containing a body (with path compression)
+static shared_ptr<DynamicBodyd> find_set(map<shared_ptr<DynamicBodyd>, shared_ptr<DynamicBodyd> >& parent, shared_ptr<DynamicBodyd> db)
+{
+  shared_ptr<DynamicBodyd> root = db;
+  while (parent[root] != root)
+    root = parent[root];
+  while (parent[db] != root)
+  {
+    shared_ptr<DynamicBodyd> next = parent[db];
+    parent[db] = root;
+    db = next;
+  }
+  return root;
+}
+
+/// Computes the recurrent forces on a rigid body (in the global frame)
+static SForced calc_recurrent_forces(RigidBodyPtr rb)
+{
+  rb->reset_accumulators();
+  const list<RecurrentForcePtr>& rfs = rb->get_recurrent_forces();
+  BOOST_FOREACH(RecurrentForcePtr rf, rfs)
+    rf->add_force(rb);
+  return Pose3d::transform(GLOBAL, rb->sum_forces());
+}
+
+/// Wakes the island containing a sleeping body
+/**
+ * Does nothing if the body is not asleep.
+ */
+void TimeSteppingSimulator::wake(RigidBodyPtr rb)
+{
+  map<RigidBodyPtr, unsigned>::const_iterator iter = _sleeping_island_map.find(rb);
+  if (iter != _sleeping_island_map.end())
+    wake_island(iter->second);
+}
+
+/// Wakes all sleeping islands
+void TimeSteppingSimulator::wake_all()
+{
+  for (unsigned i=0; i< _sleeping_islands.size(); i++)
+    wake_island(i);
+  _sleeping_islands.clear();
+}
+
+/// Wakes the i'th sleeping island
+/**
+ * The island is emptied (rather than removed) so that the indices of the
+ * other sleeping islands remain valid.
+ */
+void TimeSteppingSimulator::wake_island(unsigned i)
+{
+  vector<RigidBodyPtr>& island = _sleeping_islands[i];
+  if (island.empty())
+    return;
+
+  FILE_LOG(LOG_SIMULATOR) << "waking island of " << island.size() << " bodies (including " << island.front()->id << ")" << std::endl;
+
+  for (unsigned j=0; j< island.size(); j++)
+  {
+    island[j]->_sleeping = false;
+    _sleeping_island_map.erase(island[j]);
+    _sleep_forces.erase(island[j]);
+    _sleep_coords.erase(island[j]);
+  }
+  island.clear();
+}
+
+/// Wakes sleeping islands on which the recurrent forces have changed since they were put to sleep
+void TimeSteppingSimulator::check_sleeping_forces()
+{
+  vector<unsigned> woken;
+
+  for (map<RigidBodyPtr, SForced>::const_iterator i = _sleep_forces.begin(); i != _sleep_forces.end(); i++)
+  {
+    // compute the forces on the body now
+    SForced f = calc_recurrent_forces(i->first);
+
+    // compare against the forces when the body was put to sleep
+    const SForced& f0 = i->second;
+    const double SCALE = 1.0 + f0.get_force().norm() + f0.get_torque().norm();
+    double diff = (f.get_force() - f0.get_force()).norm() + 
+                  (f.get_torque() - f0.get_torque()).norm();
+    if (diff > NEAR_ZERO * SCALE)
+    {
+      FILE_LOG(LOG_SIMULATOR) << "forces on sleeping body " << i->first->id << " have changed" << std::endl;
+      woken.push_back(_sleeping_island_map.find(i->first)->second);
+    }
+  }
+
+  // wake the islands
+  for (unsigned i=0; i< woken.size(); i++)
+    wake_island(woken[i]);
+}
+
+/// Wakes sleeping islands in which a body has been woken (by an impulse) or has been moved or given velocity since it was put to sleep
+void TimeSteppingSimulator::check_sleeping_states()
+{
+  VectorNd q, qd;
+  vector<unsigned> woken;
+
+  for (map<RigidBodyPtr, VectorNd>::const_iterator i = _sleep_coords.begin(); i != _sleep_coords.end(); i++)
+  {
+    RigidBodyPtr rb = i->first;
+    const VectorNd& q0 = i->second;
+
+    // sleeping bodies are not integrated, so any change is a disturbance
+    rb->get_generalized_coordinates_euler(q);
+    rb->get_generalized_velocity(DynamicBodyd::eSpatial, qd);
+    bool changed = (!rb->is_sleeping() || q.size() != q0.size() || 
+                    (qd.size() > 0 && qd.norm_inf() > 0.0));
+    for (unsigned j=0; j< q.size() && !changed; j++)
+      if (q[j] != q0[j])
+        changed = true;
+    if (changed)
+    {
+      FILE_LOG(LOG_SIMULATOR) << "sleeping body " << rb->id << " has been disturbed" << std::endl;
+      woken.push_back(_sleeping_island_map.find(rb)->second);
+    }
+  }
+
+  // wake the islands
+  for (unsigned i=0; i< woken.size(); i++)
+    wake_island(woken[i]);
+}
+
+/// Puts islands of resting bodies to sleep and wakes sleeping islands that have been touched by moving bodies
+/**
+ * \param dt the amount of time integrated over the last step
+ */
+void TimeSteppingSimulator::update_sleeping(double dt)
+{
+  VectorNd qd;
+  map<shared_ptr<DynamicBodyd>, double> rest_time;
+  map<shared_ptr<DynamicBodyd>, shared_ptr<DynamicBodyd> > parent;
+  map<shared_ptr<DynamicBodyd>, vector<shared_ptr<DynamicBodyd> > > islands;
+
+  // if sleeping has been turned off, wake all islands
+  if (!sleeping)
+  {
+    if (!_sleeping_islands.empty())
+      wake_all();
+    _rest_time.clear();
+    return;
+  }
+
+  // wake islands containing bodies that have been disturbed during the step
+  // (e.g., by impulses from awake bodies)
+  check_sleeping_states();
+
+  // update the rest times of all awake bodies
+  for (unsigned i=0; i< _bodies.size(); i++)
+  {
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(_bodies[i]);
+    RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(_bodies[i]);
+    if (rb && (!rb->is_enabled() || rb->is_sleeping()))
+      continue;
+
+    // see whether the body is resting 
+    db->get_generalized_velocity(DynamicBodyd::eSpatial, qd);
+    if (db->calc_kinetic_energy() < sleep_ke_thresh && 
+        qd.norm_inf() < sleep_vel_thresh)
+    {
+      map<shared_ptr<DynamicBodyd>, double>::const_iterator iter = _rest_time.find(db);
+      rest_time[db] = ((iter != _rest_time.end()) ? iter->second : 0.0) + dt;
+    }
+    else
+      rest_time[db] = 0.0;
+
+    // make the body a singleton set
+    parent[db] = db;
+  }
+  _rest_time.swap(rest_time);
+
+  // wake sleeping islands in contact with awake bodies that are not resting;
+  // bodies that are woken here do not wake other islands
+  for (unsigned i=0; i< _pairwise_distances.size(); i++)
+  {
+    const PairwiseDistInfo& pdi = _pairwise_distances[i];
+    if (pdi.dist >= contact_dist_thresh)
+      continue;
+
+    RigidBodyPtr rba = dynamic_pointer_cast<RigidBody>(pdi.a->get_single_body());
+    RigidBodyPtr rbb = dynamic_pointer_cast<RigidBody>(pdi.b->get_single_body());
+    for (unsigned j=0; j< 2; j++)
+    {
+      RigidBodyPtr sleeper = (j == 0) ? rba : rbb;
+      RigidBodyPtr other = (j == 0) ? rbb : rba;
+      map<RigidBodyPtr, unsigned>::const_iterator iter = _sleeping_island_map.find(sleeper);
+      if (iter == _sleeping_island_map.end())
+        continue;
+      map<shared_ptr<DynamicBodyd>, double>::const_iterator rest_iter = _rest_time.find(other->get_super_body());
+      if (rest_iter != _rest_time.end() && rest_iter->second == 0.0)
+        wake_island(iter->second);
+    }
+  }
+
+  // remove woken islands 
+  vector<vector<RigidBodyPtr> > sleeping_islands;
+  _sleeping_island_map.clear();
+  for (unsigned i=0; i< _sleeping_islands.size(); i++)
+  {
+    if (_sleeping_islands[i].empty())
+      continue;
+    for (unsigned j=0; j< _sleeping_islands[i].size(); j++)
+      _sleeping_island_map[_sleeping_islands[i][j]] = sleeping_islands.size();
+    sleeping_islands.push_back(vector<RigidBodyPtr>());
+    sleeping_islands.back().swap(_sleeping_islands[i]);
+  }
+  _sleeping_islands.swap(sleeping_islands);
+
+  // find islands of awake bodies connected by contacts
+  for (unsigned i=0; i< _pairwise_distances.size(); i++)
+  {
+    const PairwiseDistInfo& pdi = _pairwise_distances[i];
+    if (pdi.dist >= contact_dist_thresh)
+      continue;
+    shared_ptr<DynamicBodyd> sba = pdi.a->get_single_body()->get_super_body();
+    shared_ptr<DynamicBodyd> sbb = pdi.b->get_single_body()->get_super_body();
+    if (parent.find(sba) == parent.end() || parent.find(sbb) == parent.end())
+      continue;
+    parent[find_set(parent, sba)] = find_set(parent, sbb);
+  }
+
+  // ... and by implicit joints
+  for (unsigned i=0; i< implicit_joints.size(); i++)
+  {
+    shared_ptr<DynamicBodyd> ib = implicit_joints[i]->get_inboard_link()->get_super_body();
+    shared_ptr<DynamicBodyd> ob = implicit_joints[i]->get_outboard_link()->get_super_body();
+    if (parent.find(ib) == parent.end() || parent.find(ob) == parent.end())
+      continue;
+    parent[find_set(parent, ib)] = find_set(parent, ob);
+  }
+
+  // group the bodies by island
+  for (map<shared_ptr<DynamicBodyd>, double>::const_iterator i = _rest_time.begin(); i != _rest_time.end(); i++)
+    islands[find_set(parent, i->first)].push_back(i->first);
+
+  // put islands to sleep in which all bodies have rested long enough
+  for (map<shared_ptr<DynamicBodyd>, vector<shared_ptr<DynamicBodyd> > >::const_iterator i = islands.begin(); i != islands.end(); i++)
+  {
+    const vector<shared_ptr<DynamicBodyd> >& island = i->second;
+
+    // only islands of controller-free rigid bodies can sleep
+    vector<RigidBodyPtr> bodies;
+    for (unsigned j=0; j< island.size(); j++)
+    {
+      RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(island[j]);
+      if (!rb || rb->controller || _rest_time[island[j]] < sleep_time)
+        break;
+      bodies.push_back(rb);
+    }
+    if (bodies.size() != island.size())
+      continue;
+
+    FILE_LOG(LOG_SIMULATOR) << "putting island of " << bodies.size() << " bodies (including " << bodies.front()->id << ") to sleep" << std::endl;
+
+    // zero the velocities, record the forces and coordinates, and put the
+    // bodies to sleep
+    for (unsigned j=0; j< bodies.size(); j++)
+    {
+      SVelocityd v = bodies[j]->get_velocity();
+      v.set_zero();
+      bodies[j]->set_velocity(v);
+      _sleep_forces[bodies[j]] = calc_recurrent_forces(bodies[j]);
+      bodies[j]->get_generalized_coordinates_euler(_sleep_coords[bodies[j]]);
+      bodies[j]->_sleeping = true;
+      _sleeping_island_map[bodies[j]] = _sleeping_islands.size();
+      _rest_time.erase(island[j]);
+    }
+    _sleeping_islands.push_back(bodies);
+  }
+}
+
 /// Checks to see whether all constraints are met
 bool TimeSteppingSimulator::constraints_met(const std::vector<PairwiseDistInfo>& current_pairwise_distances)
 {
@@ -305,6 +669,20 @@ double TimeSteppingSimulator::calc_next_CA_Euler_step(double contact_dist_thresh
     }
   }
 
+  // determine the bodies that move; pairs of bodies that do not move can 
+  // not come into contact
+  VectorNd qd;
+  set<shared_ptr<DynamicBodyd> > moving;
+  for (unsigned i=0; i< _bodies.size(); i++)
+  {
+    shared_ptr<DynamicBodyd> db = dynamic_pointer_cast<DynamicBodyd>(_bodies[i]);
+    if (!db->is_enabled())
+      continue;
+    db->get_generalized_velocity(DynamicBodyd::eSpatial, qd);
+    if (qd.norm_inf() > 0.0)
+      moving.insert(db);
+  }
+
   // if the distance between any pair of bodies is sufficiently small
   // get next possible event time
   BOOST_FOREACH(PairwiseDistInfo pdi, _pairwise_distances)
@@ -316,6 +694,11 @@ double TimeSteppingSimulator::calc_next_CA_Euler_step(double contact_dist_thresh
         rbb->compliance == RigidBody::eCompliant)
       continue; 
 
+    // only process if one of the bodies moves
+    if (moving.find(rba->get_super_body()) == moving.end() &&
+        moving.find(rbb->get_super_body()) == moving.end())
+      continue;
+
       // compute an upper bound on the event time
       double event_time = _coldet->calc_CA_Euler_step(pdi);
 
@@ -366,6 +749,7 @@ void TimeSteppingSimulator::step_si_Euler(double dt)
     q += qsave[i];
     db->set_generalized_coordinates_euler(q);
   }
+  _coldet->invalidate_transforms();
 
   // prepare to calculate forward dynamics
   precalc_fwd_dyn();
@@ -430,15 +814,28 @@ void TimeSteppingSimulator::step_si_Euler(double dt)
 */
 
 /// Does a semi-implicit step (version with conservative advancement)
-void TimeSteppingSimulator::step_si_Euler(double dt)
+/**
+ * \return the amount of time integrated (less than dt only if the mini-step
+ *         budget is exhausted and mini_step_fallback is eTruncateStep)
+ */
+double TimeSteppingSimulator::step_si_Euler(double dt)
 {
   FILE_LOG(LOG_SIMULATOR) << "-- doing semi-implicit Euler step" << std::endl;
   const double INF = std::numeric_limits<double>::max();
 
-  // do a number of mini-steps until integrated forward fully
+  // do a number of mini-steps until integrated forward fully or until the
+  // budget is exhausted
   double h = 0.0;
+  unsigned budget = max_mini_steps;
   while (h < dt)
-    h += do_mini_step(dt-h);
+  {
+    h += do_mini_step(dt-h, budget);
+    if (budget == 0)
+    {
+      FILE_LOG(LOG_SIMULATOR) << " -- integrated " << h << " of " << dt << " within the mini-step budget" << std::endl;
+      break;
+    }
+  }
 
   if (LOGGING(LOG_SIMULATOR))
   {
@@ -452,6 +849,8 @@ void TimeSteppingSimulator::step_si_Euler(double dt)
   }
 
   FILE_LOG(LOG_SIMULATOR) << "-- semi-implicit Euler step completed" << std::endl;
+
+  return h;
 }
 
 /// Implements Base::load_from_xml()
@@ -470,6 +869,50 @@ void TimeSteppingSimulator::load_from_xml(shared_ptr<const XMLTree> node, map<st
   XMLAttrib* min_step_attrib = node->get_attrib("min-step-size");
   if (min_step_attrib)
     min_step_size = min_step_attrib->get_real_value();
+
+  // read the mini-step budget and fallback
+  XMLAttrib* max_mini_steps_attrib = node->get_attrib("max-mini-steps");
+  if (max_mini_steps_attrib)
+    max_mini_steps = max_mini_steps_attrib->get_unsigned_value();
+  XMLAttrib* mini_step_fallback_attrib = node->get_attrib("mini-step-fallback");
+  if (mini_step_fallback_attrib)
+  {
+    const std::string& fallback = mini_step_fallback_attrib->get_string_value();
+    if (strcasecmp(fallback.c_str(), "accept-penetration") == 0)
+      mini_step_fallback = eAcceptPenetration;
+    else if (strcasecmp(fallback.c_str(), "truncate-step") == 0)
+      mini_step_fallback = eTruncateStep;
+    else
+      std::cerr << "TimeSteppingSimulator::load_from_xml() - unknown mini-step fallback '" << fallback << "'" << std::endl;
+  }
+
+  // read the sleeping settings
+  XMLAttrib* sleeping_attrib = node->get_attrib("sleeping");
+  if (sleeping_attrib)
+    sleeping = sleeping_attrib->get_bool_value();
+  XMLAttrib* sleep_ke_attrib = node->get_attrib("sleep-ke-thresh");
+  if (sleep_ke_attrib)
+    sleep_ke_thresh = sleep_ke_attrib->get_real_value();
+  XMLAttrib* sleep_vel_attrib = node->get_attrib("sleep-vel-thresh");
+  if (sleep_vel_attrib)
+    sleep_vel_thresh = sleep_vel_attrib->get_real_value();
+  XMLAttrib* sleep_time_attrib = node->get_attrib("sleep-time");
+  if (sleep_time_attrib)
+    sleep_time = sleep_time_attrib->get_real_value();
+
+  // read the iterative contact solver settings
+  XMLAttrib* pgs_attrib = node->get_attrib("pgs-solver");
+  if (pgs_attrib)
+    _impact_constraint_handler.use_pgs_solver = pgs_attrib->get_bool_value();
+  XMLAttrib* pgs_nncg_attrib = node->get_attrib("pgs-nncg");
+  if (pgs_nncg_attrib)
+    _impact_constraint_handler.pgs_nncg = pgs_nncg_attrib->get_bool_value();
+  XMLAttrib* pgs_max_iter_attrib = node->get_attrib("pgs-max-iterations");
+  if (pgs_max_iter_attrib)
+    _impact_constraint_handler.pgs_max_iterations = pgs_max_iter_attrib->get_unsigned_value();
+  XMLAttrib* pgs_tol_attrib = node->get_attrib("pgs-tol");
+  if (pgs_tol_attrib)
+    _impact_constraint_handler.pgs_eps = pgs_tol_attrib->get_real_value();
 }
 
 /// Implements Base::save_to_xml()
@@ -483,6 +926,148 @@ void TimeSteppingSimulator::save_to_xml(XMLTreePtr node, list<shared_ptr<const B
 
   // save the minimum step size
   node->attribs.insert(XMLAttrib("min-step-size", min_step_size));
+
+  // save the mini-step budget and fallback
+  node->attribs.insert(XMLAttrib("max-mini-steps", max_mini_steps));
+  node->attribs.insert(XMLAttrib("mini-step-fallback", std::string((mini_step_fallback == eAcceptPenetration) ? "accept-penetration" : "truncate-step")));
+
+  // save the sleeping settings
+  node->attribs.insert(XMLAttrib("sleeping", sleeping));
+  node->attribs.insert(XMLAttrib("sleep-ke-thresh", sleep_ke_thresh));
+  node->attribs.insert(XMLAttrib("sleep-vel-thresh", sleep_vel_thresh));
+  node->attribs.insert(XMLAttrib("sleep-time", sleep_time));
+
+  // save the iterative contact solver settings
+  node->attribs.insert(XMLAttrib("pgs-solver", _impact_constraint_handler.use_pgs_solver));
+  node->attribs.insert(XMLAttrib("pgs-nncg", _impact_constraint_handler.pgs_nncg));
+  node->attribs.insert(XMLAttrib("pgs-max-iterations", _impact_constraint_handler.pgs_max_iterations));
+  node->attribs.insert(XMLAttrib("pgs-tol", _impact_constraint_handler.pgs_eps));
+}
+
+/// Writes the state of the simulation that is not part of the model (see Simulator::save_state())
+/**
+ * In addition to the state written by ConstraintSimulator, writes the
+ * resting times of the awake bodies and the sleeping islands (with the
+ * forces on their bodies when they were put to sleep).
+ */
+void TimeSteppingSimulator::write_state(StateWriter& out) const
+{
+  // write the state of the constraint simulator
+  ConstraintSimulator::write_state(out);
+
+  // get the indices of the bodies
+  map<shared_ptr<DynamicBodyd>, unsigned> index;
+  for (unsigned i=0; i< _bodies.size(); i++)
+    index[dynamic_pointer_cast<DynamicBodyd>(_bodies[i])] = i;
+
+  // write the resting times of bodies still in the simulator
+  vector<pair<unsigned, double> > rest_time;
+  for (map<shared_ptr<DynamicBodyd>, double>::const_iterator i = _rest_time.begin(); i != _rest_time.end(); i++)
+  {
+    map<shared_ptr<DynamicBodyd>, unsigned>::const_iterator j = index.find(i->first);
+    if (j != index.end())
+      rest_time.push_back(make_pair(j->second, i->second));
+  }
+  out.write_unsigned(rest_time.size());
+  for (unsigned i=0; i< rest_time.size(); i++)
+  {
+    out.write_unsigned(rest_time[i].first);
+    out.write_double(rest_time[i].second);
+  }
+
+  // write the sleeping islands (woken islands are empty)
+  unsigned n_sleeping = 0;
+  for (unsigned i=0; i< _sleeping_islands.size(); i++)
+    if (!_sleeping_islands[i].empty())
+      n_sleeping++;
+  out.write_unsigned(n_sleeping);
+  for (unsigned i=0; i< _sleeping_islands.size(); i++)
+  {
+    const vector<RigidBodyPtr>& island = _sleeping_islands[i];
+    if (island.empty())
+      continue;
+    out.write_unsigned(island.size());
+    for (unsigned j=0; j< island.size(); j++)
+    {
+      const SForced& f = _sleep_forces.find(island[j])->second;
+      out.write_unsigned(index.find(dynamic_pointer_cast<DynamicBodyd>(island[j]))->second);
+      out.write_vector3d(f.get_force());
+      out.write_vector3d(f.get_torque());
+    }
+  }
 }
 
+/// Reads the state written by write_state() (see Simulator::read_state())
+void TimeSteppingSimulator::read_state(StateReader& in, bool apply)
+{
+  // read the state of the constraint simulator
+  ConstraintSimulator::read_state(in, apply);
+  if (!in.ok())
+    return;
+
+  // read the resting times
+  map<shared_ptr<DynamicBodyd>, double> rest_time;
+  const unsigned N_RESTING = in.read_unsigned();
+  for (unsigned i=0; i< N_RESTING && in.ok(); i++)
+  {
+    const unsigned IDX = in.read_unsigned();
+    const double T = in.read_double();
+    if (IDX >= _bodies.size())
+    {
+      in.fail();
+      return;
+    }
+    rest_time[dynamic_pointer_cast<DynamicBodyd>(_bodies[IDX])] = T;
+  }
 
+  // read the sleeping islands
+  vector<vector<RigidBodyPtr> > sleeping_islands;
+  map<RigidBodyPtr, SForced> sleep_forces;
+  const unsigned N_SLEEPING = in.read_unsigned();
+  for (unsigned i=0; i< N_SLEEPING && in.ok(); i++)
+  {
+    vector<RigidBodyPtr> island;
+    const unsigned N = in.read_unsigned();
+    for (unsigned j=0; j< N && in.ok(); j++)
+    {
+      const unsigned IDX = in.read_unsigned();
+      Vector3d f = in.read_vector3d(GLOBAL);
+      Vector3d t = in.read_vector3d(GLOBAL);
+      RigidBodyPtr rb = (IDX < _bodies.size()) ? dynamic_pointer_cast<RigidBody>(_bodies[IDX]) : RigidBodyPtr();
+      if (!rb || sleep_forces.find(rb) != sleep_forces.end())
+      {
+        in.fail();
+        return;
+      }
+      sleep_forces[rb] = SForced(f, t, GLOBAL);
+      island.push_back(rb);
+    }
+    sleeping_islands.push_back(island);
+  }
+  if (!in.ok() || !apply)
+    return;
+
+  // set the resting times
+  _rest_time.swap(rest_time);
+
+  // set the sleeping islands; the bodies have already been restored to the
+  // coordinates at which they were put to sleep
+  _sleeping_islands.swap(sleeping_islands);
+  _sleep_forces.swap(sleep_forces);
+  _sleeping_island_map.clear();
+  _sleep_coords.clear();
+  for (unsigned i=0; i< _bodies.size(); i++)
+  {
+    RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(_bodies[i]);
+    if (rb)
+      rb->_sleeping = false;
+  }
+  for (unsigned i=0; i< _sleeping_islands.size(); i++)
+    for (unsigned j=0; j< _sleeping_islands[i].size(); j++)
+    {
+      RigidBodyPtr rb = _sleeping_islands[i][j];
+      rb->get_generalized_coordinates_euler(_sleep_coords[rb]);
+      rb->_sleeping = true;
+      _sleeping_island_map[rb] = i;
+    }
+}
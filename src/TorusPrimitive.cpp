@@ -29,6 +29,7 @@ using namespace Moby;
 
 TorusPrimitive::TorusPrimitive()
 {
+  _type = eTorus;
   // setup torus parameters to some defaults; this gives an aspect ratio
   // (major radius / minor radius) of ~2.5, which yields a donut
   _major_radius = 2.5;
@@ -40,6 +41,7 @@ TorusPrimitive::TorusPrimitive()
 
 TorusPrimitive::TorusPrimitive(const Pose3d& P) : Primitive(P)
 {
+  _type = eTorus;
   // setup torus parameters to some defaults; this gives an aspect ratio
   // (major radius / minor radius) of ~2.5, which yields a donut
   _major_radius = 2.5;
@@ -51,6 +53,7 @@ TorusPrimitive::TorusPrimitive(const Pose3d& P) : Primitive(P)
 
 TorusPrimitive::TorusPrimitive(double major_radius, double minor_radius)
 {
+  _type = eTorus;
   // setup torus parameters to some defaults; this gives an aspect ratio
   // (major radius / minor radius) of ~2.5, which yields a donut
   _major_radius = major_radius;
@@ -12,11 +12,14 @@
 #include <osg/Geometry>
 #endif
 #include <stack>
+#include <limits>
+#include <algorithm>
 #include <cctype>
 #include <string>
 #include <queue>
 #include <iostream>
 #include <fstream>
+#include <Ravelin/sorted_pair>
 #include <Moby/Log.h>
 #include <Moby/Constants.h>
 #include <Moby/XMLTree.h>
@@ -24,6 +27,7 @@
 #include <Moby/BoundingSphere.h>
 #include <Moby/CollisionGeometry.h>
 #include <Moby/GJK.h>
+#include <Moby/PolyhedralPrimitive.h>
 #include <Moby/TriangleMeshPrimitive.h>
 
 using namespace Ravelin;
@@ -47,6 +51,7 @@ using boost::const_pointer_cast;
 /// Creates the triangle mesh primitive
 TriangleMeshPrimitive::TriangleMeshPrimitive()
 {
+  _type = eTriangleMesh;
   _convexify_inertia = false;
   _edge_sample_length = std::numeric_limits<double>::max();
 }
@@ -54,6 +59,8 @@ TriangleMeshPrimitive::TriangleMeshPrimitive()
 /// Creates the triangle mesh from a geometry file and optionally centers it
 TriangleMeshPrimitive::TriangleMeshPrimitive(const string& filename, bool center) 
 {
+  _type = eTriangleMesh;
+
   // do not convexify inertia by default
   _convexify_inertia = false;
 
@@ -62,7 +69,7 @@ TriangleMeshPrimitive::TriangleMeshPrimitive(const string& filename, bool center
 
   // construct a new triangle mesh from the filename
   if (filename.find(".obj") == filename.size() - 4)
-    set_mesh(shared_ptr<IndexedTriArray>(new IndexedTriArray(IndexedTriArray::read_from_obj(filename))));
+    load_mesh(filename);
   else
     throw std::runtime_error("TriangleMeshPrimitive (constructor): unknown mesh file type!");
 
@@ -77,6 +84,8 @@ TriangleMeshPrimitive::TriangleMeshPrimitive(const string& filename, bool center
 /// Creates the triangle mesh from a geometry file and optionally centers it
 TriangleMeshPrimitive::TriangleMeshPrimitive(const string& filename, const Pose3d& T, bool center) : Primitive(T) 
 { 
+  _type = eTriangleMesh;
+
   // do not convexify inertia by default
   _convexify_inertia = false;
 
@@ -85,7 +94,7 @@ TriangleMeshPrimitive::TriangleMeshPrimitive(const string& filename, const Pose3
 
   // construct a new triangle mesh from the filename
   if (filename.find("obj") == filename.size() - 4)
-    set_mesh(shared_ptr<IndexedTriArray>(new IndexedTriArray(IndexedTriArray::read_from_obj(filename))));
+    load_mesh(filename);
   else
     throw std::runtime_error("TriangleMeshPrimitive (constructor): unknown mesh file type!");
 
@@ -176,6 +185,28 @@ void TriangleMeshPrimitive::center()
   // do the transformation
   _mesh = shared_ptr<IndexedTriArray>(new IndexedTriArray(_mesh->transform(T)));
 
+  // the transformation is normally a pure translation, in which case the
+  // distance hierarchy and bounding volume tree (possibly loaded from the 
+  // mesh cache) can be translated rather than rebuilt
+  const bool TRANSLATION = (std::fabs(T.q.x) + std::fabs(T.q.y) + std::fabs(T.q.z) < NEAR_ZERO);
+  if (_dist_tree && TRANSLATION)
+  {
+    shared_ptr<MeshDistTree> tree(new MeshDistTree(*_dist_tree));
+    tree->translate(T.x);
+    _dist_tree = tree;
+    invalidate_sdf();
+  }
+  else
+    build_dist_tree();
+  if (_obb_tree && TRANSLATION)
+  {
+    shared_ptr<MeshOBBTree> tree(new MeshOBBTree(*_obb_tree));
+    tree->translate(T.x);
+    _obb_tree = tree;
+  }
+  else
+    _obb_tree.reset();
+
   // re-calculate mass properties 
   calc_mass_properties();
 
@@ -230,7 +261,7 @@ void TriangleMeshPrimitive::load_from_xml(shared_ptr<const XMLTree> node, map<st
 
   // get the type of file and construct the triangle mesh appropriately
   if (fname_lower.find(string(OBJ_EXT)) == fname_lower.size() - strlen(OBJ_EXT))
-    set_mesh(shared_ptr<IndexedTriArray>(new IndexedTriArray(IndexedTriArray::read_from_obj(fname))));
+    load_mesh(fname);
   else
   {
     cerr << "TriangleMeshPrimitive::load_from_xml() - unrecognized filename extension" << endl;
@@ -299,19 +330,38 @@ void TriangleMeshPrimitive::save_to_xml(XMLTreePtr node, list<shared_ptr<const B
 /// Sets the mesh
 void TriangleMeshPrimitive::set_mesh(boost::shared_ptr<const IndexedTriArray> mesh)
 {
-  // TODO: remove this calculation (replaces mesh with convex hull)
-  const vector<Origin3d>& verts = mesh->get_vertices();
-  TessellatedPolyhedronPtr poly = CompGeom::calc_convex_hull(verts.begin(), verts.end());
-  _mesh = shared_ptr<const IndexedTriArray>(new IndexedTriArray(poly->get_mesh()));
-
-  // TODO: restore this
   // set the mesh
-//  _mesh = mesh;
+  _mesh = mesh;
+
+  // vertices and bounding volumes are no longer valid
+  _vertices.clear();
+  _mesh_vertices.clear();
+  _roots.clear();
+  _obb_tree.reset();
+
+  // build the distance hierarchy (this also determines convexity)
+  build_dist_tree();
+  setup_edges();
+
+  // update visualization
+  update_visualization();
+}
+
+/// Sets the mesh from a Wavefront OBJ file, using the mesh cache
+void TriangleMeshPrimitive::load_mesh(const string& filename)
+{
+  // load the mesh, its distance hierarchy, and its bounding volume tree
+  shared_ptr<const MeshCache::Entry> entry = MeshCache::load(filename, _mesh_cache_dir);
+  _mesh = entry->mesh;
+  _dist_tree = entry->dist_tree;
+  _obb_tree = entry->obb_tree;
+  setup_edges();
 
   // vertices and bounding volumes are no longer valid
   _vertices.clear();
   _mesh_vertices.clear();
-  _roots.clear();;
+  _roots.clear();
+  invalidate_sdf();
 
   // update visualization
   update_visualization();
@@ -407,116 +457,348 @@ BVPtr TriangleMeshPrimitive::get_BVH_root(CollisionGeometryPtr geom)
   return root; 
 }
 
-/// Returns whether the mesh is convex (currently mesh must be convex)
+/// Returns whether the mesh is convex
 bool TriangleMeshPrimitive::is_convex() const
 {
-  return true;
+  return (_dist_tree) ? _dist_tree->is_convex() : true;
 }
 
-/// Computes the signed distance to a point from the mesh 
-double TriangleMeshPrimitive::calc_signed_dist(const Point3d& p) const
+/// Builds the hierarchy used for distance queries (this also determines whether the mesh is convex)
+void TriangleMeshPrimitive::build_dist_tree()
 {
-  // verify that the point is defined with respect to one of the poses
-  assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end());
+  // the signed distance field no longer matches the mesh
+  invalidate_sdf();
+
+  // if there is no mesh, there is no hierarchy
+  _dist_tree.reset();
+  if (!_mesh)
+    return;
 
-  // if the primitive is convex and the point is outside, return the closest
-  // distance
-  if (is_convex())
+  // build the hierarchy
+  shared_ptr<MeshDistTree> tree(new MeshDistTree);
+  tree->build(*_mesh);
+  _dist_tree = tree;
+}
+
+/// Determines the edges of the mesh (the edges are unaffected by transforming the mesh)
+void TriangleMeshPrimitive::setup_edges()
+{
+  _edges.clear();
+  if (!_mesh)
+    return;
+
+  // collect the edges of every facet, removing duplicates
+  const vector<IndexedTri>& facets = _mesh->get_facets();
+  vector<sorted_pair<unsigned> > edges;
+  edges.reserve(facets.size()*3);
+  for (unsigned i=0; i< facets.size(); i++)
   {
-    // loop through all triangles of the mesh
-    bool inside = false;
-    double min_dist = std::numeric_limits<double>::max();
-    double max_dist = -min_dist;
-    for (unsigned i=0; i< _mesh->num_tris(); i++)
-    {
-      double dist = _mesh->get_triangle(i, p.pose).calc_signed_dist(p);
-      if (dist < 0.0)
-      {
-        max_dist = std::max(max_dist, dist);
-        inside = true;
-      }
-      else
-        min_dist = std::min(min_dist, dist);
-    }
+    edges.push_back(make_sorted_pair(facets[i].a, facets[i].b));
+    edges.push_back(make_sorted_pair(facets[i].b, facets[i].c));
+    edges.push_back(make_sorted_pair(facets[i].c, facets[i].a));
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  _edges.resize(edges.size());
+  for (unsigned i=0; i< edges.size(); i++)
+    _edges[i] = make_pair(edges[i].first, edges[i].second);
+}
 
-    // if the point is outside, return the minimum distance
-    if (!inside)
-      return min_dist;
-    else
-      return max_dist;
-  } 
+/// Gets the edges of a primitive, as pairs of endpoints
+/**
+ * Edges are available for triangle meshes and polyhedral primitives; other
+ * primitives have no edges.
+ * \param primitive the primitive
+ * \param P the pose of the endpoints on return (must be a pose of the primitive)
+ * \param edges the edges on return
+ */
+void TriangleMeshPrimitive::get_edges(shared_ptr<const Primitive> primitive, shared_ptr<const Pose3d> P, vector<pair<Point3d, Point3d> >& edges)
+{
+  edges.clear();
+
+  // triangle meshes
+  shared_ptr<const TriangleMeshPrimitive> tm = dynamic_pointer_cast<const TriangleMeshPrimitive>(primitive);
+  if (tm)
+  {
+    if (!tm->_mesh)
+      return;
+    const vector<Origin3d>& verts = tm->_mesh->get_vertices();
+    edges.reserve(tm->_edges.size());
+    for (unsigned i=0; i< tm->_edges.size(); i++)
+      edges.push_back(make_pair(Point3d(verts[tm->_edges[i].first], P), Point3d(verts[tm->_edges[i].second], P)));
+    return;
+  }
+
+  // polyhedral primitives
+  shared_ptr<const PolyhedralPrimitive> pp = dynamic_pointer_cast<const PolyhedralPrimitive>(primitive);
+  if (pp)
+  {
+    const vector<shared_ptr<Polyhedron::Edge> >& e = pp->get_polyhedron().get_edges();
+    edges.reserve(e.size());
+    for (unsigned i=0; i< e.size(); i++)
+      edges.push_back(make_pair(Point3d(e[i]->v1->o, P), Point3d(e[i]->v2->o, P)));
+  }
+}
+
+/// Finds the closest points between a segment and the mesh
+/**
+ * \param p the first endpoint of the segment (defined in a pose of this primitive)
+ * \param q the second endpoint of the segment (defined in the same pose)
+ * \param cseg the closest point on the segment on return
+ * \param cmesh the closest point on the mesh on return
+ * \param normal on return, the normal of the triangle that cmesh lies on
+ * \param t on return, the parameter of cseg along the segment (0 at p and 1 at q)
+ * \return the (unsigned) distance between the segment and the mesh; zero
+ *         if the segment crosses the mesh
+ */
+double TriangleMeshPrimitive::calc_closest_points(const Point3d& p, const Point3d& q, Point3d& cseg, Point3d& cmesh, Vector3d& normal, double& t) const
+{
+  // verify that the points are defined with respect to one of the poses
+  assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end());
+  assert(p.pose == q.pose);
+
+  // if there is no mesh, the segment is infinitely far away
+  if (!_dist_tree)
+    return std::numeric_limits<double>::max();
+
+  Origin3d cs, cm, n;
+  double dist = _dist_tree->calc_closest_points(*_mesh, Origin3d(p), Origin3d(q), cs, cm, n, t);
+  cseg = Point3d(cs, p.pose);
+  cmesh = Point3d(cm, p.pose);
+  normal = Vector3d(n, p.pose);
+  return dist;
+}
+
+/// Finds the closest point on the mesh to a point (in the primitive frame)
+/**
+ * \param p the query point 
+ * \param closest the closest point on the mesh on return
+ * \param normal on return, the pseudo-normal of the feature that the closest
+ *        point lies on
+ * \return the signed distance from the mesh (negative if p is inside)
+ */
+double TriangleMeshPrimitive::calc_closest_point(const Origin3d& p, Origin3d& closest, Origin3d& normal) const
+{
+  // if there is no mesh, the point is infinitely far away
+  if (!_dist_tree)
+    return std::numeric_limits<double>::max();
+
+  return _dist_tree->calc_closest_point(*_mesh, p, closest, normal);
+}
+
+/// Computes the exact signed distance used to build the signed distance field
+double TriangleMeshPrimitive::calc_sdf_sample(const Origin3d& p) const
+{
+  Origin3d closest, normal;
+  return calc_closest_point(p, closest, normal);
+}
+
+/// Gets the mesh represented by the signed distance field
+void TriangleMeshPrimitive::get_sdf_geometry(vector<Origin3d>& verts, vector<IndexedTri>& facets) const
+{
+  // if there is no mesh, there is no field
+  if (!_mesh || !_dist_tree || _dist_tree->empty())
+    return;
+
+  verts = _mesh->get_vertices();
+  facets = _mesh->get_facets();
+}
+
+/// Gets the bounding box of the mesh (in the primitive frame)
+void TriangleMeshPrimitive::get_bounding_box(Origin3d& lo, Origin3d& hi) const
+{
+  if (!_dist_tree || _dist_tree->empty())
+  {
+    lo = Origin3d(0.0, 0.0, 0.0);
+    hi = Origin3d(0.0, 0.0, 0.0);
+  }
   else
   {
-    throw std::runtime_error("TriangleMeshPrimitive::calc_signed_dist() - non-convex meshes not currently supported!");
+    lo = _dist_tree->get_root().lo;
+    hi = _dist_tree->get_root().hi;
   }
 }
 
-/// Computes the distance and normal from a point on the mesh 
-double TriangleMeshPrimitive::calc_dist_and_normal(const Point3d& p, std::vector<Vector3d>& normals) const
+/// Gets the vertices of the mesh that lie within an axis-aligned box
+/**
+ * \param P the pose of the vertices on return (the box is defined in this pose)
+ * \param lo the lower corner of the box
+ * \param hi the upper corner of the box
+ * \param vertices the vertices within the box on return
+ */
+void TriangleMeshPrimitive::get_vertices(shared_ptr<const Pose3d> P, const Origin3d& lo, const Origin3d& hi, vector<Point3d>& vertices) const
 {
-  // setup the normal
-  normals.push_back(Vector3d());
-  Vector3d& normal = normals.back();
+  // verify that the primitive knows about this pose 
+  assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
 
+  vertices.clear();
+  if (!_dist_tree)
+    return;
+
+  // get the vertices within the box using the distance hierarchy
+  vector<unsigned> vidx;
+  _dist_tree->get_vertices(*_mesh, lo, hi, vidx);
+  const vector<Origin3d>& verts = _mesh->get_vertices();
+  for (unsigned i=0; i< vidx.size(); i++)
+    vertices.push_back(Point3d(verts[vidx[i]], P));
+}
+
+/// Computes the signed distance to a point from the mesh 
+double TriangleMeshPrimitive::calc_signed_dist(const Point3d& p) const
+{
   // verify that the point is defined with respect to one of the poses
   assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end());
 
-  // if the primitive is convex and the point is outside, return the closest
-  // distance
-  if (is_convex())
-  {
-    // loop through all triangles of the mesh
-    bool inside = false;
-    double min_dist = std::numeric_limits<double>::max();
-    double max_dist = -min_dist;
-    for (unsigned i=0; i< _mesh->num_tris(); i++)
-    {
-      double dist = _mesh->get_triangle(i, p.pose).calc_signed_dist(p);
-      if (dist < 0.0)
-      {
-        if (dist > max_dist)
-        {
-          normal = _mesh->get_triangle(i, p.pose).calc_normal();
-          max_dist = dist;
-        }
-        inside = true;
-      }
-      else if (!inside)
-      {
-        if (dist < min_dist)
-        {
-          normal = _mesh->get_triangle(i, p.pose).calc_normal();
-          min_dist = dist;
-        }
-      }
-    }
+  // use the signed distance field, if possible
+  double dist;
+  Vector3d sdf_normal;
+  if (calc_sdf_dist_and_normal(p, dist, sdf_normal))
+    return dist;
 
-    // if the point is outside, return the minimum distance
-    if (!inside)
-      return min_dist;
-    else
-      return max_dist;
-  } 
-  else
+  // find the closest point using the distance hierarchy
+  Origin3d closest, normal;
+  return calc_closest_point(Origin3d(p), closest, normal);
+}
+
+/// Computes the distance and normal from a point on the mesh 
+/**
+ * The normal points outward from the mesh at the closest point.
+ */
+double TriangleMeshPrimitive::calc_dist_and_normal(const Point3d& p, std::vector<Vector3d>& normals) const
+{
+  // verify that the point is defined with respect to one of the poses
+  assert(_poses.find(const_pointer_cast<Pose3d>(p.pose)) != _poses.end());
+
+  // use the signed distance field, if possible
+  double sdf_dist;
+  Vector3d sdf_normal;
+  if (calc_sdf_dist_and_normal(p, sdf_dist, sdf_normal))
   {
-    throw std::runtime_error("TriangleMeshPrimitive::calc_signed_dist() - non-convex meshes not currently supported!");
+    normals.push_back(sdf_normal);
+    return sdf_dist;
   }
+
+  // find the closest point using the distance hierarchy
+  Origin3d closest, pseudo_normal;
+  double dist = calc_closest_point(Origin3d(p), closest, pseudo_normal);
+
+  // use the direction to the closest point when it is well defined; 
+  // otherwise, use the pseudo-normal 
+  Origin3d n = pseudo_normal;
+  if (std::fabs(dist) > NEAR_ZERO && dist < std::numeric_limits<double>::max())
+    n = (Origin3d(p) - closest)*(1.0/dist);
+
+  // setup the normal
+  normals.push_back(Vector3d(n, p.pose));
+  return dist;
 }
 
-/// Computes the distance and normal from a point on the mesh 
+/// Computes the signed distance between this mesh and another primitive
+/**
+ * Pairs of convex primitives use GJK. Otherwise, the vertices of the other
+ * primitive are tested against this mesh, the vertices of this mesh that are
+ * near the other primitive are tested against it, and the edges of the other
+ * primitive (if it is a triangle mesh or polyhedron) are tested against this 
+ * mesh to catch edges that cross without any vertex penetrating. Each query
+ * against the mesh traverses its distance hierarchy and typically visits few
+ * triangles; queries far from the mesh surface, or against meshes with many
+ * nearly equidistant triangles, can visit many more. 
+ */
 double TriangleMeshPrimitive::calc_signed_dist(shared_ptr<const Primitive> primitive, Point3d& pthis, Point3d& pprimitive) const
 {
+  const double INF = std::numeric_limits<double>::max();
+
+  // get the two poses
+  shared_ptr<const Pose3d> Ptri = pthis.pose;
+  shared_ptr<const Pose3d> Pgeneric = pprimitive.pose;
+
   if (is_convex() && primitive->is_convex())
   {
-    shared_ptr<const Pose3d> Ptri = pthis.pose;
-    shared_ptr<const Pose3d> Pgeneric = pprimitive.pose;
     shared_ptr<const Primitive> tthis = dynamic_pointer_cast<const Primitive>(shared_from_this());
     return GJK::do_gjk(tthis, primitive, Ptri, Pgeneric, pthis, pprimitive);
   }
-  else
+
+  // get the transforms between the two primitives
+  Transform3d tTg = Pose3d::calc_relative_pose(Pgeneric, Ptri);
+  Transform3d gTt = tTg.inverse();
+
+  // test the vertices of the other primitive against this mesh, computing 
+  // their bounding box in this frame
+  double min_dist = INF;
+  vector<Point3d> verts;
+  const_pointer_cast<Primitive>(primitive)->get_vertices(Pgeneric, verts);
+  Origin3d lo(INF, INF, INF), hi(-INF, -INF, -INF);
+  for (unsigned i=0; i< verts.size(); i++)
+  {
+    Origin3d v(tTg.transform_point(verts[i]));
+    for (unsigned j=0; j< 3; j++)
+    {
+      lo[j] = std::min(lo[j], v[j]);
+      hi[j] = std::max(hi[j], v[j]);
+    }
+    Origin3d closest, normal;
+    double dist = calc_closest_point(v, closest, normal);
+    if (dist < min_dist)
+    {
+      min_dist = dist;
+      pthis = Point3d(closest, Ptri);
+      pprimitive = verts[i];
+    }
+  }
+
+  // test the vertices of this mesh that could be closer to the other 
+  // primitive 
+  if (!verts.empty())
   {
-    throw std::runtime_error("TriangleMeshPrimitive::calc_signed_dist() - non-convex meshes not currently supported!");
+    const double EXPAND = std::max(min_dist, 0.0);
+    for (unsigned j=0; j< 3; j++)
+    {
+      lo[j] -= EXPAND;
+      hi[j] += EXPAND;
+    }
+    vector<Point3d> tverts;
+    vector<Vector3d> normals;
+    get_vertices(Ptri, lo, hi, tverts);
+    for (unsigned i=0; i< tverts.size(); i++)
+    {
+      Point3d v = gTt.transform_point(tverts[i]);
+      normals.clear();
+      double dist = primitive->calc_dist_and_normal(v, normals);
+      if (dist < min_dist && !normals.empty())
+      {
+        min_dist = dist;
+        pthis = tverts[i];
+        pprimitive = v - normals.front()*dist;
+      }
+    }
+  }
+
+  // test the edges of the other primitive against this mesh; edges can 
+  // cross the mesh (distance zero) while all vertices lie outside of it
+  if (min_dist > 0.0)
+  {
+    vector<pair<Point3d, Point3d> > edges;
+    get_edges(primitive, Pgeneric, edges);
+    for (unsigned i=0; i< edges.size(); i++)
+    {
+      Point3d p(tTg.transform_point(edges[i].first));
+      Point3d q(tTg.transform_point(edges[i].second));
+      Point3d cseg, cmesh;
+      Vector3d normal;
+      double t;
+      double dist = calc_closest_points(p, q, cseg, cmesh, normal, t);
+      if (dist < min_dist)
+      {
+        min_dist = dist;
+        pthis = cmesh;
+        pprimitive = gTt.transform_point(cseg);
+        if (min_dist <= 0.0)
+          break;
+      }
+    }
   }
+
+  return min_dist;
 }
 
 /// Determines whether a point is inside / on one of the thick triangles
@@ -731,11 +1013,15 @@ void TriangleMeshPrimitive::get_vertices(shared_ptr<const Pose3d> P, vector<Poin
   assert(_poses.find(const_pointer_cast<Pose3d>(P)) != _poses.end());
 
   // get the mesh vertices
-  vertices = _vertices; 
+  vertices.clear();
+  if (!_mesh)
+    return;
+  const vector<Origin3d>& verts = _mesh->get_vertices();
+  vertices.reserve(verts.size());
 
   // set the pose for each vertex
-  for (unsigned i=0; i< vertices.size(); i++)
-    vertices[i].pose = P;
+  for (unsigned i=0; i< verts.size(); i++)
+    vertices.push_back(Point3d(verts[i], P));
 }
 
 /// Transforms this primitive
@@ -761,9 +1047,12 @@ void TriangleMeshPrimitive::set_pose(const Pose3d& p)
 
   // reset mesh, vertices, and bounding volumes 
   _mesh.reset();
+  _edges.clear();
   _vertices.clear();
   _mesh_vertices.clear();
   _roots.clear();
+  _obb_tree.reset();
+  build_dist_tree();
 
   // recalculate the mass properties
   calc_mass_properties();
@@ -773,15 +1062,13 @@ void TriangleMeshPrimitive::set_pose(const Pose3d& p)
  Methods for building bounding box trees begin 
 ****************************************************************************/
 
-/// Builds an bounding volume tree (OBB or BoundingSphere) from an indexed triangle mesh using a top-down approach 
-/*
- * \return the root of the bounding box tree
+/// Instantiates the bounding volume (OBB) tree for a geometry from the tree built for the mesh
+/**
+ * The tree for the mesh is loaded from the mesh cache or built on first
+ * use, and shared by all geometries (and primitives) using the mesh.
  */
 void TriangleMeshPrimitive::build_BB_tree(CollisionGeometryPtr geom)
 {
-  const unsigned THREE_D = 3;
-  BVPtr child1, child2;
-
   FILE_LOG(LOG_BV) << "TriangleMeshPrimitive::build_BB_tree() entered" << endl;
 
   // clear any existing data for BVs for this geometry
@@ -807,182 +1094,70 @@ void TriangleMeshPrimitive::build_BB_tree(CollisionGeometryPtr geom)
     }
   }
 
-  // get the vertices from the mesh
-  const vector<Origin3d>& verts = _mesh->get_vertices();
-
-  // transform the vertices into Point3d objects
-  vector<Point3d> vertices(verts.size());
-  for (unsigned i=0; i< verts.size(); i++)
-    vertices[i] = Point3d(verts[i], GLOBAL);
-
-  // build an BV around all vertices 
-  BVPtr root = BVPtr(new OBB(vertices.begin(), vertices.end()));
-
-  // point the root to the geometry
-  root->geom = geom;
-
-  // set root to point to all facet indices
-  list<unsigned> tris_idx;
-  for (unsigned i=0; i< _mesh->get_facets().size(); i++)
-    tris_idx.push_back(i);
-
-  // setup mapping from BV to mesh
-  _mesh_tris[root] = tris_idx;
-
-  FILE_LOG(LOG_BV) << "  -- created root: " << root << endl;
-
-  // add the root to a splitting queue
-  queue<BVPtr> Q;
-  Q.push(root);
-
-  // split until we can't split further
-  while (!Q.empty())
+  // build the tree for the mesh, if necessary
+  if (!_obb_tree)
   {
-    // get the bounding box off of the top of the queue
-    BVPtr bb = Q.front();
-    Q.pop();
-
-    FILE_LOG(LOG_BV) << "  -- splitting BV: " << bb << endl;
+    shared_ptr<MeshOBBTree> tree(new MeshOBBTree);
+    tree->build(*_mesh);
+    _obb_tree = tree;
+  }
 
-    // split the bounding box across each of the three axes
-    for (unsigned i=0; i< 3; i++)
-    {
-      Vector3d axis(GLOBAL);
+  // a mesh without triangles gets an empty box
+  const vector<MeshOBBTree::Node>& nodes = _obb_tree->get_nodes();
+  const vector<unsigned>& tree_tris = _obb_tree->get_tris();
+  if (nodes.empty())
+  {
+    geom_root = BVPtr(new OBB);
+    geom_root->geom = geom;
+    _mesh_tris[geom_root] = list<unsigned>();
+    construct_mesh_vertices(_mesh, geom);
+    return;
+  }
 
-      // get the i'th column of R
-      OBBPtr obb = dynamic_pointer_cast<OBB>(bb);
-      assert(obb);
-      obb->R.get_column(i, axis);
+  // create the boxes
+  vector<BVPtr> bvs(nodes.size());
+  for (unsigned i=0; i< nodes.size(); i++)
+  {
+    const MeshOBBTree::Node& node = nodes[i];
+    bvs[i] = BVPtr(new OBB(Point3d(node.center, GLOBAL), node.R, Vector3d(node.l, GLOBAL)));
+    bvs[i]->geom = geom;
+    _mesh_tris[bvs[i]] = list<unsigned>(tree_tris.begin() + node.first_tri, tree_tris.begin() + node.first_tri + node.n_tris);
+  }
 
-      // split the bounding box across the axis
-      if (split(_mesh, bb, child1, child2, axis))
-        break;
-    }
+  // link the boxes and create thick triangles for the leaves
+  for (unsigned i=0; i< nodes.size(); i++)
+  {
+    const MeshOBBTree::Node& node = nodes[i];
+    for (unsigned j=0; j< node.n_children; j++)
+      bvs[i]->children.push_back(bvs[node.first_child+j]);
 
-    // make sure that this BV was divisible
-    if (!child1)
+    // the root has no thick triangles
+    if (node.n_children > 0 || i == 0)
       continue;
-
-    // child was divisible; remove thick triangles
-    _tris.erase(bb);
-
-    // setup child pointers
-    bb->children.push_back(child1);
-    bb->children.push_back(child2);
-
-    // get lists of triangles for children
-    assert(_mesh_tris.find(child1) != _mesh_tris.end());
-    assert(_mesh_tris.find(child2) != _mesh_tris.end());
-    const std::list<unsigned>& c1tris = _mesh_tris.find(child1)->second;
-    const std::list<unsigned>& c2tris = _mesh_tris.find(child2)->second;
-
-    // create thick triangles for child1
-    list<shared_ptr<AThickTri> >& ttris1 = _tris[child1];
-    BOOST_FOREACH(unsigned idx, c1tris)
+    list<shared_ptr<AThickTri> >& ttris = _tris[bvs[i]];
+    BOOST_FOREACH(unsigned idx, _mesh_tris[bvs[i]])
     {
       try
       {
-        ttris1.push_back(shared_ptr<AThickTri>(new AThickTri(_mesh->get_triangle(idx, get_pose()), 0.0)));
-        ttris1.back()->mesh = _mesh;
-        ttris1.back()->tri_idx = idx;
+        ttris.push_back(shared_ptr<AThickTri>(new AThickTri(_mesh->get_triangle(idx, get_pose()), 0.0)));
+        ttris.back()->mesh = _mesh;
+        ttris.back()->tri_idx = idx;
       }
       catch (NumericalException e)
       {
         // we won't do anything...  we just won't add the triangle
       }
     }
-    
-    // create thick triangles for child2
-    list<shared_ptr<AThickTri> >& ttris2 = _tris[child2];
-    BOOST_FOREACH(unsigned idx, c2tris)
-    {
-      try
-      {
-        ttris2.push_back(shared_ptr<AThickTri>(new AThickTri(_mesh->get_triangle(idx, get_pose()), 0.0)));
-        ttris2.back()->mesh = _mesh;
-        ttris2.back()->tri_idx = idx;
-      }
-      catch (NumericalException e)
-      {
-        // we won't do anything...  we just won't add the triangle
-      }
-    }
-
-    // add children to the queue for processing if they have more than one tri
-    if (c1tris.size() > 1)
-      Q.push(child1);
-    if (c2tris.size() > 1)
-      Q.push(child2);
-
-    FILE_LOG(LOG_BV) << "  -- built children " << child1 << ", " << child2 << " from " << bb << endl;
-    FILE_LOG(LOG_BV) << "  -- ID: " << child1 << endl;
-    FILE_LOG(LOG_BV) << "  -- ID: " << child2 << endl;
-  }
-
-  // now, collapse the tree
-  Q.push(root);
-  while (!Q.empty())
-  {
-    // for any children with a greater volume than the obb in question,
-    // remove the grandchildren and add them as children
-    BVPtr bb = Q.front();
-    double vol = bb->calc_volume();
-    bool erased_one = false;
-    for (list<BVPtr>::iterator i = bb->children.begin(); i != bb->children.end(); )
-    {
-      // get the volume of this child
-      double voli = (*i)->calc_volume();
-      if (!(*i)->is_leaf() && voli > vol + NEAR_ZERO)
-      {
-        erased_one = true;
-        BOOST_FOREACH(BVPtr gchild, (*i)->children)
-          bb->children.push_back(gchild);
-        i = (*i)->children.erase(i);
-      }
-      else
-        i++;
-    }
-
-    if (!erased_one)
-    {
-      Q.pop();
-      BOOST_FOREACH(BVPtr child, bb->children)
-        if (!child->is_leaf())
-          Q.push(child);
-    }
-  }
-
-  Q.push(root);
-  while (!Q.empty())
-  {
-    // get the element off of the front of the queue
-    BVPtr bb = Q.front();
-    Q.pop();
-
-    // fatten the bounding volume
-    // cast it to an OBB
-    OBBPtr obb = dynamic_pointer_cast<OBB>(bb);
-    assert(obb);
-
-    // add all children to the queue
-    if (!bb->is_leaf())
-    {
-      BOOST_FOREACH(BVPtr child, bb->children)
-        Q.push(child);
-    }
-
-    // wipe out userdata
-    bb->userdata = shared_ptr<void>();
   }
 
   // save the root
-  geom_root = root;
+  geom_root = bvs.front();
 
   // output how many triangles are in each bounding box
   if (LOGGING(LOG_BV))
   {
     stack<pair<BVPtr, unsigned> > S;
-    S.push(make_pair(root, 0));
+    S.push(make_pair(geom_root, 0));
     while (!S.empty())
     {
       // get the node off of the top of the stack
@@ -1070,99 +1245,6 @@ void TriangleMeshPrimitive::construct_mesh_vertices(shared_ptr<const IndexedTriA
   }
 }
 
-/// Splits a collection of triangles along a splitting plane into 2 new meshes 
-void TriangleMeshPrimitive::split_tris(const Point3d& point, const Vector3d& normal, const IndexedTriArray& orig_mesh, const list<unsigned>& ofacets, list<unsigned>& pfacets, list<unsigned>& nfacets) 
-{
-  // get original vertices and facets
-  const vector<Origin3d>& vertices = orig_mesh.get_vertices();
-  const vector<IndexedTri>& facets = orig_mesh.get_facets();
-
-  // determine the splitting plane: ax + by + cz = d
-  double offset = Vector3d::dot(point, normal);
-
-  // determine the side of the splitting plane of the triangles
-  Plane plane(normal, offset);
-  BOOST_FOREACH(unsigned i, ofacets)
-  {
-    // setup the vertices in the same pose as the normal
-    Point3d pa(vertices[facets[i].a], normal.pose);
-    Point3d pb(vertices[facets[i].b], normal.pose);
-    Point3d pc(vertices[facets[i].c], normal.pose);
-
-    // get the three signed distances
-    double sa = plane.calc_signed_distance(pa);
-    double sb = plane.calc_signed_distance(pb);
-    double sc = plane.calc_signed_distance(pc);
-    double min_s = std::min(sa, std::min(sb, sc));
-    double max_s = std::max(sa, std::max(sb, sc));    
-
-    // see whether we can cleanly put the triangle into one side
-    if (min_s > 0)
-      pfacets.push_back(i);
-    else if (max_s < 0)
-      nfacets.push_back(i);
-    else
-    {
-      // triangle is split down the middle; get its centroid
-      Triangle tri(pa, pb, pc);
-      Point3d tri_centroid = tri.calc_centroid();
-      double scent = plane.calc_signed_distance(tri_centroid);
-      if (scent > 0)
-        pfacets.push_back(i);
-      else
-        nfacets.push_back(i);
-    }
-  }
-}
-
-/// Splits a bounding box  along a given axis into two new bounding boxes; returns true if split successful
-bool TriangleMeshPrimitive::split(shared_ptr<const IndexedTriArray> mesh, shared_ptr<BV> source, shared_ptr<BV>& tgt1, shared_ptr<BV>& tgt2, const Vector3d& axis) 
-{
-  // setup two lists of triangles
-  list<unsigned> ptris, ntris;
-
-  // clear both targets
-  tgt1 = shared_ptr<BV>();
-  tgt2 = shared_ptr<BV>();
-
-  // get the mesh and the list of triangles
-  assert(_mesh_tris.find(source) != _mesh_tris.end());
-  const list<unsigned>& tris = _mesh_tris.find(source)->second;
-
-  // make sure that not trying to split a single triangle
-  assert(tris.size() > 1); 
-
-  // determine the centroid of this set of triangles
-  list<Triangle> t_tris;
-  BOOST_FOREACH(unsigned idx, tris)
-    t_tris.push_back(mesh->get_triangle(idx, source->get_relative_pose())); 
-  Point3d centroid = CompGeom::calc_centroid_3D(t_tris.begin(), t_tris.end());
-
-  // get the side of the splitting plane of the triangles
-  split_tris(centroid, axis, *mesh, tris, ptris, ntris);
-  if (ptris.empty() || ntris.empty())
-    return false;
-
-  // get vertices from both meshes
-  vector<Point3d> pverts, nverts;
-  get_vertices(*mesh, ptris.begin(), ptris.end(), std::back_inserter(pverts), centroid.pose);
-  get_vertices(*mesh, ntris.begin(), ntris.end(), std::back_inserter(nverts), centroid.pose);
-
-  // create two new BVs 
-  tgt1 = OBBPtr(new OBB(pverts.begin(), pverts.end()));
-  tgt2 = OBBPtr(new OBB(nverts.begin(), nverts.end()));
-
-  // setup geometry pointers
-  tgt1->geom = source->geom;
-  tgt2->geom = source->geom;
-
-  // setup mesh data for the BVs
-  _mesh_tris[tgt1] = ptris;
-  _mesh_tris[tgt2] = ntris;
-
-  return true;
-}
-
 /****************************************************************************
  Methods for building bounding box trees end 
 ****************************************************************************/
@@ -0,0 +1,186 @@
+#include <cmath>
+#include <cstdlib>
+#include <Moby/CollisionGeometry.h>
+#include <Moby/BoxPrimitive.h>
+#include <Moby/SpherePrimitive.h>
+#include <Moby/PlanePrimitive.h>
+#include <Moby/HeightmapPrimitive.h>
+#include "gtest/gtest.h"
+
+using boost::shared_ptr;
+using std::vector;
+using namespace Ravelin;
+using namespace Moby;
+
+// a heightmap whose heights can be set directly
+class TestHeightmap : public HeightmapPrimitive
+{
+  public:
+    void set_heights(const MatrixNd& heights, double width, double depth, unsigned tile_size)
+    {
+      _width = width;
+      _depth = depth;
+      _tiles.set_heights(heights, tile_size);
+    }
+
+    double height(const Point3d& p) const { return calc_height(p); }
+    void gradient(const Point3d& p, double& gx, double& gz) const { calc_gradient(p, gx, gz); }
+};
+
+// gets a random number in [lo, hi]
+static double rand_real(double lo, double hi)
+{
+  return lo + (hi - lo)*((double) rand()/RAND_MAX);
+}
+
+// sets up random points in a cube, stored as separate coordinate arrays
+static void rand_points(unsigned n, double lo, double hi, vector<double>& x, vector<double>& y, vector<double>& z)
+{
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  for (unsigned i=0; i< n; i++)
+  {
+    x[i] = rand_real(lo, hi);
+    y[i] = rand_real(lo, hi);
+    z[i] = rand_real(lo, hi);
+  }
+}
+
+// gets the pose of a primitive for a new collision geometry
+static shared_ptr<const Pose3d> get_pose(PrimitivePtr p, vector<CollisionGeometryPtr>& geoms)
+{
+  CollisionGeometryPtr cg(new CollisionGeometry);
+  cg->set_geometry(p);
+  geoms.push_back(cg);
+  return p->get_pose(cg);
+}
+
+// checks that the batch signed distances match the scalar ones
+static void compare_batch(PrimitivePtr p, double lo, double hi)
+{
+  vector<CollisionGeometryPtr> geoms;
+  vector<double> x, y, z, dist;
+
+  shared_ptr<const Pose3d> P = get_pose(p, geoms);
+  rand_points(1000, lo, hi, x, y, z);
+  dist.resize(x.size());
+  p->calc_signed_dist_batch(P, &x[0], &y[0], &z[0], x.size(), &dist[0]);
+  for (unsigned i=0; i< x.size(); i++)
+    EXPECT_NEAR(dist[i], p->calc_signed_dist(Point3d(x[i], y[i], z[i], P)), 1e-12) << "point " << i;
+}
+
+TEST(BatchQueries, Box)
+{
+  srand(0);
+  shared_ptr<BoxPrimitive> box(new BoxPrimitive(1.0, 2.0, 3.0));
+  compare_batch(box, -3.0, 3.0);
+
+  // the distance inside of the box is to the nearest face
+  vector<CollisionGeometryPtr> geoms;
+  shared_ptr<const Pose3d> P = get_pose(box, geoms);
+  EXPECT_NEAR(box->calc_signed_dist(Point3d(0.4, 0.0, 0.0, P)), -0.1, 1e-12);
+  EXPECT_NEAR(box->calc_signed_dist(Point3d(0.0, 0.0, 1.2, P)), -0.3, 1e-12);
+  EXPECT_NEAR(box->calc_signed_dist(Point3d(0.0, 0.0, 0.0, P)), -0.5, 1e-12);
+}
+
+TEST(BatchQueries, Sphere)
+{
+  srand(1);
+  compare_batch(shared_ptr<SpherePrimitive>(new SpherePrimitive(1.5)), -3.0, 3.0);
+}
+
+TEST(BatchQueries, Plane)
+{
+  srand(2);
+  compare_batch(shared_ptr<PlanePrimitive>(new PlanePrimitive), -3.0, 3.0);
+}
+
+TEST(BatchQueries, Heightmap)
+{
+  const unsigned ROWS = 37, COLUMNS = 29;
+  const double WIDTH = 4.0, DEPTH = 3.0;
+  vector<CollisionGeometryPtr> geoms;
+  vector<double> x, y, z, height;
+  MatrixNd heights(ROWS, COLUMNS);
+
+  // setup random heights, using small tiles so that cells span tiles
+  srand(3);
+  for (unsigned i=0; i< ROWS; i++)
+    for (unsigned j=0; j< COLUMNS; j++)
+      heights(i,j) = rand_real(-0.5, 0.5);
+  shared_ptr<TestHeightmap> hm(new TestHeightmap);
+  hm->set_heights(heights, WIDTH, DEPTH, 4);
+  shared_ptr<const Pose3d> P = get_pose(hm, geoms);
+
+  // query points over and beyond the heightmap, including its corners
+  rand_points(2000, -3.0, 3.0, x, y, z);
+  x.push_back(-WIDTH*0.5);  y.push_back(0.0);  z.push_back(-DEPTH*0.5);
+  x.push_back(WIDTH*0.5);  y.push_back(0.0);  z.push_back(DEPTH*0.5);
+  height.resize(x.size());
+  hm->calc_height_batch(&x[0], &y[0], &z[0], x.size(), &height[0]);
+
+  for (unsigned k=0; k< x.size(); k++)
+  {
+    // compute the reference height by bilinear interpolation
+    const double U = std::min(std::max((x[k] + WIDTH*0.5)/WIDTH*(ROWS-1), 0.0), ROWS-1.0);
+    const double V = std::min(std::max((z[k] + DEPTH*0.5)/DEPTH*(COLUMNS-1), 0.0), COLUMNS-1.0);
+    const unsigned i = std::min((unsigned) std::floor(U), ROWS-2);
+    const unsigned j = std::min((unsigned) std::floor(V), COLUMNS-2);
+    const double s = U - i, t = V - j;
+    const double H = heights(i,j)*(1.0-s)*(1.0-t) + heights(i+1,j)*s*(1.0-t) + heights(i,j+1)*(1.0-s)*t + heights(i+1,j+1)*s*t;
+
+    // the batch heights match the reference and the scalar heights
+    EXPECT_NEAR(height[k], y[k] - H, 1e-12) << "point " << k;
+    EXPECT_EQ(height[k], hm->height(Point3d(x[k], y[k], z[k], P))) << "point " << k;
+  }
+
+  // the signed distances are the heights
+  vector<double> dist(x.size());
+  hm->calc_signed_dist_batch(P, &x[0], &y[0], &z[0], x.size(), &dist[0]);
+  for (unsigned k=0; k< x.size(); k++)
+    EXPECT_EQ(dist[k], height[k]);
+}
+
+TEST(BatchQueries, HeightmapSlope)
+{
+  const unsigned ROWS = 17, COLUMNS = 9;
+  const double WIDTH = 2.0, DEPTH = 1.0, A = 0.3, B = -0.2, C = 0.1;
+  vector<CollisionGeometryPtr> geoms;
+  MatrixNd heights(ROWS, COLUMNS);
+
+  // setup a sloped plane, which bilinear interpolation reproduces exactly
+  for (unsigned i=0; i< ROWS; i++)
+    for (unsigned j=0; j< COLUMNS; j++)
+    {
+      const double X = -WIDTH*0.5 + WIDTH*i/(ROWS-1);
+      const double Z = -DEPTH*0.5 + DEPTH*j/(COLUMNS-1);
+      heights(i,j) = A*X + B*Z + C;
+    }
+  shared_ptr<TestHeightmap> hm(new TestHeightmap);
+  hm->set_heights(heights, WIDTH, DEPTH, 4);
+  shared_ptr<const Pose3d> P = get_pose(hm, geoms);
+
+  srand(4);
+  for (unsigned k=0; k< 100; k++)
+  {
+    // setup a point above the heightmap (where the normal follows the slope)
+    const double X = rand_real(-WIDTH*0.5, WIDTH*0.5), Z = rand_real(-DEPTH*0.5, DEPTH*0.5);
+    Point3d p(X, A*X + B*Z + C + rand_real(0.01, 1.0), Z, P);
+
+    // the height and gradient are those of the plane
+    EXPECT_NEAR(hm->height(p), p[1] - (A*p[0] + B*p[2] + C), 1e-12);
+    double gx, gz;
+    hm->gradient(p, gx, gz);
+    EXPECT_NEAR(gx, A, 1e-12);
+    EXPECT_NEAR(gz, B, 1e-12);
+
+    // the normal points away from the slope
+    vector<Vector3d> normals;
+    hm->calc_dist_and_normal(p, normals);
+    ASSERT_EQ(normals.size(), (unsigned) 1);
+    Vector3d n = Vector3d::normalize(Vector3d(-A, 1.0, -B, P));
+    for (unsigned i=0; i< 3; i++)
+      EXPECT_NEAR(normals[0][i], n[i], 1e-12);
+  }
+}
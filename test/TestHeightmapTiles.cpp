@@ -0,0 +1,245 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <boost/cstdint.hpp>
+#include <Moby/HeightmapTiles.h>
+#include "gtest/gtest.h"
+
+using std::string;
+using std::vector;
+using namespace Ravelin;
+using namespace Moby;
+
+// the dimensions of the test heightmap (not multiples of the tile size)
+const unsigned ROWS = 37, COLUMNS = 53, TILE_SIZE = 8;
+
+// offset of the tile size in the header of a tiled heightmap file
+const unsigned TILE_SIZE_OFFSET = 24;
+
+// gets the test height at a sample
+static double height(unsigned i, unsigned j)
+{
+  return std::sin(0.3*i)*std::cos(0.2*j) + 0.01*i;
+}
+
+// sums the samples that are not culled
+struct SumVisitor
+{
+  SumVisitor(double threshold) : threshold(threshold), sum(0.0), count(0) {}
+  bool cull(double min_height, double max_height) const { return max_height < threshold; }
+  void operator()(unsigned i, unsigned j, double h)
+  {
+    if (h >= threshold)
+    {
+      sum += h;
+      count++;
+    }
+  }
+
+  double threshold, sum;
+  unsigned count;
+};
+
+// computes the sum and count of the samples at or above a threshold
+static void brute_sum(double threshold, double& sum, unsigned& count)
+{
+  sum = 0.0;
+  count = 0;
+  for (unsigned i=0; i< ROWS; i++)
+    for (unsigned j=0; j< COLUMNS; j++)
+      if (height(i, j) >= threshold)
+      {
+        sum += height(i, j);
+        count++;
+      }
+}
+
+// checks every sample, the bounds, and culled traversals of a heightmap
+static void check_heights(const HeightmapTiles& tiles)
+{
+  ASSERT_EQ(tiles.rows(), ROWS);
+  ASSERT_EQ(tiles.columns(), COLUMNS);
+  double min_height = height(0, 0), max_height = height(0, 0);
+  for (unsigned i=0; i< ROWS; i++)
+    for (unsigned j=0; j< COLUMNS; j++)
+    {
+      EXPECT_EQ(tiles.get_height(i, j), height(i, j));
+      min_height = std::min(min_height, height(i, j));
+      max_height = std::max(max_height, height(i, j));
+    }
+  EXPECT_EQ(tiles.get_min_height(), min_height);
+  EXPECT_EQ(tiles.get_max_height(), max_height);
+
+  // the quadtree culls only samples below the threshold
+  const double THRESHOLD[3] = { -2.0, 0.0, 0.5 };
+  for (unsigned k=0; k< 3; k++)
+  {
+    SumVisitor visitor(THRESHOLD[k]);
+    double sum;
+    unsigned count;
+    tiles.visit_samples(0, ROWS-1, 0, COLUMNS-1, visitor);
+    brute_sum(THRESHOLD[k], sum, count);
+    EXPECT_EQ(visitor.count, count);
+    EXPECT_NEAR(visitor.sum, sum, 1e-10);
+  }
+}
+
+// a heightmap and a temporary file for it
+class HeightmapTilesTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      char tmpl[] = "/tmp/moby-heightmap-XXXXXX";
+      int fd = mkstemp(tmpl);
+      ASSERT_GE(fd, 0);
+      close(fd);
+      fname = tmpl;
+
+      heights.resize(ROWS, COLUMNS);
+      for (unsigned i=0; i< ROWS; i++)
+        for (unsigned j=0; j< COLUMNS; j++)
+          heights(i, j) = height(i, j);
+    }
+
+    virtual void TearDown()
+    {
+      std::remove(fname.c_str());
+    }
+
+    string fname;
+    MatrixNd heights;
+};
+
+TEST_F(HeightmapTilesTest, RoundTrip)
+{
+  HeightmapTiles tiles, read;
+
+  tiles.set_heights(heights, TILE_SIZE);
+  EXPECT_EQ(tiles.get_tile_size(), TILE_SIZE);
+  check_heights(tiles);
+
+  // the file has the same samples, bounds, and tile size
+  ASSERT_TRUE(tiles.write(fname));
+  ASSERT_TRUE(read.open(fname));
+  EXPECT_EQ(read.get_tile_size(), TILE_SIZE);
+  check_heights(read);
+
+  // writing an opened file reproduces it
+  const string FNAME2 = fname + ".copy";
+  ASSERT_TRUE(read.write(FNAME2));
+  std::ifstream in1(fname.c_str(), std::ios::binary), in2(FNAME2.c_str(), std::ios::binary);
+  EXPECT_TRUE(vector<char>((std::istreambuf_iterator<char>(in1)), std::istreambuf_iterator<char>()) == vector<char>((std::istreambuf_iterator<char>(in2)), std::istreambuf_iterator<char>()));
+  std::remove(FNAME2.c_str());
+}
+
+TEST_F(HeightmapTilesTest, Eviction)
+{
+  HeightmapTiles tiles;
+
+  tiles.set_heights(heights, TILE_SIZE);
+  ASSERT_TRUE(tiles.write(fname));
+
+  // evicted tiles are reloaded from the file when queried again
+  ASSERT_TRUE(tiles.open(fname));
+  tiles.set_max_resident_tiles(2);
+  for (unsigned k=0; k< 3; k++)
+  {
+    check_heights(tiles);
+    EXPECT_LE(tiles.num_resident_tiles(), (unsigned) 2);
+  }
+
+  // lowering the limit evicts tiles immediately
+  tiles.set_max_resident_tiles(0);
+  check_heights(tiles);
+  EXPECT_GT(tiles.num_resident_tiles(), (unsigned) 2);
+  tiles.set_max_resident_tiles(1);
+  EXPECT_EQ(tiles.num_resident_tiles(), (unsigned) 1);
+  check_heights(tiles);
+}
+
+// arguments for a thread querying the heightmap
+struct QueryArgs
+{
+  const HeightmapTiles* tiles;
+  double sum;
+  unsigned count;
+};
+
+// queries the heightmap repeatedly
+static void* query_heights(void* data)
+{
+  QueryArgs* args = (QueryArgs*) data;
+  args->sum = 0.0;
+  args->count = 0;
+  for (unsigned k=0; k< 20; k++)
+  {
+    SumVisitor visitor(0.0);
+    args->tiles->visit_samples(0, ROWS-1, 0, COLUMNS-1, visitor);
+    args->sum += visitor.sum;
+    args->count += visitor.count;
+  }
+
+  return NULL;
+}
+
+TEST_F(HeightmapTilesTest, ConcurrentQueries)
+{
+  const unsigned NTHREADS = 4;
+  HeightmapTiles tiles;
+  pthread_t threads[NTHREADS];
+  QueryArgs args[NTHREADS];
+
+  // tiles evicted by one thread are not in use by another
+  tiles.set_heights(heights, TILE_SIZE);
+  ASSERT_TRUE(tiles.write(fname));
+  ASSERT_TRUE(tiles.open(fname));
+  tiles.set_max_resident_tiles(1);
+  for (unsigned i=0; i< NTHREADS; i++)
+  {
+    args[i].tiles = &tiles;
+    ASSERT_EQ(pthread_create(&threads[i], NULL, query_heights, &args[i]), 0);
+  }
+  for (unsigned i=0; i< NTHREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  double sum;
+  unsigned count;
+  brute_sum(0.0, sum, count);
+  for (unsigned i=0; i< NTHREADS; i++)
+  {
+    EXPECT_EQ(args[i].count, count*20);
+    EXPECT_NEAR(args[i].sum, sum*20, 1e-8);
+  }
+  EXPECT_EQ(tiles.num_resident_tiles(), (unsigned) 1);
+}
+
+TEST_F(HeightmapTilesTest, OversizedTiles)
+{
+  HeightmapTiles tiles;
+
+  // requested tile sizes are clamped
+  tiles.set_heights(heights, 1u << 31);
+  EXPECT_EQ(tiles.get_tile_size(), (unsigned) HeightmapTiles::MAX_TILE_SIZE);
+  tiles.set_heights(heights, 0xFFFFFFFF);
+  EXPECT_EQ(tiles.get_tile_size(), (unsigned) HeightmapTiles::MAX_TILE_SIZE);
+  check_heights(tiles);
+
+  // files with oversized tiles are rejected
+  tiles.set_heights(heights, TILE_SIZE);
+  ASSERT_TRUE(tiles.write(fname));
+  std::fstream f(fname.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+  const boost::uint32_t SIZES[2] = { 65536, 1u << 31 };
+  for (unsigned i=0; i< 2; i++)
+  {
+    f.seekp(TILE_SIZE_OFFSET);
+    f.write((const char*) &SIZES[i], sizeof(boost::uint32_t));
+    f.flush();
+    EXPECT_FALSE(tiles.open(fname));
+    EXPECT_EQ(tiles.rows(), (unsigned) 0);
+  }
+}
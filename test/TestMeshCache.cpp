@@ -0,0 +1,271 @@
+#include <dirent.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <boost/cstdint.hpp>
+#include <Moby/MeshCache.h>
+#include "gtest/gtest.h"
+
+using boost::shared_ptr;
+using std::string;
+using std::vector;
+using namespace Ravelin;
+using namespace Moby;
+
+// offsets in the binary mesh file of the counts and the first facet of a
+// mesh with eight vertices
+const unsigned VERTEX_COUNT_OFFSET = 32;
+const unsigned FACET_COUNT_OFFSET = 36;
+const unsigned NODE_COUNT_OFFSET = 52;
+const unsigned OBB_NODE_COUNT_OFFSET = 68;
+const unsigned FIRST_FACET_OFFSET = 80 + 8*3*sizeof(double);
+
+// the data in a cache entry (copied, so that the entry may be released)
+struct Snapshot
+{
+  vector<Origin3d> vertices;
+  vector<IndexedTri> facets;
+  vector<unsigned> hull_vertices;
+  vector<IndexedTri> hull_facets;
+  vector<double> dists;
+  vector<Origin3d> closest, normals;
+  vector<MeshOBBTree::Node> obb_nodes;
+  vector<unsigned> obb_tris;
+};
+
+// writes a unit cube to an OBJ file
+static void write_cube(const string& fname)
+{
+  std::ofstream out(fname.c_str());
+  out << "v 0 0 0" << std::endl << "v 1 0 0" << std::endl;
+  out << "v 1 1 0" << std::endl << "v 0 1 0" << std::endl;
+  out << "v 0 0 1" << std::endl << "v 1 0 1" << std::endl;
+  out << "v 1 1 1" << std::endl << "v 0 1 1" << std::endl;
+  out << "f 1 3 2" << std::endl << "f 1 4 3" << std::endl;
+  out << "f 5 6 7" << std::endl << "f 5 7 8" << std::endl;
+  out << "f 1 2 6" << std::endl << "f 1 6 5" << std::endl;
+  out << "f 4 8 7" << std::endl << "f 4 7 3" << std::endl;
+  out << "f 1 5 8" << std::endl << "f 1 8 4" << std::endl;
+  out << "f 2 3 7" << std::endl << "f 2 7 6" << std::endl;
+}
+
+// finds the binary mesh file in a directory
+static string find_cache_file(const string& dir)
+{
+  string fname;
+  DIR* d = opendir(dir.c_str());
+  if (!d)
+    return fname;
+  for (struct dirent* e = readdir(d); e; e = readdir(d))
+  {
+    string name(e->d_name);
+    if (name.size() > 7 && name.substr(name.size()-7) == ".mcache")
+      fname = dir + "/" + name;
+  }
+  closedir(d);
+  return fname;
+}
+
+// reads the contents of a file
+static vector<char> read_file(const string& fname)
+{
+  std::ifstream in(fname.c_str(), std::ios::binary);
+  return vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// writes the contents of a file
+static void write_file(const string& fname, const vector<char>& contents)
+{
+  std::ofstream out(fname.c_str(), std::ios::binary | std::ios::trunc);
+  if (!contents.empty())
+    out.write(&contents.front(), contents.size());
+}
+
+// overwrites an unsigned integer in a buffer
+static void poke(vector<char>& buffer, unsigned offset, boost::uint32_t x)
+{
+  ASSERT_LE(offset + sizeof(boost::uint32_t), buffer.size());
+  std::memcpy(&buffer[offset], &x, sizeof(boost::uint32_t));
+}
+
+// copies the data in an entry, including the results of distance queries
+static void snapshot(shared_ptr<const MeshCache::Entry> entry, Snapshot& s)
+{
+  ASSERT_TRUE(entry.get() != NULL);
+  s.vertices = entry->mesh->get_vertices();
+  s.facets = entry->mesh->get_facets();
+  s.hull_vertices = entry->hull_vertices;
+  s.hull_facets = entry->hull_facets;
+  ASSERT_TRUE(entry->obb_tree.get() != NULL);
+  s.obb_nodes = entry->obb_tree->get_nodes();
+  s.obb_tris = entry->obb_tree->get_tris();
+
+  // query the distance hierarchy on a grid of points
+  const double X[4] = { -0.5, 0.25, 0.5, 1.5 };
+  for (unsigned i=0; i< 4; i++)
+    for (unsigned j=0; j< 4; j++)
+      for (unsigned k=0; k< 4; k++)
+      {
+        Origin3d closest, normal;
+        s.dists.push_back(entry->dist_tree->calc_closest_point(*entry->mesh, Origin3d(X[i], X[j], X[k]), closest, normal));
+        s.closest.push_back(closest);
+        s.normals.push_back(normal);
+      }
+}
+
+// checks that two snapshots are identical
+static void compare(const Snapshot& s1, const Snapshot& s2)
+{
+  ASSERT_EQ(s1.vertices.size(), s2.vertices.size());
+  for (unsigned i=0; i< s1.vertices.size(); i++)
+    for (unsigned j=0; j< 3; j++)
+      EXPECT_EQ(s1.vertices[i][j], s2.vertices[i][j]);
+  ASSERT_EQ(s1.facets.size(), s2.facets.size());
+  for (unsigned i=0; i< s1.facets.size(); i++)
+  {
+    EXPECT_EQ(s1.facets[i].a, s2.facets[i].a);
+    EXPECT_EQ(s1.facets[i].b, s2.facets[i].b);
+    EXPECT_EQ(s1.facets[i].c, s2.facets[i].c);
+  }
+  EXPECT_TRUE(s1.hull_vertices == s2.hull_vertices);
+  ASSERT_EQ(s1.hull_facets.size(), s2.hull_facets.size());
+  for (unsigned i=0; i< s1.hull_facets.size(); i++)
+  {
+    EXPECT_EQ(s1.hull_facets[i].a, s2.hull_facets[i].a);
+    EXPECT_EQ(s1.hull_facets[i].b, s2.hull_facets[i].b);
+    EXPECT_EQ(s1.hull_facets[i].c, s2.hull_facets[i].c);
+  }
+  ASSERT_EQ(s1.obb_nodes.size(), s2.obb_nodes.size());
+  for (unsigned i=0; i< s1.obb_nodes.size(); i++)
+  {
+    const MeshOBBTree::Node& n1 = s1.obb_nodes[i];
+    const MeshOBBTree::Node& n2 = s2.obb_nodes[i];
+    for (unsigned j=0; j< 3; j++)
+    {
+      EXPECT_EQ(n1.center[j], n2.center[j]);
+      EXPECT_EQ(n1.l[j], n2.l[j]);
+      for (unsigned k=0; k< 3; k++)
+        EXPECT_EQ(n1.R(j,k), n2.R(j,k));
+    }
+    EXPECT_EQ(n1.first_child, n2.first_child);
+    EXPECT_EQ(n1.n_children, n2.n_children);
+    EXPECT_EQ(n1.first_tri, n2.first_tri);
+    EXPECT_EQ(n1.n_tris, n2.n_tris);
+  }
+  EXPECT_TRUE(s1.obb_tris == s2.obb_tris);
+  ASSERT_EQ(s1.dists.size(), s2.dists.size());
+  for (unsigned i=0; i< s1.dists.size(); i++)
+  {
+    EXPECT_EQ(s1.dists[i], s2.dists[i]);
+    for (unsigned j=0; j< 3; j++)
+    {
+      EXPECT_EQ(s1.closest[i][j], s2.closest[i][j]);
+      EXPECT_EQ(s1.normals[i][j], s2.normals[i][j]);
+    }
+  }
+}
+
+// a temporary directory containing an OBJ file and the mesh cache
+class MeshCacheTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      char tmpl[] = "/tmp/moby-mesh-cache-XXXXXX";
+      ASSERT_TRUE(mkdtemp(tmpl) != NULL);
+      dir = tmpl;
+      obj = dir + "/cube.obj";
+      write_cube(obj);
+    }
+
+    virtual void TearDown()
+    {
+      string cache_file = find_cache_file(dir);
+      if (!cache_file.empty())
+        std::remove(cache_file.c_str());
+      std::remove(obj.c_str());
+      rmdir(dir.c_str());
+    }
+
+    string dir, obj;
+};
+
+TEST_F(MeshCacheTest, RoundTrip)
+{
+  Snapshot built, read;
+
+  // the first load builds the entry and writes the cache file
+  snapshot(MeshCache::load(obj, dir), built);
+  ASSERT_EQ(built.vertices.size(), (unsigned) 8);
+  ASSERT_EQ(built.facets.size(), (unsigned) 12);
+  EXPECT_EQ(built.hull_vertices.size(), (unsigned) 8);
+  ASSERT_FALSE(built.obb_nodes.empty());
+  EXPECT_EQ(built.obb_nodes.front().n_tris, (unsigned) 12);
+  string cache_file = find_cache_file(dir);
+  ASSERT_FALSE(cache_file.empty());
+  vector<char> contents = read_file(cache_file);
+
+  // the entry has been released, so the second load reads the cache file
+  snapshot(MeshCache::load(obj, dir), read);
+  compare(built, read);
+  EXPECT_TRUE(read_file(cache_file) == contents);
+
+  // an entry still in use is shared
+  shared_ptr<const MeshCache::Entry> e1 = MeshCache::load(obj, dir);
+  shared_ptr<const MeshCache::Entry> e2 = MeshCache::load(obj, dir);
+  EXPECT_EQ(e1, e2);
+}
+
+TEST_F(MeshCacheTest, DisabledCache)
+{
+  Snapshot s;
+
+  // an empty directory disables the on-disk cache
+  snapshot(MeshCache::load(obj, ""), s);
+  EXPECT_EQ(s.facets.size(), (unsigned) 12);
+  EXPECT_TRUE(find_cache_file(dir).empty());
+}
+
+TEST_F(MeshCacheTest, CorruptFiles)
+{
+  Snapshot built;
+
+  // build the entry and get the valid cache file
+  snapshot(MeshCache::load(obj, dir), built);
+  string cache_file = find_cache_file(dir);
+  ASSERT_FALSE(cache_file.empty());
+  const vector<char> VALID = read_file(cache_file);
+
+  // setup corrupt versions of the file
+  vector<vector<char> > corrupt;
+  corrupt.push_back(vector<char>());
+  corrupt.push_back(vector<char>(VALID.begin(), VALID.begin()+40));
+  corrupt.push_back(vector<char>(VALID.begin(), VALID.begin()+VALID.size()/2));
+  corrupt.push_back(vector<char>(VALID.begin(), VALID.end()-1));
+  corrupt.push_back(VALID);
+  corrupt.back()[0] = 'X';
+  corrupt.push_back(VALID);
+  poke(corrupt.back(), VERTEX_COUNT_OFFSET, 0xFFFFFFFF);
+  corrupt.push_back(VALID);
+  poke(corrupt.back(), FACET_COUNT_OFFSET, 0xFFFFFFFF);
+  corrupt.push_back(VALID);
+  poke(corrupt.back(), NODE_COUNT_OFFSET, 0x7FFFFFFF);
+  corrupt.push_back(VALID);
+  poke(corrupt.back(), OBB_NODE_COUNT_OFFSET, 0x7FFFFFFF);
+  corrupt.push_back(VALID);
+  poke(corrupt.back(), FIRST_FACET_OFFSET, 8);
+
+  // each corrupt file is rejected, the entry is rebuilt, and the file is
+  // rewritten
+  for (unsigned i=0; i< corrupt.size(); i++)
+  {
+    Snapshot s;
+    write_file(cache_file, corrupt[i]);
+    snapshot(MeshCache::load(obj, dir), s);
+    compare(built, s);
+    EXPECT_TRUE(read_file(cache_file) == VALID) << "corruption " << i;
+  }
+}
+
@@ -0,0 +1,282 @@
+#include <cmath>
+#include <vector>
+#include <Moby/LCP.h>
+#include "gtest/gtest.h"
+
+using std::vector;
+using namespace Ravelin;
+using namespace Moby;
+
+// the number of contacts between the box and the plane
+const unsigned NC = 4;
+
+// the number of edges of each linearized friction cone
+const unsigned NK = 4;
+
+// a box of unit mass with half-lengths (a, b, c) resting on the plane z = 0,
+// with contacts at the four corners of its bottom face
+class BoxOnPlane
+{
+  public:
+    BoxOnPlane()
+    {
+      const double M = 1.0, A = 0.5, B = 0.3, C = 0.2;
+
+      // setup the inverse of the generalized inertia
+      _iM[0] = _iM[1] = _iM[2] = 1.0/M;
+      _iM[3] = 3.0/(M*(B*B + C*C));
+      _iM[4] = 3.0/(M*(A*A + C*C));
+      _iM[5] = 3.0/(M*(A*A + B*B));
+
+      // setup the contact points (relative to the center of mass)
+      const double SX[NC] = { A, A, -A, -A };
+      const double SY[NC] = { B, -B, B, -B };
+      for (unsigned i=0; i< NC; i++)
+      {
+        _r[i][0] = SX[i];
+        _r[i][1] = SY[i];
+        _r[i][2] = -C;
+      }
+    }
+
+    // computes the Jacobian row for contact i and world direction d
+    void row(unsigned i, const double d[3], double J[6]) const
+    {
+      const double* r = _r[i];
+      J[0] = d[0];
+      J[1] = d[1];
+      J[2] = d[2];
+      J[3] = r[1]*d[2] - r[2]*d[1];
+      J[4] = r[2]*d[0] - r[0]*d[2];
+      J[5] = r[0]*d[1] - r[1]*d[0];
+    }
+
+    // sets up the Jacobian for a set of (contact, direction) pairs
+    void jacobian(const vector<unsigned>& contacts, const vector<const double*>& dirs, MatrixNd& J) const
+    {
+      J.set_zero(contacts.size(), 6);
+      for (unsigned i=0; i< contacts.size(); i++)
+      {
+        double Ji[6];
+        row(contacts[i], dirs[i], Ji);
+        for (unsigned j=0; j< 6; j++)
+          J(i,j) = Ji[j];
+      }
+    }
+
+    // computes J1 * inv(M) * J2'
+    void mult_inertia(const MatrixNd& J1, const MatrixNd& J2, MatrixNd& X) const
+    {
+      X.set_zero(J1.rows(), J2.rows());
+      for (unsigned i=0; i< J1.rows(); i++)
+        for (unsigned j=0; j< J2.rows(); j++)
+          for (unsigned k=0; k< 6; k++)
+            X(i,j) += J1(i,k)*_iM[k]*J2(j,k);
+    }
+
+    // computes J * v
+    static void mult(const MatrixNd& J, const VectorNd& v, VectorNd& Jv)
+    {
+      Jv.set_zero(J.rows());
+      for (unsigned i=0; i< J.rows(); i++)
+        for (unsigned k=0; k< 6; k++)
+          Jv[i] += J(i,k)*v[k];
+    }
+
+    // computes v + inv(M) * J' * z
+    void apply_impulses(const MatrixNd& J, const VectorNd& z, const VectorNd& v, VectorNd& vplus) const
+    {
+      vplus = v;
+      for (unsigned i=0; i< J.rows(); i++)
+        for (unsigned k=0; k< 6; k++)
+          vplus[k] += _iM[k]*J(i,k)*z[i];
+    }
+
+  private:
+    double _iM[6];
+    double _r[NC][3];
+};
+
+// world directions
+static const double NORMAL[3] = { 0.0, 0.0, 1.0 };
+static const double TAN_X[3] = { 1.0, 0.0, 0.0 };
+static const double TAN_Y[3] = { 0.0, 1.0, 0.0 };
+static const double NEG_X[3] = { -1.0, 0.0, 0.0 };
+static const double NEG_Y[3] = { 0.0, -1.0, 0.0 };
+
+// solves the impact problem with the true friction cone model ([cn; cs; ct])
+// using projected Gauss-Seidel, and returns the velocity after impact
+static bool solve_pgs(const BoxOnPlane& box, const VectorNd& v, double mu, bool nncg, VectorNd& vplus)
+{
+  // setup the Jacobian [N; S; T]
+  vector<unsigned> contacts;
+  vector<const double*> dirs;
+  for (unsigned i=0; i< NC; i++)
+  {
+    contacts.push_back(i);
+    dirs.push_back(NORMAL);
+  }
+  for (unsigned i=0; i< NC; i++)
+  {
+    contacts.push_back(i);
+    dirs.push_back(TAN_X);
+  }
+  for (unsigned i=0; i< NC; i++)
+  {
+    contacts.push_back(i);
+    dirs.push_back(TAN_Y);
+  }
+  MatrixNd J, MM;
+  VectorNd qq, z;
+  box.jacobian(contacts, dirs, J);
+  box.mult_inertia(J, J, MM);
+  BoxOnPlane::mult(J, v, qq);
+
+  // setup the cones
+  vector<LCP::FrictionCone> cones(NC);
+  for (unsigned i=0; i< NC; i++)
+  {
+    cones[i].normal = i;
+    cones[i].tan1 = NC + i;
+    cones[i].tan2 = NC*2 + i;
+    cones[i].mu = mu;
+  }
+
+  // solve
+  LCP lcp;
+  bool converged = lcp.ncp_pgs(MM, qq, z, cones, 100000, 1e-12, nncg);
+  box.apply_impulses(J, z, v, vplus);
+  return converged;
+}
+
+// solves the impact problem with the linearized friction cone model
+// ([cn; beta; lambda]) using Lemke's algorithm, and returns the velocity
+// after impact
+static bool solve_lemke(const BoxOnPlane& box, const VectorNd& v, double mu, VectorNd& vplus)
+{
+  const double* EDGES[NK] = { TAN_X, NEG_X, TAN_Y, NEG_Y };
+
+  // setup the normal and tangential Jacobians
+  vector<unsigned> ncontacts, dcontacts;
+  vector<const double*> ndirs, ddirs;
+  for (unsigned i=0; i< NC; i++)
+  {
+    ncontacts.push_back(i);
+    ndirs.push_back(NORMAL);
+    for (unsigned k=0; k< NK; k++)
+    {
+      dcontacts.push_back(i);
+      ddirs.push_back(EDGES[k]);
+    }
+  }
+  MatrixNd N, D, NN, ND, DD;
+  VectorNd Nv, Dv;
+  box.jacobian(ncontacts, ndirs, N);
+  box.jacobian(dcontacts, ddirs, D);
+  box.mult_inertia(N, N, NN);
+  box.mult_inertia(N, D, ND);
+  box.mult_inertia(D, D, DD);
+  BoxOnPlane::mult(N, v, Nv);
+  BoxOnPlane::mult(D, v, Dv);
+
+  // setup the LCP
+  const unsigned NB = NC*NK, N_VARS = NC + NB + NC;
+  MatrixNd MM;
+  VectorNd qq, z;
+  MM.set_zero(N_VARS, N_VARS);
+  qq.set_zero(N_VARS);
+  for (unsigned i=0; i< NC; i++)
+  {
+    qq[i] = Nv[i];
+    for (unsigned j=0; j< NC; j++)
+      MM(i,j) = NN(i,j);
+    for (unsigned j=0; j< NB; j++)
+    {
+      MM(i,NC+j) = ND(i,j);
+      MM(NC+j,i) = ND(i,j);
+    }
+
+    // friction cone constraints: mu*cn - sum(beta) >= 0
+    MM(NC+NB+i,i) = mu;
+    for (unsigned k=0; k< NK; k++)
+    {
+      MM(NC+NB+i,NC+i*NK+k) = -1.0;
+      MM(NC+i*NK+k,NC+NB+i) = 1.0;
+    }
+  }
+  for (unsigned i=0; i< NB; i++)
+  {
+    qq[NC+i] = Dv[i];
+    for (unsigned j=0; j< NB; j++)
+      MM(NC+i,NC+j) = DD(i,j);
+  }
+
+  // solve
+  LCP lcp;
+  if (!lcp.lcp_lemke_regularized(MM, qq, z))
+    return false;
+
+  // apply the impulses
+  VectorNd cn(NC), beta(NB);
+  for (unsigned i=0; i< NC; i++)
+    cn[i] = z[i];
+  for (unsigned i=0; i< NB; i++)
+    beta[i] = z[NC+i];
+  VectorNd vn;
+  box.apply_impulses(N, cn, v, vn);
+  box.apply_impulses(D, beta, vn, vplus);
+  return true;
+}
+
+// compares the velocities after impact from the three solvers
+static void compare_solvers(const VectorNd& v, double mu)
+{
+  BoxOnPlane box;
+  VectorNd v_lemke, v_pgs, v_nncg;
+  ASSERT_TRUE(solve_lemke(box, v, mu, v_lemke));
+  EXPECT_TRUE(solve_pgs(box, v, mu, false, v_pgs));
+  EXPECT_TRUE(solve_pgs(box, v, mu, true, v_nncg));
+
+  // the box may not penetrate the plane after impact
+  EXPECT_GT(v_lemke[2], -1e-6);
+
+  // the velocities match
+  for (unsigned i=0; i< 6; i++)
+  {
+    EXPECT_NEAR(v_lemke[i], v_pgs[i], 1e-4) << "PGS, component " << i;
+    EXPECT_NEAR(v_lemke[i], v_nncg[i], 1e-4) << "NNCG, component " << i;
+  }
+}
+
+// the box lands with little tangential velocity, so friction stops it
+TEST(PGS, BoxOnPlaneSticking)
+{
+  VectorNd v;
+  v.set_zero(6);
+  v[0] = 0.1;
+  v[2] = -1.0;
+  compare_solvers(v, 1.0);
+}
+
+// the box lands sliding along a friction cone edge (where the linearized
+// and true cones coincide), so friction only slows it
+TEST(PGS, BoxOnPlaneSliding)
+{
+  VectorNd v;
+  v.set_zero(6);
+  v[0] = 2.0;
+  v[2] = -1.0;
+  compare_solvers(v, 0.1);
+}
+
+// without friction, only the normal velocity changes
+TEST(PGS, BoxOnPlaneFrictionless)
+{
+  VectorNd v;
+  v.set_zero(6);
+  v[0] = 1.0;
+  v[1] = -0.5;
+  v[2] = -1.0;
+  compare_solvers(v, 0.0);
+}
+
@@ -0,0 +1,279 @@
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <Moby/CompGeom.h>
+#include <Moby/QuickHull.h>
+#include <Moby/TessellatedPolyhedron.h>
+#include "gtest/gtest.h"
+
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace Ravelin;
+using namespace Moby;
+
+// compares two points lexicographically
+static bool lex_less(const Origin3d& a, const Origin3d& b)
+{
+  for (unsigned i=0; i< 3; i++)
+    if (a[i] != b[i])
+      return a[i] < b[i];
+  return false;
+}
+
+// gets a random number in [lo, hi]
+static double rand_real(double lo, double hi)
+{
+  return lo + (hi - lo)*((double) rand()/RAND_MAX);
+}
+
+// gets a random unit vector
+static Origin3d rand_unit()
+{
+  while (true)
+  {
+    Origin3d v(rand_real(-1.0, 1.0), rand_real(-1.0, 1.0), rand_real(-1.0, 1.0));
+    double nrm = v.norm();
+    if (nrm > 1e-3 && nrm <= 1.0)
+      return v/nrm;
+  }
+}
+
+// computes the convex hull of a set of points using the given engine
+static TessellatedPolyhedronPtr calc_hull(CompGeom::HullEngine engine, const vector<Point3d>& points)
+{
+  CompGeom::HullEngine old_engine = CompGeom::hull_engine;
+  CompGeom::hull_engine = engine;
+  TessellatedPolyhedronPtr hull = CompGeom::calc_convex_hull(points.begin(), points.end());
+  CompGeom::hull_engine = old_engine;
+  return hull;
+}
+
+// computes the intersection of a set of halfspaces using the given engine
+static TessellatedPolyhedronPtr calc_hs_intersection(CompGeom::HullEngine engine, const vector<pair<Vector3d, double> >& halfspaces, const Origin3d& interior_point)
+{
+  CompGeom::HullEngine old_engine = CompGeom::hull_engine;
+  CompGeom::hull_engine = engine;
+  TessellatedPolyhedronPtr isect = CompGeom::calc_hs_intersection(halfspaces.begin(), halfspaces.end(), interior_point);
+  CompGeom::hull_engine = old_engine;
+  return isect;
+}
+
+// checks that two hulls have the same vertices and volume
+static void compare_hulls(TessellatedPolyhedronPtr p, TessellatedPolyhedronPtr q, double tol)
+{
+  ASSERT_TRUE(p.get() != NULL);
+  ASSERT_TRUE(q.get() != NULL);
+  EXPECT_NEAR(p->calc_volume(), q->calc_volume(), tol);
+
+  vector<Origin3d> vp = p->get_vertices();
+  vector<Origin3d> vq = q->get_vertices();
+  ASSERT_EQ(vp.size(), vq.size());
+  std::sort(vp.begin(), vp.end(), lex_less);
+  std::sort(vq.begin(), vq.end(), lex_less);
+  for (unsigned i=0; i< vp.size(); i++)
+    for (unsigned j=0; j< 3; j++)
+      EXPECT_NEAR(vp[i][j], vq[i][j], tol);
+}
+
+// gets the corners of the unit cube
+static void get_cube(vector<Point3d>& points)
+{
+  points.clear();
+  for (unsigned i=0; i< 8; i++)
+    points.push_back(Point3d((i & 1) ? 1.0 : 0.0, (i & 2) ? 1.0 : 0.0, (i & 4) ? 1.0 : 0.0, GLOBAL));
+}
+
+TEST(QuickHull, Cube)
+{
+  vector<Point3d> points;
+
+  // setup the corners and some interior points
+  srand(0);
+  get_cube(points);
+  for (unsigned i=0; i< 100; i++)
+    points.push_back(Point3d(rand_real(0.1, 0.9), rand_real(0.1, 0.9), rand_real(0.1, 0.9), GLOBAL));
+  std::random_shuffle(points.begin(), points.end());
+
+  TessellatedPolyhedronPtr qh = calc_hull(CompGeom::eQuickHull, points);
+  ASSERT_TRUE(qh.get() != NULL);
+  EXPECT_EQ(qh->get_vertices().size(), (unsigned) 8);
+  EXPECT_EQ(qh->get_facets().size(), (unsigned) 12);
+  EXPECT_NEAR(qh->calc_volume(), 1.0, 1e-10);
+  compare_hulls(qh, calc_hull(CompGeom::eQhull, points), 1e-10);
+}
+
+TEST(QuickHull, CoplanarAndDuplicatePoints)
+{
+  vector<Point3d> points, corners;
+
+  // setup duplicated corners, edge midpoints, face centers, and points on
+  // the faces
+  srand(1);
+  get_cube(corners);
+  for (unsigned i=0; i< 3; i++)
+    points.insert(points.end(), corners.begin(), corners.end());
+  for (unsigned i=0; i< 8; i++)
+    for (unsigned j=i+1; j< 8; j++)
+      points.push_back((corners[i] + corners[j])*0.5);
+  for (unsigned i=0; i< 3; i++)
+    for (unsigned j=0; j< 20; j++)
+    {
+      Point3d p(rand_real(0.0, 1.0), rand_real(0.0, 1.0), rand_real(0.0, 1.0), GLOBAL);
+      p[i] = (j % 2 == 0) ? 0.0 : 1.0;
+      points.push_back(p);
+    }
+  std::random_shuffle(points.begin(), points.end());
+
+  // coplanar and duplicate points are not hull vertices
+  TessellatedPolyhedronPtr qh = calc_hull(CompGeom::eQuickHull, points);
+  ASSERT_TRUE(qh.get() != NULL);
+  EXPECT_EQ(qh->get_vertices().size(), (unsigned) 8);
+  EXPECT_NEAR(qh->calc_volume(), 1.0, 1e-10);
+  compare_hulls(qh, calc_hull(CompGeom::eQhull, points), 1e-10);
+}
+
+TEST(QuickHull, Sphere)
+{
+  vector<Point3d> points;
+
+  // every point on the sphere is on the hull
+  srand(2);
+  for (unsigned i=0; i< 200; i++)
+    points.push_back(Point3d(rand_unit(), GLOBAL));
+
+  TessellatedPolyhedronPtr qh = calc_hull(CompGeom::eQuickHull, points);
+  ASSERT_TRUE(qh.get() != NULL);
+  EXPECT_EQ(qh->get_vertices().size(), points.size());
+  compare_hulls(qh, calc_hull(CompGeom::eQhull, points), 1e-8);
+}
+
+TEST(QuickHull, Sliver)
+{
+  const double H = 1e-4;
+  vector<Point3d> points;
+
+  // setup a nearly flat tetrahedron and points inside of it
+  srand(3);
+  points.push_back(Point3d(0.0, 0.0, 0.0, GLOBAL));
+  points.push_back(Point3d(1.0, 0.0, 0.0, GLOBAL));
+  points.push_back(Point3d(0.0, 1.0, 0.0, GLOBAL));
+  points.push_back(Point3d(0.25, 0.25, H, GLOBAL));
+  for (unsigned i=0; i< 50; i++)
+  {
+    double a = rand_real(0.0, 1.0), b = rand_real(0.0, 1.0), c = rand_real(0.0, 1.0), d = rand_real(0.0, 1.0);
+    double s = a + b + c + d;
+    points.push_back((points[0]*a + points[1]*b + points[2]*c + points[3]*d)/s);
+  }
+
+  TessellatedPolyhedronPtr qh = calc_hull(CompGeom::eQuickHull, points);
+  ASSERT_TRUE(qh.get() != NULL);
+  EXPECT_EQ(qh->get_vertices().size(), (unsigned) 4);
+  EXPECT_NEAR(qh->calc_volume(), H/6.0, 1e-3*H);
+  compare_hulls(qh, calc_hull(CompGeom::eQhull, points), 1e-3*H);
+}
+
+TEST(QuickHull, DegenerateInput)
+{
+  vector<Origin3d> points;
+  vector<IndexedTri> facets;
+  QuickHull qh;
+
+  // coplanar points have no 3D hull
+  srand(4);
+  for (unsigned i=0; i< 20; i++)
+    points.push_back(Origin3d(rand_real(0.0, 1.0), rand_real(0.0, 1.0), 0.5));
+  EXPECT_FALSE(qh.calc_convex_hull_3D(points, facets));
+
+  // ... and neither do too few points
+  points.resize(3);
+  EXPECT_FALSE(qh.calc_convex_hull_3D(points, facets));
+
+  // the workspace remains usable after a failure
+  points.push_back(Origin3d(0.5, 0.5, 1.0));
+  EXPECT_TRUE(qh.calc_convex_hull_3D(points, facets));
+  EXPECT_EQ(facets.size(), (unsigned) 4);
+}
+
+TEST(QuickHull, Hull2D)
+{
+  vector<Origin2d> points;
+  vector<unsigned> hull;
+  QuickHull qh;
+
+  // setup a square with duplicate corners and collinear and interior points
+  points.push_back(Origin2d(0.0, 0.0));
+  points.push_back(Origin2d(1.0, 0.0));
+  points.push_back(Origin2d(1.0, 1.0));
+  points.push_back(Origin2d(0.0, 1.0));
+  points.push_back(Origin2d(1.0, 1.0));
+  points.push_back(Origin2d(0.5, 0.0));
+  points.push_back(Origin2d(1.0, 0.5));
+  points.push_back(Origin2d(0.5, 0.5));
+  points.push_back(Origin2d(0.0, 0.25));
+  ASSERT_TRUE(qh.calc_convex_hull_2D(points, hull));
+  ASSERT_EQ(hull.size(), (unsigned) 4);
+
+  // the hull is counter-clockwise
+  for (unsigned i=0; i< hull.size(); i++)
+  {
+    const Origin2d& a = points[hull[i]];
+    const Origin2d& b = points[hull[(i+1) % hull.size()]];
+    const Origin2d& c = points[hull[(i+2) % hull.size()]];
+    EXPECT_GT((b[0] - a[0])*(c[1] - a[1]) - (b[1] - a[1])*(c[0] - a[0]), 0.0);
+  }
+
+  // collinear points have no hull
+  points.clear();
+  for (unsigned i=0; i< 5; i++)
+    points.push_back(Origin2d(i, 2.0*i));
+  EXPECT_FALSE(qh.calc_convex_hull_2D(points, hull));
+}
+
+TEST(QuickHull, HalfspaceCube)
+{
+  vector<pair<Vector3d, double> > halfspaces;
+
+  // setup the faces of [-1,1]^3, a duplicate face, and a redundant halfspace
+  for (unsigned i=0; i< 3; i++)
+  {
+    Vector3d n(0.0, 0.0, 0.0, GLOBAL);
+    n[i] = 1.0;
+    halfspaces.push_back(make_pair(n, 1.0));
+    halfspaces.push_back(make_pair(-n, 1.0));
+  }
+  halfspaces.push_back(halfspaces.front());
+  halfspaces.push_back(make_pair(Vector3d(1.0, 0.0, 0.0, GLOBAL), 5.0));
+
+  TessellatedPolyhedronPtr qh = calc_hs_intersection(CompGeom::eQuickHull, halfspaces, Origin3d(0.1, -0.2, 0.3));
+  ASSERT_TRUE(qh.get() != NULL);
+  EXPECT_EQ(qh->get_vertices().size(), (unsigned) 8);
+  EXPECT_NEAR(qh->calc_volume(), 8.0, 1e-10);
+  compare_hulls(qh, calc_hs_intersection(CompGeom::eQhull, halfspaces, Origin3d(0.1, -0.2, 0.3)), 1e-10);
+}
+
+TEST(QuickHull, HalfspaceTangentPlanes)
+{
+  vector<pair<Vector3d, double> > halfspaces;
+
+  // bound the intersection by a box, then cut it with planes tangent to
+  // the unit sphere
+  srand(5);
+  for (unsigned i=0; i< 3; i++)
+  {
+    Vector3d n(0.0, 0.0, 0.0, GLOBAL);
+    n[i] = 1.0;
+    halfspaces.push_back(make_pair(n, 2.0));
+    halfspaces.push_back(make_pair(-n, 2.0));
+  }
+  for (unsigned i=0; i< 60; i++)
+    halfspaces.push_back(make_pair(Vector3d(rand_unit(), GLOBAL), 1.0));
+
+  // the interior point need not be the origin
+  const Origin3d INTERIOR(0.2, 0.1, -0.1);
+  TessellatedPolyhedronPtr qh = calc_hs_intersection(CompGeom::eQuickHull, halfspaces, INTERIOR);
+  ASSERT_TRUE(qh.get() != NULL);
+  EXPECT_GT(qh->calc_volume(), 4.0*M_PI/3.0);
+  compare_hulls(qh, calc_hs_intersection(CompGeom::eQhull, halfspaces, INTERIOR), 1e-8);
+}
+
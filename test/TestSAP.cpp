@@ -0,0 +1,171 @@
+#include <cstdlib>
+#include <set>
+#include <vector>
+#include <boost/weak_ptr.hpp>
+#include <Moby/CCD.h>
+#include <Moby/RigidBody.h>
+#include <Moby/CollisionGeometry.h>
+#include <Moby/SpherePrimitive.h>
+#include "gtest/gtest.h"
+
+using boost::shared_ptr;
+using boost::weak_ptr;
+using std::make_pair;
+using std::pair;
+using std::set;
+using std::vector;
+using namespace Ravelin;
+using namespace Moby;
+
+// the number of grid cells along each axis (coordinates are multiples of
+// 1/4, so many bounds coincide exactly)
+const unsigned N_CELLS = 12;
+
+// a resting (enabled) sphere; its swept AABB is its AABB
+struct Ball
+{
+  RigidBodyPtr rb;
+  CollisionGeometryPtr cg;
+  double x[3];
+  double r;
+};
+
+// gets a random grid coordinate
+static double rand_coord()
+{
+  return 0.25 * (rand() % N_CELLS);
+}
+
+// makes an ordered pair of geometries
+static pair<CollisionGeometryPtr, CollisionGeometryPtr> make_ordered_pair(CollisionGeometryPtr a, CollisionGeometryPtr b)
+{
+  return (a < b) ? make_pair(a, b) : make_pair(b, a);
+}
+
+// sets the pose of a ball from its location
+static void update_pose(Ball& b)
+{
+  b.rb->set_pose(Pose3d(Quatd::identity(), Origin3d(b.x[0], b.x[1], b.x[2])));
+}
+
+// moves a ball to a random grid location
+static void move(Ball& b)
+{
+  for (unsigned i=0; i< 3; i++)
+    b.x[i] = rand_coord();
+  update_pose(b);
+}
+
+// creates a ball of a given radius at a random grid location
+static Ball create_ball(double r)
+{
+  Ball b;
+  b.r = r;
+  b.rb = RigidBodyPtr(new RigidBody);
+  b.cg = CollisionGeometryPtr(new CollisionGeometry);
+  b.rb->geometries.push_back(b.cg);
+  b.cg->set_single_body(b.rb);
+  b.cg->set_geometry(PrimitivePtr(new SpherePrimitive(b.r)));
+  move(b);
+  return b;
+}
+
+// creates a ball of random radius at a random grid location
+static Ball create_ball()
+{
+  return create_ball((rand() % 2 == 0) ? 0.25 : 0.5);
+}
+
+// determines the overlapping pairs by checking all pairs of AABBs
+static set<pair<CollisionGeometryPtr, CollisionGeometryPtr> > brute_force(const vector<Ball>& balls)
+{
+  set<pair<CollisionGeometryPtr, CollisionGeometryPtr> > pairs;
+  for (unsigned i=0; i< balls.size(); i++)
+    for (unsigned j=i+1; j< balls.size(); j++)
+    {
+      bool overlap = true;
+      for (unsigned k=0; k< 3; k++)
+        if (balls[i].x[k] - balls[i].r > balls[j].x[k] + balls[j].r || balls[j].x[k] - balls[j].r > balls[i].x[k] + balls[i].r)
+          overlap = false;
+      if (overlap)
+        pairs.insert(make_ordered_pair(balls[i].cg, balls[j].cg));
+    }
+
+  return pairs;
+}
+
+// runs the broad phase and checks its pairs against the brute force pairs
+static void check_broad_phase(CCD& ccd, const vector<Ball>& balls)
+{
+  vector<ControlledBodyPtr> bodies;
+  for (unsigned i=0; i< balls.size(); i++)
+    bodies.push_back(balls[i].rb);
+
+  vector<pair<CollisionGeometryPtr, CollisionGeometryPtr> > to_check;
+  ccd.broad_phase(0.0, bodies, to_check);
+  set<pair<CollisionGeometryPtr, CollisionGeometryPtr> > pairs;
+  for (unsigned i=0; i< to_check.size(); i++)
+    EXPECT_TRUE(pairs.insert(make_ordered_pair(to_check[i].first, to_check[i].second)).second) << "duplicate pair";
+
+  set<pair<CollisionGeometryPtr, CollisionGeometryPtr> > expected = brute_force(balls);
+  EXPECT_EQ(pairs.size(), expected.size());
+  EXPECT_TRUE(pairs == expected);
+}
+
+// pairs from the incrementally updated sweep-and-prune structure match all
+// pairs of overlapping AABBs as balls move (with many coincident bounds)
+// and as balls are added and removed
+TEST(SAP, BruteForce)
+{
+  const unsigned N_BALLS = 60, N_STEPS = 40;
+
+  srand(0);
+  CCD ccd;
+  vector<Ball> balls;
+  for (unsigned i=0; i< N_BALLS; i++)
+    balls.push_back(create_ball());
+
+  // identical balls have identical bounds
+  balls.push_back(create_ball(balls.front().r));
+  for (unsigned i=0; i< 3; i++)
+    balls.back().x[i] = balls.front().x[i];
+  update_pose(balls.back());
+
+  check_broad_phase(ccd, balls);
+  for (unsigned step=0; step< N_STEPS; step++)
+  {
+    // move some of the balls (these are handled by the insertion sorts)
+    for (unsigned i=0; i< balls.size(); i++)
+      if (rand() % 4 == 0)
+        move(balls[i]);
+    check_broad_phase(ccd, balls);
+
+    // occasionally remove and add balls (these rebuild the structure)
+    if (step % 10 == 5)
+    {
+      for (unsigned i=0; i< 5 && !balls.empty(); i++)
+        balls.erase(balls.begin() + (rand() % balls.size()));
+      check_broad_phase(ccd, balls);
+      balls.push_back(create_ball());
+      check_broad_phase(ccd, balls);
+    }
+  }
+}
+
+// the broad phase does not keep removed geometries alive
+TEST(SAP, Removal)
+{
+  srand(1);
+  CCD ccd;
+  vector<Ball> balls;
+  for (unsigned i=0; i< 10; i++)
+    balls.push_back(create_ball());
+  check_broad_phase(ccd, balls);
+
+  // remove a ball
+  weak_ptr<CollisionGeometry> removed = balls.back().cg;
+  balls.pop_back();
+  check_broad_phase(ccd, balls);
+  EXPECT_TRUE(removed.expired());
+}
+
@@ -0,0 +1,170 @@
+#include <Moby/XMLReader.h>
+#include <Moby/TimeSteppingSimulator.h>
+#include <Moby/RigidBody.h>
+#include <Moby/GravityForce.h>
+#include "gtest/gtest.h"
+
+using boost::shared_ptr;
+using boost::dynamic_pointer_cast;
+using std::map;
+using namespace Ravelin;
+using namespace Moby;
+
+// the step size
+const double DT = 1e-2;
+
+// the maximum number of steps for the stack and the ball to fall asleep
+const unsigned MAX_SLEEP_STEPS = 500;
+
+// sets the position and the linear velocity of a body (zeroing its
+// orientation and angular velocity)
+static void set_state(RigidBodyPtr rb, const Origin3d& x, const Vector3d& xd)
+{
+  rb->set_pose(Pose3d(Quatd::identity(), x));
+  SVelocityd v;
+  v.pose = rb->get_mixed_pose();
+  v.set_linear(Vector3d(xd[0], xd[1], xd[2], v.pose));
+  v.set_angular(Vector3d::zero(v.pose));
+  rb->set_velocity(v);
+}
+
+// gets the position of a body
+static Origin3d get_position(RigidBodyPtr rb)
+{
+  return rb->get_pose()->x;
+}
+
+// a stack of two boxes and a ball, all resting on the ground and asleep
+class SleepingTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      // find the simulator, the bodies, and gravity
+      map<std::string, BasePtr> read_map = XMLReader::read("stack.xml");
+      for (map<std::string, BasePtr>::const_iterator i = read_map.begin(); i != read_map.end(); i++)
+      {
+        if (!sim)
+          sim = dynamic_pointer_cast<TimeSteppingSimulator>(i->second);
+        if (!gravity)
+          gravity = dynamic_pointer_cast<GravityForce>(i->second);
+        RigidBodyPtr rb = dynamic_pointer_cast<RigidBody>(i->second);
+        if (rb && rb->id == "box1")
+          box1 = rb;
+        else if (rb && rb->id == "box2")
+          box2 = rb;
+        else if (rb && rb->id == "ball")
+          ball = rb;
+      }
+      ASSERT_TRUE(sim.get() != NULL);
+      ASSERT_TRUE(gravity.get() != NULL);
+      ASSERT_TRUE(box1 && box2 && ball);
+      ASSERT_TRUE(sim->sleeping);
+
+      // step until everything is asleep
+      for (unsigned i=0; i< MAX_SLEEP_STEPS && !all_sleeping(); i++)
+        sim->step(DT);
+      ASSERT_TRUE(all_sleeping());
+      x1 = get_position(box1);
+      x2 = get_position(box2);
+    }
+
+    // determines whether the boxes and the ball are all asleep
+    bool all_sleeping() const
+    {
+      return box1->is_sleeping() && box2->is_sleeping() && ball->is_sleeping();
+    }
+
+    // determines whether either box in the stack is asleep
+    bool stack_sleeping() const
+    {
+      return box1->is_sleeping() || box2->is_sleeping();
+    }
+
+    shared_ptr<TimeSteppingSimulator> sim;
+    shared_ptr<GravityForce> gravity;
+    RigidBodyPtr box1, box2, ball;
+
+    // the positions of the boxes when they were put to sleep
+    Origin3d x1, x2;
+};
+
+// the resting stack is put to sleep (with the ball in its own island), and
+// sleeping bodies do not move
+TEST_F(SleepingTest, FallsAsleep)
+{
+  EXPECT_TRUE(sim->is_sleeping(box1));
+  EXPECT_TRUE(sim->is_sleeping(box2));
+  EXPECT_TRUE(sim->is_sleeping(ball));
+  EXPECT_NEAR(x1[1], 0.5, 1e-2);
+  EXPECT_NEAR(x2[1], 1.5, 1e-2);
+
+  Origin3d xb = get_position(ball);
+  for (unsigned i=0; i< 50; i++)
+  {
+    sim->step(DT);
+    ASSERT_TRUE(all_sleeping()) << "step " << i;
+  }
+  Origin3d y1 = get_position(box1), y2 = get_position(box2);
+  Origin3d yb = get_position(ball);
+  for (unsigned i=0; i< 3; i++)
+  {
+    EXPECT_EQ(y1[i], x1[i]);
+    EXPECT_EQ(y2[i], x2[i]);
+    EXPECT_EQ(yb[i], xb[i]);
+  }
+}
+
+// changing the recurrent forces wakes the stack, which then moves
+TEST_F(SleepingTest, WakesOnForce)
+{
+  // reverse gravity
+  gravity->gravity[1] = -gravity->gravity[1];
+  sim->step(DT);
+  EXPECT_FALSE(stack_sleeping());
+  EXPECT_FALSE(ball->is_sleeping());
+  for (unsigned i=0; i< 10; i++)
+    sim->step(DT);
+  EXPECT_GT(get_position(box1)[1], x1[1] + 1e-2);
+  EXPECT_GT(get_position(box2)[1], x2[1] + 1e-2);
+}
+
+// giving a sleeping body velocity wakes its island (and only its island),
+// and the body then moves
+TEST_F(SleepingTest, WakesOnStateChange)
+{
+  // push the top box sideways
+  set_state(box2, x2, Vector3d(1.0, 0.0, 0.0));
+  sim->step(DT);
+  EXPECT_FALSE(box1->is_sleeping());
+  EXPECT_FALSE(box2->is_sleeping());
+  EXPECT_TRUE(ball->is_sleeping());
+  for (unsigned i=0; i< 10; i++)
+    sim->step(DT);
+  EXPECT_GT(get_position(box2)[0], x2[0] + 1e-2);
+}
+
+// a moving body that hits the sleeping stack wakes it, and the stack then
+// moves
+TEST_F(SleepingTest, WakesOnContact)
+{
+  // throw the ball at the top box from just beside it; moving the ball wakes
+  // the ball, but not the stack
+  set_state(ball, Origin3d(x2[0] - 1.0, x2[1], x2[2]), Vector3d(8.0, 0.0, 0.0));
+  sim->step(DT);
+  EXPECT_FALSE(ball->is_sleeping());
+  EXPECT_TRUE(box1->is_sleeping());
+  EXPECT_TRUE(box2->is_sleeping());
+
+  // step until the ball hits the stack
+  for (unsigned i=0; i< 50 && stack_sleeping(); i++)
+    sim->step(DT);
+  EXPECT_FALSE(box1->is_sleeping());
+  EXPECT_FALSE(box2->is_sleeping());
+
+  // the top box is knocked away from the ball
+  for (unsigned i=0; i< 10; i++)
+    sim->step(DT);
+  EXPECT_GT(get_position(box2)[0], x2[0] + 1e-2);
+}
+
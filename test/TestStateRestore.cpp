@@ -0,0 +1,137 @@
+#include <cstring>
+#include <Moby/XMLReader.h>
+#include <Moby/TimeSteppingSimulator.h>
+#include <Moby/RigidBody.h>
+#include <Moby/StateBuffer.h>
+#include "gtest/gtest.h"
+
+using boost::shared_ptr;
+using boost::dynamic_pointer_cast;
+using std::map;
+using std::vector;
+using namespace Ravelin;
+using namespace Moby;
+
+// offsets of the size, the checksum, and the state in the header of a state
+// buffer
+const unsigned SIZE_OFFSET = 24;
+const unsigned CHECKSUM_OFFSET = 32;
+const unsigned HEADER_SIZE = 40;
+
+// the step size
+const double DT = 1e-2;
+
+// finds the simulator and the box in the objects read from a file
+static void find(const map<std::string, BasePtr>& read_map, shared_ptr<TimeSteppingSimulator>& sim, shared_ptr<RigidBody>& box)
+{
+  for (map<std::string, BasePtr>::const_iterator i = read_map.begin(); i != read_map.end(); i++)
+  {
+    if (!sim)
+      sim = dynamic_pointer_cast<TimeSteppingSimulator>(i->second);
+    shared_ptr<RigidBody> rb = dynamic_pointer_cast<RigidBody>(i->second);
+    if (rb && rb->id == "box")
+      box = rb;
+  }
+}
+
+// steps the simulator, recording the coordinates and velocities of the box
+static void step(shared_ptr<TimeSteppingSimulator> sim, shared_ptr<RigidBody> box, unsigned n, vector<VectorNd>& q, vector<VectorNd>& qd)
+{
+  q.resize(n);
+  qd.resize(n);
+  for (unsigned i=0; i< n; i++)
+  {
+    sim->step(DT);
+    box->get_generalized_coordinates_euler(q[i]);
+    box->get_generalized_velocity(DynamicBodyd::eSpatial, qd[i]);
+  }
+}
+
+// checks that two sequences of vectors are bit-identical
+static void compare(const vector<VectorNd>& v1, const vector<VectorNd>& v2)
+{
+  ASSERT_EQ(v1.size(), v2.size());
+  for (unsigned i=0; i< v1.size(); i++)
+  {
+    ASSERT_EQ(v1[i].size(), v2[i].size());
+    for (unsigned j=0; j< v1[i].size(); j++)
+      EXPECT_EQ(v1[i][j], v2[i][j]) << "step " << i << ", coordinate " << j;
+  }
+}
+
+// a box that has landed on the ground
+class StateRestoreTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      vector<VectorNd> q, qd;
+
+      find(XMLReader::read("box.xml"), sim, box);
+      ASSERT_TRUE(sim.get() != NULL);
+      ASSERT_TRUE(box.get() != NULL);
+      step(sim, box, 50, q, qd);
+    }
+
+    shared_ptr<TimeSteppingSimulator> sim;
+    shared_ptr<RigidBody> box;
+};
+
+TEST_F(StateRestoreTest, StepsAreReproduced)
+{
+  const unsigned NSTEPS = 50;
+  vector<char> buffer, restored;
+  vector<VectorNd> q1, qd1, q2, qd2;
+
+  // save the state, then step
+  sim->save_state(buffer);
+  const double T = sim->current_time;
+  step(sim, box, NSTEPS, q1, qd1);
+
+  // restoring the state reproduces the state and the steps exactly
+  ASSERT_TRUE(sim->restore_state(buffer));
+  EXPECT_EQ(sim->current_time, T);
+  sim->save_state(restored);
+  EXPECT_TRUE(restored == buffer);
+  step(sim, box, NSTEPS, q2, qd2);
+  compare(q1, q2);
+  compare(qd1, qd2);
+}
+
+TEST_F(StateRestoreTest, RejectedStateIsNotApplied)
+{
+  vector<char> buffer, before, after;
+  vector<VectorNd> q, qd;
+
+  // save the state, then step
+  sim->save_state(buffer);
+  step(sim, box, 10, q, qd);
+  sim->save_state(before);
+
+  // setup buffers whose headers are valid but whose state is not: one with
+  // extra data and one that claims a sleeping island that is not there
+  // (sleeping is disabled, so the last value written is the number of
+  // sleeping islands, zero)
+  vector<vector<char> > corrupt(2, buffer);
+  corrupt[0].insert(corrupt[0].end(), 4, 0);
+  const boost::uint32_t N_SLEEPING = 1;
+  ASSERT_GE(buffer.size(), HEADER_SIZE + sizeof(boost::uint32_t));
+  std::memcpy(&corrupt[1][buffer.size() - sizeof(boost::uint32_t)], &N_SLEEPING, sizeof(boost::uint32_t));
+
+  // fix the sizes and checksums of the buffers
+  for (unsigned i=0; i< corrupt.size(); i++)
+  {
+    boost::uint64_t size = corrupt[i].size() - HEADER_SIZE;
+    boost::uint64_t checksum = StateWriter::hash(&corrupt[i][HEADER_SIZE], size);
+    std::memcpy(&corrupt[i][SIZE_OFFSET], &size, sizeof(boost::uint64_t));
+    std::memcpy(&corrupt[i][CHECKSUM_OFFSET], &checksum, sizeof(boost::uint64_t));
+  }
+
+  // each buffer is rejected and the simulation is unchanged
+  for (unsigned i=0; i< corrupt.size(); i++)
+  {
+    EXPECT_FALSE(sim->restore_state(corrupt[i])) << "corruption " << i;
+    sim->save_state(after);
+    EXPECT_TRUE(after == before) << "corruption " << i;
+  }
+}